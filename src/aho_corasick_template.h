@@ -218,8 +218,86 @@
 ///       It should not ne applied to a keyword of type Keyword(T).
 #  define ACM_MATCH_RELEASE(match)                  do { free (ACM_MATCH_SYMBOLS (match)); ACM_MATCH_INIT (match); } while (0)
 
+/// ACDfa (T) is the type of a Aho-Corasick machine for type T compiled into a flat DFA.
+/// Note: Only single byte symbol types (such as char) can be compiled.
+#  define ACDfa(T)                                  ACDfa
+
+/// ACDfaState is the type of a state of a compiled DFA.
+#  define ACDfaState                                uint32_t
+
+/// int ACM_compile (ACMachine (T) * machine, size_t max_size)
+/// Compiles the machine into a flat DFA, which ACM_DFA returns afterwards.
+/// The DFA is a single allocation holding a transition table indexed by state and byte class,
+/// with the failure transitions pre-resolved, and the outputs of all states stored contiguously.
+/// @param [in] machine A pointer to a Aho-Corasick machine.
+/// @param [in] max_size The maximum size of the DFA in bytes, SIZE_MAX for no limit.
+/// @return 1 if the machine was compiled, -1 if the DFA would be larger than max_size,
+///         0 otherwise (out of memory or too many states).
+/// Note: The DFA is dropped when a keyword is registered or unregistered later on,
+///       and can be compiled again.
+/// Note: The equality operator, either associated to the machine, or associated to the type T, is used
+///       to compute the byte classes, so the DFA matches the same texts as the machine.
+#  define ACM_compile(machine, max_size)            (machine)->vtable->compile ((machine), (max_size))
+
+/// const ACDfa (T) * ACM_DFA (const ACMachine (T) * machine)
+/// Returns the DFA compiled by ACM_compile, or 0 if the machine is not compiled.
+#  define ACM_DFA(machine)                          ((machine)->dfa)
+
+/// ACDfaState ACM_DFA_reset (const ACDfa (T) * dfa)
+/// Returns the initial state of a DFA, ignoring all the symbols previously matched by ACM_DFA_match.
+#  define ACM_DFA_reset(dfa)                        ((ACDfaState) 0)
+
+/// size_t ACM_DFA_match (const ACDfa (T) * dfa, ACDfaState & state, T letter)
+/// Same as ACM_match for a compiled DFA: get the next state matching a symbol.
+/// @return Non-zero if registered keywords match the last letters, 0 otherwise.
+/// Note: `state` is passed by reference. It is modified by the function.
+/// Note: The low bit of a state tells whether the state has outputs, the remaining bits are its index.
+#  define ACM_DFA_match(dfa, state, letter)         \
+    (((state) = (dfa)->next[((state) >> 1) * (dfa)->nb_classes + (dfa)->class[(unsigned char) (letter)]]) & 1)
+
+/// size_t ACM_DFA_nb_matches (const ACDfa (T) * dfa, ACDfaState state)
+/// Returns the number of registered keywords matching in state, as returned by ACM_match.
+#  define ACM_DFA_nb_matches(dfa, state)            \
+    ((size_t) ((dfa)->output[((state) >> 1) + 1] - (dfa)->output[(state) >> 1]))
+
+/// size_t ACM_DFA_get_match (const ACDfa (T) * dfa, ACDfaState state, size_t index, [void **value_ptr])
+/// Same as ACM_get_match for a compiled DFA, the ith keyword matching is the same.
+/// @return The rank (unique id) of the ith matching keyword.
+/// Note: index must be lower than ACM_DFA_nb_matches.
+#  define ACM_DFA_get_match(...)                    VFUNC(ACM_DFA_get_match, __VA_ARGS__)
+
 /// Internal declarations ********************************************************************
 
+#  include <stdint.h>
+
+/* A machine compiled into a DFA, in a single allocation. */
+/* The layout does not depend on the type of symbols, which are single bytes. */
+typedef struct _ac_dfa
+{
+  unsigned short class[256]; /* byte class of each byte */
+  size_t nb_classes;
+  size_t nb_states;
+  /* next states, [state index * nb_classes + class], (index << 1) | has outputs */
+  const uint32_t *next;
+  /* offsets of the outputs of each state in match, nb_states + 1 */
+  const uint32_t *output;
+  /* outputs of all states, in the order of ACM_get_match */
+  const struct _ac_dfa_match
+  {
+    size_t rank;
+    void *value;
+  } *match;
+} ACDfa;
+
+__attribute__ ((unused)) static inline size_t
+acm_dfa_get_match (const ACDfa * dfa, ACDfaState state, size_t index, void **value)
+{
+  const struct _ac_dfa_match *m = dfa->match + dfa->output[state >> 1] + index;
+  if (value)
+    *value = m->value;
+  return m->rank;
+}
+
 // BEGIN VFUNC
 // Credits: VFUNC is a macro for overloading on number (but not types) of arguments.
 // See https://stackoverflow.com/questions/11761703/overloading-macro-on-number-of-arguments
@@ -315,6 +393,7 @@ struct _acm_vtable_##T                               \
   void (*release) (const ACMachine_##T * machine);                                                            \
   const ACState_##T * (*reset) (const ACMachine_##T * machine);                                               \
   void (*print) (ACMachine_##T * machine, FILE * stream, PRINT_##T##_TYPE printer);                           \
+  int (*compile) (ACMachine_##T * machine, size_t max_size);                                                  \
 };                                                   \
 \
 struct _ac_machine_##T                               \
@@ -330,6 +409,7 @@ struct _ac_machine_##T                               \
   T (*copy) (const T);                               \
   void (*destroy) (const T);                         \
   int (*eq) (const T, const T);                      \
+  ACDfa *dfa; /* compiled DFA, or 0 */               \
 };                                                   \
 \
 __attribute__ ((unused)) ACMachine_##T *ACM_create_##T (EQ_##T##_TYPE eq,        \
@@ -354,6 +434,9 @@ struct __useless_struct_to_allow_trailing_semicolon__##T##__
 #  define ACM_get_match3(state, index, matchholder)             ACM_get_match4((state), (index), (matchholder), 0)
 #  define ACM_get_match2(state, index)                          ACM_get_match4((state), (index), 0, 0)
 
+#  define ACM_DFA_get_match4(dfa, state, index, value)          acm_dfa_get_match ((dfa), (state), (index), (value))
+#  define ACM_DFA_get_match3(dfa, state, index)                 acm_dfa_get_match ((dfa), (state), (index), 0)
+
 #if defined(__GNUC__) || defined (__clang__)
 #define ACM_DECL5(var, T, eq, copy, dtor)  \
 __attribute__ ((cleanup (ACM_cleanup_##T))) ACMachine_##T var; machine_init_##T (&(var), state_create_##T (), (eq), (copy), (dtor))
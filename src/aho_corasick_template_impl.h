@@ -397,10 +397,18 @@ __attribute__ ((unused)) ACMachine_##ACM_SYMBOL *ACM_create_##ACM_SYMBOL (EQ_##A
   return machine;                                                      \
 }                                                                      \
 \
+static void                                                            \
+machine_dfa_free_##ACM_SYMBOL (ACMachine_##ACM_SYMBOL * machine)       \
+{                                                                      \
+  free (machine->dfa);                                                 \
+  machine->dfa = 0;                                                    \
+}                                                                      \
+\
 static int                                                             \
 ACM_register_keyword_##ACM_SYMBOL (ACMachine_##ACM_SYMBOL * machine, Keyword_##ACM_SYMBOL y,\
                                    void *value, void (*dtor) (void *))                      \
 {                                                                      \
+  machine_dfa_free_##ACM_SYMBOL (machine); /* recompiled by ACM_compile */\
   return machine_goto_update_##ACM_SYMBOL (machine, y, value, dtor);   \
                                                                        \
   /* Aho-Corasick Algorithm 2: for all a such that g(0, a) = fail do g(0, a) <- 0 */\
@@ -466,6 +474,7 @@ ACM_unregister_keyword_##ACM_SYMBOL (ACMachine_##ACM_SYMBOL * machine, Keyword_#
   ACState_##ACM_SYMBOL *last = get_last_state_##ACM_SYMBOL (machine, y); \
   if (!last)    /* The keyword y is not a registered keyword */        \
     return 0;                                                          \
+  machine_dfa_free_##ACM_SYMBOL (machine); /* recompiled by ACM_compile */\
   ACState_##ACM_SYMBOL *state_0 = machine->state_0; /* [state 0] */    \
   /* machine->rank is not decreased, so as to ensure unicity. */       \
   machine->nb_sequence--;                                              \
@@ -564,10 +573,156 @@ state_release_##ACM_SYMBOL (const ACState_##ACM_SYMBOL * state,        \
   free ((ACState_##ACM_SYMBOL *) state);                               \
 }                                                                      \
 \
+/* Compiles the machine into a DFA: states are numbered in breadth-first order, */ \
+/* so that f(s) is numbered before s and its transitions can be copied for the */ \
+/* symbols s has no goto for, and bytes the equality operator cannot tell apart */ \
+/* share a byte class, hence a column of the transition table. */      \
+static int                                                             \
+ACM_compile_##ACM_SYMBOL (ACMachine_##ACM_SYMBOL * machine, size_t max_size)\
+{                                                                      \
+  if (machine->reconstruct)                                            \
+  {                                                                    \
+    pthread_mutex_lock (&machine->lock);                               \
+    if (machine->reconstruct)                                          \
+      state_fail_state_construct_##ACM_SYMBOL (machine);               \
+    pthread_mutex_unlock (&machine->lock);                             \
+  }                                                                    \
+  machine_dfa_free_##ACM_SYMBOL (machine);                             \
+  if (machine->size >= (UINT32_MAX >> 1))                              \
+    return 0;                                                          \
+\
+  ACState_##ACM_SYMBOL *state_0 = machine->state_0;                    \
+  const ACState_##ACM_SYMBOL **queue = malloc (sizeof (*queue) * machine->size); \
+  uint32_t *number = malloc (sizeof (*number) * (machine->state_counter + 1)); \
+  if (!queue || !number)                                                \
+  {                                                                    \
+    free (queue);                                                      \
+    free (number);                                                      \
+    return 0;                                                          \
+  }                                                                    \
+\
+  /* Breadth-first numbering of the states, and the set of symbols in use */ \
+  uint64_t used[4] = { 0 };                                            \
+  size_t nb_states = 0, nb_matches = 0;                                \
+  queue[nb_states++] = state_0;                                        \
+  for (size_t i = 0; i < nb_states; i++)                               \
+  {                                                                    \
+    const ACState_##ACM_SYMBOL *s = queue[i];                          \
+    nb_matches += s->nb_sequence;                                      \
+    for (size_t j = 0; j < s->nb_goto; j++)                            \
+    {                                                                  \
+      unsigned char c = (unsigned char) s->goto_array[j].letter;       \
+      used[c >> 6] |= (uint64_t) 1 << (c & 63);                        \
+      number[s->goto_array[j].state->id] = nb_states;                   \
+      queue[nb_states++] = s->goto_array[j].state;                     \
+    }                                                                  \
+  }                                                                    \
+\
+  /* Byte classes: bytes equal to the same symbols in use share a class, */ \
+  /* class 0 holds the bytes equal to none of them */                  \
+  uint64_t sig[257][4];                                                \
+  unsigned char rep[257];                                              \
+  unsigned short class[256];                                           \
+  size_t nb_classes = 1;                                               \
+  memset (sig[0], 0, sizeof (sig[0]));                                 \
+  rep[0] = 0;                                                          \
+  for (unsigned int b = 0; b < 256; b++)                               \
+  {                                                                    \
+    uint64_t cur[4] = { 0 };                                           \
+    for (unsigned int l = 0; l < 256; l++)                             \
+      if ((used[l >> 6] >> (l & 63)) & 1 && machine->eq ((ACM_SYMBOL) l, (ACM_SYMBOL) b)) \
+        cur[l >> 6] |= (uint64_t) 1 << (l & 63);                       \
+    size_t k = 0;                                                      \
+    while (k < nb_classes && memcmp (sig[k], cur, sizeof (cur)))       \
+      k++;                                                             \
+    if (k == nb_classes)                                               \
+    {                                                                  \
+      memcpy (sig[nb_classes], cur, sizeof (cur));                     \
+      rep[nb_classes++] = b;                                           \
+    }                                                                  \
+    class[b] = k;                                                      \
+  }                                                                    \
+\
+  if (nb_matches > UINT32_MAX || nb_states > SIZE_MAX / nb_classes / sizeof (uint32_t)) \
+  {                                                                    \
+    free (queue);                                                      \
+    free (number);                                                      \
+    return 0;                                                          \
+  }                                                                    \
+  size_t dfa_size = sizeof (ACDfa) +                                   \
+                    sizeof (struct _ac_dfa_match) * nb_matches +       \
+                    sizeof (uint32_t) * nb_states * nb_classes +       \
+                    sizeof (uint32_t) * (nb_states + 1);               \
+  if (dfa_size > max_size)                                             \
+  {                                                                    \
+    free (queue);                                                      \
+    free (number);                                                     \
+    return -1;                                                         \
+  }                                                                    \
+  ACDfa *dfa = malloc (dfa_size);                                      \
+  if (!dfa)                                                            \
+  {                                                                    \
+    free (queue);                                                      \
+    free (number);                                                      \
+    return 0;                                                          \
+  }                                                                    \
+  struct _ac_dfa_match *match = (struct _ac_dfa_match *) (dfa + 1);    \
+  uint32_t *next = (uint32_t *) (match + nb_matches);                  \
+  uint32_t *output = next + nb_states * nb_classes;                    \
+  memcpy (dfa->class, class, sizeof (class));                          \
+  dfa->nb_classes = nb_classes;                                        \
+  dfa->nb_states = nb_states;                                          \
+\
+  size_t m = 0;                                                        \
+  for (size_t i = 0; i < nb_states; i++)                               \
+  {                                                                    \
+    const ACState_##ACM_SYMBOL *s = queue[i];                          \
+    uint32_t *row = next + i * nb_classes;                             \
+    const uint32_t *fail_row = s == state_0 ? 0 : next + (s->fail_state == state_0 ? 0 : number[s->fail_state->id]) * nb_classes; \
+    /* Transitions, as state_goto */                                   \
+    for (size_t k = 0; k < nb_classes; k++)                            \
+    {                                                                  \
+      const ACState_##ACM_SYMBOL *t = 0;                               \
+      if (k)                                                           \
+        for (size_t j = 0; j < s->nb_goto; j++)                        \
+          if (machine->eq (s->goto_array[j].letter, (ACM_SYMBOL) rep[k])) \
+          {                                                            \
+            t = s->goto_array[j].state;                                \
+            break;                                                     \
+          }                                                            \
+      if (t)                                                           \
+        row[k] = (number[t->id] << 1) | !!t->nb_sequence;               \
+      else                                                             \
+        row[k] = fail_row ? fail_row[k] : 0;                           \
+    }                                                                  \
+    /* Outputs, as ACM_get_match */                                    \
+    output[i] = m;                                                     \
+    size_t n = 0;                                                      \
+    for (const ACState_##ACM_SYMBOL *f = s; f && n < s->nb_sequence; f = f->fail_state, n++) \
+    {                                                                  \
+      while (!f->is_matching && f->fail_state)                         \
+        f = f->fail_state;                                             \
+      match[m].rank = f->rank;                                         \
+      match[m].value = f->value;                                       \
+      m++;                                                             \
+    }                                                                  \
+  }                                                                    \
+  output[nb_states] = m;                                               \
+  dfa->next = next;                                                    \
+  dfa->output = output;                                                \
+  dfa->match = match;                                                  \
+\
+  free (queue);                                                        \
+  free (number);                                                        \
+  machine->dfa = dfa;                                                  \
+  return 1;                                                            \
+}                                                                      \
+\
 static void                                                            \
 ACM_cleanup_##ACM_SYMBOL (const ACMachine_##ACM_SYMBOL * machine)      \
 {                                                                      \
   state_release_##ACM_SYMBOL (machine->state_0, machine->destroy);     \
+  machine_dfa_free_##ACM_SYMBOL ((ACMachine_##ACM_SYMBOL *) machine);  \
   pthread_mutex_destroy (&((ACMachine_##ACM_SYMBOL *) machine)->lock); \
 }                                                                      \
 \
@@ -651,6 +806,7 @@ static const struct _acm_vtable_##ACM_SYMBOL ACM_VTABLE_##ACM_SYMBOL = \
   ACM_release_##ACM_SYMBOL,                                            \
   ACM_reset_##ACM_SYMBOL,                                              \
   ACM_print_##ACM_SYMBOL,                                              \
+  ACM_compile_##ACM_SYMBOL,                                            \
 };                                                                     \
                                                                        \
 static void                                                            \
@@ -670,6 +826,7 @@ machine_init_##ACM_SYMBOL (ACMachine_##ACM_SYMBOL *machine,            \
   machine->copy = copier ? copier : __COPY_##ACM_SYMBOL;               \
   machine->destroy = dtor ? dtor : __DTOR_##ACM_SYMBOL;                \
   machine->eq = eq ? eq : __EQ_##ACM_SYMBOL;                           \
+  machine->dfa = 0;                                                    \
 }                                                                      \
 struct __useless_struct_to_allow_trailing_semicolon__##T##__
 // END DEFINE_ACM
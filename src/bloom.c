@@ -0,0 +1,172 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bloom.h"
+
+#include <string.h>
+
+/*
+ * Prefilter for the exact and domain suffix lookups of filtering rules.
+ *
+ * The filter is an array of 512-bit blocks, and all k bits of a key are set
+ * in the block selected by its hash, so that a check reads a single cache
+ * line, at the cost of a slightly higher false positive rate than a classic
+ * Bloom filter of the same size.  The number of blocks is rounded up to a
+ * power of two, which makes up for most of the difference.  The k bit
+ * positions are derived from the key hash by double hashing.
+ */
+
+#define BLOOM_BLOCK_BITS  512
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_BITS / 64)
+#define BLOOM_MAX_K       16
+
+struct bloom {
+	uint64_t *blocks;
+	size_t mask;
+	unsigned int k;
+};
+
+/*
+ * Incremental FNV-1a hash of the key bytes, fed to bloom_add() and
+ * bloom_check() after the last byte.
+ */
+uint64_t
+bloom_hash_init(void)
+{
+	return 0xcbf29ce484222325ULL;
+}
+
+uint64_t
+bloom_hash_update(uint64_t hash, unsigned char c)
+{
+	return (hash ^ c) * 0x100000001b3ULL;
+}
+
+/*
+ * FNV-1a spreads the last bytes of keys poorly into the high bits, so mix
+ * the hash before deriving the block and bit positions from it.
+ */
+static uint64_t
+bloom_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/*
+ * Create a Bloom filter for n keys, with a false positive rate of fprate per
+ * mille, in 1-1000.  A k of ceil(log2(1000 / fprate)) bits per key and
+ * k / ln 2 bits of filter per key give the requested rate.
+ */
+bloom_t *
+bloom_new(size_t n, unsigned int fprate)
+{
+	bloom_t *bloom;
+	size_t bits, nblocks;
+	void *blocks;
+	unsigned int k = 1;
+
+	while (k < BLOOM_MAX_K && (1U << k) * fprate < 1000)
+		k++;
+
+	if (n > SIZE_MAX / (BLOOM_MAX_K * 1443))
+		return NULL;
+	bits = n * k * 1443 / 1000 + 1;
+	nblocks = 1;
+	while (nblocks * BLOOM_BLOCK_BITS < bits)
+		nblocks <<= 1;
+
+	bloom = malloc(sizeof(bloom_t));
+	if (!bloom)
+		return NULL;
+	if (posix_memalign(&blocks, 64, nblocks * BLOOM_BLOCK_BITS / 8)) {
+		free(bloom);
+		return NULL;
+	}
+	memset(blocks, 0, nblocks * BLOOM_BLOCK_BITS / 8);
+
+	bloom->blocks = blocks;
+	bloom->mask = nblocks - 1;
+	bloom->k = k;
+	return bloom;
+}
+
+void
+bloom_free(bloom_t *bloom)
+{
+	free(bloom->blocks);
+	free(bloom);
+}
+
+void
+bloom_add(bloom_t *bloom, uint64_t hash)
+{
+	uint64_t h = bloom_mix(hash);
+	uint64_t *block = bloom->blocks + ((h >> 32) & bloom->mask) * BLOOM_BLOCK_WORDS;
+	unsigned int a = h & (BLOOM_BLOCK_BITS - 1);
+	unsigned int b = ((h >> 9) & (BLOOM_BLOCK_BITS - 1)) | 1;
+
+	for (unsigned int i = 0; i < bloom->k; i++) {
+		unsigned int bit = (a + i * b) & (BLOOM_BLOCK_BITS - 1);
+		block[bit >> 6] |= 1ULL << (bit & 63);
+	}
+}
+
+/*
+ * Returns 1 if the key with the hash may be in the filter, 0 if it is not.
+ */
+int
+bloom_check(const bloom_t *bloom, uint64_t hash)
+{
+	uint64_t h = bloom_mix(hash);
+	const uint64_t *block = bloom->blocks + ((h >> 32) & bloom->mask) * BLOOM_BLOCK_WORDS;
+	unsigned int a = h & (BLOOM_BLOCK_BITS - 1);
+	unsigned int b = ((h >> 9) & (BLOOM_BLOCK_BITS - 1)) | 1;
+
+	for (unsigned int i = 0; i < bloom->k; i++) {
+		unsigned int bit = (a + i * b) & (BLOOM_BLOCK_BITS - 1);
+		if (!(block[bit >> 6] & (1ULL << (bit & 63))))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Size of the filter in bytes.
+ */
+size_t
+bloom_size(const bloom_t *bloom)
+{
+	return (bloom->mask + 1) * BLOOM_BLOCK_BITS / 8;
+}
+
+/* vim: set noet ft=c: */
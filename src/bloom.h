@@ -0,0 +1,68 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include "attrib.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Blocked Bloom filter of 64-bit key hashes.  A check answers whether a key
+ * may be in the set, with no false negatives and about the false positive
+ * rate the filter is created with.
+ */
+typedef struct bloom bloom_t;
+
+/*
+ * Number of checks against a Bloom filter and the number of them which have
+ * skipped the lookup they were guarding.
+ */
+typedef struct bloom_stats {
+	size_t checks;
+	size_t skips;
+} bloom_stats_t;
+
+/* Default false positive rate in per mille */
+#define BLOOM_FPRATE 10
+
+uint64_t bloom_hash_init(void) WUNRES;
+uint64_t bloom_hash_update(uint64_t, unsigned char) WUNRES;
+
+bloom_t *bloom_new(size_t, unsigned int) MALLOC;
+void bloom_free(bloom_t *) NONNULL(1);
+
+void bloom_add(bloom_t *, uint64_t) NONNULL(1);
+int bloom_check(const bloom_t *, uint64_t) NONNULL(1) WUNRES;
+size_t bloom_size(const bloom_t *) NONNULL(1) WUNRES;
+
+#endif /* !BLOOM_H */
+
+/* vim: set noet ft=c: */
@@ -106,6 +106,25 @@ cache_gc(cache_t *cache)
 	pthread_mutex_unlock(&cache->mutex);
 }
 
+/*
+ * Delete all entries, e.g. when the data they were derived from changed.
+ */
+void
+cache_flush(cache_t *cache)
+{
+	khiter_t it;
+
+	pthread_mutex_lock(&cache->mutex);
+	for (it = cache->begin_cb(); it != cache->end_cb(); it++) {
+		if (cache->exist_cb(it)) {
+			cache->free_val_cb(cache->get_val_cb(it));
+			cache->free_key_cb(cache->get_key_cb(it));
+			cache->del_cb(it);
+		}
+	}
+	pthread_mutex_unlock(&cache->mutex);
+}
+
 cache_val_t
 cache_get(cache_t *cache, cache_key_t key)
 {
@@ -131,14 +150,52 @@ cache_get(cache_t *cache, cache_key_t key)
 	return rval;
 }
 
+/*
+ * Like cache_get(), but copies the value using copy_cb instead of the
+ * unpackverify callback, for caches with values made up of several parts.
+ * copy_cb is called with the cache locked, only for values that verify.
+ */
+cache_val_t
+cache_get_with(cache_t *cache, cache_key_t key, cache_copy_cb_t copy_cb,
+               void *arg)
+{
+	cache_val_t rval = NULL;
+	khiter_t it;
+
+	if (!key)
+		return NULL;
+
+	pthread_mutex_lock(&cache->mutex);
+	it = cache->get_cb(key);
+	if (it != cache->end_cb()) {
+		cache_val_t val;
+		val = cache->get_val_cb(it);
+		if (cache->unpackverify_val_cb(val, 0)) {
+			rval = copy_cb(val, arg);
+		} else {
+			cache->free_val_cb(val);
+			cache->free_key_cb(cache->get_key_cb(it));
+			cache->del_cb(it);
+		}
+	}
+	cache->free_key_cb(key);
+	pthread_mutex_unlock(&cache->mutex);
+	return rval;
+}
+
 void
 cache_set(cache_t *cache, cache_key_t key, cache_val_t val)
 {
 	khiter_t it;
 	int ret;
 
-	if (!key || !val)
+	if (!key || !val) {
+		if (key)
+			cache->free_key_cb(key);
+		if (val)
+			cache->free_val_cb(val);
 		return;
+	}
 
 	pthread_mutex_lock(&cache->mutex);
 	it = cache->put_cb(key, &ret);
@@ -166,4 +223,53 @@ cache_del(cache_t *cache, cache_key_t key)
 	pthread_mutex_unlock(&cache->mutex);
 }
 
+/*
+ * Returns 1 if the cache holds a valid entry for key, 0 otherwise.
+ * Unlike cache_get(), does not unpack or copy the value.
+ */
+int
+cache_has(cache_t *cache, cache_key_t key)
+{
+	int rv = 0;
+	khiter_t it;
+
+	if (!key)
+		return 0;
+
+	pthread_mutex_lock(&cache->mutex);
+	it = cache->get_cb(key);
+	if (it != cache->end_cb()) {
+		cache_val_t val;
+		val = cache->get_val_cb(it);
+		if (cache->unpackverify_val_cb(val, 0)) {
+			rv = 1;
+		} else {
+			cache->free_val_cb(val);
+			cache->free_key_cb(cache->get_key_cb(it));
+			cache->del_cb(it);
+		}
+	}
+	cache->free_key_cb(key);
+	pthread_mutex_unlock(&cache->mutex);
+	return rv;
+}
+
+/*
+ * Call walk_cb for each entry in the cache with the cache locked.
+ * The callback must not modify the cache.
+ */
+void
+cache_walk(cache_t *cache, cache_walk_cb_t walk_cb, void *arg)
+{
+	khiter_t it;
+
+	pthread_mutex_lock(&cache->mutex);
+	for (it = cache->begin_cb(); it != cache->end_cb(); it++) {
+		if (cache->exist_cb(it)) {
+			walk_cb(cache->get_key_cb(it), cache->get_val_cb(it), arg);
+		}
+	}
+	pthread_mutex_unlock(&cache->mutex);
+}
+
 /* vim: set noet ft=c: */
@@ -50,6 +50,8 @@ typedef cache_val_t (*cache_get_val_cb_t)(cache_iter_t);
 typedef void (*cache_set_val_cb_t)(cache_iter_t, cache_val_t);
 typedef cache_val_t (*cache_unpackverify_val_cb_t)(cache_val_t, int);
 typedef void (*cache_fini_cb_t)(void);
+typedef void (*cache_walk_cb_t)(cache_key_t, cache_val_t, void *);
+typedef cache_val_t (*cache_copy_cb_t)(cache_val_t, void *);
 
 typedef struct cache {
 	pthread_mutex_t mutex;
@@ -75,9 +77,14 @@ cache_t * cache_new(cache_init_cb_t) MALLOC;
 int cache_reinit(cache_t *) NONNULL(1) WUNRES;
 void cache_free(cache_t *) NONNULL(1);
 void cache_gc(cache_t *) NONNULL(1);
+void cache_flush(cache_t *) NONNULL(1);
 cache_val_t cache_get(cache_t *, cache_key_t) NONNULL(1) WUNRES;
+cache_val_t cache_get_with(cache_t *, cache_key_t, cache_copy_cb_t, void *)
+            NONNULL(1,3) WUNRES;
 void cache_set(cache_t *, cache_key_t, cache_val_t) NONNULL(1);
 void cache_del(cache_t *, cache_key_t) NONNULL(1);
+int cache_has(cache_t *, cache_key_t) NONNULL(1) WUNRES;
+void cache_walk(cache_t *, cache_walk_cb_t, void *) NONNULL(1,2);
 
 #endif /* !CACHE_H */
 
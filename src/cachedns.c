@@ -0,0 +1,181 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cachedns.h"
+
+#include "khash.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/*
+ * Cache for SNI hostname lookups, shared by all threads.
+ * Entries expire after the smallest TTL of the records they were built from,
+ * negative entries after DNSNegativeTTL, hosts file entries never.
+ *
+ * key: char *         lowercase hostname
+ * val: dns_addrs_t *  resolved addresses or lookup error
+ */
+
+KHASH_INIT(dnsmap_t, char*, void*, 1, kh_str_hash_func, kh_str_hash_equal)
+
+static khash_t(dnsmap_t) *dnsmap;
+
+static cache_iter_t
+cachedns_begin_cb(void)
+{
+	return kh_begin(dnsmap);
+}
+
+static cache_iter_t
+cachedns_end_cb(void)
+{
+	return kh_end(dnsmap);
+}
+
+static int
+cachedns_exist_cb(cache_iter_t it)
+{
+	return kh_exist(dnsmap, it);
+}
+
+static void
+cachedns_del_cb(cache_iter_t it)
+{
+	kh_del(dnsmap_t, dnsmap, it);
+}
+
+static cache_iter_t
+cachedns_get_cb(cache_key_t key)
+{
+	return kh_get(dnsmap_t, dnsmap, key);
+}
+
+static cache_iter_t
+cachedns_put_cb(cache_key_t key, int *ret)
+{
+	return kh_put(dnsmap_t, dnsmap, key, ret);
+}
+
+static void
+cachedns_free_key_cb(cache_key_t key)
+{
+	free(key);
+}
+
+static void
+cachedns_free_val_cb(cache_val_t val)
+{
+	free(val);
+}
+
+static cache_key_t
+cachedns_get_key_cb(cache_iter_t it)
+{
+	return kh_key(dnsmap, it);
+}
+
+static cache_val_t
+cachedns_get_val_cb(cache_iter_t it)
+{
+	return kh_val(dnsmap, it);
+}
+
+static void
+cachedns_set_val_cb(cache_iter_t it, cache_val_t val)
+{
+	kh_val(dnsmap, it) = val;
+}
+
+static cache_val_t
+cachedns_unpackverify_val_cb(cache_val_t val, int copy)
+{
+	dns_addrs_t *addrs = val;
+	dns_addrs_t *rv;
+
+	if (addrs->expiry && addrs->expiry <= time(NULL))
+		return NULL;
+	if (!copy)
+		return ((void*)-1);
+	if (!(rv = malloc(sizeof(dns_addrs_t))))
+		return NULL;
+	memcpy(rv, addrs, sizeof(dns_addrs_t));
+	return rv;
+}
+
+static void
+cachedns_fini_cb(void)
+{
+	kh_destroy(dnsmap_t, dnsmap);
+}
+
+void
+cachedns_init_cb(cache_t *cache)
+{
+	dnsmap = kh_init(dnsmap_t);
+
+	cache->begin_cb                 = cachedns_begin_cb;
+	cache->end_cb                   = cachedns_end_cb;
+	cache->exist_cb                 = cachedns_exist_cb;
+	cache->del_cb                   = cachedns_del_cb;
+	cache->get_cb                   = cachedns_get_cb;
+	cache->put_cb                   = cachedns_put_cb;
+	cache->free_key_cb              = cachedns_free_key_cb;
+	cache->free_val_cb              = cachedns_free_val_cb;
+	cache->get_key_cb               = cachedns_get_key_cb;
+	cache->get_val_cb               = cachedns_get_val_cb;
+	cache->set_val_cb               = cachedns_set_val_cb;
+	cache->unpackverify_val_cb      = cachedns_unpackverify_val_cb;
+	cache->fini_cb                  = cachedns_fini_cb;
+}
+
+cache_key_t
+cachedns_mkkey(const char *host)
+{
+	char *key, *p;
+
+	if (!(key = strdup(host)))
+		return NULL;
+	for (p = key; *p; p++)
+		*p = tolower((unsigned char)*p);
+	return key;
+}
+
+cache_val_t
+cachedns_mkval(const dns_addrs_t *addrs)
+{
+	dns_addrs_t *val;
+
+	if (!(val = malloc(sizeof(dns_addrs_t))))
+		return NULL;
+	memcpy(val, addrs, sizeof(dns_addrs_t));
+	return val;
+}
+
+/* vim: set noet ft=c: */
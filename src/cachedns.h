@@ -0,0 +1,70 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CACHEDNS_H
+#define CACHEDNS_H
+
+#include "cache.h"
+#include "attrib.h"
+
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define CACHEDNS_MAX_ADDRS 8
+
+typedef union dns_addr {
+	struct sockaddr sa;
+	struct sockaddr_in sin;
+	struct sockaddr_in6 sin6;
+} dns_addr_t;
+
+/*
+ * Resolved addresses of a hostname, port is left 0.
+ * Negative entries have naddrs 0 and the EVUTIL_EAI_* error in errcode.
+ * Entries from the hosts file have expiry 0 and never expire.
+ */
+typedef struct dns_addrs {
+	time_t expiry;
+	int errcode;
+	int naddrs;
+	dns_addr_t addr[CACHEDNS_MAX_ADDRS];
+} dns_addrs_t;
+
+#define dns_addr_len(a) ((a)->sa.sa_family == AF_INET6 ? \
+                         sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in))
+
+void cachedns_init_cb(struct cache *) NONNULL(1);
+
+cache_key_t cachedns_mkkey(const char *) NONNULL(1) WUNRES;
+cache_val_t cachedns_mkval(const dns_addrs_t *) NONNULL(1) WUNRES;
+
+#endif /* !CACHEDNS_H */
+
+/* vim: set noet ft=c: */
@@ -31,13 +31,29 @@
 #include "ssl.h"
 #include "khash.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 /*
  * Cache for generated fake certificates.
  *
  * key: char[SSL_X509_FPRSZ]  fingerprint of original server cert
- * val: X509 *                generated fake certificate
+ * val: cachefkcrt_val_t *    generated fake certificate, the number of
+ *                            cache hits, the metadata of the certs and, if
+ *                            enabled, the DER encoded original server cert
+ *                            for pre-forging
  */
 
+typedef struct cachefkcrt_val {
+	X509 *crt;
+	unsigned long hits;
+	cachefkcrt_meta_t *meta;
+	unsigned char *origder;
+	int origderlen;
+} cachefkcrt_val_t;
+
+static int keep_origcrt = 0;
+
 static inline khint_t
 kh_x509fpr_hash_func(void *b)
 {
@@ -103,7 +119,14 @@ cachefkcrt_free_key_cb(cache_key_t key)
 static void
 cachefkcrt_free_val_cb(cache_val_t val)
 {
-	X509_free(val);
+	cachefkcrt_val_t *v = val;
+
+	X509_free(v->crt);
+	if (v->meta)
+		cachefkcrt_meta_free(v->meta);
+	if (v->origder)
+		free(v->origder);
+	free(v);
 }
 
 static cache_key_t
@@ -127,11 +150,15 @@ cachefkcrt_set_val_cb(cache_iter_t it, cache_val_t val)
 static cache_val_t
 cachefkcrt_unpackverify_val_cb(cache_val_t val, int copy)
 {
-	if (!ssl_x509_is_valid(val))
+	cachefkcrt_val_t *v = val;
+
+	if (!ssl_x509_is_valid(v->crt))
 		return NULL;
 	if (copy) {
-		ssl_x509_refcount_inc(val);
-		return val;
+		/* only cache_get() copies, which makes this a cache hit */
+		v->hits++;
+		ssl_x509_refcount_inc(v->crt);
+		return v->crt;
 	}
 	return ((void*)-1);
 }
@@ -173,11 +200,253 @@ cachefkcrt_mkkey(X509 *keycrt)
 	return fpr;
 }
 
-cache_val_t
-cachefkcrt_mkval(X509 *valcrt)
+/*
+ * Create a cache value for the fake cert valcrt generated for the original
+ * cert keycrt, taking a reference to the metadata of the certs, which may be
+ * NULL.
+ */
+static cache_val_t
+cachefkcrt_mkval_internal(X509 *keycrt, X509 *valcrt, cachefkcrt_meta_t *meta)
 {
+	cachefkcrt_val_t *v;
+
+	if (!(v = malloc(sizeof(cachefkcrt_val_t))))
+		return NULL;
+	memset(v, 0, sizeof(cachefkcrt_val_t));
+	if (meta) {
+		cachefkcrt_meta_refcount_inc(meta);
+		v->meta = meta;
+	}
+	if (keep_origcrt) {
+		v->origderlen = i2d_X509(keycrt, &v->origder);
+		if (v->origderlen <= 0) {
+			v->origder = NULL;
+			v->origderlen = 0;
+		}
+	}
 	ssl_x509_refcount_inc(valcrt);
-	return valcrt;
+	v->crt = valcrt;
+	return v;
+}
+
+/*
+ * Create a cache value, computing the metadata of the certs.  The entry is
+ * still usable without metadata if that fails.
+ */
+cache_val_t
+cachefkcrt_mkval(X509 *keycrt, X509 *valcrt)
+{
+	cachefkcrt_meta_t *meta;
+	cache_val_t v;
+
+	meta = cachefkcrt_meta_new(keycrt);
+	if (meta && cachefkcrt_meta_set_usedcrt(meta, valcrt) == -1) {
+		cachefkcrt_meta_free(meta);
+		meta = NULL;
+	}
+	v = cachefkcrt_mkval_internal(keycrt, valcrt, meta);
+	if (meta)
+		cachefkcrt_meta_free(meta);
+	return v;
+}
+
+/*
+ * Create a cache value with metadata the caller has already computed.
+ */
+cache_val_t
+cachefkcrt_mkval_meta(X509 *keycrt, X509 *valcrt, cachefkcrt_meta_t *meta)
+{
+	return cachefkcrt_mkval_internal(keycrt, valcrt, meta);
+}
+
+/*
+ * Copy callback for cache_get_with(): counts the cache hit and returns the
+ * fake cert like cache_get(), and a reference to the metadata of the entry
+ * in *arg, which is set to NULL if the entry has none.
+ */
+cache_val_t
+cachefkcrt_copy_meta_cb(cache_val_t val, void *arg)
+{
+	cachefkcrt_val_t *v = val;
+	cachefkcrt_meta_t **meta = arg;
+
+	v->hits++;
+	ssl_x509_refcount_inc(v->crt);
+	if (v->meta)
+		cachefkcrt_meta_refcount_inc(v->meta);
+	*meta = v->meta;
+	return v->crt;
+}
+
+/*
+ * Enable or disable keeping a copy of the original server certs in the
+ * entries added from now on, which cachefkcrt_topn() needs.
+ */
+void
+cachefkcrt_set_keep_origcrt(int keep)
+{
+	keep_origcrt = keep;
+}
+
+typedef struct cachefkcrt_topn_ctx {
+	X509 **origcrts;
+	unsigned long *hits;
+	size_t n;
+	size_t cnt;
+} cachefkcrt_topn_ctx_t;
+
+static void
+cachefkcrt_topn_walk_cb(UNUSED cache_key_t key, cache_val_t val, void *arg)
+{
+	cachefkcrt_topn_ctx_t *ctx = arg;
+	cachefkcrt_val_t *v = val;
+	const unsigned char *p;
+	X509 *crt;
+	size_t i;
+
+	if (!v->hits || !v->origder)
+		return;
+	if (ctx->cnt == ctx->n && v->hits <= ctx->hits[ctx->n - 1])
+		return;
+
+	p = v->origder;
+	if (!(crt = d2i_X509(NULL, &p, v->origderlen)))
+		return;
+
+	if (ctx->cnt == ctx->n) {
+		X509_free(ctx->origcrts[--ctx->cnt]);
+	}
+	for (i = ctx->cnt; i > 0 && ctx->hits[i - 1] < v->hits; i--) {
+		ctx->origcrts[i] = ctx->origcrts[i - 1];
+		ctx->hits[i] = ctx->hits[i - 1];
+	}
+	ctx->origcrts[i] = crt;
+	ctx->hits[i] = v->hits;
+	ctx->cnt++;
+}
+
+/*
+ * Fill origcrts with the original server certs of the at most n entries
+ * with the most cache hits, in descending order of hits.  Entries without
+ * hits or without a copy of the original cert are skipped.
+ * The caller owns the returned certs.  Returns the number of certs, or -1 on
+ * error.
+ */
+ssize_t
+cachefkcrt_topn(cache_t *cache, X509 **origcrts, size_t n)
+{
+	cachefkcrt_topn_ctx_t ctx;
+
+	if (!n)
+		return 0;
+
+	ctx.origcrts = origcrts;
+	ctx.n = n;
+	ctx.cnt = 0;
+	if (!(ctx.hits = malloc(n * sizeof(unsigned long))))
+		return -1;
+
+	cache_walk(cache, cachefkcrt_topn_walk_cb, &ctx);
+	free(ctx.hits);
+	return ctx.cnt;
+}
+
+/*
+ * Create the metadata of origcrt, without the fake cert part, which is set
+ * using cachefkcrt_meta_set_usedcrt() once the fake cert is known.
+ * Returns NULL on error.
+ */
+cachefkcrt_meta_t *
+cachefkcrt_meta_new(X509 *origcrt)
+{
+	cachefkcrt_meta_t *m;
+	size_t n = 0;
+
+	if (!(m = malloc(sizeof(cachefkcrt_meta_t))))
+		return NULL;
+	memset(m, 0, sizeof(cachefkcrt_meta_t));
+	if (pthread_mutex_init(&m->mutex, NULL)) {
+		free(m);
+		return NULL;
+	}
+	m->references = 1;
+
+	if (!(m->names = ssl_x509_names(origcrt)) &&
+	    !(m->names = calloc(1, sizeof(char *))))
+		goto errout;
+	for (char **p = m->names; *p; p++)
+		n++;
+	if (!(m->wildcards = calloc(n + 1, sizeof(char *))))
+		goto errout;
+	for (size_t i = 0; i < n; i++) {
+		if (!(m->wildcards[i] = ssl_wildcardify(m->names[i])))
+			goto errout;
+	}
+	if (!(m->names_str = ssl_x509_names_to_str(origcrt)) ||
+	    !(m->origcrtfpr = ssl_x509_fingerprint(origcrt, 0)))
+		goto errout;
+	return m;
+
+errout:
+	cachefkcrt_meta_free(m);
+	return NULL;
+}
+
+/*
+ * Set the fake cert part of metadata not shared yet.
+ * Returns -1 on error, 0 on success.
+ */
+int
+cachefkcrt_meta_set_usedcrt(cachefkcrt_meta_t *m, X509 *usedcrt)
+{
+	if (m->usedcrtfpr)
+		free(m->usedcrtfpr);
+	m->usedcrtfpr = ssl_x509_fingerprint(usedcrt, 0);
+	return m->usedcrtfpr ? 0 : -1;
+}
+
+/*
+ * Increment reference count.
+ */
+void
+cachefkcrt_meta_refcount_inc(cachefkcrt_meta_t *m)
+{
+	pthread_mutex_lock(&m->mutex);
+	m->references++;
+	pthread_mutex_unlock(&m->mutex);
+}
+
+/*
+ * Decrement reference count and free if it drops to zero.
+ */
+void
+cachefkcrt_meta_free(cachefkcrt_meta_t *m)
+{
+	pthread_mutex_lock(&m->mutex);
+	m->references--;
+	if (m->references) {
+		pthread_mutex_unlock(&m->mutex);
+		return;
+	}
+	pthread_mutex_unlock(&m->mutex);
+	pthread_mutex_destroy(&m->mutex);
+	if (m->names) {
+		for (char **p = m->names; *p; p++)
+			free(*p);
+		free(m->names);
+	}
+	if (m->wildcards) {
+		for (char **p = m->wildcards; *p; p++)
+			free(*p);
+		free(m->wildcards);
+	}
+	if (m->names_str)
+		free(m->names_str);
+	if (m->origcrtfpr)
+		free(m->origcrtfpr);
+	if (m->usedcrtfpr)
+		free(m->usedcrtfpr);
+	free(m);
 }
 
 /* vim: set noet ft=c: */
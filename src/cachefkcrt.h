@@ -32,12 +32,46 @@
 #include "cache.h"
 #include "attrib.h"
 
+#include <sys/types.h>
+#include <pthread.h>
+
 #include <openssl/x509.h>
 
+/*
+ * Metadata of an original server cert and the fake cert generated for it,
+ * computed once when the fake cert is added to the cache and shared by
+ * reference with the conns using the cached fake cert.  Read-only once
+ * shared.
+ */
+typedef struct cachefkcrt_meta {
+	pthread_mutex_t mutex;
+	size_t references;
+	// NULL terminated CN and subjectAltNames of the original cert
+	char **names;
+	// Wildcarded forms of names, in the same order
+	char **wildcards;
+	// names as formatted by ssl_x509_names_to_str()
+	char *names_str;
+	// Hex fingerprints of the original and the fake cert
+	char *origcrtfpr;
+	char *usedcrtfpr;
+} cachefkcrt_meta_t;
+
 void cachefkcrt_init_cb(struct cache *) NONNULL(1);
 
 cache_key_t cachefkcrt_mkkey(X509 *) NONNULL(1) WUNRES;
-cache_val_t cachefkcrt_mkval(X509 *) NONNULL(1) WUNRES;
+cache_val_t cachefkcrt_mkval(X509 *, X509 *) NONNULL(1,2) WUNRES;
+cache_val_t cachefkcrt_mkval_meta(X509 *, X509 *, cachefkcrt_meta_t *)
+            NONNULL(1,2,3) WUNRES;
+cache_val_t cachefkcrt_copy_meta_cb(cache_val_t, void *) NONNULL(1,2);
+void cachefkcrt_set_keep_origcrt(int);
+ssize_t cachefkcrt_topn(struct cache *, X509 **, size_t) NONNULL(1,2) WUNRES;
+
+cachefkcrt_meta_t * cachefkcrt_meta_new(X509 *) NONNULL(1) MALLOC;
+int cachefkcrt_meta_set_usedcrt(cachefkcrt_meta_t *, X509 *)
+    NONNULL(1,2) WUNRES;
+void cachefkcrt_meta_refcount_inc(cachefkcrt_meta_t *) NONNULL(1);
+void cachefkcrt_meta_free(cachefkcrt_meta_t *) NONNULL(1);
 
 #endif /* !CACHEFKCRT_H */
 
@@ -32,6 +32,8 @@
 #include "cachetgcrt.h"
 #include "cachessess.h"
 #include "cachedsess.h"
+#include "cachedns.h"
+#include "cachevrfy.h"
 #include "log.h"
 #include "attrib.h"
 
@@ -44,6 +46,8 @@ cache_t *cachemgr_fkcrt;
 cache_t *cachemgr_tgcrt;
 cache_t *cachemgr_ssess;
 cache_t *cachemgr_dsess;
+cache_t *cachemgr_dns;
+cache_t *cachemgr_vrfy;
 
 /*
  * Garbage collector thread entry point.
@@ -65,22 +69,30 @@ int
 cachemgr_preinit(void)
 {
 	if (!(cachemgr_fkcrt = cache_new(cachefkcrt_init_cb)))
-		goto out4;
+		goto out5;
 	if (!(cachemgr_tgcrt = cache_new(cachetgcrt_init_cb)))
-		goto out3;
+		goto out4;
 	if (!(cachemgr_ssess = cache_new(cachessess_init_cb)))
-		goto out2;
+		goto out3;
 	if (!(cachemgr_dsess = cache_new(cachedsess_init_cb)))
+		goto out2;
+	if (!(cachemgr_dns = cache_new(cachedns_init_cb)))
 		goto out1;
+	if (!(cachemgr_vrfy = cache_new(cachevrfy_init_cb)))
+		goto out0;
 	return 0;
 
+out0:
+	cache_free(cachemgr_dns);
 out1:
-	cache_free(cachemgr_ssess);
+	cache_free(cachemgr_dsess);
 out2:
-	cache_free(cachemgr_tgcrt);
+	cache_free(cachemgr_ssess);
 out3:
-	cache_free(cachemgr_fkcrt);
+	cache_free(cachemgr_tgcrt);
 out4:
+	cache_free(cachemgr_fkcrt);
+out5:
 	return -1;
 }
 
@@ -99,6 +111,10 @@ cachemgr_init(void)
 		return -1;
 	if (cache_reinit(cachemgr_dsess))
 		return -1;
+	if (cache_reinit(cachemgr_dns))
+		return -1;
+	if (cache_reinit(cachemgr_vrfy))
+		return -1;
 	return 0;
 }
 
@@ -110,6 +126,8 @@ cachemgr_init(void)
 void
 cachemgr_fini(void)
 {
+	cache_free(cachemgr_vrfy);
+	cache_free(cachemgr_dns);
 	cache_free(cachemgr_dsess);
 	cache_free(cachemgr_ssess);
 	cache_free(cachemgr_tgcrt);
@@ -118,14 +136,14 @@ cachemgr_fini(void)
 
 /*
  * Garbage collect all the cache contents; free's up resources occupied by
- * certificates and sessions which are no longer valid.
+ * certificates, sessions and DNS lookups which are no longer valid.
  * This function returns after the cleanup completed and all threads are
  * joined.
  */
 void
 cachemgr_gc(void)
 {
-	pthread_t fkcrt_thr, dsess_thr, ssess_thr;
+	pthread_t fkcrt_thr, dsess_thr, ssess_thr, dns_thr, vrfy_thr;
 	int rv;
 
 	/* the tgcrt cache does not need cleanup */
@@ -148,6 +166,18 @@ cachemgr_gc(void)
 		log_err_level_printf(LOG_CRIT, "cachemgr_gc: pthread_create failed: %s\n",
 		               strerror(rv));
 	}
+	rv = pthread_create(&dns_thr, NULL, cachemgr_gc_thread,
+	                    cachemgr_dns);
+	if (rv) {
+		log_err_level_printf(LOG_CRIT, "cachemgr_gc: pthread_create failed: %s\n",
+		               strerror(rv));
+	}
+	rv = pthread_create(&vrfy_thr, NULL, cachemgr_gc_thread,
+	                    cachemgr_vrfy);
+	if (rv) {
+		log_err_level_printf(LOG_CRIT, "cachemgr_gc: pthread_create failed: %s\n",
+		               strerror(rv));
+	}
 
 	rv = pthread_join(fkcrt_thr, NULL);
 	if (rv) {
@@ -164,6 +194,27 @@ cachemgr_gc(void)
 		log_err_level_printf(LOG_CRIT, "cachemgr_gc: pthread_join failed: %s\n",
 		               strerror(rv));
 	}
+	rv = pthread_join(dns_thr, NULL);
+	if (rv) {
+		log_err_level_printf(LOG_CRIT, "cachemgr_gc: pthread_join failed: %s\n",
+		               strerror(rv));
+	}
+	rv = pthread_join(vrfy_thr, NULL);
+	if (rv) {
+		log_err_level_printf(LOG_CRIT, "cachemgr_gc: pthread_join failed: %s\n",
+		               strerror(rv));
+	}
+}
+
+/*
+ * Invalidate all cached upstream verification results, to be called after
+ * the trust store has been reloaded.
+ */
+void
+cachemgr_vrfy_invalidate(void)
+{
+	cachevrfy_next_generation();
+	cache_flush(cachemgr_vrfy);
 }
 
 /* vim: set noet ft=c: */
@@ -34,23 +34,37 @@
 #include "cachetgcrt.h"
 #include "cachessess.h"
 #include "cachedsess.h"
+#include "cachedns.h"
+#include "cachevrfy.h"
 
 extern cache_t *cachemgr_fkcrt;
 extern cache_t *cachemgr_tgcrt;
 extern cache_t *cachemgr_ssess;
 extern cache_t *cachemgr_dsess;
+extern cache_t *cachemgr_dns;
+extern cache_t *cachemgr_vrfy;
 
 int cachemgr_preinit(void) WUNRES;
 int cachemgr_init(void) WUNRES;
 void cachemgr_fini(void);
 void cachemgr_gc(void);
+void cachemgr_vrfy_invalidate(void);
 
 #define cachemgr_fkcrt_get(key) \
         cache_get(cachemgr_fkcrt, cachefkcrt_mkkey(key))
 #define cachemgr_fkcrt_set(key, val) \
-        cache_set(cachemgr_fkcrt, cachefkcrt_mkkey(key), cachefkcrt_mkval(val))
+        cache_set(cachemgr_fkcrt, cachefkcrt_mkkey(key), \
+                                  cachefkcrt_mkval((key), (val)))
+#define cachemgr_fkcrt_get_meta(key, meta) \
+        cache_get_with(cachemgr_fkcrt, cachefkcrt_mkkey(key), \
+                       cachefkcrt_copy_meta_cb, (meta))
+#define cachemgr_fkcrt_set_meta(key, val, meta) \
+        cache_set(cachemgr_fkcrt, cachefkcrt_mkkey(key), \
+                                  cachefkcrt_mkval_meta((key), (val), (meta)))
 #define cachemgr_fkcrt_del(key) \
         cache_del(cachemgr_fkcrt, cachefkcrt_mkkey(key))
+#define cachemgr_fkcrt_has(key) \
+        cache_has(cachemgr_fkcrt, cachefkcrt_mkkey(key))
 
 #define cachemgr_tgcrt_get(key) \
         cache_get(cachemgr_tgcrt, cachetgcrt_mkkey(key))
@@ -84,6 +98,19 @@ void cachemgr_gc(void);
 #define cachemgr_dsess_del(addr, addrlen, sni) \
         cache_del(cachemgr_dsess, cachedsess_mkkey((addr), (addrlen), (sni)))
 
+#define cachemgr_dns_get(host) \
+        cache_get(cachemgr_dns, cachedns_mkkey(host))
+#define cachemgr_dns_set(host, val) \
+        cache_set(cachemgr_dns, cachedns_mkkey(host), cachedns_mkval(val))
+#define cachemgr_dns_del(host) \
+        cache_del(cachemgr_dns, cachedns_mkkey(host))
+
+#define cachemgr_vrfy_get(crt, chain, host, gen) \
+        cache_get(cachemgr_vrfy, cachevrfy_mkkey((crt), (chain), (host), (gen)))
+#define cachemgr_vrfy_set(crt, chain, host, gen, vchain, result, ttl) \
+        cache_set(cachemgr_vrfy, cachevrfy_mkkey((crt), (chain), (host), (gen)), \
+                                 cachevrfy_mkval((crt), (vchain), (result), (ttl)))
+
 #endif /* !CACHEMGR_H */
 
 /* vim: set noet ft=c: */
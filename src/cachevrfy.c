@@ -0,0 +1,289 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "cachevrfy.h"
+
+#include "ssl.h"
+#include "khash.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+/*
+ * Cache for the results of verifying upstream server cert chains against the
+ * trust store, shared by all threads.
+ * Entries expire after VerifyCacheTTL seconds or when the first cert of the
+ * verified chain expires, whichever comes first.  Failures which depend on the
+ * current time are not cached.  The generation of the trust store is part of
+ * the key, so that results obtained against a previous trust store are never
+ * returned, even if set after the cache has been flushed.
+ *
+ * key: char *            hex SHA256 fingerprints of the leaf cert and of the
+ *                        chain, trust store generation and lowercase
+ *                        hostname, separated by colons
+ * val: vrfy_result_t *   X509_V_* verification result and expiry
+ */
+
+KHASH_INIT(vrfymap_t, char*, void*, 1, kh_str_hash_func, kh_str_hash_equal)
+
+static khash_t(vrfymap_t) *vrfymap;
+
+static unsigned int generation = 0;
+
+static cache_iter_t
+cachevrfy_begin_cb(void)
+{
+	return kh_begin(vrfymap);
+}
+
+static cache_iter_t
+cachevrfy_end_cb(void)
+{
+	return kh_end(vrfymap);
+}
+
+static int
+cachevrfy_exist_cb(cache_iter_t it)
+{
+	return kh_exist(vrfymap, it);
+}
+
+static void
+cachevrfy_del_cb(cache_iter_t it)
+{
+	kh_del(vrfymap_t, vrfymap, it);
+}
+
+static cache_iter_t
+cachevrfy_get_cb(cache_key_t key)
+{
+	return kh_get(vrfymap_t, vrfymap, key);
+}
+
+static cache_iter_t
+cachevrfy_put_cb(cache_key_t key, int *ret)
+{
+	return kh_put(vrfymap_t, vrfymap, key, ret);
+}
+
+static void
+cachevrfy_free_key_cb(cache_key_t key)
+{
+	free(key);
+}
+
+static void
+cachevrfy_free_val_cb(cache_val_t val)
+{
+	free(val);
+}
+
+static cache_key_t
+cachevrfy_get_key_cb(cache_iter_t it)
+{
+	return kh_key(vrfymap, it);
+}
+
+static cache_val_t
+cachevrfy_get_val_cb(cache_iter_t it)
+{
+	return kh_val(vrfymap, it);
+}
+
+static void
+cachevrfy_set_val_cb(cache_iter_t it, cache_val_t val)
+{
+	kh_val(vrfymap, it) = val;
+}
+
+static cache_val_t
+cachevrfy_unpackverify_val_cb(cache_val_t val, int copy)
+{
+	vrfy_result_t *res = val;
+	vrfy_result_t *rv;
+
+	if (res->expiry <= time(NULL))
+		return NULL;
+	if (!copy)
+		return ((void*)-1);
+	if (!(rv = malloc(sizeof(vrfy_result_t))))
+		return NULL;
+	memcpy(rv, res, sizeof(vrfy_result_t));
+	return rv;
+}
+
+static void
+cachevrfy_fini_cb(void)
+{
+	kh_destroy(vrfymap_t, vrfymap);
+}
+
+void
+cachevrfy_init_cb(cache_t *cache)
+{
+	vrfymap = kh_init(vrfymap_t);
+
+	cache->begin_cb                 = cachevrfy_begin_cb;
+	cache->end_cb                   = cachevrfy_end_cb;
+	cache->exist_cb                 = cachevrfy_exist_cb;
+	cache->del_cb                   = cachevrfy_del_cb;
+	cache->get_cb                   = cachevrfy_get_cb;
+	cache->put_cb                   = cachevrfy_put_cb;
+	cache->free_key_cb              = cachevrfy_free_key_cb;
+	cache->free_val_cb              = cachevrfy_free_val_cb;
+	cache->get_key_cb               = cachevrfy_get_key_cb;
+	cache->get_val_cb               = cachevrfy_get_val_cb;
+	cache->set_val_cb               = cachevrfy_set_val_cb;
+	cache->unpackverify_val_cb      = cachevrfy_unpackverify_val_cb;
+	cache->fini_cb                  = cachevrfy_fini_cb;
+}
+
+static char *
+cachevrfy_hex(char *p, const unsigned char *buf, size_t sz)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	for (size_t i = 0; i < sz; i++) {
+		*p++ = hex[buf[i] >> 4];
+		*p++ = hex[buf[i] & 0xf];
+	}
+	return p;
+}
+
+/*
+ * The key of the verification result of the server cert crt with the
+ * untrusted chain sent by the server, which may include crt, for hostname
+ * host, which may be NULL, against trust store generation gen.
+ */
+cache_key_t
+cachevrfy_mkkey(X509 *crt, STACK_OF(X509) *chain, const char *host,
+                unsigned int gen)
+{
+	unsigned char fpr[SSL_X509_FPRSZ_SHA256];
+	unsigned char chainfpr[SSL_X509_FPRSZ_SHA256];
+	size_t hostsz = host ? strlen(host) : 0;
+	char *key, *p;
+	int n;
+
+	if (ssl_x509_fingerprint_sha256(crt, fpr) == -1 ||
+	    ssl_x509chain_fingerprint_sha256(chain, chainfpr) == -1)
+		return NULL;
+
+	/* 2 hex fprs, generation, hostname, 3 separators and NUL */
+	if (!(key = malloc(4 * SSL_X509_FPRSZ_SHA256 + 10 + hostsz + 4)))
+		return NULL;
+	p = cachevrfy_hex(key, fpr, SSL_X509_FPRSZ_SHA256);
+	*p++ = ':';
+	p = cachevrfy_hex(p, chainfpr, SSL_X509_FPRSZ_SHA256);
+	n = sprintf(p, ":%u:", gen);
+	p += n;
+	for (size_t i = 0; i < hostsz; i++)
+		*p++ = tolower((unsigned char)host[i]);
+	*p = '\0';
+	return key;
+}
+
+/*
+ * Returns 1 if result may change with the current time alone, without the
+ * certs or the trust store changing.
+ */
+static int
+cachevrfy_time_dependent(int result)
+{
+	switch (result) {
+	case X509_V_ERR_CERT_NOT_YET_VALID:
+	case X509_V_ERR_CERT_HAS_EXPIRED:
+	case X509_V_ERR_CRL_NOT_YET_VALID:
+	case X509_V_ERR_CRL_HAS_EXPIRED:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*
+ * The verification result of the server cert crt, which expires after ttl
+ * seconds, or when crt or any cert in the verified chain vchain expires.
+ * The verified chain includes the trust anchor taken from the trust store,
+ * unlike the untrusted chain sent by the server.
+ * Returns NULL if the result is not worth caching.
+ */
+cache_val_t
+cachevrfy_mkval(X509 *crt, STACK_OF(X509) *vchain, int result,
+                unsigned int ttl)
+{
+	vrfy_result_t *val;
+	time_t now = time(NULL);
+	int day, sec;
+
+	if (cachevrfy_time_dependent(result))
+		return NULL;
+
+	if (!(val = malloc(sizeof(vrfy_result_t))))
+		return NULL;
+	val->result = result;
+	val->expiry = now + ttl;
+
+	if (ASN1_TIME_diff(&day, &sec, NULL, X509_get_notAfter(crt)) &&
+	    now + (time_t)day * 86400 + sec < val->expiry)
+		val->expiry = now + (time_t)day * 86400 + sec;
+	for (int i = 0; vchain && i < sk_X509_num(vchain); i++) {
+		if (ASN1_TIME_diff(&day, &sec, NULL,
+		                   X509_get_notAfter(sk_X509_value(vchain, i))) &&
+		    now + (time_t)day * 86400 + sec < val->expiry)
+			val->expiry = now + (time_t)day * 86400 + sec;
+	}
+	if (val->expiry <= now) {
+		/* not worth caching */
+		free(val);
+		return NULL;
+	}
+	return val;
+}
+
+/*
+ * The current trust store generation.
+ */
+unsigned int
+cachevrfy_generation(void)
+{
+	return generation;
+}
+
+/*
+ * Start a new trust store generation, so that results obtained against the
+ * previous trust store do not match anymore.
+ */
+void
+cachevrfy_next_generation(void)
+{
+	generation++;
+}
+
+/* vim: set noet ft=c: */
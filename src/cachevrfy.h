@@ -0,0 +1,60 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CACHEVRFY_H
+#define CACHEVRFY_H
+
+#include "cache.h"
+#include "attrib.h"
+
+#include <time.h>
+#include <sys/types.h>
+
+#include <openssl/x509.h>
+
+/*
+ * Result of verifying a server cert chain, valid until expiry.
+ */
+typedef struct vrfy_result {
+	time_t expiry;
+	int result;
+} vrfy_result_t;
+
+void cachevrfy_init_cb(struct cache *) NONNULL(1);
+
+cache_key_t cachevrfy_mkkey(X509 *, STACK_OF(X509) *, const char *,
+                            unsigned int) NONNULL(1) WUNRES;
+cache_val_t cachevrfy_mkval(X509 *, STACK_OF(X509) *, int, unsigned int)
+            NONNULL(1) WUNRES;
+
+unsigned int cachevrfy_generation(void);
+void cachevrfy_next_generation(void);
+
+#endif /* !CACHEVRFY_H */
+
+/* vim: set noet ft=c: */
@@ -72,6 +72,12 @@
  */
 #define DFLT_CIPHERSUITES "TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256"
 
+/*
+ * Default maximum size of data to buffer per connection direction before
+ * temporarily stopping to read data from the other end.
+ */
+#define DFLT_OUTBUF_LIMIT (128*1024)
+
 /*
  * Default elliptic curve for EC cipher suites.
  */
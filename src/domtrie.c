@@ -0,0 +1,297 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "domtrie.h"
+
+#include <string.h>
+#include <strings.h>
+
+/*
+ * Suffix trie for filtering rules on domains and their subdomains.
+ *
+ * The root node stands for the DNS root, and the children of a node are the
+ * subdomains one label below it, kept sorted for binary search.  A lookup
+ * walks the labels of the name from right to left, so it visits at most one
+ * node per label of the name, regardless of the number of domains in the
+ * trie.
+ */
+
+struct domtrie_node {
+	char *label;
+	size_t len;
+	void *value;
+	unsigned int has_value : 1;
+	size_t nb_children;
+	size_t size_children;
+	struct domtrie_node **children;
+};
+
+/*
+ * Check that domain is a nonempty sequence of nonempty labels.
+ * A single trailing dot for the root is allowed.
+ */
+int
+domtrie_domain_check(const char *domain)
+{
+	const char *p = domain;
+
+	if (!*p)
+		return -1;
+	while (*p) {
+		const char *dot = strchr(p, '.');
+		if (dot == p)
+			return -1;
+		if (!dot)
+			break;
+		p = dot + 1;
+	}
+	return 0;
+}
+
+/*
+ * Returns the length of name without the trailing dot for the root, if any.
+ */
+static size_t
+domtrie_name_len(const char *name)
+{
+	size_t len = strlen(name);
+	if (len && name[len - 1] == '.')
+		len--;
+	return len;
+}
+
+/*
+ * Moves to the label to the left of the one ending before *end, and returns
+ * its length.  Returns 0 if there is no label left.
+ */
+static size_t
+domtrie_prev_label(const char *name, size_t *end, const char **label)
+{
+	size_t e = *end;
+	size_t b = e;
+
+	if (!e)
+		return 0;
+	while (b && name[b - 1] != '.')
+		b--;
+	*label = name + b;
+	// Skip the dot before the label
+	*end = b ? b - 1 : 0;
+	return e - b;
+}
+
+static int
+domtrie_label_cmp(const char *label, size_t len, const domtrie_node_t *node)
+{
+	int rv = strncasecmp(label, node->label, len < node->len ? len : node->len);
+	if (rv)
+		return rv;
+	return (len > node->len) - (len < node->len);
+}
+
+/*
+ * Binary search for the child of node with label.  Returns the child, or
+ * NULL setting *pos to the index where it should be inserted.
+ */
+static domtrie_node_t *
+domtrie_child_find(const domtrie_node_t *node, const char *label, size_t len, size_t *pos)
+{
+	size_t lo = 0, hi = node->nb_children;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int rv = domtrie_label_cmp(label, len, node->children[mid]);
+		if (!rv)
+			return node->children[mid];
+		if (rv < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if (pos)
+		*pos = lo;
+	return NULL;
+}
+
+static domtrie_node_t *
+domtrie_child_add(domtrie_node_t *node, const char *label, size_t len, size_t pos)
+{
+	if (node->nb_children == node->size_children) {
+		size_t size = node->size_children ? node->size_children * 2 : 4;
+		domtrie_node_t **children = realloc(node->children, size * sizeof(domtrie_node_t *));
+		if (!children)
+			return NULL;
+		node->children = children;
+		node->size_children = size;
+	}
+
+	domtrie_node_t *child = malloc(sizeof(domtrie_node_t));
+	if (!child)
+		return NULL;
+	memset(child, 0, sizeof(domtrie_node_t));
+	child->label = strndup(label, len);
+	if (!child->label) {
+		free(child);
+		return NULL;
+	}
+	child->len = len;
+
+	memmove(&node->children[pos + 1], &node->children[pos], (node->nb_children - pos) * sizeof(domtrie_node_t *));
+	node->children[pos] = child;
+	node->nb_children++;
+	return child;
+}
+
+static void
+domtrie_node_free(domtrie_node_t *node, void (*free_value)(void *))
+{
+	for (size_t i = 0; i < node->nb_children; i++)
+		domtrie_node_free(node->children[i], free_value);
+	if (node->has_value && free_value)
+		free_value(node->value);
+	free(node->children);
+	free(node->label);
+	free(node);
+}
+
+domtrie_t *
+domtrie_new(void)
+{
+	domtrie_t *trie = malloc(sizeof(domtrie_t));
+	if (!trie)
+		return NULL;
+	memset(trie, 0, sizeof(domtrie_t));
+
+	trie->root = malloc(sizeof(domtrie_node_t));
+	if (!trie->root) {
+		free(trie);
+		return NULL;
+	}
+	memset(trie->root, 0, sizeof(domtrie_node_t));
+	return trie;
+}
+
+void
+domtrie_free(domtrie_t *trie, void (*free_value)(void *))
+{
+	domtrie_node_free(trie->root, free_value);
+	free(trie);
+}
+
+/*
+ * Returns the value slot for domain, inserting domain if it is not in the
+ * trie yet, in which case *created is set to 1 and the slot is NULL.
+ * Domain should be checked with domtrie_domain_check() first.
+ * Returns NULL on out of memory.
+ */
+void **
+domtrie_put(domtrie_t *trie, const char *domain, int *created)
+{
+	domtrie_node_t *node = trie->root;
+	size_t end = domtrie_name_len(domain);
+	const char *label;
+	size_t len, pos;
+
+	while ((len = domtrie_prev_label(domain, &end, &label))) {
+		domtrie_node_t *child = domtrie_child_find(node, label, len, &pos);
+		if (!child && !(child = domtrie_child_add(node, label, len, pos)))
+			return NULL;
+		node = child;
+	}
+
+	*created = !node->has_value;
+	if (*created) {
+		node->has_value = 1;
+		trie->count++;
+	}
+	return &node->value;
+}
+
+static const domtrie_node_t *
+domtrie_walk(const domtrie_t *trie, const char *name, int exact)
+{
+	const domtrie_node_t *node = trie->root;
+	const domtrie_node_t *match = NULL;
+	size_t end = domtrie_name_len(name);
+	const char *label;
+	size_t len;
+
+	if (!end)
+		return NULL;
+	while ((len = domtrie_prev_label(name, &end, &label))) {
+		if (!(node = domtrie_child_find(node, label, len, NULL)))
+			return exact ? NULL : match;
+		if (node->has_value)
+			match = node;
+	}
+	if (exact)
+		return node->has_value ? node : NULL;
+	return match;
+}
+
+/*
+ * Returns the value of domain, or NULL if domain is not in the trie.
+ */
+void *
+domtrie_get(const domtrie_t *trie, const char *domain)
+{
+	const domtrie_node_t *node = domtrie_walk(trie, domain, 1);
+	return node ? node->value : NULL;
+}
+
+/*
+ * Returns the value of the longest domain in the trie which is name or one of
+ * its parent domains, or NULL if there is none.
+ */
+void *
+domtrie_match(const domtrie_t *trie, const char *name)
+{
+	const domtrie_node_t *node = domtrie_walk(trie, name, 0);
+	return node ? node->value : NULL;
+}
+
+static void
+domtrie_node_foreach(const domtrie_node_t *node, void (*cb)(void *, void *), void *arg)
+{
+	if (node->has_value)
+		cb(node->value, arg);
+	for (size_t i = 0; i < node->nb_children; i++)
+		domtrie_node_foreach(node->children[i], cb, arg);
+}
+
+/*
+ * Calls cb for the value of each domain in the trie, parent domains first,
+ * and subdomains in label order.
+ */
+void
+domtrie_foreach(const domtrie_t *trie, void (*cb)(void *, void *), void *arg)
+{
+	domtrie_node_foreach(trie->root, cb, arg);
+}
+
+/* vim: set noet ft=c: */
@@ -0,0 +1,62 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef DOMTRIE_H
+#define DOMTRIE_H
+
+#include "attrib.h"
+
+#include <stdlib.h>
+
+typedef struct domtrie_node domtrie_node_t;
+
+/*
+ * Trie of domain names keyed on their labels in reverse order, mapping
+ * domains to values.  A name matches the longest domain in the trie which
+ * is the name itself or one of its parent domains, so example.com matches
+ * www.example.com, but not wwwexample.com.  Labels are compared ignoring
+ * case.
+ */
+typedef struct domtrie {
+	domtrie_node_t *root;
+	size_t count;
+} domtrie_t;
+
+int domtrie_domain_check(const char *) NONNULL(1) WUNRES;
+
+domtrie_t *domtrie_new(void) MALLOC;
+void domtrie_free(domtrie_t *, void (*)(void *)) NONNULL(1);
+
+void **domtrie_put(domtrie_t *, const char *, int *) NONNULL(1,2,3) WUNRES;
+void *domtrie_get(const domtrie_t *, const char *) NONNULL(1,2) WUNRES;
+void *domtrie_match(const domtrie_t *, const char *) NONNULL(1,2) WUNRES;
+void domtrie_foreach(const domtrie_t *, void (*)(void *, void *), void *) NONNULL(1,2);
+
+#endif /* !DOMTRIE_H */
+
+/* vim: set noet ft=c: */
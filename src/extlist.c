@@ -0,0 +1,789 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "extlist.h"
+
+#include "iptrie.h"
+#include "domtrie.h"
+#include "log.h"
+#include "util.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * A list file has one entry per line, a domain name, an address, or an
+ * address range in CIDR notation.  Blank lines and text after # are ignored.
+ * Domain names starting with a dot match the domain and all its subdomains,
+ * the others match the name exactly.  Names are compared ignoring case.
+ *
+ * Lists are compiled into an index in a single read-only anonymous mapping,
+ * without any per entry allocations: an array of the 64-bit hashes of the
+ * domain names sorted by hash, with offsets into a table of the names, and
+ * sorted arrays of disjoint IPv4 and IPv6 address ranges.  Names are looked
+ * up by binary search on the hashes of the name and of its parent domains,
+ * addresses by binary search on the ranges.  Domain names take 16 bytes each
+ * plus the names themselves, and address ranges 8 or 32 bytes each, so
+ * a million entries fit in a few tens of MB.
+ *
+ * A refresh compiles a new index if the list file has changed, and swaps it
+ * in under the write lock of the list, so that lookups use either the old or
+ * the new index, never a mix of both.
+ */
+
+#define EXTLIST_EXACT  0x1U
+#define EXTLIST_SUFFIX 0x2U
+
+typedef struct extlist_name {
+	uint64_t hash;
+	uint32_t name;             /* offset into the name table */
+	uint32_t flags;
+} extlist_name_t;
+
+typedef struct extlist_range4 {
+	uint32_t lo;
+	uint32_t hi;
+} extlist_range4_t;
+
+typedef struct extlist_range6 {
+	unsigned char lo[16];
+	unsigned char hi[16];
+} extlist_range6_t;
+
+typedef struct extlist_index {
+	void *map;
+	size_t mapsize;
+	const extlist_name_t *names;
+	size_t nnames;
+	const extlist_range4_t *v4;
+	size_t nv4;
+	const extlist_range6_t *v6;
+	size_t nv6;
+	const char *strs;
+} extlist_index_t;
+
+struct extlist {
+	char *path;
+	unsigned int refcount;     /* protected by extlist_mutex */
+	pthread_rwlock_t lock;
+	extlist_index_t *index;
+
+	// The list file the index has been compiled from
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+
+	struct extlist *next;
+};
+
+/*
+ * Entries of a list being compiled, in growing arrays on the heap.
+ */
+typedef struct extlist_build {
+	extlist_name_t *names;
+	size_t nnames;
+	size_t names_cap;
+	extlist_range4_t *v4;
+	size_t nv4;
+	size_t v4_cap;
+	extlist_range6_t *v6;
+	size_t nv6;
+	size_t v6_cap;
+	char *strs;
+	size_t strsize;
+	size_t strs_cap;
+} extlist_build_t;
+
+static pthread_mutex_t extlist_mutex = PTHREAD_MUTEX_INITIALIZER;
+static extlist_t *extlists = NULL;
+
+static void
+extlist_oom(void)
+{
+	log_err_level_printf(LOG_CRIT, "Out of memory\n");
+}
+
+/*
+ * FNV-1a hash of the first len chars of s, ignoring case.
+ */
+static uint64_t NONNULL(1)
+extlist_hash(const char *s, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)tolower((unsigned char)s[i]);
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/*
+ * Make room for n + need elements of size sz in the array at *p with
+ * capacity *cap.
+ */
+static int NONNULL(1,2) WUNRES
+extlist_grow(void **p, size_t *cap, size_t n, size_t need, size_t sz)
+{
+	if (n + need <= *cap)
+		return 0;
+
+	size_t newcap = *cap ? *cap * 2 : 1024;
+	while (newcap < n + need)
+		newcap *= 2;
+
+	void *np = realloc(*p, newcap * sz);
+	if (!np)
+		return -1;
+	*p = np;
+	*cap = newcap;
+	return 0;
+}
+
+static int NONNULL(1,2)
+extlist_add_prefix(extlist_build_t *b, iptrie_prefix_t *prefix)
+{
+	if (prefix->af == AF_INET) {
+		if (extlist_grow((void **)&b->v4, &b->v4_cap, b->nv4, 1, sizeof(extlist_range4_t)) == -1)
+			return -1;
+
+		uint32_t lo = (uint32_t)prefix->addr[0] << 24 | (uint32_t)prefix->addr[1] << 16 |
+		              (uint32_t)prefix->addr[2] << 8 | prefix->addr[3];
+		uint32_t hostmask = prefix->len == 32 ? 0 : 0xffffffffU >> prefix->len;
+
+		b->v4[b->nv4].lo = lo;
+		b->v4[b->nv4].hi = lo | hostmask;
+		b->nv4++;
+	} else {
+		if (extlist_grow((void **)&b->v6, &b->v6_cap, b->nv6, 1, sizeof(extlist_range6_t)) == -1)
+			return -1;
+
+		extlist_range6_t *r = &b->v6[b->nv6++];
+		memcpy(r->lo, prefix->addr, 16);
+		for (int i = 0; i < 16; i++) {
+			int bits = (int)prefix->len - 8 * i;
+			if (bits >= 8)
+				r->hi[i] = prefix->addr[i];
+			else if (bits <= 0)
+				r->hi[i] = 0xff;
+			else
+				r->hi[i] = prefix->addr[i] | (0xff >> bits);
+		}
+	}
+	return 0;
+}
+
+static int NONNULL(1,2)
+extlist_add_name(extlist_build_t *b, char *name, unsigned int flags)
+{
+	size_t len = strlen(name);
+
+	if (extlist_grow((void **)&b->names, &b->names_cap, b->nnames, 1, sizeof(extlist_name_t)) == -1 ||
+	    extlist_grow((void **)&b->strs, &b->strs_cap, b->strsize, len + 1, 1) == -1)
+		return -1;
+
+	for (size_t i = 0; i < len; i++)
+		b->strs[b->strsize + i] = tolower((unsigned char)name[i]);
+	b->strs[b->strsize + len] = '\0';
+
+	b->names[b->nnames].hash = extlist_hash(name, len);
+	b->names[b->nnames].name = b->strsize;
+	b->names[b->nnames].flags = flags;
+	b->nnames++;
+	b->strsize += len + 1;
+	return 0;
+}
+
+/*
+ * Add entry on line line_num of list file path.
+ * Returns 0 on success, -1 on invalid entry or out of memory.
+ */
+static int NONNULL(1,2,3) WUNRES
+extlist_add(extlist_build_t *b, char *entry, const char *path, unsigned int line_num)
+{
+	iptrie_prefix_t prefix;
+
+	if (iptrie_prefix_parse(entry, &prefix) == 0) {
+		if (extlist_add_prefix(b, &prefix) == -1) {
+			extlist_oom();
+			return -1;
+		}
+		return 0;
+	}
+
+	unsigned int flags = EXTLIST_EXACT;
+	char *name = entry;
+	if (*name == '.') {
+		flags = EXTLIST_SUFFIX;
+		name++;
+	}
+
+	size_t len = strlen(name);
+	if (len && name[len - 1] == '.')
+		name[--len] = '\0';
+
+	if (!len || len > UINT32_MAX / 2 || strpbrk(name, "/*") || domtrie_domain_check(name) == -1) {
+		log_err_level_printf(LOG_ERR, "Invalid entry '%s' in filter list '%s' on line %u\n", entry, path, line_num);
+		return -1;
+	}
+
+	if (extlist_add_name(b, name, flags) == -1) {
+		extlist_oom();
+		return -1;
+	}
+	return 0;
+}
+
+static int
+extlist_name_cmp(const void *a, const void *b)
+{
+	const extlist_name_t *n1 = a;
+	const extlist_name_t *n2 = b;
+
+	return n1->hash < n2->hash ? -1 : n1->hash > n2->hash;
+}
+
+static int
+extlist_range4_cmp(const void *a, const void *b)
+{
+	const extlist_range4_t *r1 = a;
+	const extlist_range4_t *r2 = b;
+
+	return r1->lo < r2->lo ? -1 : r1->lo > r2->lo;
+}
+
+static int
+extlist_range6_cmp(const void *a, const void *b)
+{
+	return memcmp(((const extlist_range6_t *)a)->lo, ((const extlist_range6_t *)b)->lo, 16);
+}
+
+/*
+ * Sort the names by hash and merge the duplicates, keeping the flags of all.
+ */
+static void NONNULL(1)
+extlist_build_names(extlist_build_t *b)
+{
+	size_t n = 0;
+
+	if (!b->nnames)
+		return;
+	qsort(b->names, b->nnames, sizeof(extlist_name_t), extlist_name_cmp);
+
+	size_t run = 0;
+	for (size_t i = 0; i < b->nnames; i++) {
+		extlist_name_t *e = &b->names[i];
+		if (!n || b->names[n - 1].hash != e->hash)
+			run = n;
+
+		size_t j;
+		for (j = run; j < n; j++) {
+			if (equal(b->strs + b->names[j].name, b->strs + e->name)) {
+				b->names[j].flags |= e->flags;
+				break;
+			}
+		}
+		if (j == n)
+			b->names[n++] = *e;
+	}
+	b->nnames = n;
+}
+
+/*
+ * Sort the address ranges and merge the overlapping ones.
+ */
+static void NONNULL(1)
+extlist_build_ranges(extlist_build_t *b)
+{
+	size_t n = 0;
+
+	if (b->nv4) {
+		qsort(b->v4, b->nv4, sizeof(extlist_range4_t), extlist_range4_cmp);
+		for (size_t i = 1; i < b->nv4; i++) {
+			extlist_range4_t *r = &b->v4[n];
+			if (b->v4[i].lo <= r->hi || (r->hi != UINT32_MAX && b->v4[i].lo == r->hi + 1)) {
+				if (b->v4[i].hi > r->hi)
+					r->hi = b->v4[i].hi;
+			} else {
+				b->v4[++n] = b->v4[i];
+			}
+		}
+		b->nv4 = n + 1;
+	}
+
+	n = 0;
+	if (b->nv6) {
+		qsort(b->v6, b->nv6, sizeof(extlist_range6_t), extlist_range6_cmp);
+		for (size_t i = 1; i < b->nv6; i++) {
+			extlist_range6_t *r = &b->v6[n];
+			if (memcmp(b->v6[i].lo, r->hi, 16) <= 0) {
+				if (memcmp(b->v6[i].hi, r->hi, 16) > 0)
+					memcpy(r->hi, b->v6[i].hi, 16);
+			} else {
+				b->v6[++n] = b->v6[i];
+			}
+		}
+		b->nv6 = n + 1;
+	}
+}
+
+static void NONNULL(1)
+extlist_index_free(extlist_index_t *index)
+{
+	if (index->map)
+		munmap(index->map, index->mapsize);
+	free(index);
+}
+
+/*
+ * Copy the compiled entries into a new read-only mapping.
+ */
+static extlist_index_t * NONNULL(1) WUNRES
+extlist_build_index(extlist_build_t *b)
+{
+	size_t strsize = 0;
+	for (size_t i = 0; i < b->nnames; i++)
+		strsize += strlen(b->strs + b->names[i].name) + 1;
+
+	extlist_index_t *index = malloc(sizeof(extlist_index_t));
+	if (!index) {
+		extlist_oom();
+		return NULL;
+	}
+	memset(index, 0, sizeof(extlist_index_t));
+
+	size_t namesize = b->nnames * sizeof(extlist_name_t);
+	size_t v4size = b->nv4 * sizeof(extlist_range4_t);
+	size_t v6size = b->nv6 * sizeof(extlist_range6_t);
+
+	index->mapsize = namesize + v4size + v6size + strsize;
+	if (!index->mapsize)
+		return index;
+
+	index->map = mmap(NULL, index->mapsize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0);
+	if (index->map == MAP_FAILED) {
+		log_err_level_printf(LOG_ERR, "Cannot map filter list index: %s\n", strerror(errno));
+		index->map = NULL;
+		extlist_index_free(index);
+		return NULL;
+	}
+
+	unsigned char *p = index->map;
+	extlist_name_t *names = (extlist_name_t *)p;
+	extlist_range4_t *v4 = (extlist_range4_t *)(p + namesize);
+	extlist_range6_t *v6 = (extlist_range6_t *)(p + namesize + v4size);
+	char *strs = (char *)(p + namesize + v4size + v6size);
+
+	size_t off = 0;
+	for (size_t i = 0; i < b->nnames; i++) {
+		const char *name = b->strs + b->names[i].name;
+		size_t len = strlen(name) + 1;
+
+		names[i] = b->names[i];
+		names[i].name = off;
+		memcpy(strs + off, name, len);
+		off += len;
+	}
+	if (v4size)
+		memcpy(v4, b->v4, v4size);
+	if (v6size)
+		memcpy(v6, b->v6, v6size);
+
+	if (mprotect(index->map, index->mapsize, PROT_READ) == -1) {
+		log_err_level_printf(LOG_ERR, "Cannot protect filter list index: %s\n", strerror(errno));
+		extlist_index_free(index);
+		return NULL;
+	}
+
+	index->names = names;
+	index->nnames = b->nnames;
+	index->v4 = v4;
+	index->nv4 = b->nv4;
+	index->v6 = v6;
+	index->nv6 = b->nv6;
+	index->strs = strs;
+	return index;
+}
+
+/*
+ * Compile the list file opened as f into a new index.
+ * Returns NULL on invalid entries or errors.
+ */
+static extlist_index_t * NONNULL(1,2) WUNRES
+extlist_compile(const char *path, FILE *f)
+{
+	extlist_build_t b;
+	extlist_index_t *index = NULL;
+	char *line = NULL;
+	size_t linecap = 0;
+	unsigned int line_num = 0;
+
+	memset(&b, 0, sizeof(extlist_build_t));
+
+	while (getline(&line, &linecap, f) != -1) {
+		line_num++;
+
+		char *entry = line + strspn(line, " \t\r\n");
+		if (*entry == '\0' || *entry == '#')
+			continue;
+
+		char *end = entry + strcspn(entry, " \t\r\n#");
+		char *rest = end + strspn(end, " \t\r\n");
+		if (*rest != '\0' && *rest != '#') {
+			log_err_level_printf(LOG_ERR, "Invalid entry '%s' in filter list '%s' on line %u, one entry per line\n", entry, path, line_num);
+			goto out;
+		}
+		*end = '\0';
+
+		if (extlist_add(&b, entry, path, line_num) == -1)
+			goto out;
+	}
+	if (ferror(f)) {
+		log_err_level_printf(LOG_ERR, "Cannot read filter list '%s': %s\n", path, strerror(errno));
+		goto out;
+	}
+
+	extlist_build_names(&b);
+	extlist_build_ranges(&b);
+	index = extlist_build_index(&b);
+out:
+	free(line);
+	free(b.names);
+	free(b.v4);
+	free(b.v6);
+	free(b.strs);
+	return index;
+}
+
+/*
+ * Compile the list file again if it has changed since the last time.
+ * Returns 1 if the list has been reloaded, 0 if the file has not changed,
+ * and -1 on error, in which case the list keeps its current entries.
+ */
+int
+extlist_refresh(extlist_t *list)
+{
+	struct stat st;
+
+	FILE *f = fopen(list->path, "r");
+	if (!f) {
+		log_err_level_printf(LOG_ERR, "Cannot open filter list '%s': %s\n", list->path, strerror(errno));
+		return -1;
+	}
+	if (fstat(fileno(f), &st) == -1) {
+		log_err_level_printf(LOG_ERR, "Cannot stat filter list '%s': %s\n", list->path, strerror(errno));
+		fclose(f);
+		return -1;
+	}
+
+	if (list->index && st.st_dev == list->dev && st.st_ino == list->ino &&
+	    st.st_size == list->size && st.st_mtime == list->mtime) {
+		fclose(f);
+		return 0;
+	}
+
+	extlist_index_t *index = extlist_compile(list->path, f);
+	fclose(f);
+	if (!index)
+		return -1;
+
+	pthread_rwlock_wrlock(&list->lock);
+	extlist_index_t *old = list->index;
+	list->index = index;
+	list->dev = st.st_dev;
+	list->ino = st.st_ino;
+	list->size = st.st_size;
+	list->mtime = st.st_mtime;
+	pthread_rwlock_unlock(&list->lock);
+
+	if (old)
+		extlist_index_free(old);
+
+	log_dbg_printf("Loaded filter list '%s': %zu names, %zu IPv4 and %zu IPv6 ranges\n",
+	               list->path, index->nnames, index->nv4, index->nv6);
+	return 1;
+}
+
+/*
+ * Refresh all open lists.
+ * Returns the number of lists reloaded, or -1 if any list failed to reload.
+ */
+int
+extlist_refresh_all(void)
+{
+	extlist_t **lists;
+	size_t n = 0;
+	int rv = 0;
+
+	pthread_mutex_lock(&extlist_mutex);
+	for (extlist_t *list = extlists; list; list = list->next)
+		n++;
+	if (!n) {
+		pthread_mutex_unlock(&extlist_mutex);
+		return 0;
+	}
+	lists = malloc(n * sizeof(extlist_t *));
+	if (!lists) {
+		pthread_mutex_unlock(&extlist_mutex);
+		extlist_oom();
+		return -1;
+	}
+	// Hold a ref, so that lists do not go away while being refreshed
+	n = 0;
+	for (extlist_t *list = extlists; list; list = list->next) {
+		list->refcount++;
+		lists[n++] = list;
+	}
+	pthread_mutex_unlock(&extlist_mutex);
+
+	for (size_t i = 0; i < n; i++) {
+		int r = extlist_refresh(lists[i]);
+		if (r == -1)
+			rv = -1;
+		else if (rv != -1)
+			rv += r;
+		extlist_close(lists[i]);
+	}
+	free(lists);
+	return rv;
+}
+
+/*
+ * Open the list at path, compiling it if it is not open yet, or else
+ * refreshing it.  Lists are refcounted, and must be closed by the caller.
+ * Returns NULL on error.
+ */
+extlist_t *
+extlist_open(const char *path)
+{
+	extlist_t *list;
+
+	pthread_mutex_lock(&extlist_mutex);
+	for (list = extlists; list; list = list->next) {
+		if (equal(list->path, path)) {
+			list->refcount++;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&extlist_mutex);
+
+	if (list) {
+		if (extlist_refresh(list) == -1) {
+			extlist_close(list);
+			return NULL;
+		}
+		return list;
+	}
+
+	list = malloc(sizeof(extlist_t));
+	if (!list) {
+		extlist_oom();
+		return NULL;
+	}
+	memset(list, 0, sizeof(extlist_t));
+
+	list->path = strdup(path);
+	if (!list->path) {
+		free(list);
+		extlist_oom();
+		return NULL;
+	}
+	if (pthread_rwlock_init(&list->lock, NULL) != 0) {
+		free(list->path);
+		free(list);
+		return NULL;
+	}
+	list->refcount = 1;
+
+	if (extlist_refresh(list) == -1) {
+		pthread_rwlock_destroy(&list->lock);
+		free(list->path);
+		free(list);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&extlist_mutex);
+	list->next = extlists;
+	extlists = list;
+	pthread_mutex_unlock(&extlist_mutex);
+	return list;
+}
+
+void
+extlist_close(extlist_t *list)
+{
+	pthread_mutex_lock(&extlist_mutex);
+	if (--list->refcount) {
+		pthread_mutex_unlock(&extlist_mutex);
+		return;
+	}
+	for (extlist_t **l = &extlists; *l; l = &(*l)->next) {
+		if (*l == list) {
+			*l = list->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&extlist_mutex);
+
+	if (list->index)
+		extlist_index_free(list->index);
+	pthread_rwlock_destroy(&list->lock);
+	free(list->path);
+	free(list);
+}
+
+static const extlist_name_t * NONNULL(1,2)
+extlist_find_name(const extlist_index_t *index, const char *s, size_t len)
+{
+	uint64_t h = extlist_hash(s, len);
+	size_t lo = 0, hi = index->nnames;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (index->names[mid].hash < h)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < index->nnames && index->names[lo].hash == h; lo++) {
+		const char *name = index->strs + index->names[lo].name;
+		if (!strncasecmp(name, s, len) && name[len] == '\0')
+			return &index->names[lo];
+	}
+	return NULL;
+}
+
+/*
+ * Returns 1 if the domain name s or one of its parent domains is in the list,
+ * 0 otherwise.
+ */
+int
+extlist_match_name(extlist_t *list, const char *s)
+{
+	size_t len = strlen(s);
+	int rv = 0;
+
+	if (len && s[len - 1] == '.')
+		len--;
+	if (!len)
+		return 0;
+
+	pthread_rwlock_rdlock(&list->lock);
+	extlist_index_t *index = list->index;
+	if (index && index->nnames) {
+		if (extlist_find_name(index, s, len)) {
+			// Suffix entries match the domain itself too
+			rv = 1;
+		} else {
+			const char *end = s + len;
+			const char *p = s;
+			const char *dot;
+			while ((dot = memchr(p, '.', end - p))) {
+				p = dot + 1;
+				const extlist_name_t *e = extlist_find_name(index, p, end - p);
+				if (e && (e->flags & EXTLIST_SUFFIX)) {
+					rv = 1;
+					break;
+				}
+			}
+		}
+	}
+	pthread_rwlock_unlock(&list->lock);
+	return rv;
+}
+
+/*
+ * Returns 1 if the address s is in one of the address ranges of the list,
+ * 0 otherwise.
+ */
+int
+extlist_match_addr(extlist_t *list, const char *s)
+{
+	iptrie_prefix_t addr;
+	int rv = 0;
+
+	if (iptrie_prefix_parse(s, &addr) == -1)
+		return 0;
+
+	pthread_rwlock_rdlock(&list->lock);
+	extlist_index_t *index = list->index;
+	if (index && addr.af == AF_INET && index->nv4) {
+		uint32_t a = (uint32_t)addr.addr[0] << 24 | (uint32_t)addr.addr[1] << 16 |
+		             (uint32_t)addr.addr[2] << 8 | addr.addr[3];
+		// Find the last range starting at or before a
+		size_t lo = 0, hi = index->nv4;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (index->v4[mid].lo <= a)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		rv = lo && a <= index->v4[lo - 1].hi;
+	} else if (index && addr.af == AF_INET6 && index->nv6) {
+		size_t lo = 0, hi = index->nv6;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (memcmp(index->v6[mid].lo, addr.addr, 16) <= 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		rv = lo && memcmp(addr.addr, index->v6[lo - 1].hi, 16) <= 0;
+	}
+	pthread_rwlock_unlock(&list->lock);
+	return rv;
+}
+
+/*
+ * Returns the number of names and address ranges in the list, after merging
+ * duplicate names and overlapping ranges.
+ */
+size_t
+extlist_count(extlist_t *list)
+{
+	size_t n = 0;
+
+	pthread_rwlock_rdlock(&list->lock);
+	if (list->index)
+		n = list->index->nnames + list->index->nv4 + list->index->nv6;
+	pthread_rwlock_unlock(&list->lock);
+	return n;
+}
+
+/* vim: set noet ft=c: */
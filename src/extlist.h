@@ -0,0 +1,56 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EXTLIST_H
+#define EXTLIST_H
+
+#include "attrib.h"
+
+#include <stdlib.h>
+
+/*
+ * List files of domains, addresses and address ranges referenced by
+ * filtering rules, compiled into read-only sorted indexes.  Lists are shared
+ * by all rules and filters referring to the same path, and can be refreshed
+ * while conns are looking them up.
+ */
+typedef struct extlist extlist_t;
+
+extlist_t *extlist_open(const char *) NONNULL(1) WUNRES;
+void extlist_close(extlist_t *) NONNULL(1);
+
+int extlist_match_name(extlist_t *, const char *) NONNULL(1,2) WUNRES;
+int extlist_match_addr(extlist_t *, const char *) NONNULL(1,2) WUNRES;
+size_t extlist_count(extlist_t *) NONNULL(1) WUNRES;
+
+int extlist_refresh(extlist_t *) NONNULL(1) WUNRES;
+int extlist_refresh_all(void) WUNRES;
+
+#endif /* !EXTLIST_H */
+
+/* vim: set noet ft=c: */
@@ -32,6 +32,9 @@
 #include "log.h"
 #include "util.h"
 
+#include <pthread.h>
+#include <ctype.h>
+
 ACM_DEFINE (char);
 
 #define free_list(list, type) do { \
@@ -55,12 +58,151 @@ ACM_DEFINE (char);
 		*list = value; \
 } while (0)
 
+/*
+ * Hash s 8 bytes at a time, and finalize with the MurmurHash3 mixer so that
+ * all bytes of the key reach the low bits khash uses to index buckets.
+ */
+static filter_key_t
+filter_key(const char *s)
+{
+	size_t len = strlen(s);
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+	const char *p = s;
+	size_t n = len;
+
+	while (n >= 8) {
+		uint64_t w;
+		memcpy(&w, p, 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 29;
+		p += 8;
+		n -= 8;
+	}
+	if (n) {
+		uint64_t w = 0;
+		memcpy(&w, p, n);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+	}
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+
+	return (filter_key_t){(khint_t)h, (unsigned int)len, s};
+}
+
+static void *
+filter_hash_get(khash_t(filter) *h, const char *s)
+{
+	khiter_t k = kh_get(filter, h, filter_key(s));
+	return k != kh_end(h) ? kh_val(h, k) : NULL;
+}
+
+/*
+ * Insert s into the hash table h, creating the table if h is NULL.
+ * The key is not copied, so s must be the string of the value stored in the
+ * returned slot.  Returns NULL on oom.
+ */
+static void **
+filter_hash_put(khash_t(filter) **h, const char *s)
+{
+	if (!*h)
+		if (!(*h = kh_init(filter)))
+			return NULL;
+
+	int ret;
+	khiter_t k = kh_put(filter, *h, filter_key(s), &ret);
+	if (ret == -1)
+		return NULL;
+	return &kh_val(*h, k);
+}
+
+typedef struct filter_hash_entry {
+	const char *str;
+	void *value;
+} filter_hash_entry_t;
+
+static int
+filter_hash_cmp(const void *a, const void *b)
+{
+	return strcmp(((const filter_hash_entry_t *)a)->str, ((const filter_hash_entry_t *)b)->str);
+}
+
+// Set if a dump failed to sort a hash table, so that filter_str() fails
+static int filter_str_oom = 0;
+
+/*
+ * Return the values of h sorted by their keys, NULL terminated, so that the
+ * rules are printed in the same order regardless of the hash table layout.
+ * Returns NULL on oom.
+ */
+static void **
+filter_hash_sorted(khash_t(filter) *h)
+{
+	size_t n = kh_size(h);
+	filter_hash_entry_t *entries = malloc((n ? n : 1) * sizeof(filter_hash_entry_t));
+	void **values = malloc((n + 1) * sizeof(void *));
+	if (!entries || !values) {
+		free(entries);
+		free(values);
+		filter_str_oom = 1;
+		return oom_return_na_null();
+	}
+
+	size_t i = 0;
+	for (khiter_t k = kh_begin(h); k != kh_end(h); ++k) {
+		if (kh_exist(h, k)) {
+			entries[i].str = kh_key(h, k).str;
+			entries[i++].value = kh_val(h, k);
+		}
+	}
+	qsort(entries, n, sizeof(filter_hash_entry_t), filter_hash_cmp);
+
+	for (i = 0; i < n; i++)
+		values[i] = entries[i].value;
+	values[n] = NULL;
+	free(entries);
+	return values;
+}
+
+#define filter_hash_traverse(type, h, __func) do { \
+	void *__v; \
+	kh_foreach_value(h, __v, { type __p = __v; __func(&__p); }); \
+} while (0)
+
+/*
+ * Run __func on the values of h in key order, or run __err on oom.
+ */
+#define filter_hash_traverse_sorted(type, h, __func, __err) do { \
+	void **__v = filter_hash_sorted(h); \
+	if (!__v) \
+		__err; \
+	for (size_t __i = 0; __v[__i]; __i++) { \
+		type __p = __v[__i]; \
+		__func(&__p); \
+	} \
+	free(__v); \
+} while (0)
+
 #define match_acm(acm, haystack, value) do { \
-	const ACState(char) *state = ACM_reset(acm); \
-	for (char *c = haystack; *c; c++) { \
-		if (ACM_match(state, *c)) { \
-			ACM_get_match(state, 0, 0, (void **)&value); \
-			break; \
+	const ACDfa(char) *dfa = ACM_DFA(acm); \
+	if (dfa) { \
+		ACDfaState state = ACM_DFA_reset(dfa); \
+		for (char *c = haystack; *c; c++) { \
+			if (ACM_DFA_match(dfa, state, *c)) { \
+				ACM_DFA_get_match(dfa, state, 0, (void **)&value); \
+				break; \
+			} \
+		} \
+	} else { \
+		const ACState(char) *state = ACM_reset(acm); \
+		for (char *c = haystack; *c; c++) { \
+			if (ACM_match(state, *c)) { \
+				ACM_get_match(state, 0, 0, (void **)&value); \
+				break; \
+			} \
 		} \
 	} \
 } while (0)
@@ -220,8 +362,12 @@ filter_rule_free(filter_rule_t *rule)
 		free(rule->host);
 	if (rule->uri)
 		free(rule->uri);
+	if (rule->list)
+		free(rule->list);
 	if (rule->port)
 		free(rule->port);
+	if (rule->path)
+		free(rule->path);
 	if (rule->ip)
 		free(rule->ip);
 #ifndef WITHOUT_USERAUTH
@@ -245,6 +391,31 @@ filter_rules_free(opts_t *opts)
 		rule = next;
 	}
 	opts->filter_rules = NULL;
+	opts->filter_rules_tail = NULL;
+}
+
+/*
+ * Append the rule, or the list of rules starting with rule, to the filtering
+ * rules of opts.
+ */
+void
+filter_rule_append(opts_t *opts, filter_rule_t *rule)
+{
+	filter_rule_t *tail = opts->filter_rules_tail;
+	if (!tail) {
+		tail = opts->filter_rules;
+		while (tail && tail->next)
+			tail = tail->next;
+	}
+
+	if (tail)
+		tail->next = rule;
+	else
+		opts->filter_rules = rule;
+
+	while (rule->next)
+		rule = rule->next;
+	opts->filter_rules_tail = rule;
 }
 
 #define free_port(p) do { \
@@ -261,23 +432,37 @@ free_port_func(void *p)
 }
 
 static void
-filter_port_btree_free(kbtree_t(port) *btree)
+filter_port_hash_free(khash_t(filter) *h)
 {
-	if (btree) {
-		__kb_traverse(filter_port_p_t, btree, free_port);
-		__kb_destroy(btree);
+	if (h) {
+		filter_hash_traverse(filter_port_t *, h, free_port);
+		kh_destroy(filter, h);
 	}
 }
 
+static void
+free_path_func(void *p)
+{
+	filter_path_t *path = p;
+	if (path->action.conn_opts)
+		conn_opts_free(path->action.conn_opts);
+	free(path->path);
+	free(path);
+}
+
 #define free_site(p) do { \
 	if ((*p)->action.conn_opts) \
 		conn_opts_free((*p)->action.conn_opts); \
+	if ((*p)->extlist) \
+		extlist_close((*p)->extlist); \
 	free((*p)->site); \
-	filter_port_btree_free((*p)->port_btree); \
+	filter_port_hash_free((*p)->port_hash); \
 	if ((*p)->port_acm) \
 		ACM_release((*p)->port_acm); \
 	if ((*p)->port_all) \
 		free_port_func((*p)->port_all); \
+	if ((*p)->path_trie) \
+		pathtrie_free((*p)->path_trie, free_path_func); \
 	free(*p); \
 } while (0)
 
@@ -290,51 +475,77 @@ free_site_func(void *s)
 static void
 filter_list_free(filter_list_t *list)
 {
-	if (list->ip_btree) {
-		__kb_traverse(filter_site_p_t, list->ip_btree, free_site);
-		__kb_destroy(list->ip_btree);
+	if (list->ip_hash) {
+		filter_hash_traverse(filter_site_t *, list->ip_hash, free_site);
+		kh_destroy(filter, list->ip_hash);
 	}
+	if (list->ip_trie)
+		iptrie_free(list->ip_trie, free_site_func);
 	if (list->ip_acm)
 		ACM_release(list->ip_acm);
 	if (list->ip_all)
 		free_site_func(list->ip_all);
 
-	if (list->sni_btree) {
-		__kb_traverse(filter_site_p_t, list->sni_btree, free_site);
-		__kb_destroy(list->sni_btree);
+	if (list->sni_hash) {
+		filter_hash_traverse(filter_site_t *, list->sni_hash, free_site);
+		kh_destroy(filter, list->sni_hash);
 	}
+	if (list->sni_trie)
+		domtrie_free(list->sni_trie, free_site_func);
 	if (list->sni_acm)
 		ACM_release(list->sni_acm);
 	if (list->sni_all)
 		free_site_func(list->sni_all);
 
-	if (list->cn_btree) {
-		__kb_traverse(filter_site_p_t, list->cn_btree, free_site);
-		__kb_destroy(list->cn_btree);
+	if (list->cn_hash) {
+		filter_hash_traverse(filter_site_t *, list->cn_hash, free_site);
+		kh_destroy(filter, list->cn_hash);
 	}
+	if (list->cn_trie)
+		domtrie_free(list->cn_trie, free_site_func);
 	if (list->cn_acm)
 		ACM_release(list->cn_acm);
 	if (list->cn_all)
 		free_site_func(list->cn_all);
 
-	if (list->host_btree) {
-		__kb_traverse(filter_site_p_t, list->host_btree, free_site);
-		__kb_destroy(list->host_btree);
+	if (list->host_hash) {
+		filter_hash_traverse(filter_site_t *, list->host_hash, free_site);
+		kh_destroy(filter, list->host_hash);
 	}
+	if (list->host_trie)
+		domtrie_free(list->host_trie, free_site_func);
 	if (list->host_acm)
 		ACM_release(list->host_acm);
 	if (list->host_all)
 		free_site_func(list->host_all);
 
-	if (list->uri_btree) {
-		__kb_traverse(filter_site_p_t, list->uri_btree, free_site);
-		__kb_destroy(list->uri_btree);
+	if (list->uri_hash) {
+		filter_hash_traverse(filter_site_t *, list->uri_hash, free_site);
+		kh_destroy(filter, list->uri_hash);
 	}
 	if (list->uri_acm)
 		ACM_release(list->uri_acm);
 	if (list->uri_all)
 		free_site_func(list->uri_all);
 
+	while (list->lists) {
+		filter_site_list_t *next = list->lists->next;
+		free_site_func(list->lists->site);
+		free(list->lists);
+		list->lists = next;
+	}
+
+	if (list->ip_bloom)
+		bloom_free(list->ip_bloom);
+	if (list->sni_bloom)
+		bloom_free(list->sni_bloom);
+	if (list->cn_bloom)
+		bloom_free(list->cn_bloom);
+	if (list->host_bloom)
+		bloom_free(list->host_bloom);
+	if (list->uri_bloom)
+		bloom_free(list->uri_bloom);
+
 	free(list);
 }
 
@@ -351,9 +562,9 @@ filter_user_free(filter_user_t *user)
 	free(user->user);
 	filter_list_free(user->list);
 
-	if (user->desc_btree) {
-		__kb_traverse(filter_desc_p_t, user->desc_btree, free_desc);
-		__kb_destroy(user->desc_btree);
+	if (user->desc_hash) {
+		filter_hash_traverse(filter_desc_t *, user->desc_hash, free_desc);
+		kh_destroy(filter, user->desc_hash);
 	}
 
 	if (user->desc_acm)
@@ -372,25 +583,27 @@ filter_user_free(filter_user_t *user)
 	free(*p); \
 } while (0)
 
-void
-filter_free(opts_t *opts)
+static void
+free_ip_func(void *i)
 {
-	if (!opts->filter)
-		return;
+	free_ip((filter_ip_t **)&i);
+}
 
-	filter_t *pf = opts->filter;
+static void
+filter_destroy(filter_t *pf)
+{
 #ifndef WITHOUT_USERAUTH
-	if (pf->user_btree) {
-		__kb_traverse(filter_user_p_t, pf->user_btree, free_user);
-		__kb_destroy(pf->user_btree);
+	if (pf->user_hash) {
+		filter_hash_traverse(filter_user_t *, pf->user_hash, free_user);
+		kh_destroy(filter, pf->user_hash);
 	}
 
 	if (pf->user_acm)
 		ACM_release(pf->user_acm);
 
-	if (pf->desc_btree) {
-		__kb_traverse(filter_desc_p_t, pf->desc_btree, free_desc);
-		__kb_destroy(pf->desc_btree);
+	if (pf->desc_hash) {
+		filter_hash_traverse(filter_desc_t *, pf->desc_hash, free_desc);
+		kh_destroy(filter, pf->desc_hash);
 	}
 
 	if (pf->desc_acm)
@@ -399,18 +612,93 @@ filter_free(opts_t *opts)
 	filter_list_free(pf->all_user);
 #endif /* !WITHOUT_USERAUTH */
 
-	if (pf->ip_btree) {
-		__kb_traverse(filter_ip_p_t, pf->ip_btree, free_ip);
-		__kb_destroy(pf->ip_btree);
+	if (pf->ip_hash) {
+		filter_hash_traverse(filter_ip_t *, pf->ip_hash, free_ip);
+		kh_destroy(filter, pf->ip_hash);
 	}
 
+	if (pf->ip_trie)
+		iptrie_free(pf->ip_trie, free_ip_func);
+
 	if (pf->ip_acm)
 		ACM_release(pf->ip_acm);
 
 	filter_list_free(pf->all);
 
-	free(opts->filter);
-	opts->filter = NULL;
+	free(pf);
+}
+
+/*
+ * Filters are refcounted, so that conns can keep using the filter they have
+ * started with after a reload publishes a new one.  The opts of a proxyspec
+ * hold one reference, and each conn holds one until it is freed.
+ * Conns are freed on conn handling threads, hence the mutex.
+ */
+static pthread_mutex_t filter_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Returns the current filter of opts with a reference taken, or NULL if
+ * opts has no filter.  Release with filter_release().
+ */
+filter_t *
+filter_acquire(opts_t *opts)
+{
+	pthread_mutex_lock(&filter_mutex);
+	filter_t *filter = opts->filter;
+	if (filter)
+		filter->refcount++;
+	pthread_mutex_unlock(&filter_mutex);
+	return filter;
+}
+
+void
+filter_release(filter_t *filter)
+{
+	if (!filter)
+		return;
+
+	pthread_mutex_lock(&filter_mutex);
+	int last = --filter->refcount == 0;
+	pthread_mutex_unlock(&filter_mutex);
+
+	if (last)
+		filter_destroy(filter);
+}
+
+/*
+ * Replace the filter of opts with filter, which may be NULL.  Conns created
+ * after this call use the new filter; the old one is freed by the last conn
+ * still using it.  Takes over the reference returned by filter_set().
+ */
+void
+filter_publish(opts_t *opts, filter_t *filter)
+{
+	pthread_mutex_lock(&filter_mutex);
+	filter_t *old = opts->filter;
+	__atomic_store_n(&opts->filter, filter, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&filter_mutex);
+
+	// Drop decisions cached by conns which acquired the old filter after it
+	// was set, but before it was published
+	filter_invalidate();
+
+	filter_release(old);
+}
+
+/*
+ * Returns 1 if filter is the filter of opts, 0 if a reload has published
+ * another one since filter was acquired.
+ */
+int
+filter_is_current(opts_t *opts, filter_t *filter)
+{
+	return __atomic_load_n(&opts->filter, __ATOMIC_ACQUIRE) == filter;
+}
+
+void
+filter_free(opts_t *opts)
+{
+	filter_publish(opts, NULL);
 }
 
 int
@@ -508,6 +796,11 @@ filter_rule_copy(filter_rule_t *rule, const char *argv0, opts_t *opts, tmp_opts_
 			if (!r->uri)
 				return oom_return(argv0);
 		}
+		if (rule->list) {
+			r->list = strdup(rule->list);
+			if (!r->list)
+				return oom_return(argv0);
+		}
 
 		r->exact_dstip = rule->exact_dstip;
 		r->exact_sni = rule->exact_sni;
@@ -529,6 +822,12 @@ filter_rule_copy(filter_rule_t *rule, const char *argv0, opts_t *opts, tmp_opts_
 		r->all_ports = rule->all_ports;
 		r->exact_port = rule->exact_port;
 
+		if (rule->path) {
+			r->path = strdup(rule->path);
+			if (!r->path)
+				return oom_return(argv0);
+		}
+
 		// The action field is not a pointer, hence the direct assignment (copy)
 		r->action = rule->action;
 
@@ -539,7 +838,7 @@ filter_rule_copy(filter_rule_t *rule, const char *argv0, opts_t *opts, tmp_opts_
 				return oom_return(argv0);
 		}
 
-		append_list(&opts->filter_rules, r, filter_rule_t);
+		filter_rule_append(opts, r);
 
 		rule = rule->next;
 	}
@@ -628,7 +927,7 @@ filter_rule_site_str(filter_rule_t *rule, char *site, unsigned int exact_site, u
 			goto err;
 	}
 
-	if (asprintf(&s, "filter rule%s: %s=%s, dstport=%s, srcip=%s"
+	if (asprintf(&s, "filter rule%s: %s=%s%s%s, dstport=%s, srcip=%s"
 #ifndef WITHOUT_USERAUTH
 		", user=%s, desc=%s"
 #endif /* !WITHOUT_USERAUTH */
@@ -649,7 +948,7 @@ filter_rule_site_str(filter_rule_t *rule, char *site, unsigned int exact_site, u
 		", line=%d"
 #endif /* DEBUG_PROXY */
 		"%s%s\n",
-		rule_num_str, apply_to, site, STRORNONE(rule->port), STRORNONE(rule->ip),
+		rule_num_str, apply_to, site, rule->path ? ", path=" : "", STRORNONE(rule->path), STRORNONE(rule->port), STRORNONE(rule->ip),
 #ifndef WITHOUT_USERAUTH
 		STRORNONE(rule->user), STRORNONE(rule->desc),
 #endif /* !WITHOUT_USERAUTH */
@@ -693,6 +992,7 @@ filter_rule_site_all_str(filter_rule_t *rule, int rule_num)
 	char *cn = NULL;
 	char *host = NULL;
 	char *uri = NULL;
+	char *list = NULL;
 
 	if (rule->dstip) {
 		dstip = filter_rule_site_str(rule, rule->dstip, rule->exact_dstip, rule->all_dstips, "dstip", rule_num);
@@ -719,8 +1019,13 @@ filter_rule_site_all_str(filter_rule_t *rule, int rule_num)
 		if (!uri)
 			goto err;
 	}
+	if (rule->list) {
+		list = filter_rule_site_str(rule, rule->list, 1, 0, "list", rule_num);
+		if (!list)
+			goto err;
+	}
 
-	if (asprintf(&s, "%s%s%s%s%s", STRORNONE(dstip), STRORNONE(sni), STRORNONE(cn), STRORNONE(host), STRORNONE(uri)) < 0) {
+	if (asprintf(&s, "%s%s%s%s%s%s", STRORNONE(dstip), STRORNONE(sni), STRORNONE(cn), STRORNONE(host), STRORNONE(uri), STRORNONE(list)) < 0) {
 		s = NULL;
 	}
 err:
@@ -734,6 +1039,8 @@ err:
 		free(host);
 	if (uri)
 		free(uri);
+	if (list)
+		free(list);
 	return s;
 }
 
@@ -854,6 +1161,72 @@ build_port_list_acm(UNUSED MatchHolder(char) match, void *v)
 	append_list(&port_list_acm, p, filter_port_list_t);
 }
 
+static char *
+filter_path_str(filter_path_list_t *path_list)
+{
+	char *s = NULL;
+
+	int count = 0;
+	while (path_list) {
+		filter_path_t *path = path_list->path;
+
+		char *copts_str = conn_opts_str(path->action.conn_opts);
+		if (!copts_str)
+			goto err;
+
+		char *p;
+		if (asprintf(&p, "%s\n          %d: %s (%s, action=%s|%s|%s|%s|%s, log=%s|%s|%s|%s|%s"
+#ifndef WITHOUT_MIRROR
+				"|%s"
+#endif /* !WITHOUT_MIRROR */
+				", precedence=%d"
+#ifdef DEBUG_PROXY
+				", line=%d"
+#endif /* DEBUG_PROXY */
+				"%s%s)", STRORNONE(s), count,
+				path->path, path->path[strlen(path->path) - 1] == '/' ? "prefix" : (strchr(path->path, '*') ? "glob" : "exact"),
+				path->action.divert ? "divert" : "", path->action.split ? "split" : "", path->action.pass ? "pass" : "", path->action.block ? "block" : "", path->action.match ? "match" : "",
+				path->action.log_connect ? (path->action.log_connect == 1 ? "!connect" : "connect") : "", path->action.log_master ? (path->action.log_master == 1 ? "!master" : "master") : "",
+				path->action.log_cert ? (path->action.log_cert == 1 ? "!cert" : "cert") : "", path->action.log_content ? (path->action.log_content == 1 ? "!content" : "content") : "",
+				path->action.log_pcap ? (path->action.log_pcap == 1 ? "!pcap" : "pcap") : "",
+#ifndef WITHOUT_MIRROR
+				path->action.log_mirror ? (path->action.log_mirror == 1 ? "!mirror" : "mirror") : "",
+#endif /* !WITHOUT_MIRROR */
+				path->action.precedence,
+#ifdef DEBUG_PROXY
+				path->action.line_num,
+#endif /* DEBUG_PROXY */
+				strlen(copts_str) ? "\n            " : "", copts_str) < 0) {
+			free(copts_str);
+			goto err;
+		}
+		free(copts_str);
+		if (s)
+			free(s);
+		s = p;
+		path_list = path_list->next;
+		count++;
+	}
+	goto out;
+err:
+	if (s) {
+		free(s);
+		s = NULL;
+	}
+out:
+	return s;
+}
+
+static void
+build_path_list(void *v, void *arg)
+{
+	filter_path_list_t *p = malloc(sizeof(filter_path_list_t));
+	memset(p, 0, sizeof(filter_path_list_t));
+	p->path = v;
+
+	append_list((filter_path_list_t **)arg, p, filter_path_list_t);
+}
+
 static char *
 filter_sites_str(filter_site_list_t *site_list)
 {
@@ -863,8 +1236,8 @@ filter_sites_str(filter_site_list_t *site_list)
 	while (site_list) {
 		filter_port_list_t *port = NULL;
 
-		if (site_list->site->port_btree)
-			__kb_traverse(filter_port_p_t, site_list->site->port_btree, build_port_list);
+		if (site_list->site->port_hash)
+			filter_hash_traverse_sorted(filter_port_t *, site_list->site->port_hash, build_port_list, goto err);
 
 		char *ports_exact = filter_port_str(port);
 		free_list(port, filter_port_list_t);
@@ -883,6 +1256,14 @@ filter_sites_str(filter_site_list_t *site_list)
 		free_list(port_list_acm, filter_port_list_t);
 		port_list_acm = NULL;
 
+		filter_path_list_t *path = NULL;
+
+		if (site_list->site->path_trie)
+			pathtrie_foreach(site_list->site->path_trie, build_path_list, &path);
+
+		char *paths = filter_path_str(path);
+		free_list(path, filter_path_list_t);
+
 		char *copts_str = conn_opts_str(site_list->site->action.conn_opts);
 		if (!copts_str)
 			goto err;
@@ -896,9 +1277,9 @@ filter_sites_str(filter_site_list_t *site_list)
 #ifdef DEBUG_PROXY
 				", line=%d"
 #endif /* DEBUG_PROXY */
-				"%s%s)%s%s%s%s%s%s",
+				"%s%s)%s%s%s%s%s%s%s%s",
 				STRORNONE(s), count,
-				site_list->site->site, site_list->site->all_sites ? "all_sites, " : "", site_list->site->exact ? "exact" : "substring",
+				site_list->site->site, site_list->site->all_sites ? "all_sites, " : "", site_list->site->extlist ? "list" : site_list->site->cidr ? "cidr" : (site_list->site->suffix ? "suffix" : (site_list->site->exact ? "exact" : "substring")),
 				site_list->site->action.divert ? "divert" : "", site_list->site->action.split ? "split" : "", site_list->site->action.pass ? "pass" : "", site_list->site->action.block ? "block" : "", site_list->site->action.match ? "match" : "",
 				site_list->site->action.log_connect ? (site_list->site->action.log_connect == 1 ? "!connect" : "connect") : "", site_list->site->action.log_master ? (site_list->site->action.log_master == 1 ? "!master" : "master") : "",
 				site_list->site->action.log_cert ? (site_list->site->action.log_cert == 1 ? "!cert" : "cert") : "", site_list->site->action.log_content ? (site_list->site->action.log_content == 1 ? "!content" : "content") : "",
@@ -913,13 +1294,16 @@ filter_sites_str(filter_site_list_t *site_list)
 				strlen(copts_str) ? "\n        " : "", copts_str,
 				ports_exact ? "\n        port exact:" : "", STRORNONE(ports_exact),
 				ports_substring ? "\n        port substring:" : "", STRORNONE(ports_substring),
-				ports_all ? "\n        port all:" : "", STRORNONE(ports_all)) < 0) {
+				ports_all ? "\n        port all:" : "", STRORNONE(ports_all),
+				paths ? "\n        path:" : "", STRORNONE(paths)) < 0) {
 			if (ports_exact)
 				free(ports_exact);
 			if (ports_substring)
 				free(ports_substring);
 			if (ports_all)
 				free(ports_all);
+			if (paths)
+				free(paths);
 			if (copts_str)
 				free(copts_str);
 			goto err;
@@ -930,6 +1314,8 @@ filter_sites_str(filter_site_list_t *site_list)
 			free(ports_substring);
 		if (ports_all)
 			free(ports_all);
+		if (paths)
+			free(paths);
 		if (copts_str)
 			free(copts_str);
 		if (s)
@@ -978,6 +1364,24 @@ build_site_list_acm(UNUSED MatchHolder(char) match, void *v)
 	append_list(&site_list_acm, s, filter_site_list_t);
 }
 
+static void
+build_site_list_trie(UNUSED const iptrie_prefix_t *prefix, void *v, void *arg)
+{
+	filter_site_list_t **list = arg;
+
+	filter_site_list_t *s = malloc(sizeof(filter_site_list_t));
+	memset(s, 0, sizeof(filter_site_list_t));
+	s->site = v;
+
+	append_list(list, s, filter_site_list_t);
+}
+
+static void
+build_site_list_domtrie(void *v, void *arg)
+{
+	build_site_list_trie(NULL, v, arg);
+}
+
 static void
 filter_tmp_site_list_free(filter_site_list_t **list)
 {
@@ -998,8 +1402,12 @@ filter_list_str(filter_list_t *list)
 	append_list(&site, s, filter_site_list_t); \
 } while (0)
 
-	if (list->ip_btree) {
-		__kb_traverse(filter_site_p_t, list->ip_btree, build_site_list);
+	if (list->ip_hash || list->ip_trie) {
+		if (list->ip_hash)
+			filter_hash_traverse_sorted(filter_site_t *, list->ip_hash, build_site_list, goto err);
+		// CIDRs are exact matches on address ranges
+		if (list->ip_trie)
+			iptrie_foreach(list->ip_trie, build_site_list_trie, &site);
 		s = filter_list_sub_str(site, s, "ip exact");
 		filter_tmp_site_list_free(&site);
 	}
@@ -1014,11 +1422,16 @@ filter_list_str(filter_list_t *list)
 		filter_tmp_site_list_free(&site_list_acm);
 	}
 
-	if (list->sni_btree) {
-		__kb_traverse(filter_site_p_t, list->sni_btree, build_site_list);
+	if (list->sni_hash) {
+		filter_hash_traverse_sorted(filter_site_t *, list->sni_hash, build_site_list, goto err);
 		s = filter_list_sub_str(site, s, "sni exact");
 		filter_tmp_site_list_free(&site);
 	}
+	if (list->sni_trie) {
+		domtrie_foreach(list->sni_trie, build_site_list_domtrie, &site);
+		s = filter_list_sub_str(site, s, "sni suffix");
+		filter_tmp_site_list_free(&site);
+	}
 	if (list->sni_acm) {
 		ACM_foreach_keyword(list->sni_acm, build_site_list_acm);
 		s = filter_list_sub_str(site_list_acm, s, "sni substring");
@@ -1030,11 +1443,16 @@ filter_list_str(filter_list_t *list)
 		filter_tmp_site_list_free(&site_list_acm);
 	}
 
-	if (list->cn_btree) {
-		__kb_traverse(filter_site_p_t, list->cn_btree, build_site_list);
+	if (list->cn_hash) {
+		filter_hash_traverse_sorted(filter_site_t *, list->cn_hash, build_site_list, goto err);
 		s = filter_list_sub_str(site, s, "cn exact");
 		filter_tmp_site_list_free(&site);
 	}
+	if (list->cn_trie) {
+		domtrie_foreach(list->cn_trie, build_site_list_domtrie, &site);
+		s = filter_list_sub_str(site, s, "cn suffix");
+		filter_tmp_site_list_free(&site);
+	}
 	if (list->cn_acm) {
 		ACM_foreach_keyword(list->cn_acm, build_site_list_acm);
 		s = filter_list_sub_str(site_list_acm, s, "cn substring");
@@ -1046,11 +1464,16 @@ filter_list_str(filter_list_t *list)
 		filter_tmp_site_list_free(&site_list_acm);
 	}
 
-	if (list->host_btree) {
-		__kb_traverse(filter_site_p_t, list->host_btree, build_site_list);
+	if (list->host_hash) {
+		filter_hash_traverse_sorted(filter_site_t *, list->host_hash, build_site_list, goto err);
 		s = filter_list_sub_str(site, s, "host exact");
 		filter_tmp_site_list_free(&site);
 	}
+	if (list->host_trie) {
+		domtrie_foreach(list->host_trie, build_site_list_domtrie, &site);
+		s = filter_list_sub_str(site, s, "host suffix");
+		filter_tmp_site_list_free(&site);
+	}
 	if (list->host_acm) {
 		ACM_foreach_keyword(list->host_acm, build_site_list_acm);
 		s = filter_list_sub_str(site_list_acm, s, "host substring");
@@ -1062,8 +1485,8 @@ filter_list_str(filter_list_t *list)
 		filter_tmp_site_list_free(&site_list_acm);
 	}
 
-	if (list->uri_btree) {
-		__kb_traverse(filter_site_p_t, list->uri_btree, build_site_list);
+	if (list->uri_hash) {
+		filter_hash_traverse_sorted(filter_site_t *, list->uri_hash, build_site_list, goto err);
 		s = filter_list_sub_str(site, s, "uri exact");
 		filter_tmp_site_list_free(&site);
 	}
@@ -1077,7 +1500,14 @@ filter_list_str(filter_list_t *list)
 		s = filter_list_sub_str(site_list_acm, s, "uri all");
 		filter_tmp_site_list_free(&site_list_acm);
 	}
+
+	if (list->lists)
+		s = filter_list_sub_str(list->lists, s, "list");
 	return s;
+err:
+	if (s)
+		free(s);
+	return NULL;
 }
 
 static char *
@@ -1091,7 +1521,7 @@ filter_ip_list_str(filter_ip_list_t *ip_list)
 
 		char *p;
 		if (asprintf(&p, "%s%s  ip %d %s (%s)=\n%s", STRORNONE(s), NLORNONE(s),
-				count, ip_list->ip->ip, ip_list->ip->exact ? "exact" : "substring", STRORNONE(list)) < 0) {
+				count, ip_list->ip->ip, ip_list->ip->cidr ? "cidr" : (ip_list->ip->exact ? "exact" : "substring"), STRORNONE(list)) < 0) {
 			if (list)
 				free(list);
 			goto err;
@@ -1114,10 +1544,22 @@ out:
 	return s;
 }
 
+static void
+build_ip_list_trie(UNUSED const iptrie_prefix_t *prefix, void *v, void *arg)
+{
+	filter_ip_list_t **list = arg;
+
+	filter_ip_list_t *i = malloc(sizeof(filter_ip_list_t));
+	memset(i, 0, sizeof(filter_ip_list_t));
+	i->ip = v;
+
+	append_list(list, i, filter_ip_list_t);
+}
+
 static char *
-filter_ip_btree_str(kbtree_t(ip) *btree)
+filter_ip_hash_str(khash_t(filter) *hash, iptrie_t *trie)
 {
-	if (!btree)
+	if (!hash && !trie)
 		return NULL;
 
 #define build_ip_list(p) do { \
@@ -1128,7 +1570,11 @@ filter_ip_btree_str(kbtree_t(ip) *btree)
 } while (0)
 	
 	filter_ip_list_t *ip = NULL;
-	__kb_traverse(filter_ip_p_t, btree, build_ip_list);
+	if (hash)
+		filter_hash_traverse_sorted(filter_ip_t *, hash, build_ip_list, return NULL);
+	// CIDRs are exact matches on address ranges
+	if (trie)
+		iptrie_foreach(trie, build_ip_list_trie, &ip);
 
 	char *s = filter_ip_list_str(ip);
 	
@@ -1177,7 +1623,7 @@ filter_user_list_str(filter_user_list_t *user)
 		// It is possible to have users without any filter rule,
 		// but the user exists because it has desc filters,
 		// so the current user should not have any desc
-		if (user->user->desc_btree || user->user->desc_acm)
+		if (user->user->desc_hash || user->user->desc_acm)
 			goto skip;
 
 		char *list = filter_list_str(user->user->list);
@@ -1217,13 +1663,13 @@ out:
 } while (0)
 
 static char *
-filter_user_btree_str(kbtree_t(user) *btree)
+filter_user_hash_str(khash_t(filter) *hash)
 {
-	if (!btree)
+	if (!hash)
 		return NULL;
 
 	filter_user_list_t *user = NULL;
-	__kb_traverse(filter_user_p_t, btree, build_user_list);
+	filter_hash_traverse_sorted(filter_user_t *, hash, build_user_list, return NULL);
 
 	char *s = filter_user_list_str(user);
 
@@ -1295,9 +1741,9 @@ out:
 }
 
 static char *
-filter_desc_btree_str(kbtree_t(desc) *btree)
+filter_desc_hash_str(khash_t(filter) *hash)
 {
-	if (!btree)
+	if (!hash)
 		return NULL;
 
 #define build_desc_list(p) do { \
@@ -1308,7 +1754,7 @@ filter_desc_btree_str(kbtree_t(desc) *btree)
 } while (0)
 
 	filter_desc_list_t *desc = NULL;
-	__kb_traverse(filter_desc_p_t, btree, build_desc_list);
+	filter_hash_traverse_sorted(filter_desc_t *, hash, build_desc_list, return NULL);
 
 	char *s = filter_desc_list_str(desc);
 
@@ -1353,10 +1799,10 @@ filter_userdesc_list_str(filter_user_list_t *user)
 	int count = 0;
 	while (user) {
 		// Make sure the current user has a desc
-		if (!user->user->desc_btree && !user->user->desc_acm)
+		if (!user->user->desc_hash && !user->user->desc_acm)
 			goto skip;
 
-		char *list_exact = filter_desc_btree_str(user->user->desc_btree);
+		char *list_exact = filter_desc_hash_str(user->user->desc_hash);
 		char *list_substr = filter_desc_acm_str(user->user->desc_acm);
 
 		char *p = NULL;
@@ -1393,13 +1839,13 @@ out:
 }
 
 static char *
-filter_userdesc_btree_str(kbtree_t(user) *btree)
+filter_userdesc_hash_str(khash_t(filter) *hash)
 {
-	if (!btree)
+	if (!hash)
 		return NULL;
 
 	filter_user_list_t *user = NULL;
-	__kb_traverse(filter_user_p_t, btree, build_user_list);
+	filter_hash_traverse_sorted(filter_user_t *, hash, build_user_list, return NULL);
 
 	char *s = filter_userdesc_list_str(user);
 
@@ -1448,19 +1894,25 @@ filter_str(filter_t *filter)
 		goto out;
 	}
 
+	filter_str_oom = 0;
+
 #ifndef WITHOUT_USERAUTH
-	userdesc_filter_exact = filter_userdesc_btree_str(filter->user_btree);
+	userdesc_filter_exact = filter_userdesc_hash_str(filter->user_hash);
 	userdesc_filter_substr = filter_userdesc_acm_str(filter->user_acm);
-	user_filter_exact = filter_user_btree_str(filter->user_btree);
+	user_filter_exact = filter_user_hash_str(filter->user_hash);
 	user_filter_substr = filter_user_acm_str(filter->user_acm);
-	desc_filter_exact = filter_desc_btree_str(filter->desc_btree);
+	desc_filter_exact = filter_desc_hash_str(filter->desc_hash);
 	desc_filter_substr = filter_desc_acm_str(filter->desc_acm);
 	user_filter_all = filter_list_str(filter->all_user);
 #endif /* !WITHOUT_USERAUTH */
-	ip_filter_exact = filter_ip_btree_str(filter->ip_btree);
+	ip_filter_exact = filter_ip_hash_str(filter->ip_hash, filter->ip_trie);
 	ip_filter_substr = filter_ip_acm_str(filter->ip_acm);
 	filter_all = filter_list_str(filter->all);
 
+	// Do not print partial rules
+	if (filter_str_oom)
+		goto out;
+
 	if (asprintf(&fs, "filter=>\n"
 #ifndef WITHOUT_USERAUTH
 			"userdesc_filter_exact->%s%s\n"
@@ -1533,6 +1985,26 @@ filter_rule_dbg_print(filter_rule_t *rule)
 }
 #endif /* DEBUG_OPTS */
 
+/*
+ * Exact sni, cn, and host specs starting with a dot match the domain and all
+ * of its subdomains.
+ */
+static int
+filter_site_is_suffix(const char *site, unsigned int exact)
+{
+	return exact && site[0] == '.';
+}
+
+static int WUNRES
+filter_site_check(const char *site, unsigned int exact, unsigned int line_num)
+{
+	if (filter_site_is_suffix(site, exact) && domtrie_domain_check(site + 1) == -1) {
+		fprintf(stderr, "Invalid domain suffix %s on line %d\n", site, line_num);
+		return -1;
+	}
+	return 0;
+}
+
 #define MAX_SITE_LEN 200
 
 int
@@ -1588,6 +2060,9 @@ filter_passsite_set(opts_t *opts, UNUSED conn_opts_t *conn_opts, char *value, un
 		exact_site = 1;
 	}
 
+	if (filter_site_check(argv[0], exact_site, line_num) == -1)
+		return -1;
+
 	rule->sni = strdup(argv[0]);
 	if (!rule->sni)
 		return oom_return_na();
@@ -1664,7 +2139,7 @@ filter_passsite_set(opts_t *opts, UNUSED conn_opts_t *conn_opts, char *value, un
 	rule->action.precedence++;
 	rule->action.pass = 1;
 
-	append_list(&opts->filter_rules, rule, filter_rule_t);
+	filter_rule_append(opts, rule);
 
 #ifdef DEBUG_OPTS
 	filter_rule_dbg_print(rule);
@@ -1761,6 +2236,28 @@ filter_macro_set(opts_t *opts, char *value, unsigned int line_num)
 	return 0;
 }
 
+/*
+ * Exact ip specs with a prefix length are CIDRs, e.g. 10.1.0.0/16, which
+ * match all addresses in the range.
+ */
+static int
+filter_ip_is_cidr(const char *ip, unsigned int exact)
+{
+	return exact && strchr(ip, '/');
+}
+
+static int WUNRES
+filter_ip_check(const char *ip, unsigned int exact, unsigned int line_num)
+{
+	iptrie_prefix_t prefix;
+
+	if (filter_ip_is_cidr(ip, exact) && iptrie_prefix_parse(ip, &prefix) == -1) {
+		fprintf(stderr, "Invalid CIDR %s on line %d\n", ip, line_num);
+		return -1;
+	}
+	return 0;
+}
+
 static char * WUNRES
 filter_site_set(filter_rule_t *rule, const char *name, const char *site, unsigned int line_num)
 {
@@ -1796,10 +2293,19 @@ filter_site_set(filter_rule_t *rule, const char *name, const char *site, unsigne
 		all_sites = 1;
 
 	if (equal(name, "ip") || equal(name, "DstIp")) {
+		if (filter_ip_check(s, exact_site, line_num) == -1) {
+			free(s);
+			return NULL;
+		}
 		rule->dstip = s;
 		rule->exact_dstip = exact_site;
 		rule->all_dstips = all_sites;
 	}
+	else if ((equal(name, "sni") || equal(name, "SNI") || equal(name, "cn") || equal(name, "CN") || equal(name, "host") || equal(name, "Host")) &&
+			filter_site_check(s, exact_site, line_num) == -1) {
+		free(s);
+		return NULL;
+	}
 	else if (equal(name, "sni") || equal(name, "SNI")) {
 		rule->sni = s;
 		rule->exact_sni = exact_site;
@@ -1824,6 +2330,34 @@ filter_site_set(filter_rule_t *rule, const char *name, const char *site, unsigne
 	return s;
 }
 
+static int WUNRES
+filter_list_set(filter_rule_t *rule, const char *list, unsigned int line_num)
+{
+	if (rule->list) {
+		fprintf(stderr, "Only one list allowed in filter rule on line %d\n", line_num);
+		return -1;
+	}
+
+	rule->list = strdup(list);
+	if (!rule->list)
+		return oom_return_na();
+	return 0;
+}
+
+static int WUNRES
+filter_path_set(filter_rule_t *rule, const char *path, unsigned int line_num)
+{
+	if (pathtrie_pattern_check(path) == -1) {
+		fprintf(stderr, "Invalid filter path '%s' on line %d\n", path, line_num);
+		return -1;
+	}
+
+	rule->path = strdup(path);
+	if (!rule->path)
+		return oom_return_na();
+	return 0;
+}
+
 static int WUNRES
 filter_port_set(filter_rule_t *rule, const char *port, unsigned int line_num)
 {
@@ -1986,6 +2520,8 @@ filter_rule_translate(opts_t *opts, const char *name, int argc, char **argv, uns
 					rule->exact_ip = filter_is_exact(argv[i]);
 					if (filter_field_set(&rule->ip, argv[i], line_num) == -1)
 						return -1;
+					if (filter_ip_check(rule->ip, rule->exact_ip, line_num) == -1)
+						return -1;
 					rule->action.precedence++;
 				}
 				i++;
@@ -2000,7 +2536,7 @@ filter_rule_translate(opts_t *opts, const char *name, int argc, char **argv, uns
 				return -1;
 
 			if (equal(argv[i], "ip") || equal(argv[i], "sni") || equal(argv[i], "cn") || equal(argv[i], "host") || equal(argv[i], "uri") ||
-					equal(argv[i], "port")) {
+					equal(argv[i], "list") || equal(argv[i], "port")) {
 				if (equal(argv[i], "ip") || equal(argv[i], "sni") || equal(argv[i], "cn") || equal(argv[i], "host") || equal(argv[i], "uri")) {
 					char *name = argv[i];
 
@@ -2014,11 +2550,42 @@ filter_rule_translate(opts_t *opts, const char *name, int argc, char **argv, uns
 
 					rule->action.precedence++;
 					done_site = 1;
-				}
 
-				if (i < argc && equal(argv[i], "port")) {
-					if ((i = filter_arg_index_inc(i, argc, argv[i], line_num)) == -1)
-						return -1;
+					// Path is more specific than host, just like port
+					if (i < argc && equal(argv[i], "path")) {
+						if (!equal(name, "host")) {
+							fprintf(stderr, "Path is allowed with host only on line %d\n", line_num);
+							return -1;
+						}
+
+						if ((i = filter_arg_index_inc(i, argc, argv[i], line_num)) == -1)
+							return -1;
+
+						rule->action.precedence++;
+
+						if (filter_path_set(rule, argv[i++], line_num) == -1)
+							return -1;
+					}
+				}
+				else if (equal(argv[i], "list")) {
+					if ((i = filter_arg_index_inc(i, argc, argv[i], line_num)) == -1)
+						return -1;
+
+					if (filter_list_set(rule, argv[i++], line_num) == -1)
+						return -1;
+
+					rule->action.precedence++;
+					done_site = 1;
+				}
+
+				if (i < argc && equal(argv[i], "port")) {
+					if (rule->path) {
+						fprintf(stderr, "Path cannot be combined with port on line %d\n", line_num);
+						return -1;
+					}
+
+					if ((i = filter_arg_index_inc(i, argc, argv[i], line_num)) == -1)
+						return -1;
 
 					rule->action.precedence++;
 
@@ -2139,7 +2706,7 @@ filter_rule_translate(opts_t *opts, const char *name, int argc, char **argv, uns
 	rule->action.line_num = line_num;
 #endif /* DEBUG_PROXY */
 
-	append_list(&opts->filter_rules, rule, filter_rule_t);
+	filter_rule_append(opts, rule);
 
 #ifdef DEBUG_OPTS
 	filter_rule_dbg_print(rule);
@@ -2295,8 +2862,9 @@ filter_rule_parse(opts_t *opts, conn_opts_t *conn_opts, const char *name, int ar
 				return -1;
 
 			if (equal(argv[i], "ip") || equal(argv[i], "sni") || equal(argv[i], "cn") || equal(argv[i], "host") || equal(argv[i], "uri") ||
-					equal(argv[i], "port")) {
-				if (equal(argv[i], "ip") || equal(argv[i], "sni") || equal(argv[i], "cn") || equal(argv[i], "host") || equal(argv[i], "uri")) {
+					equal(argv[i], "list") || equal(argv[i], "port")) {
+				if (equal(argv[i], "ip") || equal(argv[i], "sni") || equal(argv[i], "cn") || equal(argv[i], "host") || equal(argv[i], "uri") ||
+						equal(argv[i], "list")) {
 					if ((i = filter_arg_index_inc(i, argc, argv[i], line_num)) == -1)
 						return -1;
 
@@ -2304,6 +2872,16 @@ filter_rule_parse(opts_t *opts, conn_opts_t *conn_opts, const char *name, int ar
 						return rv;
 					}
 					i++;
+
+					if (i < argc && equal(argv[i], "path")) {
+						if ((i = filter_arg_index_inc(i, argc, argv[i], line_num)) == -1)
+							return -1;
+
+						if ((rv = filter_rule_macro_expand(opts, conn_opts, name, argc, argv, i, line_num)) != 0) {
+							return rv;
+						}
+						i++;
+					}
 				}
 
 				// It is possible to define port without site (i.e. * or all_sites), hence no 'else' here
@@ -2474,6 +3052,8 @@ filter_rule_struct_translate(filter_rule_t *rule, UNUSED conn_opts_t *conn_opts,
 			rule->exact_ip = filter_is_exact(value);
 			if (filter_field_set(&rule->ip, value, line_num) == -1)
 				return -1;
+			if (filter_ip_check(rule->ip, rule->exact_ip, line_num) == -1)
+				return -1;
 			rule->action.precedence++;
 		}
 	}
@@ -2481,12 +3061,22 @@ filter_rule_struct_translate(filter_rule_t *rule, UNUSED conn_opts_t *conn_opts,
 		if (!filter_site_set(rule, name, value, line_num))
 			return -1;
 	}
+	else if (equal(name, "List")) {
+		if (filter_list_set(rule, value, line_num) == -1)
+			return -1;
+	}
 	else if (equal(name, "DstPort")) {
 		rule->action.precedence++;
 
 		if (filter_port_set(rule, value, line_num) == -1)
 			return -1;
 	}
+	else if (equal(name, "Path")) {
+		rule->action.precedence++;
+
+		if (filter_path_set(rule, value, line_num) == -1)
+			return -1;
+	}
 	else if (equal(name, "Log")) {
 		// We don't support $macros within multi valued Log lines, i.e. cannot mix log actions with $macros
 		// use either log actions concat with spaces or just a $macro, and no point trying to support it either
@@ -2590,7 +3180,7 @@ filter_rule_struct_translate_nvls(opts_t *opts, name_value_lines_t nvls[], int n
 		) {
 		rule->all_conns = 1;
 	}
-	if (!rule->dstip && !rule->sni && !rule->cn && !rule->host && !rule->uri) {
+	if (!rule->dstip && !rule->sni && !rule->cn && !rule->host && !rule->uri && !rule->list) {
 		rule->dstip = strdup("");
 		if (!rule->dstip)
 			return oom_return_na();
@@ -2644,7 +3234,7 @@ filter_rule_struct_translate_nvls(opts_t *opts, name_value_lines_t nvls[], int n
 	rule->action.line_num = tmp_opts->line_num;
 #endif /* DEBUG_PROXY */
 
-	append_list(&opts->filter_rules, rule, filter_rule_t);
+	filter_rule_append(opts, rule);
 
 #ifdef DEBUG_OPTS
 	filter_rule_dbg_print(rule);
@@ -2712,6 +3302,11 @@ filter_rule_struct_parse(name_value_lines_t nvls[], int *nvls_size, conn_opts_t
 			fprintf(stderr, "Incomplete FilterRule on line %d\n", line_num);
 			return -1;
 		}
+		if (parse_state->path && (!parse_state->host || parse_state->sni || parse_state->cn || parse_state->uri || parse_state->dstip ||
+				parse_state->list || parse_state->dstport)) {
+			fprintf(stderr, "Path requires Host, and cannot be combined with other site or port specs on line %d\n", line_num);
+			return -1;
+		}
 		// Return 2 to indicate the end of structured filter rule
 		return 2;
 	}
@@ -2800,6 +3395,13 @@ filter_rule_struct_parse(name_value_lines_t nvls[], int *nvls_size, conn_opts_t
 		}
 		parse_state->dstip = 1;
 	}
+	else if (equal(name, "List")) {
+		if (parse_state->list) {
+			fprintf(stderr, "Error in conf: Only one List spec allowed '%s' on line %d\n", value, line_num);
+			return -1;
+		}
+		parse_state->list = 1;
+	}
 	else if (equal(name, "DstPort")) {
 		if (parse_state->dstport) {
 			fprintf(stderr, "Error in conf: Only one DstPort spec allowed '%s' on line %d\n", value, line_num);
@@ -2807,6 +3409,13 @@ filter_rule_struct_parse(name_value_lines_t nvls[], int *nvls_size, conn_opts_t
 		}
 		parse_state->dstport = 1;
 	}
+	else if (equal(name, "Path")) {
+		if (parse_state->path) {
+			fprintf(stderr, "Error in conf: Only one Path spec allowed '%s' on line %d\n", value, line_num);
+			return -1;
+		}
+		parse_state->path = 1;
+	}
 	else if (equal(name, "Log")) {
 		// Log can be used more than once to define multiple log actions, if not using macros
 	}
@@ -2937,13 +3546,63 @@ err:
 	return retval;
 }
 
+/*
+ * Merge the action of rule into the action of a site, port, or path, unless
+ * it has been set by a rule at higher precedence.
+ */
+static int NONNULL(1,2) WUNRES
+filter_action_merge(filter_action_t *action, filter_rule_t *rule, const char *argv0, tmp_opts_t *tmp_opts)
+{
+	// Do not override the specs of rules at higher precedence
+	// precedence can only go up not down
+	if (rule->action.precedence >= action->precedence) {
+		// Multiple rules can set an action for the same site, port, or path, hence the bit-wise OR
+		action->divert |= rule->action.divert;
+		action->split |= rule->action.split;
+		action->pass |= rule->action.pass;
+		action->block |= rule->action.block;
+		action->match |= rule->action.match;
+
+		// Multiple log actions can be set for the same site, port, or path
+		// Multiple rules can enable/disable or don't change a log action for the same site, port, or path
+		// 0: don't change, 1: disable, 2: enable
+		if (rule->action.log_connect)
+			action->log_connect = rule->action.log_connect;
+		if (rule->action.log_master)
+			action->log_master = rule->action.log_master;
+		if (rule->action.log_cert)
+			action->log_cert = rule->action.log_cert;
+		if (rule->action.log_content)
+			action->log_content = rule->action.log_content;
+		if (rule->action.log_pcap)
+			action->log_pcap = rule->action.log_pcap;
+#ifndef WITHOUT_MIRROR
+		if (rule->action.log_mirror)
+			action->log_mirror = rule->action.log_mirror;
+#endif /* !WITHOUT_MIRROR */
+
+		if (rule->action.conn_opts) {
+			if (action->conn_opts)
+				conn_opts_free(action->conn_opts);
+			action->conn_opts = conn_opts_copy(rule->action.conn_opts, argv0, tmp_opts);
+			if (!action->conn_opts)
+				return oom_return_na();
+		}
+
+		action->precedence = rule->action.precedence;
+#ifdef DEBUG_PROXY
+		action->line_num = rule->action.line_num;
+#endif /* DEBUG_PROXY */
+	}
+	return 0;
+}
+
 static filter_port_t *
-filter_port_exact_match(kbtree_t(port) *btree, char *p)
+filter_port_exact_match(khash_t(filter) *hash, char *p)
 {
-	if (!btree)
+	if (!hash)
 		return NULL;
-	filter_port_t **port = kb_get(port, btree, p);
-	return port ? *port : NULL;
+	return filter_hash_get(hash, p);
 }
 
 static filter_port_t *
@@ -2960,7 +3619,7 @@ filter_port_t *
 filter_port_find(filter_site_t *site, char *p)
 {
 	filter_port_t *port;
-	if ((port = filter_port_exact_match(site->port_btree, p)))
+	if ((port = filter_port_exact_match(site->port_hash, p)))
 		return port;
 	if ((port = filter_port_substring_match(site->port_acm, p)))
 		return port;
@@ -2992,7 +3651,7 @@ filter_port_find_exact(filter_site_t *site, filter_rule_t *rule)
 	if (rule->all_ports)
 		return site->port_all;
 	else if (rule->exact_port)
-		return filter_port_exact_match(site->port_btree, rule->port);
+		return filter_port_exact_match(site->port_hash, rule->port);
 	else
 		return filter_port_substring_exact_match(site->port_acm, rule->port);
 }
@@ -3015,11 +3674,10 @@ filter_port_add(filter_site_t *site, filter_rule_t *rule, const char *argv0, tmp
 			site->port_all = port;
 		}
 		else if (rule->exact_port) {
-			if (!site->port_btree)
-				if (!(site->port_btree = kb_init(port, KB_DEFAULT_SIZE)))
-					return oom_return_na();
-
-			kb_put(port, site->port_btree, port);
+			void **slot = filter_hash_put(&site->port_hash, port->port);
+			if (!slot)
+				return oom_return_na();
+			*slot = port;
 		}
 		else {
 			if (!site->port_acm)
@@ -3035,57 +3693,63 @@ filter_port_add(filter_site_t *site, filter_rule_t *rule, const char *argv0, tmp
 	port->all_ports = rule->all_ports;
 	port->exact = rule->exact_port;
 
-	// Do not override the specs of port rules at higher precedence
-	// precedence can only go up not down
-	if (rule->action.precedence >= port->action.precedence) {
-		// Multiple rules can set an action for the same port, hence the bit-wise OR
-		port->action.divert |= rule->action.divert;
-		port->action.split |= rule->action.split;
-		port->action.pass |= rule->action.pass;
-		port->action.block |= rule->action.block;
-		port->action.match |= rule->action.match;
-
-		// Multiple log actions can be set for the same port
-		// Multiple rules can enable/disable or don't change a log action for the same port
-		// 0: don't change, 1: disable, 2: enable
-		if (rule->action.log_connect)
-			port->action.log_connect = rule->action.log_connect;
-		if (rule->action.log_master)
-			port->action.log_master = rule->action.log_master;
-		if (rule->action.log_cert)
-			port->action.log_cert = rule->action.log_cert;
-		if (rule->action.log_content)
-			port->action.log_content = rule->action.log_content;
-		if (rule->action.log_pcap)
-			port->action.log_pcap = rule->action.log_pcap;
-#ifndef WITHOUT_MIRROR
-		if (rule->action.log_mirror)
-			port->action.log_mirror = rule->action.log_mirror;
-#endif /* !WITHOUT_MIRROR */
+	return filter_action_merge(&port->action, rule, argv0, tmp_opts);
+}
 
-		if (rule->action.conn_opts) {
-			if (port->action.conn_opts)
-				conn_opts_free(port->action.conn_opts);
-			port->action.conn_opts = conn_opts_copy(rule->action.conn_opts, argv0, tmp_opts);
-			if (!port->action.conn_opts)
-				return oom_return_na();
-		}
+/*
+ * Find the path rule of site matching the path of uri, which is either a
+ * path or an absolute URL as sent to http proxies.
+ */
+filter_path_t *
+filter_path_find(filter_site_t *site, char *uri)
+{
+	if (!site->path_trie)
+		return NULL;
 
-		port->action.precedence = rule->action.precedence;
-#ifdef DEBUG_PROXY
-		port->action.line_num = rule->action.line_num;
-#endif /* DEBUG_PROXY */
+	if (*uri != '/') {
+		char *p = strstr(uri, "://");
+		if (!p)
+			return NULL;
+		p += 3;
+		p += strcspn(p, "/?#");
+		uri = *p == '/' ? p : "/";
 	}
-	return 0;
+	return pathtrie_match(site->path_trie, uri);
+}
+
+static int NONNULL(1,2) WUNRES
+filter_path_add(filter_site_t *site, filter_rule_t *rule, const char *argv0, tmp_opts_t *tmp_opts)
+{
+	filter_path_t **slot;
+	int created;
+
+	if (!site->path_trie)
+		if (!(site->path_trie = pathtrie_new()))
+			return oom_return_na();
+
+	if (!(slot = (filter_path_t **)pathtrie_put(site->path_trie, rule->path, &created)))
+		return oom_return_na();
+
+	if (created) {
+		filter_path_t *path = malloc(sizeof(filter_path_t));
+		if (!path)
+			return oom_return_na();
+		memset(path, 0, sizeof(filter_path_t));
+		*slot = path;
+
+		path->path = strdup(rule->path);
+		if (!path->path)
+			return oom_return_na();
+	}
+	return filter_action_merge(&(*slot)->action, rule, argv0, tmp_opts);
 }
 
 filter_site_t *
-filter_site_exact_match(kbtree_t(site) *btree, char *s)
+filter_site_exact_match(khash_t(filter) *hash, char *s)
 {
-	if (!btree)
+	if (!hash)
 		return NULL;
-	filter_site_t **site = kb_get(site, btree, s);
-	return site ? *site : NULL;
+	return filter_hash_get(hash, s);
 }
 
 filter_site_t *
@@ -3098,11 +3762,124 @@ filter_site_substring_match(ACMachine(char) *acm, char *site)
 	return s;
 }
 
+/*
+ * Find the dst ip range with the longest prefix containing address s.
+ */
+filter_site_t *
+filter_site_cidr_match(iptrie_t *trie, char *s)
+{
+	iptrie_prefix_t addr;
+	void *site;
+
+	if (!trie || iptrie_prefix_parse(s, &addr) == -1)
+		return NULL;
+	return iptrie_match(trie, &addr, &site, 1) ? site : NULL;
+}
+
+/*
+ * Same as filter_site_find() for dst ips, trying the ranges containing the
+ * address instead of the domain suffixes, and the address ranges of list
+ * files instead of their domains.
+ */
 filter_site_t *
-filter_site_find(kbtree_t(site) *btree, ACMachine(char) *acm, filter_site_t *all, char *s)
+filter_dstip_find(filter_list_t *list, char *s, bloom_stats_t *stats)
 {
 	filter_site_t *site;
-	if ((site = filter_site_exact_match(btree, s)))
+	if (filter_site_bloom_check(list->ip_bloom, s, 0, stats) && (site = filter_site_exact_match(list->ip_hash, s)))
+		return site;
+	if ((site = filter_site_cidr_match(list->ip_trie, s)))
+		return site;
+	if ((site = filter_site_extlist_match(list->lists, s, 1)))
+		return site;
+	if ((site = filter_site_substring_match(list->ip_acm, s)))
+		return site;
+	return list->ip_all;
+}
+
+/*
+ * Find the longest domain suffix matching s at label boundaries.
+ */
+filter_site_t *
+filter_site_suffix_match(domtrie_t *trie, char *s)
+{
+	if (!trie)
+		return NULL;
+	return domtrie_match(trie, s);
+}
+
+/*
+ * Find the first list file containing s, an address if addr is set, or else
+ * a domain name.
+ */
+filter_site_t *
+filter_site_extlist_match(filter_site_list_t *lists, char *s, int addr)
+{
+	for (; lists; lists = lists->next) {
+		extlist_t *extlist = lists->site->extlist;
+		if (addr ? extlist_match_addr(extlist, s) : extlist_match_name(extlist, s))
+			return lists->site;
+	}
+	return NULL;
+}
+
+/*
+ * Hash of the chars of s in reverse order and ignoring case, so that the
+ * hashes of the parent domains of a name are computed on the way.
+ */
+static uint64_t
+filter_bloom_hash(const char *s, size_t len)
+{
+	uint64_t hash = bloom_hash_init();
+	while (len > 0)
+		hash = bloom_hash_update(hash, tolower((unsigned char)s[--len]));
+	return hash;
+}
+
+/*
+ * Check s against the Bloom filter of the exact sites, and if suffix is set,
+ * of the domain suffixes of a site list.  Returns 0 if s cannot match any of
+ * them, so that their lookups can be skipped, 1 otherwise.
+ */
+int
+filter_site_bloom_check(bloom_t *bloom, char *s, int suffix, bloom_stats_t *stats)
+{
+	if (!bloom)
+		return 1;
+
+	size_t len = strlen(s);
+	// Names with the root dot are only matched by the lookups
+	if (suffix && len && s[len - 1] == '.')
+		return 1;
+
+	if (stats)
+		stats->checks++;
+
+	uint64_t hash = bloom_hash_init();
+	while (len > 0) {
+		unsigned char c = tolower((unsigned char)s[--len]);
+		if (suffix && c == '.' && bloom_check(bloom, hash))
+			return 1;
+		hash = bloom_hash_update(hash, c);
+	}
+	if (bloom_check(bloom, hash))
+		return 1;
+
+	if (stats)
+		stats->skips++;
+	return 0;
+}
+
+filter_site_t *
+filter_site_find(bloom_t *bloom, khash_t(filter) *hash, domtrie_t *trie, ACMachine(char) *acm, filter_site_list_t *lists, filter_site_t *all, char *s, bloom_stats_t *stats)
+{
+	filter_site_t *site;
+	if (filter_site_bloom_check(bloom, s, trie != NULL, stats)) {
+		if ((site = filter_site_exact_match(hash, s)))
+			return site;
+		if ((site = filter_site_suffix_match(trie, s)))
+			return site;
+	}
+	if ((site = filter_site_extlist_match(lists, s, 0)))
 		return site;
 	if ((site = filter_site_substring_match(acm, s)))
 		return site;
@@ -3129,20 +3906,22 @@ filter_site_substring_exact_match(ACMachine(char) *acm, char *s)
 }
 
 static filter_site_t *
-filter_site_find_exact(kbtree_t(site) *btree, ACMachine(char) *acm, filter_site_t *all, char *s, unsigned int exact_site, unsigned int all_sites)
+filter_site_find_exact(khash_t(filter) *hash, ACMachine(char) *acm, filter_site_t *all, char *s, unsigned int exact_site, unsigned int all_sites)
 {
 	if (all_sites)
 		return all;
 	else if (exact_site)
-		return filter_site_exact_match(btree, s);
+		return filter_site_exact_match(hash, s);
 	else
 		return filter_site_substring_exact_match(acm, s);
 }
 
+static int filter_site_rule_add(filter_site_t *, filter_rule_t *, const char *, tmp_opts_t *) NONNULL(1,2) WUNRES;
+
 static int NONNULL(3) WUNRES
-filter_site_add(kbtree_t(site) **btree, ACMachine(char) **acm, filter_site_t **all, filter_rule_t *rule, char *s, unsigned int exact_site, unsigned int all_sites, const char *argv0, tmp_opts_t *tmp_opts)
+filter_site_add(khash_t(filter) **hash, ACMachine(char) **acm, filter_site_t **all, filter_rule_t *rule, char *s, unsigned int exact_site, unsigned int all_sites, const char *argv0, tmp_opts_t *tmp_opts)
 {
-	filter_site_t *site = filter_site_find_exact(*btree, *acm, *all, s, exact_site, all_sites);
+	filter_site_t *site = filter_site_find_exact(*hash, *acm, *all, s, exact_site, all_sites);
 	if (!site) {
 		site = malloc(sizeof(filter_site_t));
 		if (!site)
@@ -3157,11 +3936,10 @@ filter_site_add(kbtree_t(site) **btree, ACMachine(char) **acm, filter_site_t **a
 			*all = site;
 		}
 		else if (exact_site) {
-			if (!*btree)
-				if (!(*btree = kb_init(site, KB_DEFAULT_SIZE)))
-					return oom_return_na();
-
-			kb_put(site, *btree, site);
+			void **slot = filter_hash_put(hash, site->site);
+			if (!slot)
+				return oom_return_na();
+			*slot = site;
 		}
 		else {
 			if (!*acm)
@@ -3177,90 +3955,210 @@ filter_site_add(kbtree_t(site) **btree, ACMachine(char) **acm, filter_site_t **a
 	site->all_sites = all_sites;
 	site->exact = exact_site;
 
-	// Do not override the specs of a site with a port rule
-	// Port rule is added as a new port under the same site
-	// hence 'if else', not just 'if'
-	if (rule->port) {
-		if (filter_port_add(site, rule, argv0, tmp_opts) == -1)
-			return -1;
+	return filter_site_rule_add(site, rule, argv0, tmp_opts);
+}
+
+/*
+ * Apply rule to site, which may already have been set by other rules.
+ */
+static int
+filter_site_rule_add(filter_site_t *site, filter_rule_t *rule, const char *argv0, tmp_opts_t *tmp_opts)
+{
+	// Do not override the specs of a site with a port or path rule
+	// Port and path rules are added as new ports or paths under the same site
+	if (rule->port)
+		return filter_port_add(site, rule, argv0, tmp_opts);
+	if (rule->path)
+		return filter_path_add(site, rule, argv0, tmp_opts);
+	return filter_action_merge(&site->action, rule, argv0, tmp_opts);
+}
+
+/*
+ * Add a dst ip range to the trie of the list, and apply rule to it.
+ */
+static int NONNULL(1,2) WUNRES
+filter_site_cidr_add(iptrie_t **trie, filter_rule_t *rule, const char *argv0, tmp_opts_t *tmp_opts)
+{
+	iptrie_prefix_t prefix;
+	filter_site_t **slot;
+	int created;
+
+	if (iptrie_prefix_parse(rule->dstip, &prefix) == -1)
+		return -1;
+
+	if (!*trie)
+		if (!(*trie = iptrie_new()))
+			return oom_return_na();
+
+	if (!(slot = (filter_site_t **)iptrie_put(*trie, &prefix, &created)))
+		return oom_return_na();
+
+	if (created) {
+		filter_site_t *site = malloc(sizeof(filter_site_t));
+		if (!site)
+			return oom_return_na();
+		memset(site, 0, sizeof(filter_site_t));
+		*slot = site;
+
+		// Canonical form with the host bits cleared
+		site->site = iptrie_prefix_str(&prefix);
+		if (!site->site)
+			return oom_return_na();
+
+		site->cidr = 1;
 	}
-	// Do not override the specs of site rules at higher precedence
-	// precedence can only go up not down
-	else if (rule->action.precedence >= site->action.precedence) {
-		// Multiple rules can set an action for the same site, hence the bit-wise OR
-		site->action.divert |= rule->action.divert;
-		site->action.split |= rule->action.split;
-		site->action.pass |= rule->action.pass;
-		site->action.block |= rule->action.block;
-		site->action.match |= rule->action.match;
-
-		// Multiple log actions can be set for the same site
-		// Multiple rules can enable/disable or don't change a log action for the same site
-		// 0: don't change, 1: disable, 2: enable
-		if (rule->action.log_connect)
-			site->action.log_connect = rule->action.log_connect;
-		if (rule->action.log_master)
-			site->action.log_master = rule->action.log_master;
-		if (rule->action.log_cert)
-			site->action.log_cert = rule->action.log_cert;
-		if (rule->action.log_content)
-			site->action.log_content = rule->action.log_content;
-		if (rule->action.log_pcap)
-			site->action.log_pcap = rule->action.log_pcap;
-#ifndef WITHOUT_MIRROR
-		if (rule->action.log_mirror)
-			site->action.log_mirror = rule->action.log_mirror;
-#endif /* !WITHOUT_MIRROR */
 
-		if (rule->action.conn_opts) {
-			if (site->action.conn_opts)
-				conn_opts_free(site->action.conn_opts);
-			site->action.conn_opts = conn_opts_copy(rule->action.conn_opts, argv0, tmp_opts);
-			if (!site->action.conn_opts)
-				return oom_return_na();
+	return filter_site_rule_add(*slot, rule, argv0, tmp_opts);
+}
+
+/*
+ * Add a domain suffix to the trie of the site type, and apply rule to it.
+ */
+static int NONNULL(1,2,3) WUNRES
+filter_site_suffix_add(domtrie_t **trie, filter_rule_t *rule, char *s, const char *argv0, tmp_opts_t *tmp_opts)
+{
+	filter_site_t **slot;
+	int created;
+
+	if (!*trie)
+		if (!(*trie = domtrie_new()))
+			return oom_return_na();
+
+	// Skip the leading dot
+	if (!(slot = (filter_site_t **)domtrie_put(*trie, s + 1, &created)))
+		return oom_return_na();
+
+	if (created) {
+		filter_site_t *site = malloc(sizeof(filter_site_t));
+		if (!site)
+			return oom_return_na();
+		memset(site, 0, sizeof(filter_site_t));
+		*slot = site;
+
+		site->site = strdup(s);
+		if (!site->site)
+			return oom_return_na();
+
+		site->suffix = 1;
+	}
+
+	return filter_site_rule_add(*slot, rule, argv0, tmp_opts);
+}
+
+/*
+ * Add a list file to the lists of the site list, and apply rule to it.
+ * List files are opened once per site list, and shared by all filters.
+ */
+static int NONNULL(1,2) WUNRES
+filter_site_extlist_add(filter_site_list_t **lists, filter_rule_t *rule, const char *argv0, tmp_opts_t *tmp_opts)
+{
+	filter_site_list_t *sl;
+
+	for (sl = *lists; sl; sl = sl->next) {
+		if (equal(sl->site->site, rule->list))
+			break;
+	}
+
+	if (!sl) {
+		filter_site_t *site = malloc(sizeof(filter_site_t));
+		if (!site)
+			return oom_return_na();
+		memset(site, 0, sizeof(filter_site_t));
+
+		site->site = strdup(rule->list);
+		if (!site->site) {
+			free(site);
+			return oom_return_na();
 		}
+		site->exact = 1;
 
-		site->action.precedence = rule->action.precedence;
-#ifdef DEBUG_PROXY
-		site->action.line_num = rule->action.line_num;
-#endif /* DEBUG_PROXY */
+		if (!(site->extlist = extlist_open(rule->list))) {
+			fprintf(stderr, "Cannot load filter list '%s'\n", rule->list);
+			free_site_func(site);
+			return -1;
+		}
+
+		sl = malloc(sizeof(filter_site_list_t));
+		if (!sl) {
+			free_site_func(site);
+			return oom_return_na();
+		}
+		memset(sl, 0, sizeof(filter_site_list_t));
+		sl->site = site;
+
+		append_list(lists, sl, filter_site_list_t);
 	}
-	return 0;
+
+	return filter_site_rule_add(sl->site, rule, argv0, tmp_opts);
 }
 
 static int
 filter_sitelist_add(filter_list_t *list, filter_rule_t *rule, const char *argv0, tmp_opts_t *tmp_opts)
 {
 	if (rule->dstip) {
-		if (filter_site_add(&list->ip_btree, &list->ip_acm, &list->ip_all, rule, rule->dstip, rule->exact_dstip, rule->all_dstips, argv0, tmp_opts) == -1)
+		if (!rule->all_dstips && filter_ip_is_cidr(rule->dstip, rule->exact_dstip)) {
+			if (filter_site_cidr_add(&list->ip_trie, rule, argv0, tmp_opts) == -1)
+				return -1;
+		}
+		else if (filter_site_add(&list->ip_hash, &list->ip_acm, &list->ip_all, rule, rule->dstip, rule->exact_dstip, rule->all_dstips, argv0, tmp_opts) == -1)
 			return -1;
 	}
 	if (rule->sni) {
-		if (filter_site_add(&list->sni_btree, &list->sni_acm, &list->sni_all, rule, rule->sni, rule->exact_sni, rule->all_snis, argv0, tmp_opts) == -1)
+		if (!rule->all_snis && filter_site_is_suffix(rule->sni, rule->exact_sni)) {
+			if (filter_site_suffix_add(&list->sni_trie, rule, rule->sni, argv0, tmp_opts) == -1)
+				return -1;
+		}
+		else if (filter_site_add(&list->sni_hash, &list->sni_acm, &list->sni_all, rule, rule->sni, rule->exact_sni, rule->all_snis, argv0, tmp_opts) == -1)
 			return -1;
 	}
 	if (rule->cn) {
-		if (filter_site_add(&list->cn_btree, &list->cn_acm, &list->cn_all, rule, rule->cn, rule->exact_cn, rule->all_cns, argv0, tmp_opts) == -1)
+		if (!rule->all_cns && filter_site_is_suffix(rule->cn, rule->exact_cn)) {
+			if (filter_site_suffix_add(&list->cn_trie, rule, rule->cn, argv0, tmp_opts) == -1)
+				return -1;
+		}
+		else if (filter_site_add(&list->cn_hash, &list->cn_acm, &list->cn_all, rule, rule->cn, rule->exact_cn, rule->all_cns, argv0, tmp_opts) == -1)
 			return -1;
 	}
 	if (rule->host) {
-		if (filter_site_add(&list->host_btree, &list->host_acm, &list->host_all, rule, rule->host, rule->exact_host, rule->all_hosts, argv0, tmp_opts) == -1)
+		if (!rule->all_hosts && filter_site_is_suffix(rule->host, rule->exact_host)) {
+			if (filter_site_suffix_add(&list->host_trie, rule, rule->host, argv0, tmp_opts) == -1)
+				return -1;
+		}
+		else if (filter_site_add(&list->host_hash, &list->host_acm, &list->host_all, rule, rule->host, rule->exact_host, rule->all_hosts, argv0, tmp_opts) == -1)
 			return -1;
 	}
 	if (rule->uri) {
-		if (filter_site_add(&list->uri_btree, &list->uri_acm, &list->uri_all, rule, rule->uri, rule->exact_uri, rule->all_uris, argv0, tmp_opts) == -1)
+		if (filter_site_add(&list->uri_hash, &list->uri_acm, &list->uri_all, rule, rule->uri, rule->exact_uri, rule->all_uris, argv0, tmp_opts) == -1)
+			return -1;
+	}
+	if (rule->list) {
+		if (filter_site_extlist_add(&list->lists, rule, argv0, tmp_opts) == -1)
 			return -1;
 	}
 	return 0;
 }
 
 filter_ip_t *
-filter_ip_exact_match(kbtree_t(ip) *btree, char *i)
+filter_ip_exact_match(khash_t(filter) *hash, char *i)
 {
-	if (!btree)
+	if (!hash)
 		return NULL;
-	filter_ip_t **ip = kb_get(ip, btree, i);
-	return ip ? *ip : NULL;
+	return filter_hash_get(hash, i);
+}
+
+/*
+ * Find the src ip ranges containing address ip, and store them in ips,
+ * longest prefix first.  ips must have room for IPTRIE_MAX_MATCHES ranges.
+ * Returns the number of ranges found.
+ */
+size_t
+filter_ip_cidr_match(iptrie_t *trie, char *ip, filter_ip_t **ips)
+{
+	iptrie_prefix_t addr;
+
+	if (!trie || iptrie_prefix_parse(ip, &addr) == -1)
+		return 0;
+	return iptrie_match(trie, &addr, (void **)ips, IPTRIE_MAX_MATCHES);
 }
 
 filter_ip_t *
@@ -3296,20 +4194,60 @@ static filter_ip_t *
 filter_ip_find_exact(filter_t *filter, filter_rule_t *rule)
 {
 	if (rule->exact_ip)
-		return filter_ip_exact_match(filter->ip_btree, rule->ip);
+		return filter_ip_exact_match(filter->ip_hash, rule->ip);
 	else
 		return filter_ip_substring_exact_match(filter->ip_acm, rule->ip);
 }
 
-static void
-free_ip_func(void *i)
+/*
+ * Get the src ip range of rule from the trie of the filter, adding it first
+ * if it does not exist yet.
+ */
+static filter_ip_t *
+filter_ip_cidr_get(filter_t *filter, filter_rule_t *rule)
 {
-	free_ip((filter_ip_t **)&i);
+	iptrie_prefix_t prefix;
+	filter_ip_t **slot;
+	int created;
+
+	if (iptrie_prefix_parse(rule->ip, &prefix) == -1)
+		return NULL;
+
+	if (!filter->ip_trie)
+		if (!(filter->ip_trie = iptrie_new()))
+			return oom_return_na_null();
+
+	if (!(slot = (filter_ip_t **)iptrie_put(filter->ip_trie, &prefix, &created)))
+		return oom_return_na_null();
+
+	if (created) {
+		filter_ip_t *ip = malloc(sizeof(filter_ip_t));
+		if (!ip)
+			return oom_return_na_null();
+		memset(ip, 0, sizeof(filter_ip_t));
+		*slot = ip;
+
+		ip->list = malloc(sizeof(filter_list_t));
+		if (!ip->list)
+			return oom_return_na_null();
+		memset(ip->list, 0, sizeof(filter_list_t));
+
+		// Canonical form with the host bits cleared
+		ip->ip = iptrie_prefix_str(&prefix);
+		if (!ip->ip)
+			return oom_return_na_null();
+
+		ip->cidr = 1;
+	}
+	return *slot;
 }
 
 static filter_ip_t *
 filter_ip_get(filter_t *filter, filter_rule_t *rule)
 {
+	if (filter_ip_is_cidr(rule->ip, rule->exact_ip))
+		return filter_ip_cidr_get(filter, rule);
+
 	filter_ip_t *ip = filter_ip_find_exact(filter, rule);
 	if (!ip) {
 		ip = malloc(sizeof(filter_ip_t));
@@ -3329,11 +4267,10 @@ filter_ip_get(filter_t *filter, filter_rule_t *rule)
 		ip->exact = rule->exact_ip;
 
 		if (rule->exact_ip) {
-			if (!filter->ip_btree)
-				if (!(filter->ip_btree = kb_init(ip, KB_DEFAULT_SIZE)))
-					return oom_return_na_null();
-
-			kb_put(ip, filter->ip_btree, ip);
+			void **slot = filter_hash_put(&filter->ip_hash, ip->ip);
+			if (!slot)
+				return oom_return_na_null();
+			*slot = ip;
 		}
 		else {
 			if (!filter->ip_acm)
@@ -3350,12 +4287,11 @@ filter_ip_get(filter_t *filter, filter_rule_t *rule)
 
 #ifndef WITHOUT_USERAUTH
 filter_desc_t *
-filter_desc_exact_match(kbtree_t(desc) *btree, char *k)
+filter_desc_exact_match(khash_t(filter) *hash, char *k)
 {
-	if (!btree)
+	if (!hash)
 		return NULL;
-	filter_desc_t **desc = kb_get(desc, btree, k);
-	return desc ? *desc : NULL;
+	return filter_hash_get(hash, k);
 }
 
 filter_desc_t *
@@ -3391,7 +4327,7 @@ static filter_desc_t *
 filter_desc_find_exact(filter_t *filter, filter_user_t *user, filter_rule_t *rule)
 {
 	if (rule->exact_desc)
-		return filter_desc_exact_match(user ? user->desc_btree : filter->desc_btree, rule->desc);
+		return filter_desc_exact_match(user ? user->desc_hash : filter->desc_hash, rule->desc);
 	else
 		return filter_desc_substring_exact_match(user ? user->desc_acm : filter->desc_acm, rule->desc);
 }
@@ -3424,12 +4360,11 @@ filter_desc_get(filter_t *filter, filter_user_t *user, filter_rule_t *rule)
 		desc->exact = rule->exact_desc;
 
 		if (rule->exact_desc) {
-			kbtree_t(desc) **btree = user ? &user->desc_btree : &filter->desc_btree;
-			if (!*btree)
-				if (!(*btree = kb_init(desc, KB_DEFAULT_SIZE)))
-					return oom_return_na_null();
-
-			kb_put(desc, *btree, desc);
+			khash_t(filter) **hash = user ? &user->desc_hash : &filter->desc_hash;
+			void **slot = filter_hash_put(hash, desc->desc);
+			if (!slot)
+				return oom_return_na_null();
+			*slot = desc;
 		}
 		else {
 			ACMachine(char) **acm = user ? &user->desc_acm : &filter->desc_acm;
@@ -3446,12 +4381,11 @@ filter_desc_get(filter_t *filter, filter_user_t *user, filter_rule_t *rule)
 }
 
 filter_user_t *
-filter_user_exact_match(kbtree_t(user) *btree, char *u)
+filter_user_exact_match(khash_t(filter) *hash, char *u)
 {
-	if (!btree)
+	if (!hash)
 		return NULL;
-	filter_user_t **user = kb_get(user, btree, u);
-	return user ? *user : NULL;
+	return filter_hash_get(hash, u);
 }
 
 filter_user_t *
@@ -3487,7 +4421,7 @@ static filter_user_t *
 filter_user_find_exact(filter_t *filter, filter_rule_t *rule)
 {
 	if (rule->exact_user)
-		return filter_user_exact_match(filter->user_btree, rule->user);
+		return filter_user_exact_match(filter->user_hash, rule->user);
 	else
 		return filter_user_substring_exact_match(filter->user_acm, rule->user);
 }
@@ -3520,11 +4454,10 @@ filter_user_get(filter_t *filter, filter_rule_t *rule)
 		user->exact = rule->exact_user;
 
 		if (rule->exact_user) {
-			if (!filter->user_btree)
-				if (!(filter->user_btree = kb_init(user, KB_DEFAULT_SIZE)))
-					return oom_return_na_null();
-
-			kb_put(user, filter->user_btree, user);
+			void **slot = filter_hash_put(&filter->user_hash, user->user);
+			if (!slot)
+				return oom_return_na_null();
+			*slot = user;
 		}
 		else {
 			if (!filter->user_acm)
@@ -3540,6 +4473,275 @@ filter_user_get(filter_t *filter, filter_rule_t *rule)
 }
 #endif /* WITHOUT_USERAUTH */
 
+static size_t dfa_max_size = (size_t)FILTER_DFA_MAX_SIZE << 20;
+
+/*
+ * Set the maximum size of the DFA of each substring matcher of the filters
+ * set after this call, in MiB, 0 to disable the DFAs.
+ */
+void
+filter_dfa_max_size_set(unsigned int max_size)
+{
+	dfa_max_size = (size_t)max_size << 20;
+}
+
+/*
+ * Compile the substring matcher into a DFA, if it fits in the DFA budget.
+ * Large rule sets are matched by the plain machine, which matches the same
+ * in much less memory.
+ */
+static void
+filter_acm_compile(ACMachine(char) *acm)
+{
+	static int skipped_logged = 0;
+
+	if (!acm || !dfa_max_size)
+		return;
+
+	int rv = ACM_compile(acm, dfa_max_size);
+	if (rv == -1) {
+		// Filters are set by both the main thread and the reload thread
+		if (!__atomic_exchange_n(&skipped_logged, 1, __ATOMIC_RELAXED)) {
+			log_err_level_printf(LOG_WARNING, "Filter substring matcher too large "
+			                     "for FilterDFAMaxSize, using the slower one\n");
+		}
+	} else if (!rv) {
+		/* Not fatal, the machine matches the same without its DFA */
+		log_err_level_printf(LOG_WARNING, "Failed to compile filter "
+		                     "substring matcher, using the slower one\n");
+	}
+}
+
+#define compile_site(p) do { \
+	filter_acm_compile((*p)->port_acm); \
+} while (0)
+
+static void
+compile_site_func(UNUSED MatchHolder(char) match, void *s)
+{
+	compile_site((filter_site_t **)&s);
+}
+
+static void
+compile_site_trie_func(UNUSED const iptrie_prefix_t *prefix, void *s, UNUSED void *arg)
+{
+	compile_site((filter_site_t **)&s);
+}
+
+static void
+compile_site_domtrie_func(void *s, UNUSED void *arg)
+{
+	compile_site((filter_site_t **)&s);
+}
+
+static unsigned int bloom_fprate = BLOOM_FPRATE;
+
+/*
+ * Set the false positive rate of the Bloom filters of the filters set after
+ * this call, in per mille, 0 to disable them.
+ */
+void
+filter_bloom_fprate_set(unsigned int fprate)
+{
+	bloom_fprate = fprate;
+}
+
+#define bloom_add_site(p) bloom_add(bloom, filter_bloom_hash((*p)->site, strlen((*p)->site)))
+
+static void
+bloom_add_suffix_func(void *s, void *arg)
+{
+	// Skip the leading dot and the root dot, if any
+	char *site = ((filter_site_t *)s)->site + 1;
+	size_t len = strlen(site);
+	if (len && site[len - 1] == '.')
+		len--;
+	bloom_add(arg, filter_bloom_hash(site, len));
+}
+
+/*
+ * Create the Bloom filter of the exact sites and domain suffixes of a site
+ * list.  Failing to create it is not fatal, lookups are the same without it.
+ */
+static bloom_t *
+filter_bloom_new(khash_t(filter) *hash, domtrie_t *trie)
+{
+	size_t n = (hash ? kh_size(hash) : 0) + (trie ? trie->count : 0);
+	if (!n || !bloom_fprate)
+		return NULL;
+
+	bloom_t *bloom = bloom_new(n, bloom_fprate);
+	if (!bloom) {
+		log_err_level_printf(LOG_WARNING, "Failed to create filter Bloom filter, "
+		                     "looking up sites without it\n");
+		return NULL;
+	}
+	if (hash)
+		filter_hash_traverse(filter_site_t *, hash, bloom_add_site);
+	if (trie)
+		domtrie_foreach(trie, bloom_add_suffix_func, bloom);
+	return bloom;
+}
+
+static void
+filter_list_compile(filter_list_t *list)
+{
+	if (!list->ip_bloom)
+		list->ip_bloom = filter_bloom_new(list->ip_hash, NULL);
+	if (!list->sni_bloom)
+		list->sni_bloom = filter_bloom_new(list->sni_hash, list->sni_trie);
+	if (!list->cn_bloom)
+		list->cn_bloom = filter_bloom_new(list->cn_hash, list->cn_trie);
+	if (!list->host_bloom)
+		list->host_bloom = filter_bloom_new(list->host_hash, list->host_trie);
+	if (!list->uri_bloom)
+		list->uri_bloom = filter_bloom_new(list->uri_hash, NULL);
+
+	if (list->ip_hash)
+		filter_hash_traverse(filter_site_t *, list->ip_hash, compile_site);
+	if (list->ip_trie)
+		iptrie_foreach(list->ip_trie, compile_site_trie_func, NULL);
+	if (list->ip_acm) {
+		ACM_foreach_keyword(list->ip_acm, compile_site_func);
+		filter_acm_compile(list->ip_acm);
+	}
+	if (list->ip_all)
+		compile_site(&list->ip_all);
+
+	if (list->sni_hash)
+		filter_hash_traverse(filter_site_t *, list->sni_hash, compile_site);
+	if (list->sni_trie)
+		domtrie_foreach(list->sni_trie, compile_site_domtrie_func, NULL);
+	if (list->sni_acm) {
+		ACM_foreach_keyword(list->sni_acm, compile_site_func);
+		filter_acm_compile(list->sni_acm);
+	}
+	if (list->sni_all)
+		compile_site(&list->sni_all);
+
+	if (list->cn_hash)
+		filter_hash_traverse(filter_site_t *, list->cn_hash, compile_site);
+	if (list->cn_trie)
+		domtrie_foreach(list->cn_trie, compile_site_domtrie_func, NULL);
+	if (list->cn_acm) {
+		ACM_foreach_keyword(list->cn_acm, compile_site_func);
+		filter_acm_compile(list->cn_acm);
+	}
+	if (list->cn_all)
+		compile_site(&list->cn_all);
+
+	if (list->host_hash)
+		filter_hash_traverse(filter_site_t *, list->host_hash, compile_site);
+	if (list->host_trie)
+		domtrie_foreach(list->host_trie, compile_site_domtrie_func, NULL);
+	if (list->host_acm) {
+		ACM_foreach_keyword(list->host_acm, compile_site_func);
+		filter_acm_compile(list->host_acm);
+	}
+	if (list->host_all)
+		compile_site(&list->host_all);
+
+	if (list->uri_hash)
+		filter_hash_traverse(filter_site_t *, list->uri_hash, compile_site);
+	if (list->uri_acm) {
+		ACM_foreach_keyword(list->uri_acm, compile_site_func);
+		filter_acm_compile(list->uri_acm);
+	}
+	if (list->uri_all)
+		compile_site(&list->uri_all);
+}
+
+#ifndef WITHOUT_USERAUTH
+#define compile_desc(p) do { \
+	filter_list_compile((*p)->list); \
+} while (0)
+
+static void
+compile_desc_func(UNUSED MatchHolder(char) match, void *d)
+{
+	compile_desc((filter_desc_t **)&d);
+}
+
+static void
+filter_user_compile(filter_user_t *user)
+{
+	filter_list_compile(user->list);
+
+	if (user->desc_hash)
+		filter_hash_traverse(filter_desc_t *, user->desc_hash, compile_desc);
+	if (user->desc_acm) {
+		ACM_foreach_keyword(user->desc_acm, compile_desc_func);
+		filter_acm_compile(user->desc_acm);
+	}
+}
+
+#define compile_user(p) do { \
+	filter_user_compile(*p); \
+} while (0)
+
+static void
+compile_user_func(UNUSED MatchHolder(char) match, void *u)
+{
+	compile_user((filter_user_t **)&u);
+}
+#endif /* !WITHOUT_USERAUTH */
+
+#define compile_ip(p) do { \
+	filter_list_compile((*p)->list); \
+} while (0)
+
+static void
+compile_ip_func(UNUSED MatchHolder(char) match, void *i)
+{
+	compile_ip((filter_ip_t **)&i);
+}
+
+static void
+compile_ip_trie_func(UNUSED const iptrie_prefix_t *prefix, void *i, UNUSED void *arg)
+{
+	compile_ip((filter_ip_t **)&i);
+}
+
+/*
+ * Compile all substring matchers of the filter into flat DFAs, once the
+ * filter is complete, so that matching is a walk over a contiguous table
+ * instead of chasing the goto and fail links of the machine states.
+ */
+static void
+filter_compile(filter_t *filter)
+{
+#ifndef WITHOUT_USERAUTH
+	if (filter->user_hash)
+		filter_hash_traverse(filter_user_t *, filter->user_hash, compile_user);
+	if (filter->user_acm) {
+		ACM_foreach_keyword(filter->user_acm, compile_user_func);
+		filter_acm_compile(filter->user_acm);
+	}
+
+	if (filter->desc_hash)
+		filter_hash_traverse(filter_desc_t *, filter->desc_hash, compile_desc);
+	if (filter->desc_acm) {
+		ACM_foreach_keyword(filter->desc_acm, compile_desc_func);
+		filter_acm_compile(filter->desc_acm);
+	}
+
+	filter_list_compile(filter->all_user);
+#endif /* !WITHOUT_USERAUTH */
+
+	if (filter->ip_hash)
+		filter_hash_traverse(filter_ip_t *, filter->ip_hash, compile_ip);
+	if (filter->ip_trie)
+		iptrie_foreach(filter->ip_trie, compile_ip_trie_func, NULL);
+	if (filter->ip_acm) {
+		ACM_foreach_keyword(filter->ip_acm, compile_ip_func);
+		filter_acm_compile(filter->ip_acm);
+	}
+
+	filter_list_compile(filter->all);
+}
+
+static unsigned int generation = 0;
+
 /*
  * Translates filtering rules into data structures.
  * Never pass NULL as rule param.
@@ -3552,6 +4754,7 @@ filter_set(filter_rule_t *rule, const char *argv0, tmp_opts_t *tmp_opts)
 	if (!filter)
 		return oom_return_na_null();
 	memset(filter, 0, sizeof(filter_t));
+	filter->refcount = 1;
 
 #ifndef WITHOUT_USERAUTH
 	filter->all_user = malloc(sizeof(filter_list_t));
@@ -3609,7 +4812,32 @@ filter_set(filter_rule_t *rule, const char *argv0, tmp_opts_t *tmp_opts)
 		}
 		rule = rule->next;
 	}
+	filter_compile(filter);
+
+	filter_invalidate();
 	return filter;
 }
 
+/*
+ * The generation of filters, incremented each time a filter is set, so that
+ * decisions cached against previous filters do not match anymore.
+ * Filters may be set by a reload while conns are being handled, and every
+ * conn reads the generation, so it is atomic instead of under filter_mutex.
+ */
+unsigned int
+filter_generation(void)
+{
+	return __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Start a new generation of filters, after the filter has been set, or the
+ * list files it uses have been refreshed.
+ */
+void
+filter_invalidate(void)
+{
+	__atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+}
+
 /* vim: set noet ft=c: */
@@ -29,8 +29,13 @@
 #define FILTER_H
 
 #include "opts.h"
-#include "kbtree.h"
+#include "khash.h"
 #include "aho_corasick_template_impl.h"
+#include "iptrie.h"
+#include "domtrie.h"
+#include "pathtrie.h"
+#include "extlist.h"
+#include "bloom.h"
 
 #define FILTER_ACTION_NONE   0x00000000U
 #define FILTER_ACTION_MATCH  0x00000200U
@@ -55,6 +60,9 @@
 
 #define FILTER_PRECEDENCE    0x000000FFU
 
+// Default maximum size of the DFA of a substring matcher in MiB
+#define FILTER_DFA_MAX_SIZE  16
+
 ACM_DECLARE (char);
 
 typedef struct filter_parse_state {
@@ -68,6 +76,8 @@ typedef struct filter_parse_state {
 	unsigned int uri : 1;
 	unsigned int dstip : 1;
 	unsigned int dstport : 1;
+	unsigned int path : 1;
+	unsigned int list : 1;
 	unsigned int conn_opts : 1;
 	unsigned int reconnect_ssl : 1;
 } filter_parse_state_t;
@@ -156,11 +166,17 @@ typedef struct filter_rule {
 	unsigned int all_hosts : 1;   /* 1 to match all sites == '*' */
 	unsigned int all_uris : 1;    /* 1 to match all sites == '*' */
 
+	// Path of a list file of dst domains, ips and CIDRs
+	char *list;
+
 	// This is not for the src ip in the 'from' part of rules
 	char *port;
 	unsigned int all_ports : 1;   /* 1 to match all ports == '*' */
 	unsigned int exact_port : 1;  /* 1 for exact, 0 for substring match */
 
+	// URL path pattern under the host, only used with host
+	char *path;
+
 	struct filter_action action;
 
 	struct filter_rule *next;
@@ -174,63 +190,101 @@ typedef struct filter_port {
 	struct filter_action action;
 } filter_port_t;
 
-typedef const char *str_t;
+/*
+ * Key of the exact match hash tables.  The hash and length are computed once,
+ * when the key is stored or looked up, so probing compares the hash before the
+ * string, and the string points into the value the key maps to.
+ */
+typedef struct filter_key {
+	khint_t hash;
+	unsigned int len;
+	const char *str;
+} filter_key_t;
 
-#define getk_port(a) (a)->port
-typedef filter_port_t *filter_port_p_t;
-KBTREE_INIT(port, filter_port_p_t, kb_str_cmp, str_t, getk_port)
+#define filter_key_hash_func(k) ((k).hash)
+#define filter_key_hash_equal(a, b) ((a).hash == (b).hash && (a).len == (b).len && !memcmp((a).str, (b).str, (a).len))
+KHASH_INIT(filter, filter_key_t, void *, 1, filter_key_hash_func, filter_key_hash_equal)
 
 typedef struct filter_port_list {
 	struct filter_port *port;
 	struct filter_port_list *next;
 } filter_port_list_t;
 
+typedef struct filter_path {
+	char *path;
+
+	struct filter_action action;
+} filter_path_t;
+
+typedef struct filter_path_list {
+	struct filter_path *path;
+	struct filter_path_list *next;
+} filter_path_list_t;
+
 typedef struct filter_site {
 	char *site;
 	unsigned int all_sites : 1;
 	unsigned int exact : 1;       /* used in debug logging only */
+	unsigned int cidr : 1;        /* used in debug logging only */
+	unsigned int suffix : 1;      /* used in debug logging only */
 
-	kbtree_t(port) *port_btree;
+	// List file the site stands for, the site being its path
+	extlist_t *extlist;
+
+	khash_t(filter) *port_hash;
 	ACMachine(char) *port_acm;
 	struct filter_port *port_all;
 
+	pathtrie_t *path_trie;
+
 	struct filter_action action;
 } filter_site_t;
 
-#define getk_site(a) (a)->site
-typedef filter_site_t *filter_site_p_t;
-KBTREE_INIT(site, filter_site_p_t, kb_str_cmp, str_t, getk_site)
-
 typedef struct filter_site_list {
 	struct filter_site *site;
 	struct filter_site_list *next;
 } filter_site_list_t;
 
 typedef struct filter_list {
-	kbtree_t(site) *ip_btree;
+	khash_t(filter) *ip_hash;
+	iptrie_t *ip_trie;
 	ACMachine(char) *ip_acm;
 	struct filter_site *ip_all;
 
-	kbtree_t(site) *sni_btree;
+	khash_t(filter) *sni_hash;
+	domtrie_t *sni_trie;
 	ACMachine(char) *sni_acm;
 	struct filter_site *sni_all;
 
-	kbtree_t(site) *cn_btree;
+	khash_t(filter) *cn_hash;
+	domtrie_t *cn_trie;
 	ACMachine(char) *cn_acm;
 	struct filter_site *cn_all;
 
-	kbtree_t(site) *host_btree;
+	khash_t(filter) *host_hash;
+	domtrie_t *host_trie;
 	ACMachine(char) *host_acm;
 	struct filter_site *host_all;
 
-	kbtree_t(site) *uri_btree;
+	khash_t(filter) *uri_hash;
 	ACMachine(char) *uri_acm;
 	struct filter_site *uri_all;
+
+	// List files apply to ip, sni, cn, and host
+	struct filter_site_list *lists;
+
+	// Prefilters of the exact and suffix lookups, NULL if disabled or empty
+	bloom_t *ip_bloom;
+	bloom_t *sni_bloom;
+	bloom_t *cn_bloom;
+	bloom_t *host_bloom;
+	bloom_t *uri_bloom;
 } filter_list_t;
 
 typedef struct filter_ip {
 	char *ip;
 	unsigned int exact : 1;       /* used in debug logging only */
+	unsigned int cidr : 1;        /* used in debug logging only */
 	struct filter_list *list;
 } filter_ip_t;
 
@@ -246,10 +300,6 @@ typedef struct filter_desc {
 	struct filter_list *list;
 } filter_desc_t;
 
-#define getk_desc(a) (a)->desc
-typedef filter_desc_t *filter_desc_p_t;
-KBTREE_INIT(desc, filter_desc_p_t, kb_str_cmp, str_t, getk_desc)
-
 typedef struct filter_desc_list {
 	struct filter_desc *desc;
 	struct filter_desc_list *next;
@@ -259,39 +309,34 @@ typedef struct filter_user {
 	char *user;
 	unsigned int exact : 1;       /* used in debug logging only */
 	struct filter_list *list;
-	kbtree_t(desc) *desc_btree;
+	khash_t(filter) *desc_hash;
 	ACMachine(char) *desc_acm;
 } filter_user_t;
 
-#define getk_user(a) (a)->user
-typedef filter_user_t *filter_user_p_t;
-KBTREE_INIT(user, filter_user_p_t, kb_str_cmp, str_t, getk_user)
-
 typedef struct filter_user_list {
 	struct filter_user *user;
 	struct filter_user_list *next;
 } filter_user_list_t;
 #endif /* !WITHOUT_USERAUTH */
 
-#define getk_ip(a) (a)->ip
-typedef filter_ip_t *filter_ip_p_t;
-KBTREE_INIT(ip, filter_ip_p_t, kb_str_cmp, str_t, getk_ip)
-
 typedef struct filter {
 #ifndef WITHOUT_USERAUTH
-	kbtree_t(user) *user_btree;   /* exact */
+	khash_t(filter) *user_hash;   /* exact */
 	ACMachine(char) *user_acm;    /* substring */
 
-	kbtree_t(desc) *desc_btree;   /* exact */
+	khash_t(filter) *desc_hash;   /* exact */
 	ACMachine(char) *desc_acm;    /* substring */
 
 	struct filter_list *all_user;
 #endif /* !WITHOUT_USERAUTH */
 
-	kbtree_t(ip) *ip_btree;       /* exact */
+	khash_t(filter) *ip_hash;     /* exact */
+	iptrie_t *ip_trie;            /* cidr */
 	ACMachine(char) *ip_acm;      /* substring */
 
 	struct filter_list *all;
+
+	unsigned int refcount;        /* opts and conns using the filter */
 } filter_t;
 
 #ifndef WITHOUT_USERAUTH
@@ -303,8 +348,14 @@ int filter_userlist_set(char *, unsigned int, userlist_t **, const char *) NONNU
 
 void filter_macro_free(opts_t *) NONNULL(1);
 void filter_rules_free(opts_t *) NONNULL(1);
+void filter_rule_append(opts_t *, filter_rule_t *) NONNULL(1,2);
 void filter_free(opts_t *) NONNULL(1);
 
+filter_t *filter_acquire(opts_t *) NONNULL(1) WUNRES;
+void filter_release(filter_t *);
+void filter_publish(opts_t *, filter_t *) NONNULL(1);
+int filter_is_current(opts_t *, filter_t *) NONNULL(1) WUNRES;
+
 int filter_macro_copy(macro_t *, const char *, opts_t *) NONNULL(2,3) WUNRES;
 int filter_rule_copy(filter_rule_t *, const char *, opts_t *, tmp_opts_t *) NONNULL(2,3) WUNRES;
 
@@ -318,23 +369,35 @@ int filter_macro_set(opts_t *, char *, unsigned int) NONNULL(1,2) WUNRES;
 int load_filterrule_struct(opts_t *, conn_opts_t *, const char *, unsigned int *, FILE *, tmp_opts_t *) WUNRES;
 
 filter_port_t *filter_port_find(filter_site_t *, char *) NONNULL(1,2);
+filter_path_t *filter_path_find(filter_site_t *, char *) NONNULL(1,2);
 
-filter_site_t *filter_site_exact_match(kbtree_t(site) *, char *) NONNULL(2) WUNRES;
+filter_site_t *filter_site_exact_match(khash_t(filter) *, char *) NONNULL(2) WUNRES;
 filter_site_t *filter_site_substring_match(ACMachine(char) *, char *) NONNULL(2) WUNRES;
-filter_site_t *filter_site_find(kbtree_t(site) *, ACMachine(char) *, filter_site_t *, char *) NONNULL(4) WUNRES;
+filter_site_t *filter_site_suffix_match(domtrie_t *, char *) NONNULL(2) WUNRES;
+filter_site_t *filter_site_extlist_match(filter_site_list_t *, char *, int) NONNULL(2) WUNRES;
+int filter_site_bloom_check(bloom_t *, char *, int, bloom_stats_t *) NONNULL(2) WUNRES;
+filter_site_t *filter_site_find(bloom_t *, khash_t(filter) *, domtrie_t *, ACMachine(char) *, filter_site_list_t *, filter_site_t *, char *, bloom_stats_t *) NONNULL(7) WUNRES;
+
+filter_site_t *filter_site_cidr_match(iptrie_t *, char *) NONNULL(2) WUNRES;
+filter_site_t *filter_dstip_find(filter_list_t *, char *, bloom_stats_t *) NONNULL(1,2) WUNRES;
 
-filter_ip_t *filter_ip_exact_match(kbtree_t(ip) *, char *) NONNULL(2);
+filter_ip_t *filter_ip_exact_match(khash_t(filter) *, char *) NONNULL(2);
+size_t filter_ip_cidr_match(iptrie_t *, char *, filter_ip_t **) NONNULL(2,3);
 filter_ip_t *filter_ip_substring_match(ACMachine(char) *, char *) NONNULL(2);
 
 #ifndef WITHOUT_USERAUTH
-filter_desc_t *filter_desc_exact_match(kbtree_t(desc) *, char *) NONNULL(2) WUNRES;
+filter_desc_t *filter_desc_exact_match(khash_t(filter) *, char *) NONNULL(2) WUNRES;
 filter_desc_t *filter_desc_substring_match(ACMachine(char) *, char *) NONNULL(2) WUNRES;
 
-filter_user_t *filter_user_exact_match(kbtree_t(user) *, char *) NONNULL(2) WUNRES;
+filter_user_t *filter_user_exact_match(khash_t(filter) *, char *) NONNULL(2) WUNRES;
 filter_user_t *filter_user_substring_match(ACMachine(char) *, char *) NONNULL(2) WUNRES;
 #endif /* !WITHOUT_USERAUTH */
 int filter_rule_set(opts_t *, conn_opts_t *conn_opts, const char *, char *, unsigned int) NONNULL(1,3,4) WUNRES;
 filter_t *filter_set(filter_rule_t *, const char *, tmp_opts_t *) WUNRES;
+void filter_bloom_fprate_set(unsigned int);
+void filter_dfa_max_size_set(unsigned int);
+unsigned int filter_generation(void) WUNRES;
+void filter_invalidate(void);
 
 #endif /* !FILTER_H */
 
@@ -0,0 +1,227 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "filtercache.h"
+
+#include "khash.h"
+
+#include <string.h>
+
+/*
+ * Per-thread LRU cache of filter decisions.
+ *
+ * Each connection handling thread owns its cache, so there is no locking.
+ * Values are opaque to the cache, and NULL values are cached too, because
+ * no rule matching a connection is a decision as well.  Entries belong to a
+ * filter generation; the first access with a different generation empties
+ * the cache, so decisions made against an old filter are never returned.
+ *
+ * key: char *                 built by the caller
+ * val: filtercache_entry_t *  entry in the LRU list, most recent first
+ */
+
+typedef struct filtercache_entry {
+	char *key;
+	void *value;
+	struct filtercache_entry *prev;
+	struct filtercache_entry *next;
+} filtercache_entry_t;
+
+KHASH_INIT(fltmap_t, char*, filtercache_entry_t*, 1, kh_str_hash_func, kh_str_hash_equal)
+
+struct filtercache {
+	khash_t(fltmap_t) *map;
+	filtercache_entry_t *head;
+	filtercache_entry_t *tail;
+	size_t size;
+	unsigned int gen;
+};
+
+filtercache_t *
+filtercache_new(size_t size)
+{
+	filtercache_t *cache = malloc(sizeof(filtercache_t));
+	if (!cache)
+		return NULL;
+	memset(cache, 0, sizeof(filtercache_t));
+
+	cache->map = kh_init(fltmap_t);
+	if (!cache->map) {
+		free(cache);
+		return NULL;
+	}
+	cache->size = size;
+	return cache;
+}
+
+static void
+filtercache_clear(filtercache_t *cache)
+{
+	filtercache_entry_t *entry = cache->head;
+	while (entry) {
+		filtercache_entry_t *next = entry->next;
+		free(entry->key);
+		free(entry);
+		entry = next;
+	}
+	cache->head = cache->tail = NULL;
+	kh_clear(fltmap_t, cache->map);
+}
+
+void
+filtercache_free(filtercache_t *cache)
+{
+	filtercache_clear(cache);
+	kh_destroy(fltmap_t, cache->map);
+	free(cache);
+}
+
+static void
+filtercache_unlink(filtercache_t *cache, filtercache_entry_t *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		cache->head = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		cache->tail = entry->prev;
+}
+
+static void
+filtercache_push(filtercache_t *cache, filtercache_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+	if (cache->head)
+		cache->head->prev = entry;
+	else
+		cache->tail = entry;
+	cache->head = entry;
+}
+
+/*
+ * Empty the cache if its entries belong to another filter generation.
+ */
+static void
+filtercache_check_gen(filtercache_t *cache, unsigned int gen)
+{
+	if (cache->gen != gen) {
+		filtercache_clear(cache);
+		cache->gen = gen;
+	}
+}
+
+/*
+ * Look up key made against filter generation gen.
+ * Returns 1 and sets *value on hit, 0 on miss.
+ */
+int
+filtercache_get(filtercache_t *cache, unsigned int gen, const char *key, void **value)
+{
+	filtercache_check_gen(cache, gen);
+
+	khiter_t k = kh_get(fltmap_t, cache->map, (char *)key);
+	if (k == kh_end(cache->map))
+		return 0;
+
+	filtercache_entry_t *entry = kh_val(cache->map, k);
+	if (entry != cache->head) {
+		filtercache_unlink(cache, entry);
+		filtercache_push(cache, entry);
+	}
+	*value = entry->value;
+	return 1;
+}
+
+/*
+ * Cache value for key made against filter generation gen, evicting the least
+ * recently used entry if the cache is full.
+ * Returns 0 on success, -1 on out of memory, in which case the decision is
+ * just not cached.
+ */
+int
+filtercache_set(filtercache_t *cache, unsigned int gen, const char *key, void *value)
+{
+	filtercache_entry_t *entry;
+	khiter_t k;
+	int ret;
+
+	filtercache_check_gen(cache, gen);
+
+	k = kh_get(fltmap_t, cache->map, (char *)key);
+	if (k != kh_end(cache->map)) {
+		entry = kh_val(cache->map, k);
+		entry->value = value;
+		if (entry != cache->head) {
+			filtercache_unlink(cache, entry);
+			filtercache_push(cache, entry);
+		}
+		return 0;
+	}
+
+	if (kh_size(cache->map) >= cache->size && cache->tail) {
+		// Reuse the least recently used entry
+		entry = cache->tail;
+		filtercache_unlink(cache, entry);
+		k = kh_get(fltmap_t, cache->map, entry->key);
+		kh_del(fltmap_t, cache->map, k);
+		free(entry->key);
+	} else {
+		entry = malloc(sizeof(filtercache_entry_t));
+		if (!entry)
+			return -1;
+	}
+	memset(entry, 0, sizeof(filtercache_entry_t));
+
+	entry->key = strdup(key);
+	if (!entry->key) {
+		free(entry);
+		return -1;
+	}
+	entry->value = value;
+
+	k = kh_put(fltmap_t, cache->map, entry->key, &ret);
+	if (ret == -1) {
+		free(entry->key);
+		free(entry);
+		return -1;
+	}
+	kh_val(cache->map, k) = entry;
+	filtercache_push(cache, entry);
+	return 0;
+}
+
+size_t
+filtercache_count(filtercache_t *cache)
+{
+	return kh_size(cache->map);
+}
+
+/* vim: set noet ft=c: */
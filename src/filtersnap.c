@@ -0,0 +1,558 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "filtersnap.h"
+
+#include "util.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+/*
+ * Filter snapshots are filtering rules compiled into a binary file, so that
+ * very large rule sets are not parsed and macro expanded at every start.
+ *
+ * A snapshot is a header, followed by an array of fixed size rule records,
+ * followed by a table of NUL terminated strings.  Rule records refer to the
+ * strings by their offset into the table, offset 0 meaning no string.  The
+ * header carries a SHA-256 digest of the records and the string table, which
+ * is checked before any rule is used.  Snapshots are in native byte order.
+ * Loading maps the file read-only only while checking it and copying its
+ * rules onto the heap, so the rules do not share the pages of the file.
+ *
+ * Struct filtering rules with conn options cannot be compiled into snapshots,
+ * because conn options refer to certs and keys loaded at startup.
+ */
+
+#define FILTERSNAP_MAGIC   "SSLPFSNP"
+#define FILTERSNAP_VERSION 3
+
+typedef struct filtersnap_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t nrules;
+	uint32_t strsize;
+	uint32_t reserved;
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+} filtersnap_hdr_t;
+
+/* String fields of rules, indexes into str of rule records */
+#define FILTERSNAP_USER    0
+#define FILTERSNAP_DESC    1
+#define FILTERSNAP_IP      2
+#define FILTERSNAP_DSTIP   3
+#define FILTERSNAP_SNI     4
+#define FILTERSNAP_CN      5
+#define FILTERSNAP_HOST    6
+#define FILTERSNAP_URI     7
+#define FILTERSNAP_PORT    8
+#define FILTERSNAP_LIST    9
+#define FILTERSNAP_PATH    10
+#define FILTERSNAP_NSTRS   11
+
+typedef struct filtersnap_rule {
+	uint32_t flags;
+	uint32_t log;              /* two bits per log action, as in actions */
+	uint32_t precedence;
+	uint32_t str[FILTERSNAP_NSTRS];
+} filtersnap_rule_t;
+
+#define FILTERSNAP_ALL_CONNS   0x00000001U
+#define FILTERSNAP_ALL_USERS   0x00000002U
+#define FILTERSNAP_EXACT_USER  0x00000004U
+#define FILTERSNAP_EXACT_DESC  0x00000008U
+#define FILTERSNAP_EXACT_IP    0x00000010U
+#define FILTERSNAP_EXACT_DSTIP 0x00000020U
+#define FILTERSNAP_EXACT_SNI   0x00000040U
+#define FILTERSNAP_EXACT_CN    0x00000080U
+#define FILTERSNAP_EXACT_HOST  0x00000100U
+#define FILTERSNAP_EXACT_URI   0x00000200U
+#define FILTERSNAP_ALL_DSTIPS  0x00000400U
+#define FILTERSNAP_ALL_SNIS    0x00000800U
+#define FILTERSNAP_ALL_CNS     0x00001000U
+#define FILTERSNAP_ALL_HOSTS   0x00002000U
+#define FILTERSNAP_ALL_URIS    0x00004000U
+#define FILTERSNAP_ALL_PORTS   0x00008000U
+#define FILTERSNAP_EXACT_PORT  0x00010000U
+#define FILTERSNAP_DIVERT      0x00020000U
+#define FILTERSNAP_SPLIT       0x00040000U
+#define FILTERSNAP_PASS        0x00080000U
+#define FILTERSNAP_BLOCK       0x00100000U
+#define FILTERSNAP_MATCH       0x00200000U
+
+#define FILTERSNAP_USERAUTH (FILTERSNAP_ALL_USERS|FILTERSNAP_EXACT_USER|FILTERSNAP_EXACT_DESC)
+
+/*
+ * Set strs to the addresses of the string fields of rule, or NULL for the
+ * fields not compiled in.
+ */
+static void NONNULL(1,2)
+filtersnap_rule_strs(filter_rule_t *rule, char **strs[])
+{
+#ifndef WITHOUT_USERAUTH
+	strs[FILTERSNAP_USER] = &rule->user;
+	strs[FILTERSNAP_DESC] = &rule->desc;
+#else /* WITHOUT_USERAUTH */
+	strs[FILTERSNAP_USER] = NULL;
+	strs[FILTERSNAP_DESC] = NULL;
+#endif /* WITHOUT_USERAUTH */
+	strs[FILTERSNAP_IP] = &rule->ip;
+	strs[FILTERSNAP_DSTIP] = &rule->dstip;
+	strs[FILTERSNAP_SNI] = &rule->sni;
+	strs[FILTERSNAP_CN] = &rule->cn;
+	strs[FILTERSNAP_HOST] = &rule->host;
+	strs[FILTERSNAP_URI] = &rule->uri;
+	strs[FILTERSNAP_PORT] = &rule->port;
+	strs[FILTERSNAP_LIST] = &rule->list;
+	strs[FILTERSNAP_PATH] = &rule->path;
+}
+
+static uint32_t NONNULL(1)
+filtersnap_flags(filter_rule_t *rule)
+{
+	uint32_t flags = 0;
+
+	if (rule->all_conns)
+		flags |= FILTERSNAP_ALL_CONNS;
+#ifndef WITHOUT_USERAUTH
+	if (rule->all_users)
+		flags |= FILTERSNAP_ALL_USERS;
+	if (rule->exact_user)
+		flags |= FILTERSNAP_EXACT_USER;
+	if (rule->exact_desc)
+		flags |= FILTERSNAP_EXACT_DESC;
+#endif /* !WITHOUT_USERAUTH */
+	if (rule->exact_ip)
+		flags |= FILTERSNAP_EXACT_IP;
+	if (rule->exact_dstip)
+		flags |= FILTERSNAP_EXACT_DSTIP;
+	if (rule->exact_sni)
+		flags |= FILTERSNAP_EXACT_SNI;
+	if (rule->exact_cn)
+		flags |= FILTERSNAP_EXACT_CN;
+	if (rule->exact_host)
+		flags |= FILTERSNAP_EXACT_HOST;
+	if (rule->exact_uri)
+		flags |= FILTERSNAP_EXACT_URI;
+	if (rule->all_dstips)
+		flags |= FILTERSNAP_ALL_DSTIPS;
+	if (rule->all_snis)
+		flags |= FILTERSNAP_ALL_SNIS;
+	if (rule->all_cns)
+		flags |= FILTERSNAP_ALL_CNS;
+	if (rule->all_hosts)
+		flags |= FILTERSNAP_ALL_HOSTS;
+	if (rule->all_uris)
+		flags |= FILTERSNAP_ALL_URIS;
+	if (rule->all_ports)
+		flags |= FILTERSNAP_ALL_PORTS;
+	if (rule->exact_port)
+		flags |= FILTERSNAP_EXACT_PORT;
+	if (rule->action.divert)
+		flags |= FILTERSNAP_DIVERT;
+	if (rule->action.split)
+		flags |= FILTERSNAP_SPLIT;
+	if (rule->action.pass)
+		flags |= FILTERSNAP_PASS;
+	if (rule->action.block)
+		flags |= FILTERSNAP_BLOCK;
+	if (rule->action.match)
+		flags |= FILTERSNAP_MATCH;
+	return flags;
+}
+
+static void NONNULL(1)
+filtersnap_set_flags(filter_rule_t *rule, uint32_t flags)
+{
+	rule->all_conns = !!(flags & FILTERSNAP_ALL_CONNS);
+#ifndef WITHOUT_USERAUTH
+	rule->all_users = !!(flags & FILTERSNAP_ALL_USERS);
+	rule->exact_user = !!(flags & FILTERSNAP_EXACT_USER);
+	rule->exact_desc = !!(flags & FILTERSNAP_EXACT_DESC);
+#endif /* !WITHOUT_USERAUTH */
+	rule->exact_ip = !!(flags & FILTERSNAP_EXACT_IP);
+	rule->exact_dstip = !!(flags & FILTERSNAP_EXACT_DSTIP);
+	rule->exact_sni = !!(flags & FILTERSNAP_EXACT_SNI);
+	rule->exact_cn = !!(flags & FILTERSNAP_EXACT_CN);
+	rule->exact_host = !!(flags & FILTERSNAP_EXACT_HOST);
+	rule->exact_uri = !!(flags & FILTERSNAP_EXACT_URI);
+	rule->all_dstips = !!(flags & FILTERSNAP_ALL_DSTIPS);
+	rule->all_snis = !!(flags & FILTERSNAP_ALL_SNIS);
+	rule->all_cns = !!(flags & FILTERSNAP_ALL_CNS);
+	rule->all_hosts = !!(flags & FILTERSNAP_ALL_HOSTS);
+	rule->all_uris = !!(flags & FILTERSNAP_ALL_URIS);
+	rule->all_ports = !!(flags & FILTERSNAP_ALL_PORTS);
+	rule->exact_port = !!(flags & FILTERSNAP_EXACT_PORT);
+	rule->action.divert = !!(flags & FILTERSNAP_DIVERT);
+	rule->action.split = !!(flags & FILTERSNAP_SPLIT);
+	rule->action.pass = !!(flags & FILTERSNAP_PASS);
+	rule->action.block = !!(flags & FILTERSNAP_BLOCK);
+	rule->action.match = !!(flags & FILTERSNAP_MATCH);
+}
+
+static uint32_t NONNULL(1)
+filtersnap_log(filter_action_t *action)
+{
+	uint32_t log = action->log_connect |
+		action->log_master << 2 |
+		action->log_cert << 4 |
+		action->log_content << 6 |
+		action->log_pcap << 8;
+#ifndef WITHOUT_MIRROR
+	log |= action->log_mirror << 10;
+#endif /* !WITHOUT_MIRROR */
+	return log;
+}
+
+static void NONNULL(1)
+filtersnap_set_log(filter_action_t *action, uint32_t log)
+{
+	action->log_connect = log & 3;
+	action->log_master = (log >> 2) & 3;
+	action->log_cert = (log >> 4) & 3;
+	action->log_content = (log >> 6) & 3;
+	action->log_pcap = (log >> 8) & 3;
+#ifndef WITHOUT_MIRROR
+	action->log_mirror = (log >> 10) & 3;
+#endif /* !WITHOUT_MIRROR */
+}
+
+static int WUNRES
+filtersnap_digest(const void *recs, size_t recsize, const void *strs, size_t strsize, unsigned char *digest)
+{
+	EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+	int rv = -1;
+
+	if (!ctx)
+		return -1;
+	if (EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) == 1 &&
+	    EVP_DigestUpdate(ctx, recs, recsize) == 1 &&
+	    EVP_DigestUpdate(ctx, strs, strsize) == 1 &&
+	    EVP_DigestFinal_ex(ctx, digest, NULL) == 1)
+		rv = 0;
+	EVP_MD_CTX_free(ctx);
+	return rv;
+}
+
+/*
+ * Compile the list of rules into a snapshot file at path.
+ * Returns 0 on success, -1 on error.
+ */
+int
+filtersnap_write(filter_rule_t *rules, const char *path)
+{
+	filtersnap_hdr_t hdr;
+	filtersnap_rule_t *recs = NULL;
+	char *strs = NULL;
+	char **fields[FILTERSNAP_NSTRS];
+	size_t nrules = 0, strsize = 1;
+	FILE *f;
+	int rv = -1;
+
+	for (filter_rule_t *rule = rules; rule; rule = rule->next) {
+		if (rule->action.conn_opts) {
+			fprintf(stderr, "Cannot compile filtering rules with conn options into snapshot\n");
+			return -1;
+		}
+		filtersnap_rule_strs(rule, fields);
+		for (int i = 0; i < FILTERSNAP_NSTRS; i++) {
+			if (fields[i] && *fields[i])
+				strsize += strlen(*fields[i]) + 1;
+		}
+		nrules++;
+	}
+	if (nrules > UINT32_MAX || strsize > UINT32_MAX) {
+		fprintf(stderr, "Too many filtering rules for snapshot\n");
+		return -1;
+	}
+
+	recs = calloc(nrules ? nrules : 1, sizeof(filtersnap_rule_t));
+	strs = malloc(strsize);
+	if (!recs || !strs) {
+		rv = oom_return_na();
+		goto out;
+	}
+
+	// Offset 0 is no string, empty strings are stored as any other string
+	strs[0] = '\0';
+	size_t off = 1;
+	filtersnap_rule_t *rec = recs;
+	for (filter_rule_t *rule = rules; rule; rule = rule->next, rec++) {
+		rec->flags = filtersnap_flags(rule);
+		rec->log = filtersnap_log(&rule->action);
+		rec->precedence = rule->action.precedence;
+
+		filtersnap_rule_strs(rule, fields);
+		for (int i = 0; i < FILTERSNAP_NSTRS; i++) {
+			if (fields[i] && *fields[i]) {
+				size_t len = strlen(*fields[i]) + 1;
+				memcpy(strs + off, *fields[i], len);
+				rec->str[i] = off;
+				off += len;
+			}
+		}
+	}
+
+	memset(&hdr, 0, sizeof(filtersnap_hdr_t));
+	memcpy(hdr.magic, FILTERSNAP_MAGIC, sizeof(hdr.magic));
+	hdr.version = FILTERSNAP_VERSION;
+	hdr.nrules = nrules;
+	hdr.strsize = strsize;
+	if (filtersnap_digest(recs, nrules * sizeof(filtersnap_rule_t), strs, strsize, hdr.digest) == -1) {
+		fprintf(stderr, "Cannot compute filter snapshot digest\n");
+		goto out;
+	}
+
+	f = fopen(path, "w");
+	if (!f) {
+		fprintf(stderr, "Cannot open filter snapshot '%s': %s\n", path, strerror(errno));
+		goto out;
+	}
+	int failed = fwrite(&hdr, sizeof(filtersnap_hdr_t), 1, f) != 1 ||
+		(nrules && fwrite(recs, sizeof(filtersnap_rule_t), nrules, f) != nrules) ||
+		fwrite(strs, strsize, 1, f) != 1;
+	if (fclose(f) == EOF || failed) {
+		fprintf(stderr, "Cannot write filter snapshot '%s': %s\n", path, strerror(errno));
+		unlink(path);
+		goto out;
+	}
+	rv = 0;
+out:
+	if (recs)
+		free(recs);
+	if (strs)
+		free(strs);
+	return rv;
+}
+
+/*
+ * Returns NULL if the snapshot mapped at map is valid, or the reason if not.
+ */
+static const char *
+filtersnap_check(const unsigned char *map, size_t size)
+{
+	const filtersnap_hdr_t *hdr = (const filtersnap_hdr_t *)map;
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+
+	if (size < sizeof(filtersnap_hdr_t) || memcmp(hdr->magic, FILTERSNAP_MAGIC, sizeof(hdr->magic)))
+		return "not a filter snapshot";
+	if (hdr->version != FILTERSNAP_VERSION)
+		return "unsupported version";
+
+	size_t recsize = (size_t)hdr->nrules * sizeof(filtersnap_rule_t);
+	if (!hdr->strsize || size != sizeof(filtersnap_hdr_t) + recsize + hdr->strsize)
+		return "wrong size";
+
+	const unsigned char *recs = map + sizeof(filtersnap_hdr_t);
+	const char *strs = (const char *)recs + recsize;
+	if (filtersnap_digest(recs, recsize, strs, hdr->strsize, digest) == -1 ||
+	    memcmp(digest, hdr->digest, SHA256_DIGEST_LENGTH))
+		return "checksum mismatch";
+
+	// Make sure all strings are terminated
+	if (strs[0] != '\0' || strs[hdr->strsize - 1] != '\0')
+		return "corrupt string table";
+
+	const filtersnap_rule_t *rec = (const filtersnap_rule_t *)recs;
+	for (uint32_t i = 0; i < hdr->nrules; i++, rec++) {
+		for (int j = 0; j < FILTERSNAP_NSTRS; j++) {
+			if (rec->str[j] >= hdr->strsize)
+				return "corrupt rule";
+		}
+#ifdef WITHOUT_USERAUTH
+		if ((rec->flags & FILTERSNAP_USERAUTH) || rec->str[FILTERSNAP_USER] || rec->str[FILTERSNAP_DESC])
+			return "user or desc rules not supported";
+#endif /* WITHOUT_USERAUTH */
+#ifdef WITHOUT_MIRROR
+		if (rec->log >> 10)
+			return "mirror log action not supported";
+#endif /* WITHOUT_MIRROR */
+	}
+	return NULL;
+}
+
+static int NONNULL(1,2,3)
+filtersnap_rule_set(filter_rule_t *rule, const filtersnap_rule_t *rec, const char *strs)
+{
+	char **fields[FILTERSNAP_NSTRS];
+
+	filtersnap_set_flags(rule, rec->flags);
+	filtersnap_set_log(&rule->action, rec->log);
+	rule->action.precedence = rec->precedence;
+
+	filtersnap_rule_strs(rule, fields);
+	for (int i = 0; i < FILTERSNAP_NSTRS; i++) {
+		if (fields[i] && rec->str[i]) {
+			*fields[i] = strdup(strs + rec->str[i]);
+			if (!*fields[i])
+				return oom_return_na();
+		}
+	}
+	return 0;
+}
+
+/*
+ * Map the snapshot at path, check it, and create the list of rules in it.
+ * Returns 0 on success, -1 on error.
+ */
+static int NONNULL(1,2,3)
+filtersnap_read(const char *path, filtersnap_hdr_t *hdr, filter_rule_t **rules)
+{
+	struct stat st;
+	unsigned char *map;
+	const char *err;
+	int rv = -1;
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "Cannot open filter snapshot '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(filtersnap_hdr_t)) {
+		fprintf(stderr, "Invalid filter snapshot '%s': not a filter snapshot\n", path);
+		close(fd);
+		return -1;
+	}
+	size_t size = st.st_size;
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Cannot map filter snapshot '%s': %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	err = filtersnap_check(map, size);
+	if (err) {
+		fprintf(stderr, "Invalid filter snapshot '%s': %s\n", path, err);
+		goto out;
+	}
+	memcpy(hdr, map, sizeof(filtersnap_hdr_t));
+
+	const filtersnap_rule_t *rec = (const filtersnap_rule_t *)(map + sizeof(filtersnap_hdr_t));
+	const char *strs = (const char *)(rec + hdr->nrules);
+	filter_rule_t **tail = rules;
+	for (uint32_t i = 0; i < hdr->nrules; i++, rec++) {
+		filter_rule_t *rule = malloc(sizeof(filter_rule_t));
+		if (!rule) {
+			rv = oom_return_na();
+			goto out;
+		}
+		memset(rule, 0, sizeof(filter_rule_t));
+		*tail = rule;
+		tail = &rule->next;
+
+		if (filtersnap_rule_set(rule, rec, strs) == -1)
+			goto out;
+	}
+	rv = 0;
+out:
+	munmap(map, size);
+	return rv;
+}
+
+static void
+filtersnap_rules_free(filter_rule_t *rules)
+{
+	opts_t opts;
+
+	memset(&opts, 0, sizeof(opts_t));
+	opts.filter_rules = rules;
+	filter_rules_free(&opts);
+}
+
+/*
+ * Append the rules in the snapshot at path to the filtering rules of opts,
+ * as if they were defined in the conf file on line_num.
+ * Returns 0 on success, -1 on error.
+ */
+int
+filtersnap_load(opts_t *opts, const char *path, UNUSED unsigned int line_num)
+{
+	filtersnap_hdr_t hdr;
+	filter_rule_t *rules = NULL;
+
+	if (filtersnap_read(path, &hdr, &rules) == -1) {
+		filtersnap_rules_free(rules);
+		return -1;
+	}
+
+#ifdef DEBUG_PROXY
+	for (filter_rule_t *rule = rules; rule; rule = rule->next) {
+		rule->action.line_num = line_num;
+	}
+#endif /* DEBUG_PROXY */
+
+	if (rules)
+		filter_rule_append(opts, rules);
+	return 0;
+}
+
+/*
+ * Print the header and the rules of the snapshot at path to stdout.
+ * Returns 0 on success, -1 on error.
+ */
+int
+filtersnap_print(const char *path)
+{
+	filtersnap_hdr_t hdr;
+	filter_rule_t *rules = NULL;
+	int rv = -1;
+
+	if (filtersnap_read(path, &hdr, &rules) == -1)
+		goto out;
+
+	char *s = filter_rule_str(rules);
+	if (!s)
+		goto out;
+
+	printf("Filter snapshot: %s\n", path);
+	printf("Version: %u\n", hdr.version);
+	printf("Rules: %u\n", hdr.nrules);
+	printf("Strings: %u bytes\n", hdr.strsize);
+	printf("SHA-256: ");
+	for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+		printf("%02x", hdr.digest[i]);
+	}
+	printf("\n%s", s);
+	free(s);
+	rv = 0;
+out:
+	filtersnap_rules_free(rules);
+	return rv;
+}
+
+/* vim: set noet ft=c: */
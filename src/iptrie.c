@@ -0,0 +1,330 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "iptrie.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+/*
+ * Longest-prefix-match trie for filtering rules on IP address ranges.
+ *
+ * Each node holds a prefix, and every prefix in its subtrees extends it.
+ * Glue nodes without a value are created where the prefixes of two
+ * subtrees diverge, so there are at most twice as many nodes as prefixes
+ * and a lookup visits at most one node per stored prefix length.
+ */
+
+struct iptrie_node {
+	iptrie_prefix_t prefix;
+	void *value;
+	unsigned int glue : 1;
+	struct iptrie_node *child[2];
+};
+
+static const unsigned char iptrie_v4mapped[12] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff
+};
+
+static int
+iptrie_bit(const unsigned char *addr, unsigned int i)
+{
+	return (addr[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+/*
+ * Clear the host bits of prefix p.
+ */
+static void
+iptrie_prefix_mask(iptrie_prefix_t *p)
+{
+	unsigned int i = p->len >> 3;
+
+	if (i < 16 && (p->len & 7)) {
+		p->addr[i] &= 0xff << (8 - (p->len & 7));
+		i++;
+	}
+	if (i < 16)
+		memset(p->addr + i, 0, 16 - i);
+}
+
+/*
+ * Number of leading bits a and b have in common, at most max.
+ */
+static unsigned int
+iptrie_common(const unsigned char *a, const unsigned char *b, unsigned int max)
+{
+	unsigned int i = 0;
+
+	while (i + 8 <= max && a[i >> 3] == b[i >> 3])
+		i += 8;
+	while (i < max && iptrie_bit(a, i) == iptrie_bit(b, i))
+		i++;
+	return i;
+}
+
+/*
+ * Parse an address or an address prefix in CIDR notation, e.g. 10.1.0.0/16
+ * or 2001:db8::/32, into p.  An address without a prefix length is a host
+ * prefix, /32 or /128.  Host bits are cleared.
+ * Returns 0 on success, -1 if s is not a valid address or prefix.
+ */
+int
+iptrie_prefix_parse(const char *s, iptrie_prefix_t *p)
+{
+	char buf[INET6_ADDRSTRLEN];
+	const char *slash = strchr(s, '/');
+	size_t sz = slash ? (size_t)(slash - s) : strlen(s);
+	unsigned int max;
+
+	if (sz == 0 || sz >= sizeof(buf))
+		return -1;
+	memcpy(buf, s, sz);
+	buf[sz] = '\0';
+
+	memset(p, 0, sizeof(iptrie_prefix_t));
+	if (inet_pton(AF_INET, buf, p->addr) == 1) {
+		p->af = AF_INET;
+		max = 32;
+	} else if (inet_pton(AF_INET6, buf, p->addr) == 1) {
+		p->af = AF_INET6;
+		max = 128;
+	} else {
+		return -1;
+	}
+
+	if (slash) {
+		const char *c = slash + 1;
+		p->len = 0;
+		if (!*c || strlen(c) > 3)
+			return -1;
+		for (; *c; c++) {
+			if (*c < '0' || *c > '9')
+				return -1;
+			p->len = p->len * 10 + (*c - '0');
+		}
+		if (p->len > max)
+			return -1;
+	} else {
+		p->len = max;
+	}
+
+	if (p->af == AF_INET6 && p->len >= 96 &&
+	    !memcmp(p->addr, iptrie_v4mapped, sizeof(iptrie_v4mapped))) {
+		p->af = AF_INET;
+		p->len -= 96;
+		memmove(p->addr, p->addr + 12, 4);
+		memset(p->addr + 4, 0, 12);
+	}
+	iptrie_prefix_mask(p);
+	return 0;
+}
+
+/*
+ * Returns the prefix in CIDR notation, which the caller must free.
+ */
+char *
+iptrie_prefix_str(const iptrie_prefix_t *p)
+{
+	char buf[INET6_ADDRSTRLEN];
+	char *s;
+
+	if (!inet_ntop(p->af, p->addr, buf, sizeof(buf)))
+		return NULL;
+	if (asprintf(&s, "%s/%u", buf, p->len) < 0)
+		return NULL;
+	return s;
+}
+
+iptrie_t *
+iptrie_new(void)
+{
+	iptrie_t *trie = malloc(sizeof(iptrie_t));
+	if (!trie)
+		return NULL;
+	memset(trie, 0, sizeof(iptrie_t));
+	return trie;
+}
+
+static void
+iptrie_node_free(iptrie_node_t *node, void (*free_value)(void *))
+{
+	if (!node)
+		return;
+	iptrie_node_free(node->child[0], free_value);
+	iptrie_node_free(node->child[1], free_value);
+	if (!node->glue && free_value)
+		free_value(node->value);
+	free(node);
+}
+
+/*
+ * Free the trie, and its values with free_value if not NULL.
+ */
+void
+iptrie_free(iptrie_t *trie, void (*free_value)(void *))
+{
+	iptrie_node_free(trie->root[0], free_value);
+	iptrie_node_free(trie->root[1], free_value);
+	free(trie);
+}
+
+static iptrie_node_t *
+iptrie_node_new(const iptrie_prefix_t *p, unsigned int len, int glue)
+{
+	iptrie_node_t *node = malloc(sizeof(iptrie_node_t));
+	if (!node)
+		return NULL;
+	memset(node, 0, sizeof(iptrie_node_t));
+	node->prefix = *p;
+	node->prefix.len = len;
+	iptrie_prefix_mask(&node->prefix);
+	node->glue = glue;
+	return node;
+}
+
+/*
+ * Returns the value slot for prefix p, inserting p if it is not in the trie
+ * yet, in which case *created is set to 1 and the slot is NULL.
+ * Returns NULL on out of memory.
+ */
+void **
+iptrie_put(iptrie_t *trie, const iptrie_prefix_t *p, int *created)
+{
+	iptrie_node_t **pp = &trie->root[p->af == AF_INET6];
+	iptrie_node_t *node, *n;
+
+	*created = 0;
+	while ((n = *pp)) {
+		unsigned int common = iptrie_common(n->prefix.addr, p->addr,
+			n->prefix.len < p->len ? n->prefix.len : p->len);
+		if (common < n->prefix.len) {
+			/* p diverges from n or is a prefix of n */
+			iptrie_node_t *parent;
+			if (common == p->len) {
+				if (!(parent = node = iptrie_node_new(p, p->len, 0)))
+					return NULL;
+			} else {
+				if (!(node = iptrie_node_new(p, p->len, 0)))
+					return NULL;
+				if (!(parent = iptrie_node_new(p, common, 1))) {
+					free(node);
+					return NULL;
+				}
+				parent->child[iptrie_bit(p->addr, common)] = node;
+			}
+			parent->child[iptrie_bit(n->prefix.addr, common)] = n;
+			*pp = parent;
+			goto created;
+		}
+		if (n->prefix.len == p->len) {
+			if (n->glue) {
+				n->glue = 0;
+				node = n;
+				goto created;
+			}
+			return &n->value;
+		}
+		pp = &n->child[iptrie_bit(p->addr, n->prefix.len)];
+	}
+	if (!(node = iptrie_node_new(p, p->len, 0)))
+		return NULL;
+	*pp = node;
+created:
+	trie->count++;
+	*created = 1;
+	return &node->value;
+}
+
+/*
+ * Returns the value of exactly prefix p, or NULL if p is not in the trie.
+ */
+void *
+iptrie_get(const iptrie_t *trie, const iptrie_prefix_t *p)
+{
+	const iptrie_node_t *n = trie->root[p->af == AF_INET6];
+
+	while (n && n->prefix.len <= p->len &&
+	       iptrie_common(n->prefix.addr, p->addr, n->prefix.len) == n->prefix.len) {
+		if (n->prefix.len == p->len)
+			return n->glue ? NULL : n->value;
+		n = n->child[iptrie_bit(p->addr, n->prefix.len)];
+	}
+	return NULL;
+}
+
+/*
+ * Find the prefixes covering address or prefix p, and store their values in
+ * values, longest prefix first, at most max of them.
+ * Returns the number of values stored.
+ */
+size_t
+iptrie_match(const iptrie_t *trie, const iptrie_prefix_t *p, void **values, size_t max)
+{
+	const iptrie_node_t *n = trie->root[p->af == AF_INET6];
+	const iptrie_node_t *found[IPTRIE_MAX_MATCHES];
+	size_t count = 0, i;
+
+	while (n && n->prefix.len <= p->len &&
+	       iptrie_common(n->prefix.addr, p->addr, n->prefix.len) == n->prefix.len) {
+		if (!n->glue)
+			found[count++] = n;
+		if (n->prefix.len == p->len)
+			break;
+		n = n->child[iptrie_bit(p->addr, n->prefix.len)];
+	}
+	for (i = 0; i < count && i < max; i++)
+		values[i] = found[count - i - 1]->value;
+	return i;
+}
+
+static void
+iptrie_node_foreach(const iptrie_node_t *n, void (*cb)(const iptrie_prefix_t *, void *, void *), void *arg)
+{
+	if (!n)
+		return;
+	if (!n->glue)
+		cb(&n->prefix, n->value, arg);
+	iptrie_node_foreach(n->child[0], cb, arg);
+	iptrie_node_foreach(n->child[1], cb, arg);
+}
+
+/*
+ * Call cb on each prefix and value, IPv4 before IPv6, in address order and
+ * shorter prefixes before the longer prefixes they cover.
+ */
+void
+iptrie_foreach(const iptrie_t *trie, void (*cb)(const iptrie_prefix_t *, void *, void *), void *arg)
+{
+	iptrie_node_foreach(trie->root[0], cb, arg);
+	iptrie_node_foreach(trie->root[1], cb, arg);
+}
+
+/* vim: set noet ft=c: */
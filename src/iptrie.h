@@ -0,0 +1,73 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IPTRIE_H
+#define IPTRIE_H
+
+#include "attrib.h"
+
+#include <stdlib.h>
+
+/* Max number of prefixes covering an address, /0 to /128 */
+#define IPTRIE_MAX_MATCHES 129
+
+/*
+ * IPv4 or IPv6 address prefix in network byte order, with the host bits
+ * cleared.  IPv4-mapped IPv6 addresses are stored as IPv4.
+ */
+typedef struct iptrie_prefix {
+	int af;
+	unsigned int len;
+	unsigned char addr[16];
+} iptrie_prefix_t;
+
+typedef struct iptrie_node iptrie_node_t;
+
+/*
+ * Path-compressed binary radix (Patricia) trie mapping address prefixes to
+ * values, with one root per address family.
+ */
+typedef struct iptrie {
+	iptrie_node_t *root[2];
+	size_t count;
+} iptrie_t;
+
+int iptrie_prefix_parse(const char *, iptrie_prefix_t *) NONNULL(1,2) WUNRES;
+char *iptrie_prefix_str(const iptrie_prefix_t *) NONNULL(1) MALLOC;
+
+iptrie_t *iptrie_new(void) MALLOC;
+void iptrie_free(iptrie_t *, void (*)(void *)) NONNULL(1);
+
+void **iptrie_put(iptrie_t *, const iptrie_prefix_t *, int *) NONNULL(1,2,3) WUNRES;
+void *iptrie_get(const iptrie_t *, const iptrie_prefix_t *) NONNULL(1,2) WUNRES;
+size_t iptrie_match(const iptrie_t *, const iptrie_prefix_t *, void **, size_t) NONNULL(1,2,3);
+void iptrie_foreach(const iptrie_t *, void (*)(const iptrie_prefix_t *, void *, void *), void *) NONNULL(1,2);
+
+#endif /* !IPTRIE_H */
+
+/* vim: set noet ft=c: */
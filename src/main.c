@@ -34,12 +34,15 @@
 
 #include "opts.h"
 #include "filter.h"
+#include "filtersnap.h"
 #include "proxy.h"
 #include "privsep.h"
 #include "ssl.h"
 #include "nat.h"
 #include "proc.h"
 #include "cachemgr.h"
+#include "preforge.h"
+#include "pxydns.h"
 #include "sys.h"
 #include "log.h"
 #include "build.h"
@@ -254,6 +257,8 @@ main_usage(void)
 "  -D          debug mode: run in foreground, log debug messages on stderr\n"
 "  -n          split mode: do not divert packets to listening programs\n"
 "              overrides the divert mode of all proxyspecs\n"
+"  -z snapfile compile global filtering rules into snapfile and exit\n"
+"  -v snapfile print filtering rules in snapfile and exit\n"
 "  -V          print version information and exit\n"
 "  -h          print usage information and exit\n";
 	const char *usagefmt2 =
@@ -328,32 +333,6 @@ main_load_leafcert(const char *filename, void *arg)
 	return 0;
 }
 
-static int WUNRES
-main_check_opts(opts_t *opts, conn_opts_t *conn_opts, const char *argv0, const char *name)
-{
-	if (conn_opts->cacrt && !conn_opts->cakey) {
-		fprintf(stderr, "%s: no CA key specified (-k) in %s.\n", argv0, name);
-		return -1;
-	}
-	if (conn_opts->cakey && !conn_opts->cacrt) {
-		fprintf(stderr, "%s: no CA cert specified (-c) in %s.\n", argv0, name);
-		return -1;
-	}
-	if (conn_opts->cakey && conn_opts->cacrt &&
-		(X509_check_private_key(conn_opts->cacrt, conn_opts->cakey) != 1)) {
-		fprintf(stderr, "%s: CA cert does not match key in %s.\n", argv0, name);
-		ERR_print_errors_fp(stderr);
-		return -1;
-	}
-	if (!conn_opts->cakey &&
-	    !opts->global->leafcertdir &&
-	    !opts->global->defaultleafcert) {
-		fprintf(stderr, "%s: at least one of -c/-k, -t or -A must be specified in %s.\n", argv0, name);
-		return -1;
-	}
-	return 0;
-}
-
 /*
  * Handle out of memory conditions in early stages of main().
  * Print error message and exit with failure status code.
@@ -378,6 +357,7 @@ main(int argc, char *argv[])
 	char *natengine;
 	int pidfd = -1;
 	int test_config = 0;
+	const char *snapfile = NULL;
 	int rv = EXIT_FAILURE;
 
 	argv0 = argv[0];
@@ -397,28 +377,14 @@ main(int argc, char *argv[])
 	while ((ch = getopt(argc, argv,
 	                    OPT_g OPT_G OPT_Z OPT_i OPT_x OPT_T OPT_I
 	                    "k:c:C:K:t:A:OPa:b:s:U:r:R:B:e:Eu:m:j:p:l:L:S:F:M:"
-	                    "dD::VhW:w:q:f:o:X:Y:y:JnQ")) != -1) {
+	                    "dD::VhW:w:q:f:o:X:Y:y:JnQz:v:")) != -1) {
+		/* options configuring proxyspecs and filtering rules */
+		int cli_rv = global_set_cli_option(global, argv0, ch, optarg, &natengine, global_tmp_opts);
+		if (cli_rv == -1)
+			exit(EXIT_FAILURE);
+		if (cli_rv == 0)
+			continue;
 		switch (ch) {
-			case 'f':
-				if (global_load_conffile(global, argv0, optarg, &natengine, global_tmp_opts) == -1)
-					exit(EXIT_FAILURE);
-				break;
-			case 'o':
-				if (global_set_option(global, argv0, optarg, &natengine, global_tmp_opts) == -1)
-					exit(EXIT_FAILURE);
-				break;
-			case 'c':
-				if (opts_set_cacrt(global->conn_opts, argv0, optarg, global_tmp_opts) == -1)
-					exit(EXIT_FAILURE);
-				break;
-			case 'k':
-				if (opts_set_cakey(global->conn_opts, argv0, optarg, global_tmp_opts) == -1)
-					exit(EXIT_FAILURE);
-				break;
-			case 'C':
-				if (opts_set_chain(global->conn_opts, argv0, optarg, global_tmp_opts) == -1)
-					exit(EXIT_FAILURE);
-				break;
 			case 'K':
 				if (global_set_leafkey(global, argv0, optarg) == -1)
 					exit(EXIT_FAILURE);
@@ -431,74 +397,12 @@ main(int argc, char *argv[])
 				if (global_set_defaultleafcert(global, argv0, optarg) == -1)
 					exit(EXIT_FAILURE);
 				break;
-			case 'q':
-				if (opts_set_leafcrlurl(global->conn_opts, argv0, optarg, global_tmp_opts) == -1)
-					exit(EXIT_FAILURE);
-				break;
-			case 'O':
-				opts_set_deny_ocsp(global->conn_opts);
-				break;
-			case 'P':
-				opts_set_passthrough(global->conn_opts);
-				break;
-			case 'a':
-				if (opts_set_clientcrt(global->conn_opts, argv0, optarg, global_tmp_opts) == -1)
-					exit(EXIT_FAILURE);
-				break;
-			case 'b':
-				if (opts_set_clientkey(global->conn_opts, argv0, optarg, global_tmp_opts) == -1)
-					exit(EXIT_FAILURE);
-				break;
-#ifndef OPENSSL_NO_DH
-			case 'g':
-				if (opts_set_dh(global->conn_opts, argv0, optarg, global_tmp_opts) == -1)
-					exit(EXIT_FAILURE);
-				break;
-#endif /* !OPENSSL_NO_DH */
-#ifndef OPENSSL_NO_ECDH
-			case 'G':
-				if (opts_set_ecdhcurve(global->conn_opts, argv0, optarg) == -1)
-					exit(EXIT_FAILURE);
-				break;
-#endif /* !OPENSSL_NO_ECDH */
-#ifdef SSL_OP_NO_COMPRESSION
-			case 'Z':
-				opts_unset_sslcomp(global->conn_opts);
-				break;
-#endif /* SSL_OP_NO_COMPRESSION */
-			case 's':
-				if (opts_set_ciphers(global->conn_opts, argv0, optarg) == -1)
-					exit(EXIT_FAILURE);
-				break;
-			case 'U':
-				if (opts_set_ciphersuites(global->conn_opts, argv0, optarg) == -1)
-					exit(EXIT_FAILURE);
-				break;
-			case 'r':
-				if (opts_force_proto(global->conn_opts, argv0, optarg) == -1)
-					exit(EXIT_FAILURE);
-				break;
-			case 'R':
-				if (opts_disable_enable_proto(global->conn_opts, argv0, optarg, 1) == -1)
-					exit(EXIT_FAILURE);
-				break;
-			case 'B':
-				if (opts_disable_enable_proto(global->conn_opts, argv0, optarg, 0) == -1)
-					exit(EXIT_FAILURE);
-				break;
 #ifndef OPENSSL_NO_ENGINE
 			case 'x':
 				if (global_set_openssl_engine(global, argv0, optarg) == -1)
 					exit(EXIT_FAILURE);
 				break;
 #endif /* !OPENSSL_NO_ENGINE */
-			case 'e':
-				if (natengine)
-					free(natengine);
-				natengine = strdup(optarg);
-				if (!natengine)
-					oom_die(argv0);
-				break;
 			case 'E':
 				nat_list_engines();
 				exit(EXIT_SUCCESS);
@@ -587,13 +491,14 @@ main(int argc, char *argv[])
 						exit(EXIT_FAILURE);
 				}
 				break;
-			case 'n':
-				opts_unset_divert(global->opts);
-				global_tmp_opts->split = 1;
-				break;
 			case 'Q':
 				test_config = 1;
 				break;
+			case 'z':
+				snapfile = optarg;
+				break;
+			case 'v':
+				exit(filtersnap_print(optarg) == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
 			case 'V':
 				main_version();
 				exit(EXIT_SUCCESS);
@@ -607,9 +512,14 @@ main(int argc, char *argv[])
 				exit(EXIT_FAILURE);
 		}
 	}
+	if (snapfile) {
+		if (filtersnap_write(global->opts->filter_rules, snapfile) == -1)
+			exit(EXIT_FAILURE);
+		exit(EXIT_SUCCESS);
+	}
 	argc -= optind;
 	argv += optind;
-	if (proxyspec_parse(&argc, &argv, natengine, global, argv0, global_tmp_opts) == -1)
+	if (global_set_cli_proxyspecs(global, argv0, argc, argv, natengine, global_tmp_opts) == -1)
 		exit(EXIT_FAILURE);
 
 	/* usage checks before defaults */
@@ -665,22 +575,8 @@ main(int argc, char *argv[])
 		// because global options do not have to have SSL options, but proxyspecs do have to,
 		// and global options are copied into proxyspecs and then into struct filter rules anyway
 		for (proxyspec_t *spec = global->spec; spec; spec = spec->next) {
-			if (spec->ssl || spec->upgrade) {
-				// Either the proxyspec itself or all of the filtering rules copied into or defined in the proxyspec must have a complete SSL/TLS configuration
-				if (main_check_opts(spec->opts, spec->conn_opts, argv0, "ProxySpec") == -1) {
-					if (!spec->opts->filter_rules)
-						exit(EXIT_FAILURE);
-
-					filter_rule_t *rule = spec->opts->filter_rules;
-					while (rule) {
-						if (!rule->action.conn_opts || (main_check_opts(spec->opts, rule->action.conn_opts, argv0, "FilterRule") == -1)) {
-							fprintf(stderr, "%s: no or incomplete SSL/TLS configuration in ProxySpec and/or FilterRule.\n", argv0);
-							exit(EXIT_FAILURE);
-						}
-						rule = rule->next;
-					}
-				}
-			}
+			if (proxyspec_check_ssl(spec, argv0) == -1)
+				exit(EXIT_FAILURE);
 		}
 	}
 #ifdef __APPLE__
@@ -726,44 +622,11 @@ main(int argc, char *argv[])
 #endif /* !WITHOUT_USERAUTH */
 
 	/* dynamic defaults */
-	if (!global->conn_opts->ciphers) {
-		global->conn_opts->ciphers = strdup(DFLT_CIPHERS);
-		if (!global->conn_opts->ciphers)
-			oom_die(argv0);
-	}
-	if (!global->conn_opts->ciphersuites) {
-		global->conn_opts->ciphersuites = strdup(DFLT_CIPHERSUITES);
-		if (!global->conn_opts->ciphersuites)
-			oom_die(argv0);
-	}
+	if (conn_opts_set_dflt_ciphers(global->conn_opts) == -1)
+		oom_die(argv0);
 	for (proxyspec_t *spec = global->spec; spec; spec = spec->next) {
-		if (!spec->conn_opts->ciphers) {
-			spec->conn_opts->ciphers = strdup(DFLT_CIPHERS);
-			if (!spec->conn_opts->ciphers)
-				oom_die(argv0);
-		}
-		if (!spec->conn_opts->ciphersuites) {
-			spec->conn_opts->ciphersuites = strdup(DFLT_CIPHERSUITES);
-			if (!spec->conn_opts->ciphersuites)
-				oom_die(argv0);
-		}
-
-		filter_rule_t *rule = spec->opts->filter_rules;
-		while (rule) {
-			if (rule->action.conn_opts) {
-				if (!rule->action.conn_opts->ciphers) {
-					rule->action.conn_opts->ciphers = strdup(DFLT_CIPHERS);
-					if (!rule->action.conn_opts->ciphers)
-						oom_die(argv0);
-				}
-				if (!rule->action.conn_opts->ciphersuites) {
-					rule->action.conn_opts->ciphersuites = strdup(DFLT_CIPHERSUITES);
-					if (!rule->action.conn_opts->ciphersuites)
-						oom_die(argv0);
-				}
-			}
-			rule = rule->next;
-		}
+		if (proxyspec_set_dflt_ciphers(spec) == -1)
+			oom_die(argv0);
 	}
 	if (!global->dropuser && !geteuid() && !getuid() &&
 	    sys_isuser(DFLT_DROPUSER)) {
@@ -888,6 +751,8 @@ main(int argc, char *argv[])
 		fclose(keyf);
 	}
 
+	filter_bloom_fprate_set(global->filter_bloom_fprate);
+	filter_dfa_max_size_set(global->filter_dfa_max_size);
 	for (proxyspec_t *spec = global->spec; spec; spec = spec->next) {
 		if (spec->opts->filter_rules) {
 			spec->opts->filter = filter_set(spec->opts->filter_rules, argv0, global_tmp_opts);
@@ -1018,6 +883,17 @@ main(int argc, char *argv[])
 		}
 	}
 
+	/* Load the hosts file for SNI lookups before chroot */
+	for (proxyspec_t *spec = global->spec; spec; spec = spec->next) {
+		if (spec->sni_port) {
+			if (pxy_dns_load_hosts("/etc/hosts") == -1) {
+				fprintf(stderr, "%s: failed to load /etc/hosts: %s, "
+				                "ignoring\n", argv0, strerror(errno));
+			}
+			break;
+		}
+	}
+
 	if (test_config) {
 		rv = EXIT_SUCCESS;
 		goto out_test_config;
@@ -1074,6 +950,12 @@ main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
+	/* Load certs to pre-forge and open the learn file before dropping privs */
+	if (preforge_preinit(global) == -1) {
+		log_err_level_printf(LOG_CRIT, "Failed to initialize pre-forging.\n");
+		exit(EXIT_FAILURE);
+	}
+
 	/* Drop privs, chroot */
 	if (sys_privdrop(global->dropuser, global->dropgroup,
 	                 global->jaildir) == -1) {
@@ -1100,6 +982,10 @@ main(int argc, char *argv[])
 		log_err_level_printf(LOG_CRIT, "Failed to init cache manager.\n");
 		goto out_cachemgr_failed;
 	}
+	if (preforge_init() == -1) {
+		log_err_level_printf(LOG_CRIT, "Failed to init pre-forging.\n");
+		goto out_preforge_failed;
+	}
 	if (nat_init() == -1) {
 		log_err_level_printf(LOG_CRIT, "Failed to init NAT state table lookup.\n");
 		goto out_nat_failed;
@@ -1129,6 +1015,8 @@ main(int argc, char *argv[])
 	proxy_free(proxy);
 	nat_fini();
 out_nat_failed:
+out_preforge_failed:
+	preforge_fini();
 	cachemgr_fini();
 out_cachemgr_failed:
 	log_fini();
@@ -1137,6 +1025,7 @@ out_log_failed:
 out_parent:
 out_test_config:
 	global_free(global);
+	opts_keymat_free();
 	ssl_fini();
 	if (natengine)
 		free(natengine);
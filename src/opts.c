@@ -29,6 +29,7 @@
 
 #include "opts.h"
 #include "filter.h"
+#include "filtersnap.h"
 
 #include "sys.h"
 #include "log.h"
@@ -39,11 +40,14 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/resource.h>
+#include <sys/un.h>
+#include <pthread.h>
 
 #ifndef OPENSSL_NO_DH
 #include <openssl/dh.h>
 #endif /* !OPENSSL_NO_DH */
 #include <openssl/x509.h>
+#include <openssl/err.h>
 
 /*
  * Temporary struct used while configuring proxyspec.
@@ -145,6 +149,7 @@ conn_opts_new(void)
 	conn_opts->user_timeout = 300;
 #endif /* !WITHOUT_USERAUTH */
 	conn_opts->max_http_header_size = 8192;
+	conn_opts->outbuf_limit = DFLT_OUTBUF_LIMIT;
 	return conn_opts;
 }
 
@@ -174,8 +179,19 @@ global_new(void)
 
 	global->leafkey_rsabits = DFLT_LEAFKEY_RSABITS;
 	global->conn_idle_timeout = 120;
+	global->conn_idle_reclaim_time = 30;
 	global->expired_conn_check_period = 10;
 	global->stats_period = 1;
+	global->dns_cache_max_ttl = 300;
+	global->dns_negative_ttl = 5;
+	global->verify_cache_ttl = 300;
+	global->filter_bloom_fprate = BLOOM_FPRATE;
+	global->filter_dfa_max_size = FILTER_DFA_MAX_SIZE;
+	global->happy_eyeballs_delay = 250;
+	global->connect_timeout = 10;
+	global->clienthello_max_size = 16384;
+	global->preforge_learn_topn = 100;
+	global->preforge_rate = 10;
 
 	global->conn_opts = conn_opts_new();
 	if (!global->conn_opts)
@@ -207,7 +223,7 @@ conn_opts_free(conn_opts_t *conn_opts)
 	}
 #ifndef OPENSSL_NO_DH
 	if (conn_opts->dh) {
-		DH_free(conn_opts->dh);
+		ssl_dh_free(conn_opts->dh);
 	}
 #endif /* !OPENSSL_NO_DH */
 #ifndef OPENSSL_NO_ECDH
@@ -350,6 +366,18 @@ global_free(global_t *global)
 	if (global->conffile) {
 		free(global->conffile);
 	}
+	while (global->cli_opts) {
+		cli_opt_t *next = global->cli_opts->next;
+		free(global->cli_opts->arg);
+		free(global->cli_opts);
+		global->cli_opts = next;
+	}
+	if (global->cli_specv) {
+		for (int i = 0; i < global->cli_specc; i++) {
+			free(global->cli_specv[i]);
+		}
+		free(global->cli_specv);
+	}
 	if (global->connectlog) {
 		free(global->connectlog);
 	}
@@ -359,6 +387,12 @@ global_free(global_t *global)
 	if (global->certgendir) {
 		free(global->certgendir);
 	}
+	if (global->preforgecertdir) {
+		free(global->preforgecertdir);
+	}
+	if (global->preforgelearnfile) {
+		free(global->preforgelearnfile);
+	}
 	if (global->contentlog_basedir) {
 		free(global->contentlog_basedir);
 	}
@@ -530,6 +564,7 @@ tmp_opts_copy(tmp_opts_t *src_tmp_opts)
 		tmp_opts->dh_str = strdup(src_tmp_opts->dh_str);
 	tmp_opts->split = src_tmp_opts->split;
 	tmp_opts->include = src_tmp_opts->include;
+	tmp_opts->reload = src_tmp_opts->reload;
 #ifdef DEBUG_PROXY
 	tmp_opts->line_num = src_tmp_opts->line_num;
 #endif /* DEBUG_PROXY */
@@ -586,6 +621,10 @@ conn_opts_copy(conn_opts_t *conn_opts, const char *argv0, tmp_opts_t *tmp_opts)
 	cops->validate_proto = conn_opts->validate_proto;
 	cops->reconnect_ssl = conn_opts->reconnect_ssl;
 	cops->max_http_header_size = conn_opts->max_http_header_size;
+	cops->outbuf_limit = conn_opts->outbuf_limit;
+	cops->adaptive_outbuf_limit = conn_opts->adaptive_outbuf_limit;
+	cops->ktls = conn_opts->ktls;
+	cops->dynamic_record_sizing = conn_opts->dynamic_record_sizing;
 
 	// Pass NULL as tmp_opts param, so we don't reassign the var to itself
 	// That would be harmless but incorrect
@@ -802,6 +841,12 @@ proxyspec_set_return_addr(proxyspec_t *spec, char *addr)
 						addr, "0", AF_INET, EVUTIL_AI_PASSIVE) == -1) {
 		return -1;
 	}
+	// Child listeners append .pid.fd to the path, see pxy_opensock_child()
+	if (spec->return_addr.ss_family == AF_UNIX &&
+		strlen(((struct sockaddr_un *)&spec->return_addr)->sun_path) + RETURN_ADDR_UNIX_SUFFIX_LEN >= sizeof(((struct sockaddr_un *)0)->sun_path)) {
+		fprintf(stderr, "ReturnAddr unix socket path too long: %s\n", addr);
+		return -1;
+	}
 #ifdef DEBUG_OPTS
 	log_dbg_printf("ReturnAddr: [%s]\n", addr);
 #endif /* DEBUG_OPTS */
@@ -1049,7 +1094,7 @@ conn_opts_str(conn_opts_t *conn_opts)
 #ifndef WITHOUT_USERAUTH
 				 "%s|%s|%d"
 #endif /* !WITHOUT_USERAUTH */
-				 "%s%s|%d",
+				 "%s%s|%d|%u%s%s%s",
 #if (OPENSSL_VERSION_NUMBER < 0x10100000L) || (defined(LIBRESSL_VERSION_NUMBER) && LIBRESSL_VERSION_NUMBER < 0x20702000L)
 #ifdef HAVE_SSLV2
 	               (conn_opts->sslmethod == SSLv2_method) ? "ssl2" :
@@ -1184,7 +1229,11 @@ conn_opts_str(conn_opts_t *conn_opts)
 #endif /* !WITHOUT_USERAUTH */
 	             (conn_opts->validate_proto ? "|validate_proto" : ""),
 	             (conn_opts->reconnect_ssl ? "|reconnect_ssl" : ""),
-	             conn_opts->max_http_header_size
+	             conn_opts->max_http_header_size,
+	             conn_opts->outbuf_limit,
+	             (conn_opts->adaptive_outbuf_limit ? "|adaptive_outbuf_limit" : ""),
+	             (conn_opts->ktls ? "|ktls" : ""),
+	             (conn_opts->dynamic_record_sizing ? "|dynamic_record_sizing" : "")
 	               ) < 0) {
 		return oom_return_na_null();
 	}
@@ -1359,6 +1408,185 @@ out:
 	return s;
 }
 
+/*
+ * Key material loaded from files, shared by path.  Filtering rules reloaded
+ * on SIGHUP reuse the key material loaded on startup, so key files need not
+ * be readable after dropping privileges or chrooting.
+ */
+#define KEYMAT_X509  0
+#define KEYMAT_KEY   1
+#define KEYMAT_CHAIN 2
+#define KEYMAT_DH    3
+
+typedef struct opts_keymat {
+	int type;
+	char *path;
+	void *obj;
+	struct opts_keymat *next;
+} opts_keymat_t;
+
+static pthread_mutex_t keymat_mutex = PTHREAD_MUTEX_INITIALIZER;
+static opts_keymat_t *keymats = NULL;
+
+static void *
+opts_keymat_new_obj(int type, const char *path)
+{
+	STACK_OF(X509) *chain = NULL;
+
+	switch (type) {
+	case KEYMAT_X509:
+		return ssl_x509_load(path);
+	case KEYMAT_KEY:
+		return ssl_key_load(path);
+	case KEYMAT_CHAIN:
+		if (ssl_x509chain_load(NULL, &chain, path) == -1) {
+			if (chain)
+				sk_X509_pop_free(chain, X509_free);
+			return NULL;
+		}
+		return chain;
+#ifndef OPENSSL_NO_DH
+	case KEYMAT_DH:
+		return ssl_dh_load(path);
+#endif /* !OPENSSL_NO_DH */
+	default:
+		return NULL;
+	}
+}
+
+static void
+opts_keymat_ref_obj(int type, void *obj)
+{
+	switch (type) {
+	case KEYMAT_X509:
+		ssl_x509_refcount_inc(obj);
+		break;
+	case KEYMAT_KEY:
+		ssl_key_refcount_inc(obj);
+		break;
+#ifndef OPENSSL_NO_DH
+	case KEYMAT_DH:
+		ssl_dh_refcount_inc(obj);
+		break;
+#endif /* !OPENSSL_NO_DH */
+	default:
+		break;
+	}
+}
+
+static void
+opts_keymat_free_obj(int type, void *obj)
+{
+	switch (type) {
+	case KEYMAT_X509:
+		X509_free(obj);
+		break;
+	case KEYMAT_KEY:
+		EVP_PKEY_free(obj);
+		break;
+	case KEYMAT_CHAIN:
+		sk_X509_pop_free(obj, X509_free);
+		break;
+#ifndef OPENSSL_NO_DH
+	case KEYMAT_DH:
+		ssl_dh_free(obj);
+		break;
+#endif /* !OPENSSL_NO_DH */
+	default:
+		break;
+	}
+}
+
+/*
+ * Return the key material of type loaded from path, loading it only if it
+ * has not been loaded before.  The caller owns a reference, except for
+ * chains, which remain owned by the registry.  Failed loads are not
+ * remembered.  Returns NULL on error.
+ */
+static void *
+opts_keymat_load(int type, const char *path)
+{
+	opts_keymat_t *km;
+	void *obj;
+
+	pthread_mutex_lock(&keymat_mutex);
+	for (km = keymats; km; km = km->next) {
+		if (km->type == type && equal(km->path, path)) {
+			obj = km->obj;
+			goto out;
+		}
+	}
+
+	obj = opts_keymat_new_obj(type, path);
+	if (!obj)
+		goto leave;
+
+	km = malloc(sizeof(opts_keymat_t));
+	if (!km || !(km->path = strdup(path))) {
+		if (km)
+			free(km);
+		// Hand over the only reference, chains are owned by the registry
+		if (type == KEYMAT_CHAIN) {
+			opts_keymat_free_obj(type, obj);
+			obj = NULL;
+		}
+		goto leave;
+	}
+	km->type = type;
+	km->obj = obj;
+	km->next = keymats;
+	keymats = km;
+out:
+	opts_keymat_ref_obj(type, obj);
+leave:
+	pthread_mutex_unlock(&keymat_mutex);
+	return obj;
+}
+
+/*
+ * Push the certs of the chain file at path onto *chain, which is created
+ * if NULL.  Returns -1 on error.
+ */
+static int
+opts_keymat_chain_load(STACK_OF(X509) **chain, const char *path)
+{
+	STACK_OF(X509) *certs = opts_keymat_load(KEYMAT_CHAIN, path);
+	if (!certs)
+		return -1;
+
+	if (!*chain) {
+		*chain = sk_X509_new_null();
+		if (!*chain)
+			return -1;
+	}
+	for (int i = 0; i < sk_X509_num(certs); i++) {
+		X509 *crt = sk_X509_value(certs, i);
+		ssl_x509_refcount_inc(crt);
+		if (!sk_X509_push(*chain, crt)) {
+			X509_free(crt);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Free all key material remembered by the registry.
+ */
+void
+opts_keymat_free(void)
+{
+	pthread_mutex_lock(&keymat_mutex);
+	while (keymats) {
+		opts_keymat_t *next = keymats->next;
+		opts_keymat_free_obj(keymats->type, keymats->obj);
+		free(keymats->path);
+		free(keymats);
+		keymats = next;
+	}
+	pthread_mutex_unlock(&keymat_mutex);
+}
+
 int
 opts_set_cacrt(conn_opts_t *conn_opts, const char *argv0, const char *optarg, tmp_opts_t *tmp_opts)
 {
@@ -1372,7 +1600,7 @@ opts_set_cacrt(conn_opts_t *conn_opts, const char *argv0, const char *optarg, tm
 
 	if (conn_opts->cacrt)
 		X509_free(conn_opts->cacrt);
-	conn_opts->cacrt = ssl_x509_load(optarg);
+	conn_opts->cacrt = opts_keymat_load(KEYMAT_X509, optarg);
 	if (!conn_opts->cacrt) {
 		fprintf(stderr, "%s: error loading CA cert from '%s':\n",
 		        argv0, optarg);
@@ -1386,11 +1614,11 @@ opts_set_cacrt(conn_opts_t *conn_opts, const char *argv0, const char *optarg, tm
 	ssl_x509_refcount_inc(conn_opts->cacrt);
 	sk_X509_insert(conn_opts->chain, conn_opts->cacrt, 0);
 	if (!conn_opts->cakey) {
-		conn_opts->cakey = ssl_key_load(optarg);
+		conn_opts->cakey = opts_keymat_load(KEYMAT_KEY, optarg);
 	}
 #ifndef OPENSSL_NO_DH
 	if (!conn_opts->dh) {
-		conn_opts->dh = ssl_dh_load(optarg);
+		conn_opts->dh = opts_keymat_load(KEYMAT_DH, optarg);
 	}
 #endif /* !OPENSSL_NO_DH */
 #ifdef DEBUG_OPTS
@@ -1412,7 +1640,7 @@ opts_set_cakey(conn_opts_t *conn_opts, const char *argv0, const char *optarg, tm
 
 	if (conn_opts->cakey)
 		EVP_PKEY_free(conn_opts->cakey);
-	conn_opts->cakey = ssl_key_load(optarg);
+	conn_opts->cakey = opts_keymat_load(KEYMAT_KEY, optarg);
 	if (!conn_opts->cakey) {
 		fprintf(stderr, "%s: error loading CA key from '%s':\n",
 		        argv0, optarg);
@@ -1424,7 +1652,7 @@ opts_set_cakey(conn_opts_t *conn_opts, const char *argv0, const char *optarg, tm
 		return -1;
 	}
 	if (!conn_opts->cacrt) {
-		conn_opts->cacrt = ssl_x509_load(optarg);
+		conn_opts->cacrt = opts_keymat_load(KEYMAT_X509, optarg);
 		if (conn_opts->cacrt) {
 			ssl_x509_refcount_inc(conn_opts->cacrt);
 			sk_X509_insert(conn_opts->chain, conn_opts->cacrt, 0);
@@ -1432,7 +1660,7 @@ opts_set_cakey(conn_opts_t *conn_opts, const char *argv0, const char *optarg, tm
 	}
 #ifndef OPENSSL_NO_DH
 	if (!conn_opts->dh) {
-		conn_opts->dh = ssl_dh_load(optarg);
+		conn_opts->dh = opts_keymat_load(KEYMAT_DH, optarg);
 	}
 #endif /* !OPENSSL_NO_DH */
 #ifdef DEBUG_OPTS
@@ -1452,7 +1680,7 @@ opts_set_chain(conn_opts_t *conn_opts, const char *argv0, const char *optarg, tm
 			return oom_return(argv0);
 	}
 
-	if (ssl_x509chain_load(NULL, &conn_opts->chain, optarg) == -1) {
+	if (opts_keymat_chain_load(&conn_opts->chain, optarg) == -1) {
 		fprintf(stderr, "%s: error loading chain from '%s':\n",
 		        argv0, optarg);
 		if (errno) {
@@ -1538,7 +1766,7 @@ opts_set_clientcrt(conn_opts_t *conn_opts, const char *argv0, const char *optarg
 
 	if (conn_opts->clientcrt)
 		X509_free(conn_opts->clientcrt);
-	conn_opts->clientcrt = ssl_x509_load(optarg);
+	conn_opts->clientcrt = opts_keymat_load(KEYMAT_X509, optarg);
 	if (!conn_opts->clientcrt) {
 		fprintf(stderr, "%s: error loading client cert from '%s':\n",
 		        argv0, optarg);
@@ -1568,7 +1796,7 @@ opts_set_clientkey(conn_opts_t *conn_opts, const char *argv0, const char *optarg
 
 	if (conn_opts->clientkey)
 		EVP_PKEY_free(conn_opts->clientkey);
-	conn_opts->clientkey = ssl_key_load(optarg);
+	conn_opts->clientkey = opts_keymat_load(KEYMAT_KEY, optarg);
 	if (!conn_opts->clientkey) {
 		fprintf(stderr, "%s: error loading client key from '%s':\n",
 		        argv0, optarg);
@@ -1598,8 +1826,8 @@ opts_set_dh(conn_opts_t *conn_opts, const char *argv0, const char *optarg, tmp_o
 	}
 
 	if (conn_opts->dh)
-		DH_free(conn_opts->dh);
-	conn_opts->dh = ssl_dh_load(optarg);
+		ssl_dh_free(conn_opts->dh);
+	conn_opts->dh = opts_keymat_load(KEYMAT_DH, optarg);
 	if (!conn_opts->dh) {
 		fprintf(stderr, "%s: error loading DH params from '%s':\n",
 		        argv0, optarg);
@@ -1935,6 +2163,44 @@ opts_unset_verify_peer(conn_opts_t *conn_opts)
 	conn_opts->verify_peer = 0;
 }
 
+static void
+opts_set_adaptive_outbuf_limit(conn_opts_t *conn_opts)
+{
+	conn_opts->adaptive_outbuf_limit = 1;
+}
+
+static void
+opts_unset_adaptive_outbuf_limit(conn_opts_t *conn_opts)
+{
+	conn_opts->adaptive_outbuf_limit = 0;
+}
+
+static void
+opts_set_dynamic_record_sizing(conn_opts_t *conn_opts)
+{
+	conn_opts->dynamic_record_sizing = 1;
+}
+
+static void
+opts_unset_dynamic_record_sizing(conn_opts_t *conn_opts)
+{
+	conn_opts->dynamic_record_sizing = 0;
+}
+
+#ifdef SSL_OP_ENABLE_KTLS
+static void
+opts_set_ktls(conn_opts_t *conn_opts)
+{
+	conn_opts->ktls = 1;
+}
+
+static void
+opts_unset_ktls(conn_opts_t *conn_opts)
+{
+	conn_opts->ktls = 0;
+}
+#endif /* SSL_OP_ENABLE_KTLS */
+
 static void
 opts_set_allow_wrong_host(conn_opts_t *conn_opts)
 {
@@ -2088,6 +2354,101 @@ global_set_certgendir_writeall(global_t *global, const char *argv0,
 	return 0;
 }
 
+static int WUNRES
+conn_opts_check(opts_t *opts, conn_opts_t *conn_opts, const char *argv0, const char *name)
+{
+	if (conn_opts->cacrt && !conn_opts->cakey) {
+		fprintf(stderr, "%s: no CA key specified (-k) in %s.\n", argv0, name);
+		return -1;
+	}
+	if (conn_opts->cakey && !conn_opts->cacrt) {
+		fprintf(stderr, "%s: no CA cert specified (-c) in %s.\n", argv0, name);
+		return -1;
+	}
+	if (conn_opts->cakey && conn_opts->cacrt &&
+		(X509_check_private_key(conn_opts->cacrt, conn_opts->cakey) != 1)) {
+		fprintf(stderr, "%s: CA cert does not match key in %s.\n", argv0, name);
+		ERR_print_errors_fp(stderr);
+		return -1;
+	}
+	if (!conn_opts->cakey &&
+	    !opts->global->leafcertdir &&
+	    !opts->global->defaultleafcert) {
+		fprintf(stderr, "%s: at least one of -c/-k, -t or -A must be specified in %s.\n", argv0, name);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Either the proxyspec itself or all of the filtering rules copied into or
+ * defined in the proxyspec must have a complete SSL/TLS configuration.
+ * Return 0 if complete or not an SSL proxyspec, -1 otherwise.
+ */
+int
+proxyspec_check_ssl(proxyspec_t *spec, const char *argv0)
+{
+	if (!spec->ssl && !spec->upgrade)
+		return 0;
+
+	if (conn_opts_check(spec->opts, spec->conn_opts, argv0, "ProxySpec") == 0)
+		return 0;
+
+	if (!spec->opts->filter_rules)
+		return -1;
+
+	filter_rule_t *rule = spec->opts->filter_rules;
+	while (rule) {
+		if (!rule->action.conn_opts || (conn_opts_check(spec->opts, rule->action.conn_opts, argv0, "FilterRule") == -1)) {
+			fprintf(stderr, "%s: no or incomplete SSL/TLS configuration in ProxySpec and/or FilterRule.\n", argv0);
+			return -1;
+		}
+		rule = rule->next;
+	}
+	return 0;
+}
+
+/*
+ * Set the default ciphers and ciphersuites if not configured.
+ * Return -1 on out of memory, 0 otherwise.
+ */
+int
+conn_opts_set_dflt_ciphers(conn_opts_t *conn_opts)
+{
+	if (!conn_opts->ciphers) {
+		conn_opts->ciphers = strdup(DFLT_CIPHERS);
+		if (!conn_opts->ciphers)
+			return -1;
+	}
+	if (!conn_opts->ciphersuites) {
+		conn_opts->ciphersuites = strdup(DFLT_CIPHERSUITES);
+		if (!conn_opts->ciphersuites)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Set the default ciphers and ciphersuites of the proxyspec and of its
+ * filtering rules.
+ * Return -1 on out of memory, 0 otherwise.
+ */
+int
+proxyspec_set_dflt_ciphers(proxyspec_t *spec)
+{
+	if (conn_opts_set_dflt_ciphers(spec->conn_opts) == -1)
+		return -1;
+
+	filter_rule_t *rule = spec->opts->filter_rules;
+	while (rule) {
+		if (rule->action.conn_opts &&
+		    conn_opts_set_dflt_ciphers(rule->action.conn_opts) == -1)
+			return -1;
+		rule = rule->next;
+	}
+	return 0;
+}
+
 int
 global_set_user(global_t *global, const char *argv0, const char *optarg)
 {
@@ -2646,6 +3007,25 @@ set_conn_opts_option(conn_opts_t *conn_opts, const char *argv0,
 		}
 #ifdef DEBUG_OPTS
 		log_dbg_printf("MaxHTTPHeaderSize: %u\n", conn_opts->max_http_header_size);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "OutbufLimit")) {
+		unsigned int i = atoi(value);
+		if (i >= 16384 && i <= 67108864) {
+			conn_opts->outbuf_limit = i;
+		} else {
+			fprintf(stderr, "Invalid OutbufLimit %s on line %d, use 16384-67108864\n", value, line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("OutbufLimit: %u\n", conn_opts->outbuf_limit);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "AdaptiveOutbufLimit")) {
+		yes = check_value_yesno(value, "AdaptiveOutbufLimit", line_num);
+		if (yes == -1)
+			return -1;
+		yes ? opts_set_adaptive_outbuf_limit(conn_opts) : opts_unset_adaptive_outbuf_limit(conn_opts);
+#ifdef DEBUG_OPTS
+		log_dbg_printf("AdaptiveOutbufLimit: %u\n", conn_opts->adaptive_outbuf_limit);
 #endif /* DEBUG_OPTS */
 	} else if (equal(name, "VerifyPeer")) {
 		yes = check_value_yesno(value, "VerifyPeer", line_num);
@@ -2678,6 +3058,24 @@ set_conn_opts_option(conn_opts_t *conn_opts, const char *argv0,
 		yes ? opts_set_remove_http_referer(conn_opts) : opts_unset_remove_http_referer(conn_opts);
 #ifdef DEBUG_OPTS
 		log_dbg_printf("RemoveHTTPReferer: %u\n", conn_opts->remove_http_referer);
+#endif /* DEBUG_OPTS */
+#ifdef SSL_OP_ENABLE_KTLS
+	} else if (equal(name, "KTLS")) {
+		yes = check_value_yesno(value, "KTLS", line_num);
+		if (yes == -1)
+			return -1;
+		yes ? opts_set_ktls(conn_opts) : opts_unset_ktls(conn_opts);
+#ifdef DEBUG_OPTS
+		log_dbg_printf("KTLS: %u\n", conn_opts->ktls);
+#endif /* DEBUG_OPTS */
+#endif /* SSL_OP_ENABLE_KTLS */
+	} else if (equal(name, "DynamicRecordSizing")) {
+		yes = check_value_yesno(value, "DynamicRecordSizing", line_num);
+		if (yes == -1)
+			return -1;
+		yes ? opts_set_dynamic_record_sizing(conn_opts) : opts_unset_dynamic_record_sizing(conn_opts);
+#ifdef DEBUG_OPTS
+		log_dbg_printf("DynamicRecordSizing: %u\n", conn_opts->dynamic_record_sizing);
 #endif /* DEBUG_OPTS */
 	}
 	else {
@@ -2721,6 +3119,11 @@ set_option(opts_t *opts, conn_opts_t *conn_opts, const char *argv0,
 		return filter_passsite_set(opts, conn_opts, value, *line_num);
 	} else if (equal(name, "Define")) {
 		return filter_macro_set(opts, value, *line_num);
+	} else if (equal(name, "FilterSnapshot")) {
+		if (filtersnap_load(opts, value, *line_num) == -1) {
+			fprintf(stderr, "Error in conf: FilterSnapshot on line %d\n", *line_num);
+			return -1;
+		}
 	} else if (equal(name, "Split") || equal(name, "Pass") || equal(name, "Block") || equal(name, "Match")) {
 		return filter_rule_set(opts, conn_opts, name, value, *line_num);
 	} else if (equal(name, "Divert")) {
@@ -2740,6 +3143,9 @@ set_option(opts_t *opts, conn_opts_t *conn_opts, const char *argv0,
 			fprintf(stderr, "Error in conf: '%s' on line %d\n", name, *line_num);
 			return -1;
 		} else if (rv == 1) {
+			// Global options are skipped on reload
+			if (tmp_opts->reload)
+				return 0;
 			fprintf(stderr, "Error in conf: Unknown option '%s' on line %d\n", name, *line_num);
 			return -1;
 		}
@@ -2776,6 +3182,11 @@ set_proxyspec_option(proxyspec_t *spec, const char *argv0,
 		}
 	}
 	else if (equal(name, "DivertAddr")) {
+		// Unix domain socket addresses do not have a port, so DivertPort is optional
+		if (sys_get_af(value) == AF_UNIX) {
+			if (proxyspec_set_divert_addr(spec, value, "0") == -1)
+				return -1;
+		}
 		spec_addrs->divert_addr = strdup(value);
 		if (!spec_addrs->divert_addr)
 			return oom_return(argv0);
@@ -3058,6 +3469,12 @@ set_global_option(global_t *global, const char *argv0,
 		return -1;
 	}
 
+	// Global options take effect on restart only, and may not be loadable
+	// after dropping privileges, so reload filtering rules and conn opts only
+	if (tmp_opts->reload && !equal(name, "Include") && !equal(name, "ProxySpec")) {
+		return set_option(global->opts, global->conn_opts, argv0, name, value, natengine, f, line_num, tmp_opts);
+	}
+
 	if (equal(name, "LeafCertDir")) {
 		return global_set_leafcertdir(global, argv0, value);
 	} else if (equal(name, "DefaultLeafCert")) {
@@ -3147,6 +3564,17 @@ set_global_option(global_t *global, const char *argv0,
 		}
 #ifdef DEBUG_OPTS
 		log_dbg_printf("ConnIdleTimeout: %u\n", global->conn_idle_timeout);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "ConnIdleReclaimTime")) {
+		unsigned int i = atoi(value);
+		if (i <= 3600) {
+			global->conn_idle_reclaim_time = i;
+		} else {
+			fprintf(stderr, "Invalid ConnIdleReclaimTime %s on line %d, use 0-3600\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("ConnIdleReclaimTime: %u\n", global->conn_idle_reclaim_time);
 #endif /* DEBUG_OPTS */
 	} else if (equal(name, "ExpiredConnCheckPeriod")) {
 		unsigned int i = atoi(value);
@@ -3177,6 +3605,179 @@ set_global_option(global_t *global, const char *argv0,
 		}
 #ifdef DEBUG_OPTS
 		log_dbg_printf("StatsPeriod: %u\n", global->stats_period);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "OutbufMemBudget")) {
+		unsigned int i = atoi(value);
+		if (i <= 65536) {
+			global->outbuf_mem_budget = i;
+		} else {
+			fprintf(stderr, "Invalid OutbufMemBudget %s on line %d, use 0-65536\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("OutbufMemBudget: %u\n", global->outbuf_mem_budget);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "DivertConnPool")) {
+		unsigned int i = atoi(value);
+		if (i <= 256) {
+			global->divert_conn_pool = i;
+		} else {
+			fprintf(stderr, "Invalid DivertConnPool %s on line %d, use 0-256\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("DivertConnPool: %u\n", global->divert_conn_pool);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "DNSCacheMaxTTL")) {
+		unsigned int i = atoi(value);
+		if (i <= 86400) {
+			global->dns_cache_max_ttl = i;
+		} else {
+			fprintf(stderr, "Invalid DNSCacheMaxTTL %s on line %d, use 0-86400\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("DNSCacheMaxTTL: %u\n", global->dns_cache_max_ttl);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "DNSNegativeTTL")) {
+		unsigned int i = atoi(value);
+		if (i <= 3600) {
+			global->dns_negative_ttl = i;
+		} else {
+			fprintf(stderr, "Invalid DNSNegativeTTL %s on line %d, use 0-3600\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("DNSNegativeTTL: %u\n", global->dns_negative_ttl);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "FilterListRefresh")) {
+		unsigned int i = atoi(value);
+		if (i <= 86400) {
+			global->filter_list_refresh = i;
+		} else {
+			fprintf(stderr, "Invalid FilterListRefresh %s on line %d, use 0-86400\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("FilterListRefresh: %u\n", global->filter_list_refresh);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "FilterBloomFPRate")) {
+		unsigned int i = atoi(value);
+		if (i <= 500) {
+			global->filter_bloom_fprate = i;
+		} else {
+			fprintf(stderr, "Invalid FilterBloomFPRate %s on line %d, use 0-500\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("FilterBloomFPRate: %u\n", global->filter_bloom_fprate);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "FilterDFAMaxSize")) {
+		unsigned int i = atoi(value);
+		if (i <= 1024) {
+			global->filter_dfa_max_size = i;
+		} else {
+			fprintf(stderr, "Invalid FilterDFAMaxSize %s on line %d, use 0-1024\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("FilterDFAMaxSize: %u\n", global->filter_dfa_max_size);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "VerifyCacheTTL")) {
+		unsigned int i = atoi(value);
+		if (i <= 86400) {
+			global->verify_cache_ttl = i;
+		} else {
+			fprintf(stderr, "Invalid VerifyCacheTTL %s on line %d, use 0-86400\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("VerifyCacheTTL: %u\n", global->verify_cache_ttl);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "HappyEyeballsDelay")) {
+		unsigned int i = atoi(value);
+		if (i <= 2000) {
+			global->happy_eyeballs_delay = i;
+		} else {
+			fprintf(stderr, "Invalid HappyEyeballsDelay %s on line %d, use 0-2000\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("HappyEyeballsDelay: %u\n", global->happy_eyeballs_delay);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "ConnectTimeout")) {
+		unsigned int i = atoi(value);
+		if (i >= 1 && i <= 300) {
+			global->connect_timeout = i;
+		} else {
+			fprintf(stderr, "Invalid ConnectTimeout %s on line %d, use 1-300\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("ConnectTimeout: %u\n", global->connect_timeout);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "SpeculativeConnect")) {
+		yes = check_value_yesno(value, "SpeculativeConnect", *line_num);
+		if (yes == -1)
+			return -1;
+		global->speculative_connect = yes;
+#ifdef DEBUG_OPTS
+		log_dbg_printf("SpeculativeConnect: %u\n", global->speculative_connect);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "ClientHelloMaxSize")) {
+		unsigned int i = atoi(value);
+		if (i >= 1024 && i <= 65536) {
+			global->clienthello_max_size = i;
+		} else {
+			fprintf(stderr, "Invalid ClientHelloMaxSize %s on line %d, use 1024-65536\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("ClientHelloMaxSize: %u\n", global->clienthello_max_size);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "PreForgeCertDir")) {
+		if (!sys_isdir(value)) {
+			fprintf(stderr, "%s: '%s' is not a directory\n", argv0, value);
+			return -1;
+		}
+		if (global->preforgecertdir)
+			free(global->preforgecertdir);
+		global->preforgecertdir = strdup(value);
+		if (!global->preforgecertdir)
+			return oom_return(argv0);
+#ifdef DEBUG_OPTS
+		log_dbg_printf("PreForgeCertDir: %s\n", global->preforgecertdir);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "PreForgeLearnFile")) {
+		if (global->preforgelearnfile)
+			free(global->preforgelearnfile);
+		global->preforgelearnfile = strdup(value);
+		if (!global->preforgelearnfile)
+			return oom_return(argv0);
+#ifdef DEBUG_OPTS
+		log_dbg_printf("PreForgeLearnFile: %s\n", global->preforgelearnfile);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "PreForgeLearnTopN")) {
+		unsigned int i = atoi(value);
+		if (i <= 10000) {
+			global->preforge_learn_topn = i;
+		} else {
+			fprintf(stderr, "Invalid PreForgeLearnTopN %s on line %d, use 0-10000\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("PreForgeLearnTopN: %u\n", global->preforge_learn_topn);
+#endif /* DEBUG_OPTS */
+	} else if (equal(name, "PreForgeRate")) {
+		unsigned int i = atoi(value);
+		if (i >= 1 && i <= 1000) {
+			global->preforge_rate = i;
+		} else {
+			fprintf(stderr, "Invalid PreForgeRate %s on line %d, use 1-1000\n", value, *line_num);
+			return -1;
+		}
+#ifdef DEBUG_OPTS
+		log_dbg_printf("PreForgeRate: %u\n", global->preforge_rate);
 #endif /* DEBUG_OPTS */
 	} else if (equal(name, "OpenFilesLimit")) {
 		return global_set_open_files_limit(value, *line_num);
@@ -3310,7 +3911,10 @@ global_load_conffile(global_t *global, const char *argv0, const char *optarg, ch
 {
 	if (global->conffile)
 		free(global->conffile);
-	global->conffile = strdup(optarg);
+	// Absolute path to reload the conf file from after daemon() chdirs to /
+	global->conffile = realpath(optarg, NULL);
+	if (!global->conffile)
+		global->conffile = strdup(optarg);
 	if (!global->conffile)
 		return oom_return(argv0);
 	int retval = opts_load_conffile(global, argv0, global->conffile, natengine, tmp_opts);
@@ -3319,4 +3923,304 @@ global_load_conffile(global_t *global, const char *argv0, const char *optarg, ch
 	return retval;
 }
 
+static int WUNRES
+global_add_cli_opt(global_t *global, const char *argv0, int ch, const char *optarg)
+{
+	cli_opt_t **p;
+
+	for (p = &global->cli_opts; *p; p = &(*p)->next);
+	*p = malloc(sizeof(cli_opt_t));
+	if (!*p)
+		return oom_return(argv0);
+	memset(*p, 0, sizeof(cli_opt_t));
+	(*p)->ch = ch;
+	if (optarg) {
+		(*p)->arg = strdup(optarg);
+		if (!(*p)->arg)
+			return oom_return(argv0);
+	}
+	return 0;
+}
+
+/*
+ * Set the command line option ch if it configures proxyspecs or filtering
+ * rules, and remember it to replay on filter reloads.
+ * Return 1 if ch is not such an option, 0 on success, -1 on error.
+ */
+int
+global_set_cli_option(global_t *global, const char *argv0, int ch, const char *optarg,
+		char **natengine, tmp_opts_t *tmp_opts)
+{
+	int rv = 0;
+
+	switch (ch) {
+		case 'f':
+			rv = global_load_conffile(global, argv0, optarg, natengine, tmp_opts);
+			optarg = global->conffile;
+			break;
+		case 'o':
+			rv = global_set_option(global, argv0, optarg, natengine, tmp_opts);
+			break;
+		case 'c':
+			rv = opts_set_cacrt(global->conn_opts, argv0, optarg, tmp_opts);
+			break;
+		case 'k':
+			rv = opts_set_cakey(global->conn_opts, argv0, optarg, tmp_opts);
+			break;
+		case 'C':
+			rv = opts_set_chain(global->conn_opts, argv0, optarg, tmp_opts);
+			break;
+		case 'q':
+			rv = opts_set_leafcrlurl(global->conn_opts, argv0, optarg, tmp_opts);
+			break;
+		case 'O':
+			opts_set_deny_ocsp(global->conn_opts);
+			break;
+		case 'P':
+			opts_set_passthrough(global->conn_opts);
+			break;
+		case 'a':
+			rv = opts_set_clientcrt(global->conn_opts, argv0, optarg, tmp_opts);
+			break;
+		case 'b':
+			rv = opts_set_clientkey(global->conn_opts, argv0, optarg, tmp_opts);
+			break;
+#ifndef OPENSSL_NO_DH
+		case 'g':
+			rv = opts_set_dh(global->conn_opts, argv0, optarg, tmp_opts);
+			break;
+#endif /* !OPENSSL_NO_DH */
+#ifndef OPENSSL_NO_ECDH
+		case 'G':
+			rv = opts_set_ecdhcurve(global->conn_opts, argv0, optarg);
+			break;
+#endif /* !OPENSSL_NO_ECDH */
+#ifdef SSL_OP_NO_COMPRESSION
+		case 'Z':
+			opts_unset_sslcomp(global->conn_opts);
+			break;
+#endif /* SSL_OP_NO_COMPRESSION */
+		case 's':
+			rv = opts_set_ciphers(global->conn_opts, argv0, optarg);
+			break;
+		case 'U':
+			rv = opts_set_ciphersuites(global->conn_opts, argv0, optarg);
+			break;
+		case 'r':
+			rv = opts_force_proto(global->conn_opts, argv0, optarg);
+			break;
+		case 'R':
+			rv = opts_disable_enable_proto(global->conn_opts, argv0, optarg, 1);
+			break;
+		case 'B':
+			rv = opts_disable_enable_proto(global->conn_opts, argv0, optarg, 0);
+			break;
+		case 'e':
+			if (*natengine)
+				free(*natengine);
+			*natengine = strdup(optarg);
+			if (!*natengine)
+				return oom_return(argv0);
+			break;
+		case 'n':
+			opts_unset_divert(global->opts);
+			tmp_opts->split = 1;
+			break;
+		default:
+			return 1;
+	}
+	if (rv == -1 || tmp_opts->reload)
+		return rv;
+	return global_add_cli_opt(global, argv0, ch, optarg);
+}
+
+/*
+ * Parse the proxyspecs given on the command line, and remember them to
+ * replay on filter reloads.
+ */
+int
+global_set_cli_proxyspecs(global_t *global, const char *argv0, int argc, char **argv,
+		const char *natengine, tmp_opts_t *tmp_opts)
+{
+	if (!tmp_opts->reload && argc) {
+		global->cli_specv = malloc(argc * sizeof(char *));
+		if (!global->cli_specv)
+			return oom_return(argv0);
+		for (global->cli_specc = 0; global->cli_specc < argc; global->cli_specc++) {
+			global->cli_specv[global->cli_specc] = strdup(argv[global->cli_specc]);
+			if (!global->cli_specv[global->cli_specc])
+				return oom_return(argv0);
+		}
+	}
+	return proxyspec_parse(&argc, &argv, natengine, global, argv0, tmp_opts);
+}
+
+/*
+ * Return 1 if the proxyspecs listen on the same address for the same
+ * protocol, 0 otherwise.
+ */
+static int NONNULL(1,2)
+proxyspec_same_listener(proxyspec_t *spec1, proxyspec_t *spec2)
+{
+	return spec1->listen_addrlen == spec2->listen_addrlen &&
+	       !memcmp(&spec1->listen_addr, &spec2->listen_addr, spec1->listen_addrlen) &&
+	       spec1->ssl == spec2->ssl &&
+	       spec1->http == spec2->http &&
+	       spec1->upgrade == spec2->upgrade &&
+	       spec1->pop3 == spec2->pop3 &&
+	       spec1->smtp == spec2->smtp;
+}
+
+/*
+ * Load the filtering rules of proxyspecs by replaying the command line
+ * options, the conf file, and the command line proxyspecs into a new global.
+ * Only filtering rules and the conn opts they inherit are reloaded, global
+ * options are skipped, and key files are not read again if already loaded.
+ * Does not touch the running filters, so may run in a thread other than
+ * the main thread, as long as the proxyspecs of global do not change.
+ * Returns the filters of the proxyspecs in the order of global->spec, or
+ * NULL on error, or if the proxyspecs have changed.
+ */
+filter_t **
+global_load_filters(global_t *global, const char *argv0)
+{
+	global_t *reload;
+	tmp_opts_t *tmp_opts = NULL;
+	char *natengine = NULL;
+	filter_t **filters = NULL;
+	proxyspec_t *spec, *rspec;
+	int count = 0, set = 0;
+	int rv = -1;
+
+	reload = global_new();
+	if (!reload)
+		return NULL;
+
+	tmp_opts = malloc(sizeof(tmp_opts_t));
+	if (!tmp_opts) {
+		rv = oom_return(argv0);
+		goto out;
+	}
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+	tmp_opts->reload = 1;
+
+	if (nat_getdefaultname()) {
+		natengine = strdup(nat_getdefaultname());
+		if (!natengine) {
+			rv = oom_return(argv0);
+			goto out;
+		}
+	}
+
+	for (cli_opt_t *cli_opt = global->cli_opts; cli_opt; cli_opt = cli_opt->next) {
+		if (global_set_cli_option(reload, argv0, cli_opt->ch, cli_opt->arg, &natengine, tmp_opts) == -1)
+			goto out;
+	}
+	if (global_set_cli_proxyspecs(reload, argv0, global->cli_specc, global->cli_specv, natengine, tmp_opts) == -1)
+		goto out;
+
+	for (spec = global->spec, rspec = reload->spec; spec && rspec; spec = spec->next, rspec = rspec->next) {
+		if (!proxyspec_same_listener(spec, rspec))
+			break;
+		count++;
+	}
+	if (spec || rspec) {
+		fprintf(stderr, "%s: ProxySpecs have changed, restart to apply\n", argv0);
+		goto out;
+	}
+
+	for (rspec = reload->spec; rspec; rspec = rspec->next) {
+		if (proxyspec_check_ssl(rspec, argv0) == -1)
+			goto out;
+		if (proxyspec_set_dflt_ciphers(rspec) == -1) {
+			rv = oom_return(argv0);
+			goto out;
+		}
+	}
+
+	filters = malloc(count * sizeof(filter_t *));
+	if (!filters) {
+		rv = oom_return(argv0);
+		goto out;
+	}
+
+	for (rspec = reload->spec; rspec; rspec = rspec->next) {
+		filters[set] = NULL;
+		if (rspec->opts->filter_rules) {
+			filters[set] = filter_set(rspec->opts->filter_rules, argv0, tmp_opts);
+			if (!filters[set])
+				goto out;
+		}
+		set++;
+	}
+	rv = 0;
+out:
+	if (rv == -1 && filters) {
+		while (set > 0) {
+			filter_release(filters[--set]);
+		}
+		free(filters);
+		filters = NULL;
+	}
+	for (rspec = reload->spec; rspec; rspec = rspec->next) {
+		filter_macro_free(rspec->opts);
+		filter_rules_free(rspec->opts);
+	}
+	filter_macro_free(reload->opts);
+	filter_rules_free(reload->opts);
+	global_free(reload);
+	if (tmp_opts)
+		tmp_opts_free(tmp_opts);
+	if (natengine)
+		free(natengine);
+	return filters;
+}
+
+/*
+ * Replace the filters of proxyspecs with the filters loaded by
+ * global_load_filters(), and free the filters array.
+ * Conns keep using the filter they have started with, see filter_acquire().
+ */
+void
+global_publish_filters(global_t *global, filter_t **filters)
+{
+	int set = 0;
+
+	for (proxyspec_t *spec = global->spec; spec; spec = spec->next) {
+		filter_publish(spec->opts, filters[set++]);
+	}
+	free(filters);
+}
+
+/*
+ * Free the filters loaded by global_load_filters() without publishing them.
+ */
+void
+global_filters_free(global_t *global, filter_t **filters)
+{
+	int set = 0;
+
+	for (proxyspec_t *spec = global->spec; spec; spec = spec->next) {
+		filter_release(filters[set++]);
+	}
+	free(filters);
+}
+
+/*
+ * Reload the filtering rules of proxyspecs, see global_load_filters().
+ * The filters of the running proxyspecs are replaced only if the filters
+ * of all of them can be set.
+ * Proxyspecs cannot change, and all other options take effect on restart only.
+ * Return 0 on success, -1 on error, leaving the running filters untouched.
+ */
+int
+global_reload_filters(global_t *global, const char *argv0)
+{
+	filter_t **filters = global_load_filters(global, argv0);
+	if (!filters)
+		return -1;
+	global_publish_filters(global, filters);
+	return 0;
+}
+
 /* vim: set noet ft=c: */
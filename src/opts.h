@@ -49,6 +49,9 @@
 #define STRORNONE(x)	(((x)&&*(x))?(x):"")
 #define NLORNONE(x)		(((x)&&*(x))?"\n":"")
 
+// Max length of the .pid.fd suffix of child listener paths with unix ReturnAddr
+#define RETURN_ADDR_UNIX_SUFFIX_LEN 22
+
 #define FILTER_ACTION_NONE   0x00000000U
 #define FILTER_ACTION_MATCH  0x00000200U
 #define FILTER_ACTION_DIVERT 0x00000400U
@@ -136,6 +139,14 @@ typedef struct conn_opts {
 	// Used with struct filtering rules only
 	unsigned int reconnect_ssl : 1;
 	unsigned int max_http_header_size;
+	// Max size of data to buffer per conn direction before pausing reads
+	unsigned int outbuf_limit;
+	// Set to 1 to size outbuf limits using TCP_INFO
+	unsigned int adaptive_outbuf_limit : 1;
+	// Set to 1 to let OpenSSL offload the record layer to kernel TLS
+	unsigned int ktls : 1;
+	// Set to 1 to write small TLS records to the client at conn start and after idle periods
+	unsigned int dynamic_record_sizing : 1;
 } conn_opts_t;
 
 typedef struct opts {
@@ -152,6 +163,8 @@ typedef struct opts {
 	// Freed during startup after the filter is created and debug printed
 	struct macro *macro;
 	struct filter_rule *filter_rules;
+	// Last rule, so that large rule sets are not walked on every append
+	struct filter_rule *filter_rules_tail;
 
 	struct filter *filter;
 	global_t *global;
@@ -204,11 +217,20 @@ typedef struct tmp_opts {
 	unsigned int split : 1;
 	// Prevents Include option in include files
 	unsigned int include : 1;
+	// Reloading filtering rules, global options are skipped
+	unsigned int reload : 1;
 #ifdef DEBUG_PROXY
 	unsigned int line_num;
 #endif /* DEBUG_PROXY */
 } tmp_opts_t;
 
+// Command line option replayed on filter reloads
+typedef struct cli_opt {
+	int ch;
+	char *arg;
+	struct cli_opt *next;
+} cli_opt_t;
+
 struct global {
 	unsigned int debug : 1;
 	unsigned int detach : 1;
@@ -227,6 +249,10 @@ struct global {
 	char *jaildir;
 	char *pidfile;
 	char *conffile;
+	// Command line options and proxyspecs which configure filtering rules
+	cli_opt_t *cli_opts;
+	char **cli_specv;
+	int cli_specc;
 	char *connectlog;
 	char *contentlog;
 	char *contentlog_basedir; /* static part of logspec for privsep srv */
@@ -238,10 +264,44 @@ struct global {
 	char *mirrortarget;
 #endif /* !WITHOUT_MIRROR */
 	unsigned int conn_idle_timeout;
+	// Reclaim evbuffer memory of conns idle this many seconds, 0 to disable
+	unsigned int conn_idle_reclaim_time;
 	unsigned int expired_conn_check_period;
 	unsigned int stats_period;
+	// Total memory in MiB for adaptive outbuf limits, 0 for unlimited
+	unsigned int outbuf_mem_budget;
+	// Number of pre-established divert conns per thread and proxyspec, 0 to disable
+	unsigned int divert_conn_pool;
+	// Cap on the TTL of cached SNI lookups in seconds, 0 to disable caching
+	unsigned int dns_cache_max_ttl;
+	// How long failed SNI lookups are cached in seconds, 0 to disable
+	unsigned int dns_negative_ttl;
+	// Period in seconds to check filter list files for changes, 0 to disable
+	unsigned int filter_list_refresh;
+	// False positive rate of the Bloom filters of site lookups in per mille, 0 to disable
+	unsigned int filter_bloom_fprate;
+	// Maximum size of the DFA of each filter substring matcher in MiB, 0 to disable
+	unsigned int filter_dfa_max_size;
+	// How long upstream cert verification results are cached in seconds, 0 to disable
+	unsigned int verify_cache_ttl;
+	// Delay in msec between connect attempts to the addresses of an SNI host
+	unsigned int happy_eyeballs_delay;
+	// Timeout in seconds of all connect attempts to the addresses of an SNI host
+	unsigned int connect_timeout;
+	// Max size of ClientHello messages reassembled to parse the SNI
+	unsigned int clienthello_max_size;
+	// Dir of original server certs to forge fake certs for in advance
+	char *preforgecertdir;
+	// File to persist the original certs of the most used fake certs in
+	char *preforgelearnfile;
+	// Number of most used fake certs to learn and pre-forge
+	unsigned int preforge_learn_topn;
+	// Max number of certs pre-forged per second
+	unsigned int preforge_rate;
 	unsigned int statslog: 1;
 	unsigned int log_stats: 1;
+	// Connect to known destinations of SSL conns while peeking the ClientHello
+	unsigned int speculative_connect: 1;
 #ifndef WITHOUT_USERAUTH
 	char *userdb_path;
 	sqlite3 *userdb;
@@ -290,11 +350,14 @@ int proxyspec_parse(int *, char **[], const char *, global_t *, const char *, tm
 
 char *conn_opts_str(conn_opts_t *);
 char *proxyspec_str(proxyspec_t *) NONNULL(1) MALLOC;
+int proxyspec_check_ssl(proxyspec_t *, const char *) NONNULL(1,2) WUNRES;
+int proxyspec_set_dflt_ciphers(proxyspec_t *) NONNULL(1) WUNRES;
 
 conn_opts_t *conn_opts_new(void) MALLOC;
 opts_t *opts_new(void) MALLOC;
 void opts_free(opts_t *) NONNULL(1);
 void conn_opts_free(conn_opts_t *);
+int conn_opts_set_dflt_ciphers(conn_opts_t *) NONNULL(1) WUNRES;
 tmp_opts_t *tmp_opts_copy(tmp_opts_t *) NONNULL(1) MALLOC;
 conn_opts_t *conn_opts_copy(conn_opts_t *, const char *, tmp_opts_t *) WUNRES;
 int opts_set_cacrt(conn_opts_t *, const char *, const char *, tmp_opts_t *) NONNULL(1,2,3) WUNRES;
@@ -364,6 +427,13 @@ int global_set_certgendir_writeall(global_t *, const char *, const char *) NONNU
 int global_set_certgendir_writegencerts(global_t *, const char *, const char *) NONNULL(1,2,3) WUNRES;
 int global_set_openssl_engine(global_t *, const char *, const char *) NONNULL(1,2,3) WUNRES;
 int global_load_conffile(global_t *, const char *, const char *, char **, tmp_opts_t *) NONNULL(1,2,4) WUNRES;
+int global_set_cli_option(global_t *, const char *, int, const char *, char **, tmp_opts_t *) NONNULL(1,2,5,6) WUNRES;
+int global_set_cli_proxyspecs(global_t *, const char *, int, char **, const char *, tmp_opts_t *) NONNULL(1,2,6) WUNRES;
+struct filter **global_load_filters(global_t *, const char *) NONNULL(1,2) WUNRES;
+void global_publish_filters(global_t *, struct filter **) NONNULL(1,2);
+void global_filters_free(global_t *, struct filter **) NONNULL(1,2);
+int global_reload_filters(global_t *, const char *) NONNULL(1,2) WUNRES;
+void opts_keymat_free(void);
 #endif /* !OPTS_H */
 
 /* vim: set noet ft=c: */
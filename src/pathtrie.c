@@ -0,0 +1,482 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pathtrie.h"
+
+#include <string.h>
+#include <stdint.h>
+
+/*
+ * Segment trie for filtering rules on URL paths.
+ *
+ * The root node stands for the path /, and the children of a node are the
+ * segments one level below it.  Literal segments are kept sorted for binary
+ * search, segments with globs are kept in the order they were added.  A
+ * lookup walks the segments of the path from left to right, trying the
+ * literal child before the glob children at each level, so it visits each
+ * node of the trie at most once, and at most one node per segment of the
+ * path if there are no globs.
+ *
+ * Paths are normalized before matching: the query and fragment are dropped,
+ * percent-encoded characters are decoded except for / and NUL, empty and .
+ * segments are skipped, and .. segments remove the segment before them, so
+ * that /admin cannot be reached through /public/../admin or /%61dmin.
+ */
+
+struct pathtrie_node {
+	char *label;
+	size_t len;
+	unsigned int glob : 1;
+	unsigned int has_value : 1;
+	unsigned int has_prefix : 1;
+	void *value;
+	void *prefix;
+	size_t nb_children;
+	size_t size_children;
+	struct pathtrie_node **children;
+	size_t nb_globs;
+	size_t size_globs;
+	struct pathtrie_node **globs;
+};
+
+typedef struct pathtrie_path {
+	const char *seg[PATHTRIE_MAX_SEGMENTS];
+	size_t len[PATHTRIE_MAX_SEGMENTS];
+	size_t nb;
+	unsigned int truncated : 1;
+} pathtrie_path_t;
+
+typedef struct pathtrie_result {
+	const pathtrie_node_t *value;
+	const pathtrie_node_t *prefix;
+	size_t depth;
+} pathtrie_result_t;
+
+/*
+ * Moves to the segment starting at *p, skipping the / before it, and returns
+ * its length.  Returns 0 if there is no segment left, or if the segment is
+ * empty, in which case *p points to the following / or to the end.
+ */
+static size_t
+pathtrie_next_seg(const char **p, const char **seg)
+{
+	const char *s = *p;
+
+	if (*s == '/')
+		s++;
+	*seg = s;
+	while (*s && *s != '/')
+		s++;
+	*p = s;
+	return s - *seg;
+}
+
+static int
+pathtrie_is_dot(const char *seg, size_t len)
+{
+	if (len == 1 && seg[0] == '.')
+		return 1;
+	if (len == 2 && seg[0] == '.' && seg[1] == '.')
+		return 2;
+	return 0;
+}
+
+/*
+ * Check that pattern is an absolute path of at most PATHTRIE_MAX_SEGMENTS
+ * nonempty segments, optionally followed by a single trailing /.  Patterns
+ * cannot have a query or fragment, or . and .. segments.
+ */
+int
+pathtrie_pattern_check(const char *pattern)
+{
+	const char *p = pattern;
+	const char *seg;
+	size_t len, nb = 0;
+
+	if (*p != '/')
+		return -1;
+	while (*p && p[1]) {
+		if (!(len = pathtrie_next_seg(&p, &seg)))
+			return -1;
+		if (pathtrie_is_dot(seg, len))
+			return -1;
+		if (memchr(seg, '?', len) || memchr(seg, '#', len))
+			return -1;
+		if (++nb > PATHTRIE_MAX_SEGMENTS)
+			return -1;
+	}
+	return 0;
+}
+
+static int
+pathtrie_label_cmp(const char *label, size_t len, const pathtrie_node_t *node)
+{
+	int rv = memcmp(label, node->label, len < node->len ? len : node->len);
+	if (rv)
+		return rv;
+	return (len > node->len) - (len < node->len);
+}
+
+/*
+ * Binary search for the literal child of node with label.  Returns the
+ * child, or NULL setting *pos to the index where it should be inserted.
+ */
+static pathtrie_node_t *
+pathtrie_child_find(const pathtrie_node_t *node, const char *label, size_t len, size_t *pos)
+{
+	size_t lo = 0, hi = node->nb_children;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int rv = pathtrie_label_cmp(label, len, node->children[mid]);
+		if (!rv)
+			return node->children[mid];
+		if (rv < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if (pos)
+		*pos = lo;
+	return NULL;
+}
+
+static pathtrie_node_t *
+pathtrie_glob_find(const pathtrie_node_t *node, const char *label, size_t len)
+{
+	for (size_t i = 0; i < node->nb_globs; i++) {
+		if (!pathtrie_label_cmp(label, len, node->globs[i]))
+			return node->globs[i];
+	}
+	return NULL;
+}
+
+static pathtrie_node_t *
+pathtrie_child_add(pathtrie_node_t *node, const char *label, size_t len, int glob, size_t pos)
+{
+	pathtrie_node_t ***children = glob ? &node->globs : &node->children;
+	size_t *nb = glob ? &node->nb_globs : &node->nb_children;
+	size_t *size = glob ? &node->size_globs : &node->size_children;
+
+	if (*nb == *size) {
+		size_t new_size = *size ? *size * 2 : 4;
+		pathtrie_node_t **new_children = realloc(*children, new_size * sizeof(pathtrie_node_t *));
+		if (!new_children)
+			return NULL;
+		*children = new_children;
+		*size = new_size;
+	}
+
+	pathtrie_node_t *child = malloc(sizeof(pathtrie_node_t));
+	if (!child)
+		return NULL;
+	memset(child, 0, sizeof(pathtrie_node_t));
+	child->label = strndup(label, len);
+	if (!child->label) {
+		free(child);
+		return NULL;
+	}
+	child->len = len;
+	child->glob = glob;
+
+	// Glob children are tried in the order they were added
+	if (glob)
+		pos = *nb;
+	memmove(&(*children)[pos + 1], &(*children)[pos], (*nb - pos) * sizeof(pathtrie_node_t *));
+	(*children)[pos] = child;
+	(*nb)++;
+	return child;
+}
+
+static void
+pathtrie_node_free(pathtrie_node_t *node, void (*free_value)(void *))
+{
+	for (size_t i = 0; i < node->nb_children; i++)
+		pathtrie_node_free(node->children[i], free_value);
+	for (size_t i = 0; i < node->nb_globs; i++)
+		pathtrie_node_free(node->globs[i], free_value);
+	if (node->has_value && free_value)
+		free_value(node->value);
+	if (node->has_prefix && free_value)
+		free_value(node->prefix);
+	free(node->children);
+	free(node->globs);
+	free(node->label);
+	free(node);
+}
+
+pathtrie_t *
+pathtrie_new(void)
+{
+	pathtrie_t *trie = malloc(sizeof(pathtrie_t));
+	if (!trie)
+		return NULL;
+	memset(trie, 0, sizeof(pathtrie_t));
+
+	trie->root = malloc(sizeof(pathtrie_node_t));
+	if (!trie->root) {
+		free(trie);
+		return NULL;
+	}
+	memset(trie->root, 0, sizeof(pathtrie_node_t));
+	return trie;
+}
+
+void
+pathtrie_free(pathtrie_t *trie, void (*free_value)(void *))
+{
+	pathtrie_node_free(trie->root, free_value);
+	free(trie);
+}
+
+/*
+ * Returns the value slot for pattern, inserting pattern if it is not in the
+ * trie yet, in which case *created is set to 1 and the slot is NULL.
+ * A pattern and the same pattern with a trailing / have separate slots.
+ * Pattern should be checked with pathtrie_pattern_check() first.
+ * Returns NULL on out of memory.
+ */
+void **
+pathtrie_put(pathtrie_t *trie, const char *pattern, int *created)
+{
+	pathtrie_node_t *node = trie->root;
+	const char *p = pattern;
+	const char *seg;
+	size_t len, pos = 0;
+
+	while ((len = pathtrie_next_seg(&p, &seg))) {
+		int glob = memchr(seg, '*', len) != NULL;
+		pathtrie_node_t *child = glob ? pathtrie_glob_find(node, seg, len) : pathtrie_child_find(node, seg, len, &pos);
+		if (!child && !(child = pathtrie_child_add(node, seg, len, glob, pos)))
+			return NULL;
+		node = child;
+	}
+
+	if (pattern[strlen(pattern) - 1] == '/') {
+		*created = !node->has_prefix;
+		node->has_prefix = 1;
+		if (*created)
+			trie->count++;
+		return &node->prefix;
+	}
+	*created = !node->has_value;
+	node->has_value = 1;
+	if (*created)
+		trie->count++;
+	return &node->value;
+}
+
+static int
+pathtrie_hex(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/*
+ * Copies len chars of path to buf decoding percent-encoded chars, except for
+ * the ones decoding to / or NUL, which are kept encoded.
+ */
+static void
+pathtrie_path_decode(char *buf, const char *path, size_t len)
+{
+	size_t i = 0;
+
+	while (i < len) {
+		int hi, lo;
+		if (path[i] == '%' && i + 2 < len && (hi = pathtrie_hex(path[i + 1])) != -1 && (lo = pathtrie_hex(path[i + 2])) != -1) {
+			char c = (char)(hi << 4 | lo);
+			if (c != '/' && c != '\0') {
+				*buf++ = c;
+				i += 3;
+				continue;
+			}
+		}
+		*buf++ = path[i++];
+	}
+	*buf = '\0';
+}
+
+/*
+ * Splits the normalized path into its segments.  Segments deeper than
+ * PATHTRIE_MAX_SEGMENTS are dropped, and the path is marked truncated if any
+ * remain after removing the .. segments.
+ */
+static void
+pathtrie_path_split(pathtrie_path_t *path, const char *p)
+{
+	const char *seg;
+	size_t len, depth = 0;
+
+	while (*p) {
+		if (!(len = pathtrie_next_seg(&p, &seg)))
+			continue;
+		switch (pathtrie_is_dot(seg, len)) {
+		case 1:
+			break;
+		case 2:
+			if (depth)
+				depth--;
+			break;
+		default:
+			if (depth < PATHTRIE_MAX_SEGMENTS) {
+				path->seg[depth] = seg;
+				path->len[depth] = len;
+			}
+			depth++;
+			break;
+		}
+	}
+	path->truncated = depth > PATHTRIE_MAX_SEGMENTS;
+	path->nb = path->truncated ? PATHTRIE_MAX_SEGMENTS : depth;
+}
+
+/*
+ * Matches label with a * in it against seg.  The * matches any run of chars,
+ * which cannot contain / since seg is a single segment.
+ */
+static int
+pathtrie_glob_match(const char *glob, size_t glen, const char *seg, size_t len)
+{
+	size_t g = 0, i = 0;
+	size_t star = SIZE_MAX, mark = 0;
+
+	while (i < len) {
+		if (g < glen && glob[g] == '*') {
+			star = g++;
+			mark = i;
+		} else if (g < glen && glob[g] == seg[i]) {
+			g++;
+			i++;
+		} else if (star != SIZE_MAX) {
+			g = star + 1;
+			i = ++mark;
+		} else {
+			return 0;
+		}
+	}
+	while (g < glen && glob[g] == '*')
+		g++;
+	return g == glen;
+}
+
+/*
+ * Depth first search for the pattern matching the whole path, recording the
+ * deepest prefix pattern seen on the way.  Returns 1 if a whole path match is
+ * found, which ends the search.
+ */
+static int
+pathtrie_node_match(const pathtrie_node_t *node, const pathtrie_path_t *path, size_t depth, pathtrie_result_t *res)
+{
+	if (node->has_prefix && (!res->prefix || depth > res->depth)) {
+		res->prefix = node;
+		res->depth = depth;
+	}
+	if (depth == path->nb) {
+		if (node->has_value && !path->truncated) {
+			res->value = node;
+			return 1;
+		}
+		return 0;
+	}
+
+	const char *seg = path->seg[depth];
+	size_t len = path->len[depth];
+
+	pathtrie_node_t *child = pathtrie_child_find(node, seg, len, NULL);
+	if (child && pathtrie_node_match(child, path, depth + 1, res))
+		return 1;
+	for (size_t i = 0; i < node->nb_globs; i++) {
+		child = node->globs[i];
+		if (pathtrie_glob_match(child->label, child->len, seg, len) && pathtrie_node_match(child, path, depth + 1, res))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Returns the value of the pattern matching the whole path, or if there is
+ * none, the value of the longest prefix pattern matching the path, or NULL.
+ * Literal segments are preferred over globs.  Path is a request path, which
+ * may carry a query and percent-encoded chars.
+ */
+void *
+pathtrie_match(const pathtrie_t *trie, const char *path)
+{
+	char buf[1024];
+	char *p = buf;
+	size_t len = strcspn(path, "?#");
+
+	if (len >= sizeof(buf) && !(p = malloc(len + 1)))
+		return NULL;
+	pathtrie_path_decode(p, path, len);
+
+	pathtrie_path_t segs;
+	pathtrie_path_split(&segs, p);
+
+	pathtrie_result_t res;
+	memset(&res, 0, sizeof(pathtrie_result_t));
+	pathtrie_node_match(trie->root, &segs, 0, &res);
+
+	if (p != buf)
+		free(p);
+
+	if (res.value)
+		return res.value->value;
+	return res.prefix ? res.prefix->prefix : NULL;
+}
+
+static void
+pathtrie_node_foreach(const pathtrie_node_t *node, void (*cb)(void *, void *), void *arg)
+{
+	if (node->has_prefix)
+		cb(node->prefix, arg);
+	if (node->has_value)
+		cb(node->value, arg);
+	for (size_t i = 0; i < node->nb_children; i++)
+		pathtrie_node_foreach(node->children[i], cb, arg);
+	for (size_t i = 0; i < node->nb_globs; i++)
+		pathtrie_node_foreach(node->globs[i], cb, arg);
+}
+
+/*
+ * Calls cb for the value of each pattern in the trie, prefix patterns before
+ * the patterns below them, literal segments in order before globs.
+ */
+void
+pathtrie_foreach(const pathtrie_t *trie, void (*cb)(void *, void *), void *arg)
+{
+	pathtrie_node_foreach(trie->root, cb, arg);
+}
+
+/* vim: set noet ft=c: */
@@ -0,0 +1,64 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PATHTRIE_H
+#define PATHTRIE_H
+
+#include "attrib.h"
+
+#include <stdlib.h>
+
+#define PATHTRIE_MAX_SEGMENTS 64
+
+typedef struct pathtrie_node pathtrie_node_t;
+
+/*
+ * Trie of URL path patterns keyed on their '/' separated segments, mapping
+ * patterns to values.  A pattern matches whole paths, or with a trailing '/'
+ * the path itself and all paths below it, so /admin/ matches /admin and
+ * /admin/users, but not /administrator.  A '*' in a segment matches any
+ * characters but '/', so a v* segment matches v1 and v2 in /api/v1/upload and
+ * /api/v2/upload.  Segments are compared case sensitively.
+ */
+typedef struct pathtrie {
+	pathtrie_node_t *root;
+	size_t count;
+} pathtrie_t;
+
+int pathtrie_pattern_check(const char *) NONNULL(1) WUNRES;
+
+pathtrie_t *pathtrie_new(void) MALLOC;
+void pathtrie_free(pathtrie_t *, void (*)(void *)) NONNULL(1);
+
+void **pathtrie_put(pathtrie_t *, const char *, int *) NONNULL(1,2,3) WUNRES;
+void *pathtrie_match(const pathtrie_t *, const char *) NONNULL(1,2) WUNRES;
+void pathtrie_foreach(const pathtrie_t *, void (*)(void *, void *), void *) NONNULL(1,2);
+
+#endif /* !PATHTRIE_H */
+
+/* vim: set noet ft=c: */
@@ -0,0 +1,463 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "preforge.h"
+
+#include "cachemgr.h"
+#include "ssl.h"
+#include "sys.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <openssl/pem.h>
+#include <openssl/err.h>
+
+/*
+ * Pre-forging of fake certificates.
+ *
+ * A background thread forges fake certs for a list of original server certs
+ * into the fake cert cache, so that the first connections to popular sites
+ * after a restart do not pay the forging latency.  The list consists of the
+ * certs in PreForgeCertDir and of the original certs of the fake certs with
+ * the most cache hits, which are learned at runtime and persisted in
+ * PreForgeLearnFile.  The thread forges at most PreForgeRate certs per second
+ * and repeats every PREFORGE_INTERVAL seconds, which re-forges the certs
+ * removed from the cache after expiry.
+ */
+
+#define PREFORGE_INTERVAL 300
+
+typedef struct preforge_list {
+	X509 **crts;
+	size_t cnt;
+	size_t cap;
+} preforge_list_t;
+
+static preforge_list_t certs;
+static preforge_list_t learned;
+
+static X509 *cacrt;
+static EVP_PKEY *cakey;
+static EVP_PKEY *leafkey;
+static char *crlurl;
+
+static int learnfd = -1;
+static unsigned int learn_topn;
+static unsigned int rate;
+
+static pthread_t thr;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int running;
+static int stopping;
+
+static int WUNRES NONNULL(1,2)
+preforge_list_add(preforge_list_t *list, X509 *crt)
+{
+	if (list->cnt == list->cap) {
+		size_t cap = list->cap ? list->cap * 2 : 64;
+		X509 **crts = realloc(list->crts, cap * sizeof(X509 *));
+		if (!crts)
+			return -1;
+		list->crts = crts;
+		list->cap = cap;
+	}
+	list->crts[list->cnt++] = crt;
+	return 0;
+}
+
+static int NONNULL(1,2)
+preforge_list_has(preforge_list_t *list, X509 *crt)
+{
+	for (size_t i = 0; i < list->cnt; i++) {
+		if (!X509_cmp(list->crts[i], crt))
+			return 1;
+	}
+	return 0;
+}
+
+static void NONNULL(1)
+preforge_list_free(preforge_list_t *list)
+{
+	for (size_t i = 0; i < list->cnt; i++) {
+		X509_free(list->crts[i]);
+	}
+	free(list->crts);
+	memset(list, 0, sizeof(preforge_list_t));
+}
+
+/*
+ * Callback to load an original server cert for PreForgeCertDir.
+ * Files which do not contain a cert are skipped.
+ */
+static int
+preforge_load_cert(const char *filename, UNUSED void *arg)
+{
+	X509 *crt;
+
+	if (!(crt = ssl_x509_load(filename))) {
+		log_err_level_printf(LOG_WARNING, "Failed to load cert to pre-forge "
+		                     "from '%s', skipping\n", filename);
+		return 0;
+	}
+	if (preforge_list_has(&certs, crt)) {
+		X509_free(crt);
+		return 0;
+	}
+	if (preforge_list_add(&certs, crt) == -1) {
+		X509_free(crt);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Load the learned certs from the learn file, at most learn_topn of them.
+ */
+static int
+preforge_load_learned(void)
+{
+	BIO *bio;
+	X509 *crt;
+
+	if (!(bio = BIO_new_fd(learnfd, BIO_NOCLOSE)))
+		return -1;
+	while (learned.cnt < learn_topn &&
+	       (crt = PEM_read_bio_X509(bio, NULL, NULL, NULL))) {
+		if (preforge_list_has(&certs, crt) ||
+		    preforge_list_has(&learned, crt) ||
+		    preforge_list_add(&learned, crt) == -1) {
+			X509_free(crt);
+		}
+	}
+	/* reading stops with an error at end of file */
+	ERR_clear_error();
+	BIO_free(bio);
+	return 0;
+}
+
+/*
+ * Rewrite the learn file with the currently learned certs.
+ */
+static int
+preforge_save_learned(void)
+{
+	BIO *bio;
+	int rv = 0;
+
+	if (lseek(learnfd, 0, SEEK_SET) == -1 || ftruncate(learnfd, 0) == -1)
+		return -1;
+	if (!(bio = BIO_new_fd(learnfd, BIO_NOCLOSE)))
+		return -1;
+	for (size_t i = 0; i < learned.cnt; i++) {
+		if (!PEM_write_bio_X509(bio, learned.crts[i])) {
+			rv = -1;
+			break;
+		}
+	}
+	BIO_free(bio);
+	return rv;
+}
+
+/*
+ * Replace the learned certs with the original certs of the most used fake
+ * certs in the cache, topped up with the previously learned certs, and
+ * persist them.
+ */
+static void
+preforge_learn(void)
+{
+	preforge_list_t top;
+	ssize_t n;
+
+	memset(&top, 0, sizeof(preforge_list_t));
+	if (!(top.crts = malloc(learn_topn * sizeof(X509 *))))
+		goto err;
+	top.cap = learn_topn;
+
+	if ((n = cachefkcrt_topn(cachemgr_fkcrt, top.crts, learn_topn)) == -1)
+		goto err;
+	for (ssize_t i = 0; i < n; i++) {
+		/* the cache may hold certs of both the list and the learn file */
+		if (preforge_list_has(&certs, top.crts[i]) ||
+		    preforge_list_has(&top, top.crts[i])) {
+			X509_free(top.crts[i]);
+			continue;
+		}
+		top.crts[top.cnt++] = top.crts[i];
+	}
+	for (size_t i = 0; i < learned.cnt && top.cnt < learn_topn; i++) {
+		if (!preforge_list_has(&top, learned.crts[i])) {
+			ssl_x509_refcount_inc(learned.crts[i]);
+			top.crts[top.cnt++] = learned.crts[i];
+		}
+	}
+	preforge_list_free(&learned);
+	learned = top;
+
+	if (preforge_save_learned() == -1) {
+		log_err_level_printf(LOG_WARNING, "Failed to write pre-forge learn "
+		                     "file: %s (%i)\n", strerror(errno), errno);
+	}
+	return;
+err:
+	preforge_list_free(&top);
+	log_err_level_printf(LOG_WARNING, "Failed to learn certs to pre-forge\n");
+}
+
+/*
+ * Wait for sec seconds and nsec nanoseconds, or until preforge_fini() stops
+ * the thread.  Returns 1 if stopping, 0 otherwise.
+ */
+static int
+preforge_wait(time_t sec, long nsec)
+{
+	struct timespec ts;
+	int rv;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += sec;
+	ts.tv_nsec += nsec;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&mutex);
+	while (!stopping) {
+		if (pthread_cond_timedwait(&cond, &mutex, &ts) == ETIMEDOUT)
+			break;
+	}
+	rv = stopping;
+	pthread_mutex_unlock(&mutex);
+	return rv;
+}
+
+/*
+ * Forge the certs in list which are not in the cache.
+ * Returns 1 if stopping, 0 otherwise.
+ */
+static int
+preforge_list_forge(preforge_list_t *list, size_t *forged)
+{
+	X509 *crt;
+
+	for (size_t i = 0; i < list->cnt; i++) {
+		if (cachemgr_fkcrt_has(list->crts[i]))
+			continue;
+
+		crt = ssl_x509_forge(cacrt, cakey, list->crts[i], leafkey,
+		                     NULL, crlurl);
+		if (!crt) {
+			log_err_level_printf(LOG_WARNING, "Failed to pre-forge cert\n");
+			continue;
+		}
+		cachemgr_fkcrt_set(list->crts[i], crt);
+		X509_free(crt);
+		(*forged)++;
+
+		/* rate limit so as not to compete with live connections */
+		if (preforge_wait(0, 1000000000L / rate))
+			return 1;
+	}
+	return 0;
+}
+
+static void *
+preforge_thread(UNUSED void *arg)
+{
+	size_t forged;
+
+	do {
+		forged = 0;
+		if (preforge_list_forge(&certs, &forged) ||
+		    preforge_list_forge(&learned, &forged))
+			break;
+		if (forged) {
+			log_dbg_printf("Pre-forged %zu certs\n", forged);
+		}
+		if (learnfd != -1) {
+			preforge_learn();
+		}
+	} while (!preforge_wait(PREFORGE_INTERVAL, 0));
+	return NULL;
+}
+
+/*
+ * Select the CA to forge with: the global one, or else the one of the first
+ * proxyspec which has one.
+ */
+static conn_opts_t *
+preforge_conn_opts(global_t *global)
+{
+	if (global->conn_opts->cacrt && global->conn_opts->cakey)
+		return global->conn_opts;
+	for (proxyspec_t *spec = global->spec; spec; spec = spec->next) {
+		if (spec->ssl && spec->conn_opts->cacrt && spec->conn_opts->cakey)
+			return spec->conn_opts;
+	}
+	return NULL;
+}
+
+/*
+ * Load the certs to pre-forge and open the learn file.
+ * Must be called before dropping privileges and chroot.
+ * Returns -1 on error, 0 on success.
+ */
+int
+preforge_preinit(global_t *global)
+{
+	conn_opts_t *conn_opts;
+
+	if (!global->preforgecertdir &&
+	    !(global->preforgelearnfile && global->preforge_learn_topn))
+		return 0;
+
+	if (!(conn_opts = preforge_conn_opts(global)) || !global->leafkey) {
+		log_err_level_printf(LOG_WARNING, "No CA to pre-forge certs with, "
+		                     "disabling pre-forging\n");
+		return 0;
+	}
+	cacrt = conn_opts->cacrt;
+	ssl_x509_refcount_inc(cacrt);
+	cakey = conn_opts->cakey;
+	ssl_key_refcount_inc(cakey);
+	leafkey = global->leafkey;
+	ssl_key_refcount_inc(leafkey);
+	if (conn_opts->leafcrlurl) {
+		if (!(crlurl = strdup(conn_opts->leafcrlurl)))
+			return -1;
+	}
+	rate = global->preforge_rate;
+
+	if (global->preforgecertdir) {
+		if (sys_dir_eachfile(global->preforgecertdir,
+		                     preforge_load_cert, NULL) == -1) {
+			log_err_level_printf(LOG_CRIT, "Failed to load certs to pre-forge "
+			                     "from %s\n", global->preforgecertdir);
+			return -1;
+		}
+	}
+
+	if (global->preforgelearnfile && global->preforge_learn_topn) {
+		learnfd = open(global->preforgelearnfile, O_RDWR|O_CREAT, 0600);
+		if (learnfd == -1) {
+			log_err_level_printf(LOG_CRIT, "Failed to open pre-forge learn "
+			                     "file '%s': %s (%i)\n",
+			                     global->preforgelearnfile,
+			                     strerror(errno), errno);
+			return -1;
+		}
+		learn_topn = global->preforge_learn_topn;
+		if (preforge_load_learned() == -1)
+			return -1;
+		cachefkcrt_set_keep_origcrt(1);
+	}
+
+	log_dbg_printf("Pre-forging %zu certs from PreForgeCertDir and %zu "
+	               "learned certs\n", certs.cnt, learned.cnt);
+	return 0;
+}
+
+/*
+ * Start the pre-forging thread if there is anything to do.
+ * Must be called after cachemgr_init().
+ * Returns -1 on error, 0 on success.
+ */
+int
+preforge_init(void)
+{
+	int rv;
+
+	if (!cacrt || (!certs.cnt && learnfd == -1))
+		return 0;
+
+	if ((rv = pthread_create(&thr, NULL, preforge_thread, NULL))) {
+		log_err_level_printf(LOG_CRIT, "preforge_init: pthread_create "
+		                     "failed: %s\n", strerror(rv));
+		return -1;
+	}
+	running = 1;
+	return 0;
+}
+
+/*
+ * Stop the pre-forging thread, persist the learned certs and free all
+ * memory.  Must be called before cachemgr_fini().
+ */
+void
+preforge_fini(void)
+{
+	int rv;
+
+	if (running) {
+		pthread_mutex_lock(&mutex);
+		stopping = 1;
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&mutex);
+		if ((rv = pthread_join(thr, NULL))) {
+			log_err_level_printf(LOG_CRIT, "preforge_fini: pthread_join "
+			                     "failed: %s\n", strerror(rv));
+		}
+		running = 0;
+		if (learnfd != -1) {
+			preforge_learn();
+		}
+	}
+	if (learnfd != -1) {
+		close(learnfd);
+		learnfd = -1;
+	}
+	preforge_list_free(&learned);
+	preforge_list_free(&certs);
+	if (crlurl) {
+		free(crlurl);
+		crlurl = NULL;
+	}
+	if (leafkey) {
+		EVP_PKEY_free(leafkey);
+		leafkey = NULL;
+	}
+	if (cakey) {
+		EVP_PKEY_free(cakey);
+		cakey = NULL;
+	}
+	if (cacrt) {
+		X509_free(cacrt);
+		cacrt = NULL;
+	}
+}
+
+/* vim: set noet ft=c: */
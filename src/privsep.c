@@ -92,6 +92,7 @@ static volatile sig_atomic_t received_sigquit;
 static volatile sig_atomic_t received_sigterm;
 static volatile sig_atomic_t received_sigchld;
 static volatile sig_atomic_t received_sigusr1;
+static volatile sig_atomic_t received_sigusr2;
 /* write end of pipe used for unblocking select */
 static volatile sig_atomic_t selfpipe_wrfd;
 
@@ -125,6 +126,9 @@ privsep_server_signal_handler(int sig)
 	case SIGUSR1:
 		received_sigusr1 = 1;
 		break;
+	case SIGUSR2:
+		received_sigusr2 = 1;
+		break;
 	}
 	if (selfpipe_wrfd != -1) {
 		ssize_t n;
@@ -710,6 +714,15 @@ privsep_server(global_t *global, int sigpipe, int srvsock[], size_t nsrvsock,
 				}
 				received_sigusr1 = 0;
 			}
+			if (received_sigusr2) {
+				if (kill(childpid, SIGUSR2) == -1) {
+					log_err_level_printf(LOG_CRIT, "kill(%i,SIGUSR2) "
+					               "failed: %s (%i)\n",
+					               childpid,
+					               strerror(errno), errno);
+				}
+				received_sigusr2 = 0;
+			}
 			if (received_sigint) {
 				/* if we don't detach from the TTY, the
 				 * child process receives SIGINT directly */
@@ -1011,6 +1024,7 @@ privsep_fork(global_t *global, int clisock[], size_t nclisock, int *parent_rv)
 	received_sigint = 0;
 	received_sigchld = 0;
 	received_sigusr1 = 0;
+	received_sigusr2 = 0;
 
 	if (pipe(selfpipev) == -1) {
 		log_err_level_printf(LOG_CRIT, "Failed to create self-pipe: %s (%i)\n",
@@ -1112,6 +1126,11 @@ privsep_fork(global_t *global, int clisock[], size_t nclisock, int *parent_rv)
 		               strerror(errno), errno);
 		return -1;
 	}
+	if (signal(SIGUSR2, privsep_server_signal_handler) == SIG_ERR) {
+		log_err_level_printf(LOG_CRIT, "Failed to install SIGUSR2 handler: %s (%i)\n",
+		               strerror(errno), errno);
+		return -1;
+	}
 	if (signal(SIGCHLD, privsep_server_signal_handler) == SIG_ERR) {
 		log_err_level_printf(LOG_CRIT, "Failed to install SIGCHLD handler: %s (%i)\n",
 		               strerror(errno), errno);
@@ -137,6 +137,7 @@ protoautossl_setup_src_new_bev_ssl_accepting(pxy_conn_ctx_t *ctx)
 		return -1;
 	}
 	ctx->src.free = protoautossl_bufferevent_free_and_close_fd;
+	protossl_setup_record_sizing(ctx);
 	return 0;
 }
 
@@ -228,24 +229,29 @@ protoautossl_upgrade_dst_child(pxy_conn_child_ctx_t *ctx)
  * Peek into pending data to see if it is an SSL/TLS ClientHello, and if so,
  * upgrade the connection from plain TCP to SSL/TLS.
  *
+ * The pending data is fed to the ClientHello assembler chain by chain, only
+ * the octets not seen in previous calls.  A truncated ClientHello is kept in
+ * the input buffer until the rest arrives.
+ *
  * Return 1 if ClientHello was found and connection was upgraded to SSL/TLS,
- * 0 otherwise.
+ * or if a truncated ClientHello is waiting for more data, 0 otherwise.
  *
  * WARNING: This is experimental code and will need to be improved.
  *
  * TODO - enable search and skip bytes before ClientHello in case it does not
- *        start at offset 0 (i.e. chello > vec_out[0].iov_base)
- * TODO - peek into more than just the current segment
- * TODO - add retry mechanism for short truncated ClientHello, possibly generic
+ *        start at offset 0
  */
 static int NONNULL(1)
 protoautossl_peek_and_upgrade(pxy_conn_ctx_t *ctx)
 {
 	protoautossl_ctx_t *autossl_ctx = ctx->protoctx->arg;
 
+	ssl_tls_clienthello_asm_t *chasm = &ctx->sslctx->clienthello_asm;
 	struct evbuffer *inbuf;
+	struct evbuffer_ptr pos;
 	struct evbuffer_iovec vec_out[1];
-	const unsigned char *chello;
+	size_t len;
+	int rv = 1;
 
 	log_finest("ENTER");
 
@@ -255,54 +261,73 @@ protoautossl_peek_and_upgrade(pxy_conn_ctx_t *ctx)
 
 	/* peek the buffer */
 	inbuf = bufferevent_get_input(ctx->src.bev);
-	if (evbuffer_peek(inbuf, 1024, 0, vec_out, 1)) {
-		if (ssl_tls_clienthello_parse(vec_out[0].iov_base, vec_out[0].iov_len, 0, &chello, &ctx->sslctx->sni) == 0) {
-			if (OPTS_DEBUG(ctx->global)) {
-				log_dbg_printf("Peek found ClientHello\n");
-			}
+	len = evbuffer_get_length(inbuf);
+	while (rv == 1 && chasm->consumed < len) {
+		if (evbuffer_ptr_set(inbuf, &pos, chasm->consumed, EVBUFFER_PTR_SET) == -1 ||
+		    evbuffer_peek(inbuf, len - chasm->consumed, &pos, vec_out, 1) < 1)
+			break;
+		rv = ssl_tls_clienthello_asm_feed(chasm, vec_out[0].iov_base,
+				MIN(vec_out[0].iov_len, len - chasm->consumed), &ctx->sslctx->sni);
+	}
+
+	if (rv == 1 && chasm->consumed) {
+		if (OPTS_DEBUG(ctx->global)) {
+			log_dbg_printf("Peek found truncated ClientHello, waiting for more data\n");
+		}
+		return 1;
+	}
 
-			if (ctx->divert) {
-				if (!ctx->children) {
-					// This means that there was no autossl handshake prior to ClientHello, e.g. no STARTTLS message
-					// This is perhaps the SSL handshake of a direct SSL connection
-					log_fine("Upgrading srvdst, no child conn set up yet");
-					protoautossl_upgrade_srvdst(ctx);
-					bufferevent_enable(ctx->srvdst.bev, EV_READ|EV_WRITE);
-				}
-				else {
-					// @attention Autossl protocol should never have multiple children.
-					log_fine("Upgrading child dst");
-					protoautossl_upgrade_dst_child(ctx->children);
-				}
-
-				// Change p in sslproxy_header to s
-				if (ctx->sslproxy_header) {
-					free(ctx->sslproxy_header);
-					ctx->sslproxy_header = NULL;
-					ctx->sslproxy_header_len = 0;
-					if (pxy_set_sslproxy_header(ctx, 1) == -1) {
-						return -1;
-					}
-				} else {
-					log_err_level(LOG_CRIT, "No sslproxy_header set up in divert mode in autossl");
-					return -1;
-				}
-			} else {
-				// srvdst == dst in split mode
-				protoautossl_upgrade_dst(ctx);
-				bufferevent_enable(ctx->dst.bev, EV_READ|EV_WRITE);
-			}
+	if (rv != 0) {
+		if (OPTS_DEBUG(ctx->global)) {
+			log_dbg_printf("Peek found no ClientHello\n");
+		}
+		/* Look for a ClientHello at the start of the next data */
+		ssl_tls_clienthello_asm_free(chasm);
+		return 0;
+	}
+	if (OPTS_DEBUG(ctx->global)) {
+		char *ja3 = ssl_tls_clienthello_ja3_hash(&chasm->info);
+		log_dbg_printf("Peek found ClientHello, JA3: %s\n", ja3 ? ja3 : "n/a");
+		if (ja3)
+			free(ja3);
+	}
+	ssl_tls_clienthello_asm_free(chasm);
+
+	if (ctx->divert) {
+		if (!ctx->children) {
+			// This means that there was no autossl handshake prior to ClientHello, e.g. no STARTTLS message
+			// This is perhaps the SSL handshake of a direct SSL connection
+			log_fine("Upgrading srvdst, no child conn set up yet");
+			protoautossl_upgrade_srvdst(ctx);
+			bufferevent_enable(ctx->srvdst.bev, EV_READ|EV_WRITE);
+		}
+		else {
+			// @attention Autossl protocol should never have multiple children.
+			log_fine("Upgrading child dst");
+			protoautossl_upgrade_dst_child(ctx->children);
+		}
 
-			autossl_ctx->clienthello_search = 0;
-			autossl_ctx->clienthello_found = 1;
-			return 1;
-		} else {
-			if (OPTS_DEBUG(ctx->global)) {
-				log_dbg_printf("Peek found no ClientHello\n");
+		// Change p in sslproxy_header to s
+		if (ctx->sslproxy_header) {
+			free(ctx->sslproxy_header);
+			ctx->sslproxy_header = NULL;
+			ctx->sslproxy_header_len = 0;
+			if (pxy_set_sslproxy_header(ctx, 1) == -1) {
+				return -1;
 			}
+		} else {
+			log_err_level(LOG_CRIT, "No sslproxy_header set up in divert mode in autossl");
+			return -1;
 		}
+	} else {
+		// srvdst == dst in split mode
+		protoautossl_upgrade_dst(ctx);
+		bufferevent_enable(ctx->dst.bev, EV_READ|EV_WRITE);
 	}
-	return 0;
+
+	autossl_ctx->clienthello_search = 0;
+	autossl_ctx->clienthello_found = 1;
+	return 1;
 }
 
 static int NONNULL(1) WUNRES
@@ -321,22 +346,26 @@ protoautossl_conn_connect(pxy_conn_ctx_t *ctx)
 }
 
 static void
-protoautossl_try_set_watermark(struct bufferevent *bev, pxy_conn_ctx_t *ctx, struct bufferevent *other)
+protoautossl_try_set_watermark(struct bufferevent *bev, pxy_conn_ctx_t *ctx, pxy_conn_desc_t *other)
 {
-	struct bufferevent *ubev_other = bufferevent_get_underlying(other);
-	if (evbuffer_get_length(bufferevent_get_output(other)) >= OUTBUF_LIMIT ||
-			(ubev_other && evbuffer_get_length(bufferevent_get_output(ubev_other)) >= OUTBUF_LIMIT)) {
+	struct bufferevent *ubev_other = bufferevent_get_underlying(other->bev);
+	size_t len = evbuffer_get_length(bufferevent_get_output(other->bev));
+	if (ubev_other)
+		len = MAX(len, evbuffer_get_length(bufferevent_get_output(ubev_other)));
+	size_t limit = prototcp_get_outbuf_limit(ctx, other, len);
+
+	if (len >= limit) {
 		log_fine_va("%s", prototcp_get_event_name(bev, ctx));
 
 		/* temporarily disable data source;
 		 * set an appropriate watermark. */
-		bufferevent_setwatermark(other, EV_WRITE, OUTBUF_LIMIT/2, OUTBUF_LIMIT);
+		bufferevent_setwatermark(other->bev, EV_WRITE, limit/2, limit);
 		bufferevent_disable(bev, EV_READ);
 
 		/* The watermark for ubev_other may be already set, see pxy_try_unset_watermark,
 		 * but getting is equally expensive as setting */
 		if (ubev_other)
-			bufferevent_setwatermark(ubev_other, EV_WRITE, OUTBUF_LIMIT/2, OUTBUF_LIMIT);
+			bufferevent_setwatermark(ubev_other, EV_WRITE, limit/2, limit);
 
 		ctx->thr->set_watermarks++;
 	}
@@ -355,10 +384,14 @@ protoautossl_try_unset_watermark(struct bufferevent *bev, pxy_conn_ctx_t *ctx, p
 
 		/* Do not reset the watermark for ubev without checking its buf len,
 		 * because the current write event may be due to the buf len of bev
-		 * falling below OUTBUF_LIMIT/2, not that of ubev */
+		 * falling below the low watermark, not that of ubev */
 		struct bufferevent *ubev = bufferevent_get_underlying(bev);
-		if (ubev && evbuffer_get_length(bufferevent_get_output(ubev)) < OUTBUF_LIMIT/2)
-			bufferevent_setwatermark(ubev, EV_WRITE, 0, 0);
+		if (ubev) {
+			// Only the src and dst bevs of the parent conn are upgraded to filter bevs
+			pxy_conn_desc_t *this = (bev == ctx->src.bev) ? &ctx->src : &ctx->dst;
+			if (evbuffer_get_length(bufferevent_get_output(ubev)) < prototcp_get_outbuf_limit(ctx, this, 0)/2)
+				bufferevent_setwatermark(ubev, EV_WRITE, 0, 0);
+		}
 
 		ctx->thr->unset_watermarks++;
 	}
@@ -433,7 +466,7 @@ protoautossl_bev_readcb_src(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 		return;
 	}
 
-	ctx->protoctx->set_watermarkcb(bev, ctx, ctx->dst.bev);
+	ctx->protoctx->set_watermarkcb(bev, ctx, &ctx->dst);
 }
 
 static void NONNULL(1)
@@ -456,7 +489,7 @@ protoautossl_bev_readcb_srvdst(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 	}
 
 	evbuffer_add_buffer(bufferevent_get_output(ctx->src.bev), bufferevent_get_input(bev));
-	ctx->protoctx->set_watermarkcb(bev, ctx, ctx->src.bev);
+	ctx->protoctx->set_watermarkcb(bev, ctx, &ctx->src);
 }
 
 static int NONNULL(1) WUNRES
@@ -530,6 +563,7 @@ protoautossl_enable_conn_src(pxy_conn_ctx_t *ctx)
 	// Save the ssl info for logging, srvdst == dst in split mode
 	ctx->sslctx->srvdst_ssl_version = strdup(SSL_get_version(ctx->srvdst.ssl ? ctx->srvdst.ssl : ctx->dst.ssl));
 	ctx->sslctx->srvdst_ssl_cipher = strdup(SSL_get_cipher(ctx->srvdst.ssl ? ctx->srvdst.ssl : ctx->dst.ssl));
+	ctx->sslctx->srvdst_ktls = protossl_ktls_str(ctx->srvdst.ssl ? ctx->srvdst.ssl : ctx->dst.ssl);
 
 	// Now open the gates for a second time after autossl upgrade
 	bufferevent_enable(ctx->src.bev, EV_READ|EV_WRITE);
@@ -619,6 +653,7 @@ protoautossl_enable_conn_src_child(pxy_conn_child_ctx_t *ctx)
 	// srvdst is xferred to the first child conn, so save the ssl info for logging
 	ctx->conn->sslctx->srvdst_ssl_version = strdup(SSL_get_version(ctx->conn->srvdst.ssl ? ctx->conn->srvdst.ssl : ctx->dst.ssl));
 	ctx->conn->sslctx->srvdst_ssl_cipher = strdup(SSL_get_cipher(ctx->conn->srvdst.ssl ? ctx->conn->srvdst.ssl : ctx->dst.ssl));
+	ctx->conn->sslctx->srvdst_ktls = protossl_ktls_str(ctx->conn->srvdst.ssl ? ctx->conn->srvdst.ssl : ctx->dst.ssl);
 
 	log_finer_va("Enabling ssl src, %s", ctx->conn->sslproxy_header);
 
@@ -796,6 +831,7 @@ protoautossl_setup(pxy_conn_ctx_t *ctx)
 		return PROTO_ERROR;
 	}
 	memset(ctx->sslctx, 0, sizeof(ssl_ctx_t));
+	ssl_tls_clienthello_asm_init(&ctx->sslctx->clienthello_asm, ctx->global->clienthello_max_size);
 
 	return PROTO_AUTOSSL;
 }
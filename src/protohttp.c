@@ -101,10 +101,17 @@ protohttp_log_connect(pxy_conn_ctx_t *ctx)
 #endif /* !WITHOUT_USERAUTH */
 		              );
 	} else {
+		/* only log kTLS state if requested, keeps the log format unchanged otherwise */
+		char ktls[24] = "";
+		if (ctx->conn_opts->ktls) {
+			snprintf(ktls, sizeof(ktls), " ktls:%s:%s",
+			         protossl_ktls_str(ctx->src.ssl),
+			         STRORDASH(ctx->sslctx->srvdst_ktls));
+		}
 		rv = asprintf(&msg, "CONN: https %s %s %s %s %s %s %s %s %s "
 		              "sni:%s names:%s "
 		              "sproto:%s:%s dproto:%s:%s "
-		              "origcrt:%s usedcrt:%s"
+		              "origcrt:%s usedcrt:%s%s"
 #ifdef HAVE_LOCAL_PROCINFO
 		              " %s"
 #endif /* HAVE_LOCAL_PROCINFO */
@@ -130,6 +137,7 @@ protohttp_log_connect(pxy_conn_ctx_t *ctx)
 		              STRORDASH(ctx->sslctx->srvdst_ssl_cipher),
 		              STRORDASH(ctx->sslctx->origcrtfpr),
 		              STRORDASH(ctx->sslctx->usedcrtfpr),
+		              ktls,
 #ifdef HAVE_LOCAL_PROCINFO
 		              lpi,
 #endif /* HAVE_LOCAL_PROCINFO */
@@ -377,12 +385,39 @@ protohttp_filter_request_header_line(const char *line, protohttp_ctx_t *http_ctx
 	return (char*)line;
 }
 
+/*
+ * Path rules are more specific than the host rule they are defined under,
+ * so they are tried before the port and host rules of the site.
+ */
+static filter_action_t * NONNULL(1,2)
+protohttp_filter_path(pxy_conn_ctx_t *ctx, filter_site_t *site)
+{
+	protohttp_ctx_t *http_ctx = ctx->protoctx->arg;
+
+	if (!site->path_trie || !http_ctx->http_uri)
+		return NULL;
+
+	filter_path_t *path = filter_path_find(site, http_ctx->http_uri);
+	if (!path) {
+		log_finest_va("No filter match with path: %s, %s", http_ctx->http_host, http_ctx->http_uri);
+		return NULL;
+	}
+
+	log_fine_va("Found path (line=%d): %s for %s, %s", path->action.line_num, path->path, http_ctx->http_host, http_ctx->http_uri);
+
+	if (path->action.precedence < ctx->filter_precedence) {
+		log_finest_va("Rule path precedence lower than conn filter precedence %d < %d (line=%d): %s, %s", path->action.precedence, ctx->filter_precedence, path->action.line_num, path->path, http_ctx->http_uri);
+		return NULL;
+	}
+	return &path->action;
+}
+
 static filter_action_t * NONNULL(1,2)
 protohttp_filter_match_host(pxy_conn_ctx_t *ctx, filter_list_t *list)
 {
 	protohttp_ctx_t *http_ctx = ctx->protoctx->arg;
 
-	filter_site_t *site = filter_site_find(list->host_btree, list->host_acm, list->host_all, http_ctx->http_host);
+	filter_site_t *site = filter_site_find(list->host_bloom, list->host_hash, list->host_trie, list->host_acm, list->lists, list->host_all, http_ctx->http_host, &ctx->thr->filter_bloom_stats);
 	if (!site)
 		return NULL;
 
@@ -396,7 +431,7 @@ protohttp_filter_match_host(pxy_conn_ctx_t *ctx, filter_list_t *list)
 		STRORDASH(http_ctx->http_host));
 #endif /* WITHOUT_USERAUTH */
 
-	if (!site->port_btree && !site->port_acm && (site->action.precedence < ctx->filter_precedence)) {
+	if (!site->port_hash && !site->port_acm && !site->path_trie && (site->action.precedence < ctx->filter_precedence)) {
 		log_finest_va("Rule precedence lower than conn filter precedence %d < %d (line=%d): %s, %s", site->action.precedence, ctx->filter_precedence, site->action.line_num, site->site, http_ctx->http_host);
 		return NULL;
 	}
@@ -404,12 +439,20 @@ protohttp_filter_match_host(pxy_conn_ctx_t *ctx, filter_list_t *list)
 #ifdef DEBUG_PROXY
 	if (site->all_sites)
 		log_finest_va("Match all host (line=%d): %s, %s", site->action.line_num, site->site, http_ctx->http_host);
+	else if (site->extlist)
+		log_finest_va("Match list with host (line=%d): %s, %s", site->action.line_num, site->site, http_ctx->http_host);
+	else if (site->suffix)
+		log_finest_va("Match suffix with host (line=%d): %s, %s", site->action.line_num, site->site, http_ctx->http_host);
 	else if (site->exact)
 		log_finest_va("Match exact with host (line=%d): %s, %s", site->action.line_num, site->site, http_ctx->http_host);
 	else
 		log_finest_va("Match substring in host (line=%d): %s, %s", site->action.line_num, site->site, http_ctx->http_host);
 #endif /* DEBUG_PROXY */
 
+	filter_action_t *path_action = protohttp_filter_path(ctx, site);
+	if (path_action)
+		return path_action;
+
 	filter_action_t *port_action = pxy_conn_filter_port(ctx, site);
 	if (port_action)
 		return port_action;
@@ -422,7 +465,7 @@ protohttp_filter_match_uri(pxy_conn_ctx_t *ctx, filter_list_t *list)
 {
 	protohttp_ctx_t *http_ctx = ctx->protoctx->arg;
 
-	filter_site_t *site = filter_site_find(list->uri_btree, list->uri_acm, list->uri_all, http_ctx->http_uri);
+	filter_site_t *site = filter_site_find(list->uri_bloom, list->uri_hash, NULL, list->uri_acm, NULL, list->uri_all, http_ctx->http_uri, &ctx->thr->filter_bloom_stats);
 	if (!site)
 		return NULL;
 
@@ -436,7 +479,7 @@ protohttp_filter_match_uri(pxy_conn_ctx_t *ctx, filter_list_t *list)
 		STRORDASH(http_ctx->http_uri));
 #endif /* WITHOUT_USERAUTH */
 
-	if (!site->port_btree && !site->port_acm && (site->action.precedence < ctx->filter_precedence)) {
+	if (!site->port_hash && !site->port_acm && (site->action.precedence < ctx->filter_precedence)) {
 		log_finest_va("Rule precedence lower than conn filter precedence %d < %d (line=%d): %s, %s", site->action.precedence, ctx->filter_precedence, site->action.line_num, site->site, http_ctx->http_uri);
 		return NULL;
 	}
@@ -508,7 +551,8 @@ protohttp_apply_filter(pxy_conn_ctx_t *ctx)
 {
 	int rv = 0;
 	filter_action_t *a;
-	if ((a = pxy_conn_filter(ctx, protohttp_filter))) {
+	protohttp_ctx_t *http_ctx = ctx->protoctx->arg;
+	if ((a = pxy_conn_filter(ctx, protohttp_filter, http_ctx->http_host, http_ctx->http_uri))) {
 		unsigned int action = pxy_conn_translate_filter_action(ctx, a);
 
 		ctx->filter_precedence = action & FILTER_PRECEDENCE;
@@ -849,7 +893,7 @@ protohttp_bev_readcb_src(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 		}
 	}
 
-	ctx->protoctx->set_watermarkcb(bev, ctx, ctx->dst.bev);
+	ctx->protoctx->set_watermarkcb(bev, ctx, &ctx->dst);
 }
 
 /*
@@ -992,7 +1036,7 @@ protohttp_bev_readcb_dst(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 		log_finest_va("HTTP Response Body, size=%zu", evbuffer_get_length(inbuf));
 		evbuffer_add_buffer(outbuf, inbuf);
 	}
-	ctx->protoctx->set_watermarkcb(bev, ctx, ctx->src.bev);
+	ctx->protoctx->set_watermarkcb(bev, ctx, &ctx->src);
 }
 
 static void NONNULL(1)
@@ -1025,7 +1069,7 @@ protohttp_bev_readcb_src_child(struct bufferevent *bev, pxy_conn_child_ctx_t *ct
 		log_finest_va("HTTP Request Body, size=%zu", evbuffer_get_length(inbuf));
 		evbuffer_add_buffer(outbuf, inbuf);
 	}
-	ctx->conn->protoctx->set_watermarkcb(bev, ctx->conn, ctx->dst.bev);
+	ctx->conn->protoctx->set_watermarkcb(bev, ctx->conn, &ctx->dst);
 }
 
 static void NONNULL(1)
@@ -1053,7 +1097,7 @@ protohttp_bev_readcb_dst_child(struct bufferevent *bev, pxy_conn_child_ctx_t *ct
 		log_finest_va("HTTP Response Body, size=%zu", evbuffer_get_length(inbuf));
 		evbuffer_add_buffer(outbuf, inbuf);
 	}
-	ctx->conn->protoctx->set_watermarkcb(bev, ctx->conn, ctx->src.bev);
+	ctx->conn->protoctx->set_watermarkcb(bev, ctx->conn, &ctx->src);
 }
 
 static void NONNULL(1)
@@ -143,7 +143,7 @@ protopassthrough_bev_readcb_src(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 	}
 
 	evbuffer_add_buffer(bufferevent_get_output(ctx->srvdst.bev), bufferevent_get_input(bev));
-	ctx->protoctx->set_watermarkcb(bev, ctx, ctx->srvdst.bev);
+	ctx->protoctx->set_watermarkcb(bev, ctx, &ctx->srvdst);
 }
 
 static void NONNULL(1)
@@ -158,7 +158,7 @@ protopassthrough_bev_readcb_srvdst(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 	}
 
 	evbuffer_add_buffer(bufferevent_get_output(ctx->src.bev), bufferevent_get_input(bev));
-	ctx->protoctx->set_watermarkcb(bev, ctx, ctx->src.bev);
+	ctx->protoctx->set_watermarkcb(bev, ctx, &ctx->src);
 }
 
 static void NONNULL(1)
@@ -212,7 +212,7 @@ protosmtp_bev_readcb_srvdst(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 	}
 
 	evbuffer_add_buffer(outbuf, inbuf);
-	ctx->protoctx->set_watermarkcb(bev, ctx, ctx->src.bev);
+	ctx->protoctx->set_watermarkcb(bev, ctx, &ctx->src);
 }
 
 static void NONNULL(1,2)
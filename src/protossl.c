@@ -30,13 +30,31 @@
 #include "protossl.h"
 #include "prototcp.h"
 #include "protopassthrough.h"
+#include "pxydns.h"
 
 #include "cachemgr.h"
 
 #include <string.h>
+#include <errno.h>
 #include <sys/param.h>
 #include <event2/bufferevent_ssl.h>
 
+/*
+ * Seconds to wait for the rest of a truncated ClientHello before connecting
+ * without SNI.
+ */
+#define PROTOSSL_CLIENTHELLO_TIMEOUT 5
+
+/*
+ * Dynamic record sizing: max size of the TLS records written to the client at
+ * conn start and after PROTOSSL_DRS_IDLE_MSEC without data to send, until
+ * PROTOSSL_DRS_BYTES have been sent. A record of this size with its TLS
+ * overhead fits in a single TCP segment.
+ */
+#define PROTOSSL_DRS_SMALL_RECORD 1400
+#define PROTOSSL_DRS_BYTES (1024 * 1024)
+#define PROTOSSL_DRS_IDLE_MSEC 1000
+
 /*
  * Context used for all server sessions.
  */
@@ -101,7 +119,7 @@ protossl_log_ssl_error(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 						   ERR_GET_FUNC(sslerr), STRORDASH(ERR_func_error_string(sslerr)));
 		}
 	}
-	if (ctx->spec->opts->filter && !ctx->pass) {
+	if (ctx->filter && !ctx->pass) {
 		log_err_level_printf(LOG_WARNING, "Closing on ssl error without filter match: %s:%s, %s:%s, "
 #ifndef WITHOUT_USERAUTH
 			"%s, %s, "
@@ -270,6 +288,32 @@ protossl_ossl_sessget_cb(UNUSED SSL *ssl, const unsigned char *id, int idlen, in
 	return sess;
 }
 
+/*
+ * Return a static string describing the kTLS state of the ssl connection:
+ * "txrx", "tx" or "rx" if the record layer is offloaded to the kernel in
+ * those directions, "no" otherwise.
+ */
+const char *
+protossl_ktls_str(SSL *ssl)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+	BIO *wbio = SSL_get_wbio(ssl);
+	BIO *rbio = SSL_get_rbio(ssl);
+	int tx = wbio ? BIO_get_ktls_send(wbio) : 0;
+	int rx = rbio ? BIO_get_ktls_recv(rbio) : 0;
+
+	if (tx && rx)
+		return "txrx";
+	if (tx)
+		return "tx";
+	if (rx)
+		return "rx";
+#else /* !SSL_OP_ENABLE_KTLS */
+	(void)ssl;
+#endif /* !SSL_OP_ENABLE_KTLS */
+	return "no";
+}
+
 /*
  * Set SSL_CTX options that are the same for incoming and outgoing SSL_CTX.
  */
@@ -331,6 +375,14 @@ protossl_sslctx_setoptions(SSL_CTX *sslctx, pxy_conn_ctx_t *ctx)
 	}
 #endif /* SSL_OP_NO_COMPRESSION */
 
+#ifdef SSL_OP_ENABLE_KTLS
+	/* OpenSSL silently falls back to userspace crypto if the kernel,
+	 * the BIO, or the negotiated cipher does not support kTLS */
+	if (ctx->conn_opts->ktls) {
+		SSL_CTX_set_options(sslctx, SSL_OP_ENABLE_KTLS);
+	}
+#endif /* SSL_OP_ENABLE_KTLS */
+
 	SSL_CTX_set_cipher_list(sslctx, ctx->conn_opts->ciphers);
 #ifdef HAVE_TLSV13
 	SSL_CTX_set_ciphersuites(sslctx, ctx->conn_opts->ciphersuites);
@@ -493,10 +545,49 @@ protossl_srccert_write(pxy_conn_ctx_t *ctx)
 	}
 }
 
+/*
+ * Free a log string of the SSL ctx, unless it is borrowed from origcrtmeta.
+ */
+static void
+protossl_free_logstr(ssl_ctx_t *sslctx, char *s)
+{
+	cachefkcrt_meta_t *m = sslctx->origcrtmeta;
+
+	if (m && (s == m->names_str || s == m->origcrtfpr || s == m->usedcrtfpr))
+		return;
+	free(s);
+}
+
 static cert_t *
 protossl_srccert_create(pxy_conn_ctx_t *ctx)
 {
 	cert_t *cert = NULL;
+	X509 *fkcrt = NULL;
+
+	if (ctx->sslctx->origcrt) {
+		/* look up the fake cert first to reuse the metadata of the
+		 * original cert cached along with it */
+		if (ctx->global->leafkey) {
+			fkcrt = cachemgr_fkcrt_get_meta(ctx->sslctx->origcrt,
+			                                &ctx->sslctx->origcrtmeta);
+		}
+		/* only worth computing if it is cached with the fake cert, or
+		 * if the target certs are looked up by its names or the
+		 * fingerprints are logged below; the names string for
+		 * filtering is computed on demand otherwise */
+		if (!ctx->sslctx->origcrtmeta &&
+		    (ctx->global->leafkey ||
+		     (ctx->global->leafcertdir && !ctx->sslctx->sni) ||
+		     WANT_CONNECT_LOG(ctx) || ctx->global->certgendir)) {
+			ctx->sslctx->origcrtmeta = cachefkcrt_meta_new(ctx->sslctx->origcrt);
+			if (!ctx->sslctx->origcrtmeta) {
+				if (fkcrt)
+					X509_free(fkcrt);
+				ctx->enomem = 1;
+				return NULL;
+			}
+		}
+	}
 
 	if (ctx->global->leafcertdir) {
 		if (ctx->sslctx->sni) {
@@ -515,28 +606,13 @@ protossl_srccert_create(pxy_conn_ctx_t *ctx)
 				log_dbg_printf("Target cert by SNI\n");
 			}
 		} else if (ctx->sslctx->origcrt) {
-			char **names = ssl_x509_names(ctx->sslctx->origcrt);
-			for (char **p = names; *p; p++) {
-				if (!cert) {
-					cert = cachemgr_tgcrt_get(*p);
-				}
+			cachefkcrt_meta_t *m = ctx->sslctx->origcrtmeta;
+			for (size_t i = 0; !cert && m->names[i]; i++) {
+				/* increases ref count */
+				cert = cachemgr_tgcrt_get(m->names[i]);
 				if (!cert) {
-					char *wildcarded;
-					wildcarded = ssl_wildcardify(*p);
-					if (!wildcarded) {
-						ctx->enomem = 1;
-					} else {
-						/* increases ref count */
-						cert = cachemgr_tgcrt_get(
-						       wildcarded);
-						free(wildcarded);
-					}
+					cert = cachemgr_tgcrt_get(m->wildcards[i]);
 				}
-				free(*p);
-			}
-			free(names);
-			if (ctx->enomem) {
-				return NULL;
 			}
 			if (cert && OPTS_DEBUG(ctx->global)) {
 				log_dbg_printf("Target cert by origcrt\n");
@@ -560,7 +636,8 @@ protossl_srccert_create(pxy_conn_ctx_t *ctx)
 	if (!cert && ctx->sslctx->origcrt && ctx->global->leafkey) {
 		cert = cert_new();
 
-		cert->crt = cachemgr_fkcrt_get(ctx->sslctx->origcrt);
+		cert->crt = fkcrt;
+		fkcrt = NULL;
 		if (cert->crt) {
 			if (OPTS_DEBUG(ctx->global))
 				log_dbg_printf("Certificate cache: HIT\n");
@@ -573,23 +650,35 @@ protossl_srccert_create(pxy_conn_ctx_t *ctx)
 			                           ctx->global->leafkey,
 			                           NULL,
 			                           ctx->conn_opts->leafcrlurl);
-			cachemgr_fkcrt_set(ctx->sslctx->origcrt, cert->crt);
+			if (cert->crt) {
+				if (cachefkcrt_meta_set_usedcrt(ctx->sslctx->origcrtmeta, cert->crt) == -1)
+					ctx->enomem = 1;
+				cachemgr_fkcrt_set_meta(ctx->sslctx->origcrt, cert->crt,
+				                        ctx->sslctx->origcrtmeta);
+			}
 		}
 		cert_set_key(cert, ctx->global->leafkey);
 		cert_set_chain(cert, ctx->conn_opts->chain);
 		ctx->sslctx->generated_cert = 1;
 	}
+	if (fkcrt) {
+		/* a target or the default leaf cert is used instead */
+		X509_free(fkcrt);
+	}
 
 	if ((WANT_CONNECT_LOG(ctx) || ctx->global->certgendir) && ctx->sslctx->origcrt) {
-		ctx->sslctx->origcrtfpr = ssl_x509_fingerprint(ctx->sslctx->origcrt, 0);
-		if (!ctx->sslctx->origcrtfpr)
-			ctx->enomem = 1;
+		ctx->sslctx->origcrtfpr = ctx->sslctx->origcrtmeta->origcrtfpr;
 	}
 	if ((WANT_CONNECT_LOG(ctx) || ctx->global->certgen_writeall) &&
 	    cert && cert->crt) {
-		ctx->sslctx->usedcrtfpr = ssl_x509_fingerprint(cert->crt, 0);
-		if (!ctx->sslctx->usedcrtfpr)
-			ctx->enomem = 1;
+		if (ctx->sslctx->generated_cert && ctx->sslctx->origcrtmeta &&
+		    ctx->sslctx->origcrtmeta->usedcrtfpr) {
+			ctx->sslctx->usedcrtfpr = ctx->sslctx->origcrtmeta->usedcrtfpr;
+		} else {
+			ctx->sslctx->usedcrtfpr = ssl_x509_fingerprint(cert->crt, 0);
+			if (!ctx->sslctx->usedcrtfpr)
+				ctx->enomem = 1;
+		}
 	}
 
 	return cert;
@@ -598,7 +687,7 @@ protossl_srccert_create(pxy_conn_ctx_t *ctx)
 static filter_action_t * NONNULL(1,2)
 protossl_filter_match_sni(pxy_conn_ctx_t *ctx, filter_list_t *list)
 {
-	filter_site_t *site = filter_site_find(list->sni_btree, list->sni_acm, list->sni_all, ctx->sslctx->sni);
+	filter_site_t *site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, ctx->sslctx->sni, &ctx->thr->filter_bloom_stats);
 	if (!site)
 		return NULL;
 
@@ -612,7 +701,7 @@ protossl_filter_match_sni(pxy_conn_ctx_t *ctx, filter_list_t *list)
 		STRORDASH(ctx->sslctx->sni));
 #endif /* WITHOUT_USERAUTH */
 
-	if (!site->port_btree && !site->port_acm && (site->action.precedence < ctx->filter_precedence)) {
+	if (!site->port_hash && !site->port_acm && (site->action.precedence < ctx->filter_precedence)) {
 		log_finest_va("Rule precedence lower than conn filter precedence %d < %d (line=%d): %s, %s", site->action.precedence, ctx->filter_precedence, site->action.line_num, site->site, ctx->sslctx->sni);
 		return NULL;
 	}
@@ -620,6 +709,10 @@ protossl_filter_match_sni(pxy_conn_ctx_t *ctx, filter_list_t *list)
 #ifdef DEBUG_PROXY
 	if (site->all_sites)
 		log_finest_va("Match all sni (line=%d): %s, %s", site->action.line_num, site->site, ctx->sslctx->sni);
+	else if (site->extlist)
+		log_finest_va("Match list with sni (line=%d): %s, %s", site->action.line_num, site->site, ctx->sslctx->sni);
+	else if (site->suffix)
+		log_finest_va("Match suffix with sni (line=%d): %s, %s", site->action.line_num, site->site, ctx->sslctx->sni);
 	else if (site->exact)
 		log_finest_va("Match exact with sni (line=%d): %s, %s", site->action.line_num, site->site, ctx->sslctx->sni);
 	else
@@ -652,8 +745,11 @@ protossl_filter_match_cn(pxy_conn_ctx_t *ctx, filter_list_t *list)
 		return NULL;
 	}
 
-	// Do not tokenize ssl_names if there is no rule to match exact common names
-	if (list->cn_btree) {
+	// Do not tokenize ssl_names if there is no rule to match exact common names, domain suffixes, or list files
+	if (list->cn_hash || list->cn_trie || list->lists) {
+		filter_site_t *suffix_site = NULL;
+		filter_site_t *list_site = NULL;
+
 		// strtok_r() modifies the string param, so copy ssl_names to a local var and pass it to strtok_r()
 		char _cn[len + 1];
 		memcpy(_cn, ctx->sslctx->ssl_names, len);
@@ -663,17 +759,28 @@ protossl_filter_match_cn(pxy_conn_ctx_t *ctx, filter_list_t *list)
 			 p;
 			 (p = strtok_r(NULL, "/", &last))) {
 			if (argc++ < MAX_CN_TOKENS) {
-				site = filter_site_exact_match(list->cn_btree, p);
-				if (site) {
-					log_finest_va("Match exact with common name (%d) (line=%d): %s, %s", argc, site->action.line_num, p, ctx->sslctx->ssl_names);
-					break;
+				if (filter_site_bloom_check(list->cn_bloom, p, 1, &ctx->thr->filter_bloom_stats)) {
+					site = filter_site_exact_match(list->cn_hash, p);
+					if (site) {
+						log_finest_va("Match exact with common name (%d) (line=%d): %s, %s", argc, site->action.line_num, p, ctx->sslctx->ssl_names);
+						break;
+					}
+					// Exact matches on any common name take precedence over suffix matches
+					if (!suffix_site && (suffix_site = filter_site_suffix_match(list->cn_trie, p)))
+						log_finest_va("Match suffix with common name (%d) (line=%d): %s, %s", argc, suffix_site->action.line_num, p, ctx->sslctx->ssl_names);
 				}
+				if (!list_site && (list_site = filter_site_extlist_match(list->lists, p, 0)))
+					log_finest_va("Match list with common name (%d) (line=%d): %s, %s", argc, list_site->action.line_num, p, ctx->sslctx->ssl_names);
 			}
 			else {
 				log_err_level_printf(LOG_WARNING, "Too many tokens in common names, max tokens %d: %s\n", MAX_CN_TOKENS, ctx->sslctx->ssl_names);
 				break;
 			}
 		}
+		if (!site)
+			site = suffix_site;
+		if (!site)
+			site = list_site;
 	}
 
 	if (!site) {
@@ -695,7 +802,7 @@ protossl_filter_match_cn(pxy_conn_ctx_t *ctx, filter_list_t *list)
 		STRORDASH(ctx->sslctx->ssl_names));
 #endif /* WITHOUT_USERAUTH */
 
-	if (!site->port_btree && !site->port_acm && (site->action.precedence < ctx->filter_precedence)) {
+	if (!site->port_hash && !site->port_acm && (site->action.precedence < ctx->filter_precedence)) {
 		log_finest_va("Rule precedence lower than conn filter precedence %d < %d (line=%d): %s, %s", site->action.precedence, ctx->filter_precedence, site->action.line_num, site->site, ctx->sslctx->ssl_names);
 		return NULL;
 	}
@@ -782,7 +889,7 @@ protossl_apply_filter(pxy_conn_ctx_t *ctx)
 {
 	int rv = 0;
 	filter_action_t *a;
-	if ((a = pxy_conn_filter(ctx, protossl_filter))) {
+	if ((a = pxy_conn_filter(ctx, protossl_filter, ctx->sslctx->sni, ctx->sslctx->ssl_names))) {
 		unsigned int action = pxy_conn_translate_filter_action(ctx, a);
 
 		ctx->filter_precedence = action & FILTER_PRECEDENCE;
@@ -900,12 +1007,16 @@ protossl_srcssl_create(pxy_conn_ctx_t *ctx, SSL *origssl)
 		protossl_debug_crt(cert->crt);
 	}
 
-	if (WANT_CONNECT_LOG(ctx) || ctx->spec->opts->filter) {
-		ctx->sslctx->ssl_names = ssl_x509_names_to_str(ctx->sslctx->origcrt ?
-		                                       ctx->sslctx->origcrt :
-		                                       cert->crt);
-		if (!ctx->sslctx->ssl_names)
-			ctx->enomem = 1;
+	if (WANT_CONNECT_LOG(ctx) || ctx->filter) {
+		if (ctx->sslctx->origcrtmeta) {
+			ctx->sslctx->ssl_names = ctx->sslctx->origcrtmeta->names_str;
+		} else {
+			ctx->sslctx->ssl_names = ssl_x509_names_to_str(ctx->sslctx->origcrt ?
+			                                       ctx->sslctx->origcrt :
+			                                       cert->crt);
+			if (!ctx->sslctx->ssl_names)
+				ctx->enomem = 1;
+		}
 	}
 
 	// Defers any block action until HTTP filter application
@@ -1008,9 +1119,9 @@ protossl_ossl_servername_cb(SSL *ssl, UNUSED int *al, void *arg)
 			               "certificate:\n");
 			protossl_debug_crt(newcrt);
 		}
-		if (WANT_CONNECT_LOG(ctx) || ctx->spec->opts->filter) {
+		if (WANT_CONNECT_LOG(ctx) || ctx->filter) {
 			if (ctx->sslctx->ssl_names) {
-				free(ctx->sslctx->ssl_names);
+				protossl_free_logstr(ctx->sslctx, ctx->sslctx->ssl_names);
 			}
 			ctx->sslctx->ssl_names = ssl_x509_names_to_str(newcrt);
 			if (!ctx->sslctx->ssl_names) {
@@ -1019,7 +1130,7 @@ protossl_ossl_servername_cb(SSL *ssl, UNUSED int *al, void *arg)
 		}
 		if (WANT_CONNECT_LOG(ctx) || ctx->global->certgendir) {
 			if (ctx->sslctx->usedcrtfpr) {
-				free(ctx->sslctx->usedcrtfpr);
+				protossl_free_logstr(ctx->sslctx, ctx->sslctx->usedcrtfpr);
 			}
 			ctx->sslctx->usedcrtfpr = ssl_x509_fingerprint(newcrt, 0);
 			if (!ctx->sslctx->usedcrtfpr) {
@@ -1045,6 +1156,49 @@ protossl_ossl_servername_cb(SSL *ssl, UNUSED int *al, void *arg)
 }
 #endif /* !OPENSSL_NO_TLSEXT */
 
+/*
+ * Cert verify callback for outgoing connections, which looks up the result of
+ * verifying the server cert chain in the verification cache before running
+ * the actual verification.  Only the result is cached, so the verify callback
+ * of the SSL_CTX, if any, is not called on cache hits.
+ */
+static int
+protossl_verify_cert_cb(X509_STORE_CTX *sctx, void *arg)
+{
+	pxy_conn_ctx_t *ctx = arg;
+	X509 *crt = X509_STORE_CTX_get0_cert(sctx);
+	STACK_OF(X509) *chain = X509_STORE_CTX_get0_untrusted(sctx);
+	unsigned int gen = cachevrfy_generation();
+	vrfy_result_t *res;
+	int rv;
+
+	if (!crt)
+		return X509_verify_cert(sctx);
+
+	res = cachemgr_vrfy_get(crt, chain, ctx->sslctx->sni, gen);
+	if (res) {
+		rv = res->result;
+		free(res);
+		ctx->thr->verify_cache_hits++;
+		log_finest_va("Verification cache: HIT, result=%d", rv);
+		X509_STORE_CTX_set_error(sctx, rv);
+		return rv == X509_V_OK;
+	}
+
+	rv = X509_verify_cert(sctx);
+	ctx->thr->verify_cache_misses++;
+	log_finest_va("Verification cache: MISS, result=%d",
+	              X509_STORE_CTX_get_error(sctx));
+	/* negative results are errors, not verification results */
+	if (rv >= 0) {
+		cachemgr_vrfy_set(crt, chain, ctx->sslctx->sni, gen,
+		                  X509_STORE_CTX_get0_chain(sctx),
+		                  X509_STORE_CTX_get_error(sctx),
+		                  ctx->global->verify_cache_ttl);
+	}
+	return rv;
+}
+
 /*
  * Create new SSL context for outgoing connections to the original destination.
  * If hostname sni is provided, use it for Server Name Indication.
@@ -1090,6 +1244,10 @@ protossl_dstssl_create(pxy_conn_ctx_t *ctx)
 	if (ctx->conn_opts->verify_peer) {
 		SSL_CTX_set_verify(sslctx, SSL_VERIFY_PEER, NULL);
 		SSL_CTX_set_default_verify_paths(sslctx);
+		if (ctx->global->verify_cache_ttl) {
+			SSL_CTX_set_cert_verify_callback(sslctx,
+			                                 protossl_verify_cert_cb, ctx);
+		}
 	} else {
 		SSL_CTX_set_verify(sslctx, SSL_VERIFY_NONE, NULL);
 	}
@@ -1262,13 +1420,16 @@ void
 protossl_free(pxy_conn_ctx_t *ctx)
 {
 	if (ctx->sslctx->ssl_names) {
-		free(ctx->sslctx->ssl_names);
+		protossl_free_logstr(ctx->sslctx, ctx->sslctx->ssl_names);
 	}
 	if (ctx->sslctx->origcrtfpr) {
-		free(ctx->sslctx->origcrtfpr);
+		protossl_free_logstr(ctx->sslctx, ctx->sslctx->origcrtfpr);
 	}
 	if (ctx->sslctx->usedcrtfpr) {
-		free(ctx->sslctx->usedcrtfpr);
+		protossl_free_logstr(ctx->sslctx, ctx->sslctx->usedcrtfpr);
+	}
+	if (ctx->sslctx->origcrtmeta) {
+		cachefkcrt_meta_free(ctx->sslctx->origcrtmeta);
 	}
 	if (ctx->sslctx->origcrt) {
 		X509_free(ctx->sslctx->origcrt);
@@ -1276,6 +1437,7 @@ protossl_free(pxy_conn_ctx_t *ctx)
 	if (ctx->sslctx->sni) {
 		free(ctx->sslctx->sni);
 	}
+	ssl_tls_clienthello_asm_free(&ctx->sslctx->clienthello_asm);
 	if (ctx->sslctx->srvdst_ssl_version) {
 		free(ctx->sslctx->srvdst_ssl_version);
 	}
@@ -1289,11 +1451,36 @@ protossl_free(pxy_conn_ctx_t *ctx)
 
 #ifndef OPENSSL_NO_TLSEXT
 /*
- * The SNI hostname has been resolved.  Fill the first resolved address into
- * the context and continue connecting.
+ * A connect attempt to the SNI hostname has won the race.  Fill its address
+ * into the context and continue connecting on its socket.  If all attempts
+ * failed, drop the connection, as if the hostname could not be resolved.
  */
 static void
-protossl_sni_resolve_cb(int errcode, struct evutil_addrinfo *ai, void *arg)
+protossl_sni_connect_cb(evutil_socket_t fd, int error, const struct sockaddr *addr, socklen_t addrlen, void *arg)
+{
+	pxy_conn_ctx_t *ctx = arg;
+
+	log_finest("ENTER");
+
+	if (fd == -1) {
+		log_err_printf("Cannot connect to SNI hostname '%s': %s\n", ctx->sslctx->sni, strerror(error));
+		evutil_closesocket(ctx->fd);
+		pxy_conn_ctx_free(ctx, 1);
+		return;
+	}
+
+	memcpy(&ctx->dstaddr, addr, addrlen);
+	ctx->dstaddrlen = addrlen;
+	ctx->srvdst_early_fd = fd;
+	pxy_conn_connect(ctx);
+}
+
+/*
+ * The SNI hostname has been resolved.  Race connects to the resolved
+ * addresses.
+ */
+static void
+protossl_sni_resolve_cb(int errcode, const dns_addrs_t *addrs, void *arg)
 {
 	pxy_conn_ctx_t *ctx = arg;
 
@@ -1306,23 +1493,61 @@ protossl_sni_resolve_cb(int errcode, struct evutil_addrinfo *ai, void *arg)
 		return;
 	}
 
-	memcpy(&ctx->dstaddr, ai->ai_addr, ai->ai_addrlen);
-	ctx->dstaddrlen = ai->ai_addrlen;
-	evutil_freeaddrinfo(ai);
-	pxy_conn_connect(ctx);
+	if (pxy_dns_connect(ctx->thr->evbase, ctx->global, addrs, ctx->spec->sni_port, protossl_sni_connect_cb, ctx, &ctx->dns_race) == -1) {
+		log_err_level_printf(LOG_CRIT, "Error starting connect to SNI hostname '%s'\n", ctx->sslctx->sni);
+		evutil_closesocket(ctx->fd);
+		pxy_conn_ctx_free(ctx, 1);
+	}
 }
 #endif /* !OPENSSL_NO_TLSEXT */
 
+static void protossl_fd_readcb(evutil_socket_t, short, void *);
+
+/*
+ * Wait for the rest of a truncated ClientHello.  The receive low watermark is
+ * set to the octets the ClientHello assembler needs, so that the fd does not
+ * become readable again before they are all there.  Because we only peek at
+ * the pending octets and never actually read them, the fd would be readable
+ * all the time otherwise.
+ */
+static int NONNULL(1) WUNRES
+protossl_fd_wait_clienthello(pxy_conn_ctx_t *ctx, evutil_socket_t fd)
+{
+	ssl_tls_clienthello_asm_t *chasm = &ctx->sslctx->clienthello_asm;
+	struct timeval timeout = {PROTOSSL_CLIENTHELLO_TIMEOUT, 0};
+	int lowat;
+
+	lowat = chasm->consumed + ssl_tls_clienthello_asm_need(chasm);
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat)) == -1) {
+		log_err_level_printf(LOG_CRIT, "Error setting receive low watermark: %s\n", strerror(errno));
+		return -1;
+	}
+
+	ctx->ev = event_new(ctx->thr->evbase, fd, EV_READ, protossl_fd_readcb, ctx);
+	if (!ctx->ev) {
+		log_err_level(LOG_CRIT, "Error creating ClientHello event, aborting connection");
+		return -1;
+	}
+	if (event_add(ctx->ev, &timeout) == -1)
+		return -1;
+	return 0;
+}
+
 /*
  * The src fd is readable.  This is used to sneak-preview the SNI on SSL
- * connections.  If ctx->ev is NULL, it was called manually for a non-SSL
- * connection.  If ctx->opts->passthrough is set, it was called a second time
- * after the first ssl callout failed because of client cert auth.
+ * connections.  All pending octets up to the size of a ClientHello in a
+ * single record are peeked and fed to the ClientHello assembler, so that a
+ * ClientHello that arrived in one piece is parsed on the first wakeup.  Only
+ * a truncated ClientHello makes us wait for the rest, until it is complete or
+ * PROTOSSL_CLIENTHELLO_TIMEOUT seconds have passed.
  */
 static void
-protossl_fd_readcb(evutil_socket_t fd, UNUSED short what, void *arg)
+protossl_fd_readcb(evutil_socket_t fd, short what, void *arg)
 {
 	pxy_conn_ctx_t *ctx = arg;
+	ssl_tls_clienthello_asm_t *chasm = &ctx->sslctx->clienthello_asm;
+	/* we are only called again after waiting for the rest */
+	int waited = chasm->consumed > 0;
 
 	log_finest("ENTER");
 
@@ -1332,67 +1557,89 @@ protossl_fd_readcb(evutil_socket_t fd, UNUSED short what, void *arg)
 	// Child connections will use the sni info obtained by the parent conn
 	/* for SSL, peek ClientHello and parse SNI from it */
 
-	unsigned char buf[1024];
+	unsigned char *buf;
+	size_t sz;
 	ssize_t n;
-	const unsigned char *chello;
 	int rv;
 
-	n = recv(fd, buf, sizeof(buf), MSG_PEEK);
+	if (what & EV_TIMEOUT) {
+		log_err_printf("Timed out waiting for the rest of the ClientHello, not parsing SNI\n");
+		log_fine("Timed out waiting for the rest of the ClientHello, not parsing SNI");
+		goto connect;
+	}
+
+	/* 5 octets for the record header */
+	sz = ctx->global->clienthello_max_size + 5;
+	if (sz < chasm->consumed + ssl_tls_clienthello_asm_need(chasm))
+		sz = chasm->consumed + ssl_tls_clienthello_asm_need(chasm);
+	buf = malloc(sz);
+	if (!buf) {
+		log_err_level(LOG_CRIT, "Error allocating ClientHello peek buffer, aborting connection");
+		goto out;
+	}
+
+	n = recv(fd, buf, sz, MSG_PEEK);
 	if (n == -1) {
+		free(buf);
 		log_err_printf("Error peeking on fd, aborting connection\n");
 		log_fine("Error peeking on fd, aborting connection");
 		goto out;
 	}
 	if (n == 0) {
+		free(buf);
 		/* socket got closed while we were waiting */
 		log_err_printf("Socket got closed while waiting\n");
 		log_fine("Socket got closed while waiting");
 		goto out;
 	}
+	if ((size_t)n <= chasm->consumed) {
+		free(buf);
+		/* readable below the low watermark, client shut down its
+		 * side after a truncated ClientHello */
+		log_err_printf("Client closed after a truncated ClientHello, not parsing SNI\n");
+		log_fine("Client closed after a truncated ClientHello, not parsing SNI");
+		goto connect;
+	}
 
-	rv = ssl_tls_clienthello_parse(buf, n, 0, &chello, &ctx->sslctx->sni);
-	if ((rv == 1) && !chello) {
+	rv = ssl_tls_clienthello_asm_feed(chasm, buf + chasm->consumed, n - chasm->consumed, &ctx->sslctx->sni);
+	free(buf);
+	if (rv == -1) {
 		log_err_printf("Peeking did not yield a (truncated) ClientHello message, aborting connection\n");
 		log_fine("Peeking did not yield a (truncated) ClientHello message, aborting connection");
 		goto out;
 	}
 	if (OPTS_DEBUG(ctx->global)) {
 		log_dbg_printf("SNI peek: [%s] [%s], fd=%d\n", ctx->sslctx->sni ? ctx->sslctx->sni : "n/a",
-					   ((rv == 1) && chello) ? "incomplete" : "complete", ctx->fd);
-	}
-	if ((rv == 1) && chello && (ctx->sslctx->sni_peek_retries++ < 50)) {
-		/* ssl_tls_clienthello_parse indicates that we
-		 * should retry later when we have more data, and we
-		 * haven't reached the maximum retry count yet.
-		 * Reschedule this event as timeout-only event in
-		 * order to prevent busy looping over the read event.
-		 * Because we only peeked at the pending bytes and
-		 * never actually read them, fd is still ready for
-		 * reading now.  We use 25 * 0.2 s = 5 s timeout. */
-		struct timeval retry_delay = {0, 100};
-
-		ctx->ev = event_new(ctx->thr->evbase, fd, 0, protossl_fd_readcb, ctx);
-		if (!ctx->ev) {
-			log_err_level(LOG_CRIT, "Error creating retry event, aborting connection");
-			goto out;
-		}
-		if (event_add(ctx->ev, &retry_delay) == -1)
+					   (rv == 1) ? "incomplete" : ((rv == 2) ? "too large" : "complete"), ctx->fd);
+	}
+	if (rv == 0 && OPTS_DEBUG(ctx->global)) {
+		char *ja3 = ssl_tls_clienthello_ja3_hash(&chasm->info);
+		log_dbg_printf("ClientHello JA3: %s, fd=%d\n", ja3 ? ja3 : "n/a", ctx->fd);
+		if (ja3)
+			free(ja3);
+	}
+	if (rv == 1) {
+		if (protossl_fd_wait_clienthello(ctx, fd) == -1)
 			goto out;
 		return;
 	}
+	if (rv == 2) {
+		log_fine_va("ClientHello larger than ClientHelloMaxSize %u, not parsing SNI", ctx->global->clienthello_max_size);
+	}
 
-	if (ctx->sslctx->sni && !ctx->dstaddrlen && ctx->spec->sni_port) {
-		char sniport[6];
-		struct evutil_addrinfo hints;
-
-		memset(&hints, 0, sizeof(hints));
-		hints.ai_family = ctx->af;
-		hints.ai_flags = EVUTIL_AI_ADDRCONFIG;
-		hints.ai_socktype = SOCK_STREAM;
-		hints.ai_protocol = IPPROTO_TCP;
+connect:
+	if (waited) {
+		/* reset the receive low watermark */
+		int lowat = 1;
+		setsockopt(fd, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat));
+	}
+	ssl_tls_clienthello_asm_free(chasm);
 
-		snprintf(sniport, sizeof(sniport), "%i", ctx->spec->sni_port);
-		evdns_getaddrinfo(ctx->thr->dnsbase, ctx->sslctx->sni, sniport, &hints, protossl_sni_resolve_cb, ctx);
+	if (ctx->sslctx->sni && !ctx->dstaddrlen && ctx->spec->sni_port) {
+		if (pxy_dns_resolve(ctx->thr->evbase, ctx->thr->dnsbase, ctx->global, ctx->sslctx->sni, protossl_sni_resolve_cb, ctx, &ctx->dns_waiter) == -1) {
+			log_err_level_printf(LOG_CRIT, "Error resolving SNI hostname '%s'\n", ctx->sslctx->sni);
+			goto out;
+		}
 		return;
 	}
 
@@ -1403,6 +1650,35 @@ out:
 	pxy_conn_ctx_free(ctx, 1);
 }
 
+/*
+ * Start connecting to a destination known at accept time, i.e. by NAT lookup
+ * or static address, while waiting for the ClientHello.  This takes the
+ * connect round trip off the handshake.  The socket is closed with the conn
+ * if the conn never gets to connect.  Failures are not fatal, the conn
+ * connects as usual then.
+ */
+static void NONNULL(1)
+protossl_connect_early(pxy_conn_ctx_t *ctx)
+{
+	evutil_socket_t fd;
+
+	fd = socket(ctx->dstaddr.ss_family, SOCK_STREAM, 0);
+	if (fd == -1)
+		return;
+
+	if (evutil_make_socket_nonblocking(fd) == -1 ||
+	    evutil_make_socket_closeonexec(fd) == -1 ||
+	    (connect(fd, (struct sockaddr *)&ctx->dstaddr, ctx->dstaddrlen) == -1 && errno != EINPROGRESS)) {
+		log_finer_va("Speculative connect failed, fd=%d: %s", fd, strerror(errno));
+		evutil_closesocket(fd);
+		return;
+	}
+
+	log_finer_va("Speculative connect started, fd=%d", fd);
+	ctx->srvdst_early_fd = fd;
+	ctx->srvdst_early_connecting = 1;
+}
+
 void
 protossl_init_conn(evutil_socket_t fd, UNUSED short what, void *arg)
 {
@@ -1421,6 +1697,12 @@ protossl_init_conn(evutil_socket_t fd, UNUSED short what, void *arg)
 	return;
 #endif /* !OPENSSL_NO_TLSEXT */
 
+	if (ctx->global->speculative_connect && ctx->dstaddrlen) {
+		protossl_connect_early(ctx);
+	}
+
+	ssl_tls_clienthello_asm_init(&ctx->sslctx->clienthello_asm, ctx->global->clienthello_max_size);
+
 	/* for SSL, defer dst connection setup to initial_readcb */
 	ctx->ev = event_new(ctx->thr->evbase, ctx->fd, EV_READ, protossl_fd_readcb, ctx);
 	if (!ctx->ev)
@@ -1601,6 +1883,62 @@ protossl_setup_src_ssl_from_child_dst(pxy_conn_child_ctx_t *ctx)
 	return -1;
 }
 
+/*
+ * Called on each change of the src outbuf, before the data is written.
+ * OpenSSL splits the data into records of at most max_send_fragment bytes on
+ * SSL_write(), so setting it here applies to the data just added.
+ */
+static void
+protossl_record_sizing_outbuf_cb(UNUSED struct evbuffer *buf, const struct evbuffer_cb_info *info, void *arg)
+{
+	pxy_conn_ctx_t *ctx = arg;
+	struct timeval now, idle;
+
+	if (!info->n_added || !ctx->src.ssl)
+		return;
+
+	event_base_gettimeofday_cached(ctx->thr->evbase, &now);
+	evutil_timersub(&now, &ctx->sslctx->drs_atime, &idle);
+	ctx->sslctx->drs_atime = now;
+
+	if (idle.tv_sec * 1000 + idle.tv_usec / 1000 >= PROTOSSL_DRS_IDLE_MSEC) {
+		ctx->sslctx->drs_bytes = 0;
+		if (ctx->sslctx->drs_full_records) {
+			SSL_set_max_send_fragment(ctx->src.ssl, PROTOSSL_DRS_SMALL_RECORD);
+			ctx->sslctx->drs_full_records = 0;
+		}
+	}
+
+	ctx->sslctx->drs_bytes += info->n_added;
+	if (!ctx->sslctx->drs_full_records && ctx->sslctx->drs_bytes >= PROTOSSL_DRS_BYTES) {
+		SSL_set_max_send_fragment(ctx->src.ssl, SSL3_RT_MAX_PLAIN_LENGTH);
+#ifdef SSL_CTRL_SET_SPLIT_SEND_FRAGMENT
+		// Lowering max_send_fragment lowers split_send_fragment too, but raising it does not
+		SSL_set_split_send_fragment(ctx->src.ssl, SSL3_RT_MAX_PLAIN_LENGTH);
+#endif /* SSL_CTRL_SET_SPLIT_SEND_FRAGMENT */
+		ctx->sslctx->drs_full_records = 1;
+	}
+}
+
+/*
+ * Start writing small records to the client, if DynamicRecordSizing is enabled.
+ * Must be called after the src bev is created.
+ */
+void
+protossl_setup_record_sizing(pxy_conn_ctx_t *ctx)
+{
+	if (!ctx->conn_opts->dynamic_record_sizing)
+		return;
+
+	if (!evbuffer_add_cb(bufferevent_get_output(ctx->src.bev), protossl_record_sizing_outbuf_cb, ctx)) {
+		log_err_level_printf(LOG_WARNING, "Failed to enable dynamic record sizing\n");
+		return;
+	}
+	SSL_set_max_send_fragment(ctx->src.ssl, PROTOSSL_DRS_SMALL_RECORD);
+	ctx->sslctx->drs_full_records = 0;
+	log_finest("Enabled dynamic record sizing");
+}
+
 static int NONNULL(1)
 protossl_setup_src(pxy_conn_ctx_t *ctx)
 {
@@ -1618,6 +1956,7 @@ protossl_setup_src(pxy_conn_ctx_t *ctx)
 		return -1;
 	}
 	ctx->src.free = protossl_bufferevent_free_and_close_fd;
+	protossl_setup_record_sizing(ctx);
 	return 0;
 }
 
@@ -1635,6 +1974,7 @@ protossl_enable_src(pxy_conn_ctx_t *ctx)
 	// Save the srvdst ssl info for logging
 	ctx->sslctx->srvdst_ssl_version = strdup(SSL_get_version(ctx->srvdst.ssl));
 	ctx->sslctx->srvdst_ssl_cipher = strdup(SSL_get_cipher(ctx->srvdst.ssl));
+	ctx->sslctx->srvdst_ktls = protossl_ktls_str(ctx->srvdst.ssl);
 
 	if (pxy_setup_child_listener(ctx) == -1) {
 		return -1;
@@ -1686,12 +2026,7 @@ protossl_bev_eventcb_connected_srvdst(UNUSED struct bufferevent *bev, pxy_conn_c
 	}
 
 	if (ctx->divert) {
-		bufferevent_setcb(ctx->dst.bev, pxy_bev_readcb, pxy_bev_writecb, pxy_bev_eventcb, ctx);
-		if (bufferevent_socket_connect(ctx->dst.bev, (struct sockaddr *)&ctx->spec->divert_addr, ctx->spec->divert_addrlen) == -1) {
-			log_fine("FAILED bufferevent_socket_connect for divert addr");
-			pxy_conn_term(ctx, 1);
-			return;
-		}
+		prototcp_connect_divert_dst(ctx);
 	}
 }
 
@@ -34,6 +34,7 @@
 
 int protossl_log_masterkey(pxy_conn_ctx_t *, pxy_conn_desc_t *) NONNULL(1,2);
 void protossl_log_ssl_error(struct bufferevent *, pxy_conn_ctx_t *) NONNULL(1,2);
+const char *protossl_ktls_str(SSL *) NONNULL(1);
 
 // @todo Used externally by pxy_log_connect_src(), create tcp and ssl versions of that function instead?
 void protossl_srccert_write(pxy_conn_ctx_t *) NONNULL(1);
@@ -48,6 +49,7 @@ int protossl_enable_src(pxy_conn_ctx_t *) NONNULL(1);
 
 int protossl_setup_src_ssl_from_dst(pxy_conn_ctx_t *) NONNULL(1);
 int protossl_setup_src_ssl_from_child_dst(pxy_conn_child_ctx_t *) NONNULL(1);
+void protossl_setup_record_sizing(pxy_conn_ctx_t *) NONNULL(1);
 
 int protossl_setup_dst_ssl(pxy_conn_ctx_t *) NONNULL(1);
 int protossl_setup_dst_ssl_child(pxy_conn_child_ctx_t *) NONNULL(1);
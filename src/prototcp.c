@@ -29,6 +29,8 @@
 
 #include "prototcp.h"
 #include "protopassthrough.h"
+#include "pxypool.h"
+#include "sys.h"
 
 #include <sys/param.h>
 #include <string.h>
@@ -172,6 +174,39 @@ prototcp_setup_dst(pxy_conn_ctx_t *ctx)
 	return 0;
 }
 
+/*
+ * Connect the parent dst to the divert address.
+ * Takes an already established conn from the divert pool of the thread if
+ * there is one, otherwise connects as usual. Either way the listening program
+ * identifies the conn by the SSLproxy line.
+ */
+int
+prototcp_connect_divert_dst(pxy_conn_ctx_t *ctx)
+{
+	bufferevent_setcb(ctx->dst.bev, pxy_bev_readcb, pxy_bev_writecb, pxy_bev_eventcb, ctx);
+
+	evutil_socket_t fd = pxy_pool_take(ctx->thr, ctx->spec);
+	if (fd != -1) {
+		log_finer_va("Using divert pool conn, fd=%d", fd);
+		if (bufferevent_setfd(ctx->dst.bev, fd) == -1) {
+			log_fine("FAILED bufferevent_setfd for divert pool conn");
+			evutil_closesocket(fd);
+			pxy_conn_term(ctx, 1);
+			return -1;
+		}
+		// Raise the connected event as bufferevent_socket_connect() would, deferred
+		bufferevent_trigger_event(ctx->dst.bev, BEV_EVENT_CONNECTED, BEV_TRIG_DEFER_CALLBACKS);
+		return 0;
+	}
+
+	if (bufferevent_socket_connect(ctx->dst.bev, (struct sockaddr *)&ctx->spec->divert_addr, ctx->spec->divert_addrlen) == -1) {
+		log_fine("FAILED bufferevent_socket_connect for divert addr");
+		pxy_conn_term(ctx, 1);
+		return -1;
+	}
+	return 0;
+}
+
 int
 prototcp_setup_srvdst(pxy_conn_ctx_t *ctx)
 {
@@ -290,15 +325,59 @@ prototcp_get_event_name(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 }
 #endif /* DEBUG_PROXY */
 
+/*
+ * Return the outbuf limit of the other end, given the length len of its
+ * output buffer.  In adaptive mode, the limit is recomputed only when len
+ * reaches the current limit, which avoids a getsockopt() call on each read,
+ * and is kept per conn end, since each end has its own path to its peer.
+ * The adaptive limit is twice the bandwidth-delay product of the socket of
+ * the other end, but not more than the fair share of the global memory budget
+ * per conn direction.  Filter bevs, such as those of autossl after the
+ * upgrade, use the socket of their underlying bev.  If the estimate is not
+ * available, the static limit is used.
+ */
+size_t
+prototcp_get_outbuf_limit(pxy_conn_ctx_t *ctx, pxy_conn_desc_t *other, size_t len)
+{
+	size_t limit = other->outbuf_limit ? other->outbuf_limit : ctx->conn_opts->outbuf_limit;
+
+	if (!ctx->conn_opts->adaptive_outbuf_limit || !other->bev || len < limit)
+		return limit;
+
+	evutil_socket_t fd = bufferevent_getfd(other->bev);
+	if (fd == -1) {
+		struct bufferevent *ubev = bufferevent_get_underlying(other->bev);
+		if (ubev)
+			fd = bufferevent_getfd(ubev);
+	}
+
+	size_t bdp = sys_get_sock_bdp(fd);
+	limit = bdp ? 2 * bdp : ctx->conn_opts->outbuf_limit;
+
+	if (ctx->global->outbuf_mem_budget) {
+		size_t conns = pxy_thrmgr_get_load(ctx->thrmgr);
+		size_t share = ((size_t)ctx->global->outbuf_mem_budget * 1024 * 1024) / (2 * (conns ? conns : 1));
+		limit = MIN(limit, share);
+	}
+	limit = MIN(MAX(limit, ADAPTIVE_OUTBUF_LIMIT_MIN), ADAPTIVE_OUTBUF_LIMIT_MAX);
+
+	log_finer_va("Adaptive outbuf limit=%zu, bdp=%zu, fd=%d", limit, bdp, fd);
+	other->outbuf_limit = limit;
+	return limit;
+}
+
 void
-prototcp_try_set_watermark(struct bufferevent *bev, pxy_conn_ctx_t *ctx, struct bufferevent *other)
+prototcp_try_set_watermark(struct bufferevent *bev, pxy_conn_ctx_t *ctx, pxy_conn_desc_t *other)
 {
-	if (evbuffer_get_length(bufferevent_get_output(other)) >= OUTBUF_LIMIT) {
+	size_t len = evbuffer_get_length(bufferevent_get_output(other->bev));
+	size_t limit = prototcp_get_outbuf_limit(ctx, other, len);
+
+	if (len >= limit) {
 		log_fine_va("%s", prototcp_get_event_name(bev, ctx));
 
 		/* temporarily disable data source;
 		 * set an appropriate watermark. */
-		bufferevent_setwatermark(other, EV_WRITE, OUTBUF_LIMIT/2, OUTBUF_LIMIT);
+		bufferevent_setwatermark(other->bev, EV_WRITE, limit/2, limit);
 		bufferevent_disable(bev, EV_READ);
 		ctx->thr->set_watermarks++;
 	}
@@ -417,7 +496,7 @@ prototcp_bev_readcb_src(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 		return;
 	}
 
-	ctx->protoctx->set_watermarkcb(bev, ctx, ctx->dst.bev);
+	ctx->protoctx->set_watermarkcb(bev, ctx, &ctx->dst);
 }
 
 void
@@ -431,7 +510,7 @@ prototcp_bev_readcb_dst(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 	}
 
 	evbuffer_add_buffer(bufferevent_get_output(ctx->src.bev), bufferevent_get_input(bev));
-	ctx->protoctx->set_watermarkcb(bev, ctx, ctx->src.bev);
+	ctx->protoctx->set_watermarkcb(bev, ctx, &ctx->src);
 }
 
 static void NONNULL(1)
@@ -470,7 +549,7 @@ prototcp_bev_readcb_src_child(struct bufferevent *bev, pxy_conn_child_ctx_t *ctx
 	} else {
 		evbuffer_add_buffer(outbuf, inbuf);
 	}
-	ctx->conn->protoctx->set_watermarkcb(bev, ctx->conn, ctx->dst.bev);
+	ctx->conn->protoctx->set_watermarkcb(bev, ctx->conn, &ctx->dst);
 }
 
 static void NONNULL(1)
@@ -484,7 +563,7 @@ prototcp_bev_readcb_dst_child(struct bufferevent *bev, pxy_conn_child_ctx_t *ctx
 	}
 
 	evbuffer_add_buffer(bufferevent_get_output(ctx->src.bev), bufferevent_get_input(bev));
-	ctx->conn->protoctx->set_watermarkcb(bev, ctx->conn, ctx->src.bev);
+	ctx->conn->protoctx->set_watermarkcb(bev, ctx->conn, &ctx->src);
 }
 
 static int NONNULL(1) WUNRES
@@ -672,12 +751,7 @@ prototcp_bev_eventcb_connected_srvdst(UNUSED struct bufferevent *bev, pxy_conn_c
 	}
 
 	if (ctx->divert) {
-		bufferevent_setcb(ctx->dst.bev, pxy_bev_readcb, pxy_bev_writecb, pxy_bev_eventcb, ctx);
-		if (bufferevent_socket_connect(ctx->dst.bev, (struct sockaddr *)&ctx->spec->divert_addr, ctx->spec->divert_addrlen) == -1) {
-			log_fine("FAILED bufferevent_socket_connect for divert addr");
-			pxy_conn_term(ctx, 1);
-			return;
-		}
+		prototcp_connect_divert_dst(ctx);
 	}
 }
 
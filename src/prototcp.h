@@ -33,10 +33,10 @@
 #include "pxyconn.h"
 
 /*
- * Maximum size of data to buffer per connection direction before
- * temporarily stopping to read data from the other end.
+ * Bounds of the outbuf limit computed in adaptive mode.
  */
-#define OUTBUF_LIMIT	(128*1024)
+#define ADAPTIVE_OUTBUF_LIMIT_MIN	(16*1024)
+#define ADAPTIVE_OUTBUF_LIMIT_MAX	(64*1024*1024)
 
 #ifdef DEBUG_PROXY
 void prototcp_log_dbg_evbuf_info(pxy_conn_ctx_t *, pxy_conn_desc_t *, pxy_conn_desc_t *) NONNULL(1,2,3);
@@ -47,7 +47,8 @@ void prototcp_init_conn(evutil_socket_t, short, void *);
 #ifdef DEBUG_PROXY
 char *prototcp_get_event_name(struct bufferevent *, pxy_conn_ctx_t *) NONNULL(2);
 #endif /* DEBUG_PROXY */
-void prototcp_try_set_watermark(struct bufferevent *, pxy_conn_ctx_t *, struct bufferevent *) NONNULL(1,2,3);
+size_t prototcp_get_outbuf_limit(pxy_conn_ctx_t *, pxy_conn_desc_t *, size_t) NONNULL(1,2) WUNRES;
+void prototcp_try_set_watermark(struct bufferevent *, pxy_conn_ctx_t *, pxy_conn_desc_t *) NONNULL(1,2,3);
 void prototcp_try_unset_watermark(struct bufferevent *, pxy_conn_ctx_t *, pxy_conn_desc_t *) NONNULL(1,2,3);
 
 void prototcp_try_discard_inbuf(struct bufferevent *) NONNULL(1);
@@ -91,6 +92,7 @@ void prototcp_bev_eventcb_srvdst(struct bufferevent *, short, pxy_conn_ctx_t *)
 int prototcp_setup_src(pxy_conn_ctx_t *) NONNULL(1);
 void prototcp_disable_srvdst(pxy_conn_ctx_t *) NONNULL(1);
 int prototcp_setup_dst(pxy_conn_ctx_t *) NONNULL(1);
+int prototcp_connect_divert_dst(pxy_conn_ctx_t *) NONNULL(1);
 int prototcp_setup_srvdst(pxy_conn_ctx_t *) NONNULL(1);
 
 int prototcp_setup_src_child(pxy_conn_child_ctx_t *) NONNULL(1);
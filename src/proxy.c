@@ -38,8 +38,11 @@
 #include "protosmtp.h"
 #include "protoautossl.h"
 #include "cachemgr.h"
+#include "filter.h"
+#include "extlist.h"
 #include "opts.h"
 #include "log.h"
+#include "build.h"
 #include "attrib.h"
 
 #include <sys/types.h>
@@ -50,6 +53,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include <event2/event.h>
 #include <event2/listener.h>
@@ -62,16 +66,24 @@
  * Proxy engine, built around libevent 2.x.
  */
 
-static int signals[] = { SIGTERM, SIGQUIT, SIGHUP, SIGINT, SIGPIPE, SIGUSR1 };
+static int signals[] = { SIGTERM, SIGQUIT, SIGHUP, SIGINT, SIGPIPE, SIGUSR1, SIGUSR2 };
 
 struct proxy_ctx {
 	pxy_thrmgr_ctx_t *thrmgr;
 	struct event_base *evbase;
 	struct event *sev[sizeof(signals)/sizeof(int)];
 	struct event *gcev;
+	struct event *listev;
+	struct event *reloadev;
 	struct proxy_listener_ctx *lctx;
 	global_t *global;
 	int loopbreak_reason;
+	/* filter reload thread, results are read after joining it */
+	pthread_t reload_thr;
+	unsigned int reload_running : 1;
+	unsigned int reload_pending : 1;
+	int reload_lists;
+	struct filter **reload_filters;
 };
 
 static proxy_listener_ctx_t * MALLOC
@@ -168,13 +180,16 @@ proxy_conn_ctx_new(evutil_socket_t fd,
 #endif /* DEBUG_PROXY */
 	ctx->conn = ctx;
 	ctx->fd = fd;
+	ctx->srvdst_early_fd = -1;
 	ctx->thrmgr = thrmgr;
 	ctx->spec = spec;
+	ctx->global = global;
 	ctx->conn_opts = spec->conn_opts;
 	ctx->divert = spec->opts->divert;
+	ctx->filter = filter_acquire(spec->opts);
 
 	// Enable all logging for conn if proxyspec does not have any filter
-	if (!spec->opts->filter) {
+	if (!ctx->filter) {
 		ctx->log_connect = 1;
 		ctx->log_master = 1;
 		ctx->log_cert = 1;
@@ -187,11 +202,11 @@ proxy_conn_ctx_new(evutil_socket_t fd,
 
 	ctx->proto = proxy_setup_proto(ctx);
 	if (ctx->proto == PROTO_ERROR) {
+		filter_release(ctx->filter);
 		free(ctx);
 		return NULL;
 	}
 
-	ctx->global = global;
 #ifndef WITHOUT_USERAUTH
 	ctx->clisock = clisock;
 #endif /* !WITHOUT_USERAUTH */
@@ -223,6 +238,7 @@ proxy_conn_ctx_free(pxy_conn_ctx_t *ctx)
 		ctx->protoctx->proto_free(ctx);
 	}
 	free(ctx->protoctx);
+	filter_release(ctx->filter);
 	free(ctx);
 }
 
@@ -361,7 +377,94 @@ proxy_listener_setup(struct event_base *evbase, pxy_thrmgr_ctx_t *thrmgr,
 }
 
 /*
- * Signal handler for SIGTERM, SIGQUIT, SIGINT, SIGHUP, SIGPIPE and SIGUSR1.
+ * Reload the filter list files which have changed, leaving the rest of the
+ * filters as they are.
+ */
+static void
+proxy_refresh_lists(void)
+{
+	int rv = extlist_refresh_all();
+	if (rv == -1) {
+		log_err_level_printf(LOG_WARNING, "Failed to refresh filter lists, keeping their old entries\n");
+	} else if (rv > 0) {
+		log_dbg_printf("Refreshed %d filter lists\n", rv);
+	}
+	// Filter decisions cached before the refresh may not be valid anymore
+	if (rv != 0)
+		filter_invalidate();
+}
+
+/*
+ * Filter reload thread: re-read the filter list files and the filtering
+ * rules off the event loop, then pass the filters to proxy_reload_cb().
+ */
+static void *
+proxy_reload_thr(void *arg)
+{
+	proxy_ctx_t *ctx = arg;
+
+	ctx->reload_lists = extlist_refresh_all();
+	ctx->reload_filters = global_load_filters(ctx->global, build_pkgname);
+	event_active(ctx->reloadev, 0, 0);
+	return NULL;
+}
+
+/*
+ * Start reloading the filtering rules, or reload once more after the
+ * running reload has finished, so that the last SIGHUP wins.
+ */
+static void
+proxy_reload_start(proxy_ctx_t *ctx)
+{
+	if (ctx->reload_running) {
+		ctx->reload_pending = 1;
+		return;
+	}
+	if (pthread_create(&ctx->reload_thr, NULL, proxy_reload_thr, ctx) != 0) {
+		log_err_level_printf(LOG_WARNING, "Failed to start reloading filtering rules, keeping running rules\n");
+		return;
+	}
+	ctx->reload_running = 1;
+}
+
+/*
+ * Filter reload completion handler, publishes the reloaded filters.
+ */
+static void
+proxy_reload_cb(UNUSED evutil_socket_t fd, UNUSED short what, void *arg)
+{
+	proxy_ctx_t *ctx = arg;
+
+	pthread_join(ctx->reload_thr, NULL);
+	ctx->reload_running = 0;
+
+	if (ctx->reload_lists == -1) {
+		log_err_level_printf(LOG_WARNING, "Failed to refresh filter lists, keeping their old entries\n");
+	} else if (ctx->reload_lists > 0) {
+		log_dbg_printf("Refreshed %d filter lists\n", ctx->reload_lists);
+	}
+
+	/* conns keep the filter they have started with */
+	if (ctx->reload_filters) {
+		global_publish_filters(ctx->global, ctx->reload_filters);
+		ctx->reload_filters = NULL;
+		log_dbg_printf("Reloaded filtering rules\n");
+	} else {
+		log_err_level_printf(LOG_WARNING, "Failed to reload filtering rules, keeping running rules\n");
+		// Filter decisions cached before the refresh may not be valid anymore
+		if (ctx->reload_lists != 0)
+			filter_invalidate();
+	}
+
+	if (ctx->reload_pending) {
+		ctx->reload_pending = 0;
+		proxy_reload_start(ctx);
+	}
+}
+
+/*
+ * Signal handler for SIGTERM, SIGQUIT, SIGINT, SIGHUP, SIGPIPE, SIGUSR1 and
+ * SIGUSR2.
  */
 static void
 proxy_signal_cb(evutil_socket_t fd, UNUSED short what, void *arg)
@@ -379,6 +482,12 @@ proxy_signal_cb(evutil_socket_t fd, UNUSED short what, void *arg)
 		proxy_loopbreak(ctx, fd);
 		break;
 	case SIGHUP:
+		/* the trust store is loaded per conn, so may have changed */
+		cachemgr_vrfy_invalidate();
+		log_dbg_printf("Invalidated verification cache\n");
+		/* parsing and compiling filters may take long, so use a thread */
+		proxy_reload_start(ctx);
+		/* FALLTHROUGH */
 	case SIGUSR1:
 		if (log_reopen() == -1) {
 			log_err_level_printf(LOG_WARNING, "Failed to reopen logs\n");
@@ -386,6 +495,9 @@ proxy_signal_cb(evutil_socket_t fd, UNUSED short what, void *arg)
 			log_dbg_printf("Reopened log files\n");
 		}
 		break;
+	case SIGUSR2:
+		proxy_refresh_lists();
+		break;
 	case SIGPIPE:
 		log_err_level_printf(LOG_WARNING, "Received SIGPIPE; ignoring.\n");
 		break;
@@ -412,6 +524,15 @@ proxy_gc_cb(UNUSED evutil_socket_t fd, UNUSED short what, void *arg)
 		log_dbg_printf("Garbage collecting caches done.\n");
 }
 
+/*
+ * Filter list refresh handler.
+ */
+static void
+proxy_list_cb(UNUSED evutil_socket_t fd, UNUSED short what, UNUSED void *arg)
+{
+	proxy_refresh_lists();
+}
+
 /*
  * Set up the core event loop.
  * Socket clisock is the privsep client socket used for binding to ports.
@@ -507,6 +628,18 @@ proxy_new(global_t *global, int clisock)
 		goto leave4;
 	evtimer_add(ctx->gcev, &gc_delay);
 
+	ctx->reloadev = event_new(ctx->evbase, -1, 0, proxy_reload_cb, ctx);
+	if (!ctx->reloadev)
+		goto leave4;
+
+	if (global->filter_list_refresh) {
+		struct timeval list_delay = {global->filter_list_refresh, 0};
+		ctx->listev = event_new(ctx->evbase, -1, EV_PERSIST, proxy_list_cb, ctx);
+		if (!ctx->listev)
+			goto leave4;
+		evtimer_add(ctx->listev, &list_delay);
+	}
+
 	// @attention Do not close privsep sock if the USERAUTH feature is compiled in, we use it to update user atime
 #ifdef WITHOUT_USERAUTH
 	privsep_client_close(clisock);
@@ -514,6 +647,12 @@ proxy_new(global_t *global, int clisock)
 	return ctx;
 
 leave4:
+	if (ctx->reloadev) {
+		event_free(ctx->reloadev);
+	}
+	if (ctx->listev) {
+		event_free(ctx->listev);
+	}
 	if (ctx->gcev) {
 		event_free(ctx->gcev);
 	}
@@ -585,6 +724,17 @@ proxy_loopbreak(proxy_ctx_t *ctx, int reason)
 void
 proxy_free(proxy_ctx_t *ctx)
 {
+	if (ctx->reload_running) {
+		pthread_join(ctx->reload_thr, NULL);
+		if (ctx->reload_filters)
+			global_filters_free(ctx->global, ctx->reload_filters);
+	}
+	if (ctx->reloadev) {
+		event_free(ctx->reloadev);
+	}
+	if (ctx->listev) {
+		event_free(ctx->listev);
+	}
 	if (ctx->gcev) {
 		event_free(ctx->gcev);
 	}
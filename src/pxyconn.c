@@ -42,11 +42,15 @@
 #include "log.h"
 #include "attrib.h"
 #include "proc.h"
+#include "pxydns.h"
 #include "util.h"
 
 #include <string.h>
+#include <stdint.h>
+#include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/param.h>
+#include <sys/un.h>
 #include <assert.h>
 
 #include <event2/listener.h>
@@ -178,7 +182,7 @@ pxy_conn_attach_child(pxy_conn_child_ctx_t *ctx)
 
 	// @attention Child connections use the parent's event bases, otherwise we would get multithreading issues
 	// Always keep thr load and conns list in sync
-	ctx->conn->thr->load++;
+	__atomic_add_fetch(&ctx->conn->thr->load, 1, __ATOMIC_RELAXED);
 	ctx->conn->thr->max_load = max(ctx->conn->thr->max_load, ctx->conn->thr->load);
 
 	// Prepend child to the children list of parent
@@ -197,7 +201,7 @@ pxy_conn_detach_child(pxy_conn_child_ctx_t *ctx)
 
 	log_finest("Removing child conn");
 
-	ctx->conn->thr->load--;
+	__atomic_sub_fetch(&ctx->conn->thr->load, 1, __ATOMIC_RELAXED);
 
 	if (ctx->prev) {
 		ctx->prev->next = ctx->next;
@@ -274,6 +278,35 @@ pxy_conn_term_child(pxy_conn_child_ctx_t *ctx)
 	ctx->term = 1;
 }
 
+/*
+ * Child listeners of a conn with a unix domain socket return address bind to
+ * the ReturnAddr path suffixed with the pid and the listener fd, which is
+ * unique while the listener fd is open.
+ */
+static int WUNRES NONNULL(1,2)
+pxy_child_unix_addr(pxy_conn_ctx_t *ctx, struct sockaddr_un *sun, evutil_socket_t fd)
+{
+	memset(sun, 0, sizeof(struct sockaddr_un));
+	sun->sun_family = AF_UNIX;
+
+	int rv = snprintf(sun->sun_path, sizeof(sun->sun_path), "%s.%ld.%d",
+			((struct sockaddr_un *)&ctx->spec->return_addr)->sun_path, (long)getpid(), fd);
+	if (rv < 0 || (size_t)rv >= sizeof(sun->sun_path)) {
+		return -1;
+	}
+	return 0;
+}
+
+static void NONNULL(1)
+pxy_unlink_child_unix(pxy_conn_ctx_t *ctx)
+{
+	struct sockaddr_un sun;
+
+	if (ctx->spec->return_addr.ss_family == AF_UNIX && pxy_child_unix_addr(ctx, &sun, ctx->child_fd) == 0) {
+		unlink(sun.sun_path);
+	}
+}
+
 void
 pxy_conn_free_children(pxy_conn_ctx_t *ctx)
 {
@@ -288,6 +321,9 @@ pxy_conn_free_children(pxy_conn_ctx_t *ctx)
 	if (ctx->child_evcl) {
 		log_finer_va("Freeing child_evcl, children fd=%d", ctx->children ? ctx->children->fd : -1);
 
+		// @attention Unlink before closing the fd, the path is unique only while the fd is open
+		pxy_unlink_child_unix(ctx);
+
 		// @attention child_evcl was created with LEV_OPT_CLOSE_ON_FREE, so do not close ctx->child_fd
 		evconnlistener_free(ctx->child_evcl);
 		ctx->child_evcl = NULL;
@@ -305,6 +341,15 @@ pxy_conn_ctx_free(pxy_conn_ctx_t *ctx, int by_requestor)
 {
 	log_finest("ENTER");
 
+	// The conn may be freed while waiting for the SNI hostname lookup or
+	// connect race, e.g. by the idle conn timer
+	if (ctx->dns_waiter) {
+		pxy_dns_resolve_cancel(ctx->dns_waiter);
+	}
+	if (ctx->dns_race) {
+		pxy_dns_connect_cancel(ctx->dns_race);
+	}
+
 	if (WANT_CONTENT_LOG(ctx)) {
 		// Always try to close log files, even if content, pcap, or mirror logging is disabled by filter rules
 		// The log files may have been initialized and opened
@@ -366,6 +411,9 @@ pxy_conn_ctx_free(pxy_conn_ctx_t *ctx, int by_requestor)
 	if (ctx->ev) {
 		event_free(ctx->ev);
 	}
+	if (ctx->srvdst_early_fd != -1) {
+		evutil_closesocket(ctx->srvdst_early_fd);
+	}
 	if (ctx->sslproxy_header) {
 		free(ctx->sslproxy_header);
 	}
@@ -386,6 +434,7 @@ pxy_conn_ctx_free(pxy_conn_ctx_t *ctx, int by_requestor)
 		free(ctx->desc);
 	}
 #endif /* !WITHOUT_USERAUTH */
+	filter_release(ctx->filter);
 	free(ctx);
 }
 
@@ -484,10 +533,17 @@ pxy_log_connect_nonhttp(pxy_conn_ctx_t *ctx)
 #endif /* !WITHOUT_USERAUTH */
 		              );
 	} else {
+		/* only log kTLS state if requested, keeps the log format unchanged otherwise */
+		char ktls[24] = "";
+		if (ctx->conn_opts->ktls) {
+			snprintf(ktls, sizeof(ktls), " ktls:%s:%s",
+			         protossl_ktls_str(ctx->src.ssl),
+			         STRORDASH(ctx->sslctx->srvdst_ktls));
+		}
 		rv = asprintf(&msg, "CONN: %s %s %s %s %s "
 		              "sni:%s names:%s "
 		              "sproto:%s:%s dproto:%s:%s "
-		              "origcrt:%s usedcrt:%s"
+		              "origcrt:%s usedcrt:%s%s"
 #ifdef HAVE_LOCAL_PROCINFO
 		              " %s"
 #endif /* HAVE_LOCAL_PROCINFO */
@@ -507,7 +563,8 @@ pxy_log_connect_nonhttp(pxy_conn_ctx_t *ctx)
 		              STRORDASH(ctx->sslctx->srvdst_ssl_version),
 		              STRORDASH(ctx->sslctx->srvdst_ssl_cipher),
 		              STRORDASH(ctx->sslctx->origcrtfpr),
-		              STRORDASH(ctx->sslctx->usedcrtfpr)
+		              STRORDASH(ctx->sslctx->usedcrtfpr),
+		              ktls
 #ifdef HAVE_LOCAL_PROCINFO
 		              , lpi
 #endif /* HAVE_LOCAL_PROCINFO */
@@ -1047,7 +1104,8 @@ out:
 static int WUNRES NONNULL(1)
 pxy_opensock_child(pxy_conn_ctx_t *ctx)
 {
-	evutil_socket_t fd = socket(ctx->spec->return_addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+	int af = ctx->spec->return_addr.ss_family;
+	evutil_socket_t fd = socket(af, SOCK_STREAM, af == AF_UNIX ? 0 : IPPROTO_TCP);
 	if (fd == -1) {
 		log_err_level_printf(LOG_CRIT, "Error from socket(): %s (%i)\n", strerror(errno), errno);
 		log_fine_va("Error from socket(): %s (%i)", strerror(errno), errno);
@@ -1077,7 +1135,22 @@ pxy_opensock_child(pxy_conn_ctx_t *ctx)
 		return -1;
 	}
 
-	if (bind(fd, (struct sockaddr *)&ctx->spec->return_addr, ctx->spec->return_addrlen) == -1) {
+	if (af == AF_UNIX) {
+		struct sockaddr_un sun;
+		if (pxy_child_unix_addr(ctx, &sun, fd) == -1) {
+			log_err_level_printf(LOG_CRIT, "Child unix socket path too long\n");
+			evutil_closesocket(fd);
+			return -1;
+		}
+		// Remove any stale socket left by a crashed process with the same pid
+		unlink(sun.sun_path);
+		if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) == -1) {
+			log_err_level_printf(LOG_CRIT, "Error from bind(): %s (%i)\n", strerror(errno), errno);
+			log_fine_va("Error from bind(): %s (%i)", strerror(errno), errno);
+			evutil_closesocket(fd);
+			return -1;
+		}
+	} else if (bind(fd, (struct sockaddr *)&ctx->spec->return_addr, ctx->spec->return_addrlen) == -1) {
 		log_err_level_printf(LOG_CRIT, "Error from bind(): %s (%i)\n", strerror(errno), errno);
 		log_fine_va("Error from bind(): %s (%i)", strerror(errno), errno);
 		evutil_closesocket(fd);
@@ -1089,7 +1162,7 @@ pxy_opensock_child(pxy_conn_ctx_t *ctx)
 int
 pxy_set_sslproxy_header(pxy_conn_ctx_t *ctx, int upgraded)
 {
-	struct sockaddr_in child_listener_addr;
+	struct sockaddr_storage child_listener_addr;
 	socklen_t child_listener_len = sizeof(child_listener_addr);
 
 	if (getsockname(ctx->child_fd, (struct sockaddr *)&child_listener_addr, &child_listener_len) < 0) {
@@ -1099,16 +1172,30 @@ pxy_set_sslproxy_header(pxy_conn_ctx_t *ctx, int upgraded)
 		return -1;
 	}
 
-	// @todo Children are assumed to be listening on an IPv4 address, should we support IPv6 children?
-	char addr[INET_ADDRSTRLEN];
-	if (!inet_ntop(AF_INET, &child_listener_addr.sin_addr, addr, INET_ADDRSTRLEN)) {
-		pxy_conn_term(ctx, 1);
-		return -1;
-	}
+	struct sockaddr_un *sun = (struct sockaddr_un *)&child_listener_addr;
+	// +1 for NULL, sun_path may not be null-terminated
+	char addr[SYS_UNIX_PREFIX_LEN + sizeof(sun->sun_path) + 1];
+	unsigned int port;
+	size_t port_len;
+
+	if (child_listener_addr.ss_family == AF_UNIX) {
+		// The listening program connects back to the path of the child listener,
+		// SSLproxy: [unix:/var/run/sslproxy/return.1234.56]:0,[192.168.3.24]:47286,[74.125.206.108]:465,s
+		snprintf(addr, sizeof(addr), "%s%.*s", SYS_UNIX_PREFIX, (int)sizeof(sun->sun_path), sun->sun_path);
+		port = 0;
+		port_len = 1;
+	} else {
+		// @todo Children are assumed to be listening on an IPv4 address, should we support IPv6 children?
+		struct sockaddr_in *sin = (struct sockaddr_in *)&child_listener_addr;
+		if (!inet_ntop(AF_INET, &sin->sin_addr, addr, INET_ADDRSTRLEN)) {
+			pxy_conn_term(ctx, 1);
+			return -1;
+		}
 
-	// Port may be 4 or 5 chars long
-	unsigned int port = ntohs(child_listener_addr.sin_port);
-	size_t port_len = port < 10000 ? 4 : 5;
+		// Port may be 4 or 5 chars long
+		port = ntohs(sin->sin_port);
+		port_len = port < 10000 ? 4 : 5;
+	}
 
 #ifndef WITHOUT_USERAUTH
 	int user_len = 0;
@@ -1185,6 +1272,7 @@ pxy_setup_child_listener(pxy_conn_ctx_t *ctx)
 		log_fine_va("Error creating child evconnlistener: %s", strerror(errno));
 
 		// @attention Close child fd separately, because child evcl does not exist yet, hence fd would not be closed by calling pxy_conn_free()
+		pxy_unlink_child_unix(ctx);
 		evutil_closesocket(ctx->child_fd);
 		pxy_conn_term(ctx, 1);
 		return -1;
@@ -1535,7 +1623,7 @@ pxy_bev_eventcb_child(struct bufferevent *bev, short events, void *arg)
 static filter_action_t * NONNULL(1,2)
 pxy_conn_filter_match_ip(pxy_conn_ctx_t *ctx, filter_list_t *list)
 {
-	filter_site_t *site = filter_site_find(list->ip_btree, list->ip_acm, list->ip_all, ctx->dsthost_str);
+	filter_site_t *site = filter_dstip_find(list, ctx->dsthost_str, &ctx->thr->filter_bloom_stats);
 	if (!site)
 		return NULL;
 
@@ -1543,7 +1631,7 @@ pxy_conn_filter_match_ip(pxy_conn_ctx_t *ctx, filter_list_t *list)
 		STRORDASH(ctx->srchost_str), STRORDASH(ctx->srcport_str), STRORDASH(ctx->dsthost_str), STRORDASH(ctx->dstport_str));
 
 	// Port spec determines the precedence of a site rule, unless the rule does not have any port
-	if (!site->port_btree && !site->port_acm && (site->action.precedence < ctx->filter_precedence)) {
+	if (!site->port_hash && !site->port_acm && (site->action.precedence < ctx->filter_precedence)) {
 		log_finest_va("Rule precedence lower than conn filter precedence %d < %d (line=%d): %s, %s", site->action.precedence, ctx->filter_precedence, site->action.line_num, site->site, ctx->dsthost_str);
 		return NULL;
 	}
@@ -1551,8 +1639,12 @@ pxy_conn_filter_match_ip(pxy_conn_ctx_t *ctx, filter_list_t *list)
 #ifdef DEBUG_PROXY
 	if (site->all_sites)
 		log_finest_va("Match all dst (line=%d): %s, %s", site->action.line_num, site->site, ctx->dsthost_str);
+	else if (site->extlist)
+		log_finest_va("Match list with dst (line=%d): %s, %s", site->action.line_num, site->site, ctx->dsthost_str);
 	else if (site->exact)
 		log_finest_va("Match exact with dst (line=%d): %s, %s", site->action.line_num, site->site, ctx->dsthost_str);
+	else if (site->cidr)
+		log_finest_va("Match cidr with dst (line=%d): %s, %s", site->action.line_num, site->site, ctx->dsthost_str);
 	else
 		log_finest_va("Match substring in dst (line=%d): %s, %s", site->action.line_num, site->site, ctx->dsthost_str);
 #endif /* DEBUG_PROXY */
@@ -1587,7 +1679,7 @@ pxy_conn_apply_filter(pxy_conn_ctx_t *ctx, unsigned int defer_action)
 {
 	int rv = 0;
 	filter_action_t *a;
-	if ((a = pxy_conn_filter(ctx, pxy_conn_dsthost_filter))) {
+	if ((a = pxy_conn_filter(ctx, pxy_conn_dsthost_filter, ctx->dsthost_str, NULL))) {
 		unsigned int action = pxy_conn_translate_filter_action(ctx, a);
 
 		ctx->filter_precedence = action & FILTER_PRECEDENCE;
@@ -1708,6 +1800,31 @@ pxy_conn_connect(pxy_conn_ctx_t *ctx)
 		return;
 	}
 
+	if (ctx->srvdst_early_fd != -1) {
+		evutil_socket_t fd = ctx->srvdst_early_fd;
+		ctx->srvdst_early_fd = -1;
+
+		// Only an SSL srvdst can take a socket which may still be connecting,
+		// it starts the handshake once the socket becomes writable
+		if (ctx->srvdst_early_connecting && !ctx->srvdst.ssl) {
+			log_finer("Discarding early srvdst socket, connecting as usual");
+			evutil_closesocket(fd);
+		} else {
+			if (bufferevent_setfd(ctx->srvdst.bev, fd) == -1) {
+				log_err_level(LOG_CRIT, "bufferevent_setfd for srvdst failed");
+				evutil_closesocket(fd);
+				pxy_conn_free(ctx, ctx->term ? ctx->term_requestor : 1);
+				return;
+			}
+			// Raise the connected event for a plain srvdst as
+			// bufferevent_socket_connect() would, deferred
+			if (!ctx->srvdst.ssl) {
+				bufferevent_trigger_event(ctx->srvdst.bev, BEV_EVENT_CONNECTED, BEV_TRIG_DEFER_CALLBACKS);
+			}
+			return;
+		}
+	}
+
 	if (bufferevent_socket_connect(ctx->srvdst.bev, (struct sockaddr *)&ctx->dstaddr, ctx->dstaddrlen) == -1) {
 		log_err_level(LOG_CRIT, "bufferevent_socket_connect for srvdst failed");
 		pxy_conn_free(ctx, ctx->term ? ctx->term_requestor : 1);
@@ -2206,7 +2323,7 @@ pxy_conn_filter_user(pxy_conn_ctx_t *ctx, proto_filter_func_t filtercb, filter_u
 	if (user) {
 		if (ctx->desc) {
 			log_finest_va("Searching user keyword exact: %s, %s", ctx->user, ctx->desc);
-			filter_desc_t *keyword = filter_desc_exact_match(user->desc_btree, ctx->desc);
+			filter_desc_t *keyword = filter_desc_exact_match(user->desc_hash, ctx->desc);
 			if (keyword && (action = filtercb(ctx, keyword->list))) {
 				return action;
 			}
@@ -2225,17 +2342,17 @@ pxy_conn_filter_user(pxy_conn_ctx_t *ctx, proto_filter_func_t filtercb, filter_u
 }
 #endif /* !WITHOUT_USERAUTH */
 
-filter_action_t *
-pxy_conn_filter(pxy_conn_ctx_t *ctx, proto_filter_func_t filtercb)
+static filter_action_t *
+pxy_conn_filter_lookup(pxy_conn_ctx_t *ctx, proto_filter_func_t filtercb)
 {
 	filter_action_t * action = NULL;
 
-	filter_t *filter = ctx->spec->opts->filter;
+	filter_t *filter = ctx->filter;
 	if (filter) {
 #ifndef WITHOUT_USERAUTH
 		if (ctx->user) {
 			log_finest_va("Searching user exact: %s", ctx->user);
-			filter_user_t *user = filter_user_exact_match(filter->user_btree, ctx->user);
+			filter_user_t *user = filter_user_exact_match(filter->user_hash, ctx->user);
 			if ((action = pxy_conn_filter_user(ctx, filtercb, user)))
 				return action;
 
@@ -2246,7 +2363,7 @@ pxy_conn_filter(pxy_conn_ctx_t *ctx, proto_filter_func_t filtercb)
 
 			if (ctx->desc) {
 				log_finest_va("Searching keyword exact: %s", ctx->desc);
-				filter_desc_t *keyword = filter_desc_exact_match(filter->desc_btree, ctx->desc);
+				filter_desc_t *keyword = filter_desc_exact_match(filter->desc_hash, ctx->desc);
 				if (keyword && (action = filtercb(ctx, keyword->list))) {
 					return action;
 				}
@@ -2266,11 +2383,21 @@ pxy_conn_filter(pxy_conn_ctx_t *ctx, proto_filter_func_t filtercb)
 #endif /* !WITHOUT_USERAUTH */
 		if (ctx->srchost_str) {
 			log_finest_va("Searching ip exact: %s", ctx->srchost_str);
-			filter_ip_t *ip = filter_ip_exact_match(filter->ip_btree, ctx->srchost_str);
+			filter_ip_t *ip = filter_ip_exact_match(filter->ip_hash, ctx->srchost_str);
 			if (ip && (action = filtercb(ctx, ip->list))) {
 				return action;
 			}
 
+			log_finest_va("Searching ip cidr: %s", ctx->srchost_str);
+			filter_ip_t *ips[IPTRIE_MAX_MATCHES];
+			size_t n = filter_ip_cidr_match(filter->ip_trie, ctx->srchost_str, ips);
+			// Longest prefix first, fall back to the shorter prefixes like exact to substring
+			for (size_t i = 0; i < n; i++) {
+				if ((action = filtercb(ctx, ips[i]->list))) {
+					return action;
+				}
+			}
+
 			log_finest_va("Searching ip substring: %s", ctx->srchost_str);
 			ip = filter_ip_substring_match(filter->ip_acm, ctx->srchost_str);
 			if (ip && (action = filtercb(ctx, ip->list))) {
@@ -2286,6 +2413,91 @@ pxy_conn_filter(pxy_conn_ctx_t *ctx, proto_filter_func_t filtercb)
 	return action;
 }
 
+// Longer keys are not cached, e.g. with long uris
+#define FILTER_CACHE_KEY_LEN 1024
+
+/*
+ * Append s to the filter cache key as a length-prefixed field, so that no two
+ * different sets of fields give the same key, whatever chars they contain.
+ */
+static size_t
+pxy_conn_filter_key_add(char *key, size_t len, const char *s)
+{
+	int n;
+
+	if (len >= FILTER_CACHE_KEY_LEN)
+		return len;
+	if (s)
+		n = snprintf(key + len, FILTER_CACHE_KEY_LEN - len, "%zu:%s,", strlen(s), s);
+	else
+		n = snprintf(key + len, FILTER_CACHE_KEY_LEN - len, "-,");
+	// Mark truncated keys as too long
+	return n < 0 ? FILTER_CACHE_KEY_LEN : len + n;
+}
+
+/*
+ * Build the filter cache key from all the conn fields the filter decision
+ * depends on: the filter, the filter callback, the precedence of the current
+ * filter action, the user, desc, src ip, and dst port of the conn, and the
+ * site values s1 and s2 matched by filtercb.
+ * Returns -1 if the key is too long.
+ */
+static int
+pxy_conn_filter_key(pxy_conn_ctx_t *ctx, proto_filter_func_t filtercb, const char *s1, const char *s2, char *key)
+{
+	int n = snprintf(key, FILTER_CACHE_KEY_LEN, "%p:%p:%u:", (void *)ctx->filter, (void *)(uintptr_t)filtercb, ctx->filter_precedence);
+	if (n < 0 || n >= FILTER_CACHE_KEY_LEN)
+		return -1;
+
+	size_t len = n;
+#ifndef WITHOUT_USERAUTH
+	len = pxy_conn_filter_key_add(key, len, ctx->user);
+	len = pxy_conn_filter_key_add(key, len, ctx->desc);
+#endif /* !WITHOUT_USERAUTH */
+	len = pxy_conn_filter_key_add(key, len, ctx->srchost_str);
+	len = pxy_conn_filter_key_add(key, len, ctx->dstport_str);
+	len = pxy_conn_filter_key_add(key, len, s1);
+	len = pxy_conn_filter_key_add(key, len, s2);
+	return len < FILTER_CACHE_KEY_LEN ? 0 : -1;
+}
+
+/*
+ * Find the filter action for the conn, s1 and s2 are the site values matched
+ * by filtercb, which must be the only conn fields filtercb depends on other
+ * than the ones in the filter cache key.  Same conns on the same thread are
+ * mostly served from the filter cache of the thread.
+ */
+filter_action_t *
+pxy_conn_filter(pxy_conn_ctx_t *ctx, proto_filter_func_t filtercb, const char *s1, const char *s2)
+{
+	filter_action_t *action;
+	filtercache_t *cache = ctx->thr->filter_cache;
+	char key[FILTER_CACHE_KEY_LEN];
+
+	if (!ctx->filter)
+		return NULL;
+
+	if (!cache || pxy_conn_filter_key(ctx, filtercb, s1, s2, key) == -1)
+		return pxy_conn_filter_lookup(ctx, filtercb);
+
+	unsigned int gen = filter_generation();
+	if (filtercache_get(cache, gen, key, (void **)&action)) {
+		log_finest_va("Filter cache hit: %s", key);
+		ctx->thr->filter_cache_hits++;
+		return action;
+	}
+
+	ctx->thr->filter_cache_misses++;
+	action = pxy_conn_filter_lookup(ctx, filtercb);
+	// The action of a filter replaced by a reload must not be cached under
+	// the generation of the new filter, it may be freed before the entry
+	if (!filter_is_current(ctx->spec->opts, ctx->filter))
+		return action;
+	// Not caching the action is not an error
+	(void)filtercache_set(cache, gen, key, action);
+	return action;
+}
+
 int
 pxy_conn_init(pxy_conn_ctx_t *ctx)
 {
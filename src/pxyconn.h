@@ -84,7 +84,7 @@ typedef void (*proto_classify_user_func_t)(pxy_conn_ctx_t *);
 typedef int (*child_connect_func_t)(pxy_conn_child_ctx_t *) NONNULL(1) WUNRES;
 typedef void (*child_proto_free_func_t)(pxy_conn_child_ctx_t *);
 
-typedef void (*set_watermark_func_t)(struct bufferevent *, pxy_conn_ctx_t *, struct bufferevent *);
+typedef void (*set_watermark_func_t)(struct bufferevent *, pxy_conn_ctx_t *, pxy_conn_desc_t *);
 typedef void (*unset_watermark_func_t)(struct bufferevent *, pxy_conn_ctx_t *, pxy_conn_desc_t *);
 typedef void (*discard_inbuf_func_t)(struct bufferevent *) NONNULL(1);
 typedef void (*discard_outbuf_func_t)(struct bufferevent *) NONNULL(1);
@@ -112,6 +112,8 @@ struct pxy_conn_desc {
 	SSL *ssl;
 	unsigned int closed : 1;
 	bev_free_func_t free;
+	// Outbuf limit of bev computed in adaptive mode, 0 until first computed
+	size_t outbuf_limit;
 };
 
 enum conn_type {
@@ -145,7 +147,6 @@ struct ssl_ctx {
 	char *usedcrtfpr;
 
 	/* ssl */
-	unsigned int sni_peek_retries : 6;       /* max 64 SNI parse retries */
 	unsigned int immutable_cert : 1;  /* 1 if the cert cannot be changed */
 	unsigned int generated_cert : 1;     /* 1 if we generated a new cert */
 	unsigned int have_sslerr : 1;           /* 1 if we have an ssl error */
@@ -154,11 +155,23 @@ struct ssl_ctx {
 
 	/* server name indicated by client in SNI TLS extension */
 	char *sni;
+	/* reassembles the ClientHello to parse the SNI from */
+	ssl_tls_clienthello_asm_t clienthello_asm;
 
 	X509 *origcrt;
+	/* names and fingerprints of origcrt, may be shared with the fake cert
+	 * cache, the log strings above may point into it */
+	struct cachefkcrt_meta *origcrtmeta;
 
 	char *srvdst_ssl_version;
 	char *srvdst_ssl_cipher;
+	/* static string, see protossl_ktls_str() */
+	const char *srvdst_ktls;
+
+	/* dynamic record sizing on src, see protossl_setup_record_sizing() */
+	unsigned int drs_full_records : 1;   /* 1 if writing full size records */
+	size_t drs_bytes;            /* bytes sent since conn start or idle */
+	struct timeval drs_atime;           /* time data was last sent */
 };
 
 struct proto_ctx {
@@ -289,9 +302,21 @@ struct pxy_conn_ctx {
 	conn_opts_t *conn_opts;
 	proxyspec_t *spec;
 	global_t *global;
+	// Filter of proxyspec when the conn was created, so that a reload does
+	// not change the filter under the conn, released when the conn is freed
+	filter_t *filter;
 
 	evutil_socket_t dst_fd;
 	evutil_socket_t srvdst_fd;
+	// Socket to dstaddr opened before srvdst setup, by the SNI connect race
+	// or SpeculativeConnect, -1 if none
+	evutil_socket_t srvdst_early_fd;
+	// 1 if the connect of srvdst_early_fd may still be in progress
+	unsigned int srvdst_early_connecting : 1;
+	// SNI hostname lookup and connect race in progress, NULL if none,
+	// canceled if the conn is freed before they call back
+	struct pxy_dns_waiter *dns_waiter;
+	struct pxy_dns_race *dns_race;
 
 #ifndef WITHOUT_USERAUTH
 	// Privsep socket to update user atime
@@ -479,7 +504,7 @@ filter_action_t *pxy_conn_set_filter_action(filter_action_t *, filter_action_t *
 #endif /* DEBUG_PROXY */
 	) WUNRES;
 filter_action_t *pxy_conn_filter_port(pxy_conn_ctx_t *, filter_site_t *) NONNULL(1,2);
-filter_action_t * pxy_conn_filter(pxy_conn_ctx_t *, proto_filter_func_t) NONNULL(1) WUNRES;
+filter_action_t * pxy_conn_filter(pxy_conn_ctx_t *, proto_filter_func_t, const char *, const char *) NONNULL(1) WUNRES;
 void pxy_conn_setup(evutil_socket_t, struct sockaddr *, int,
                     pxy_thrmgr_ctx_t *, proxyspec_t *, global_t *,
 					evutil_socket_t)
@@ -0,0 +1,638 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pxydns.h"
+
+#include "cachemgr.h"
+#include "log.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/*
+ * SNI hostname resolution and connection racing.
+ *
+ * Lookups go through the process-wide DNS cache first, which also holds the
+ * hosts file entries.  On a miss, the A and AAAA queries are sent on the
+ * dnsbase of the thread asking first, and other threads asking for the same
+ * host while those queries are in flight wait for the same answer.  Waiters
+ * are called back on their own event base.
+ *
+ * Connects to the resolved addresses are raced as in RFC 8305: one attempt
+ * per address, IPv6 and IPv4 interleaved, a new attempt started every
+ * HappyEyeballsDelay msec or as soon as the previous one fails.  The first
+ * attempt to connect wins, the others are closed.  The race fails if none
+ * has connected after ConnectTimeout seconds.
+ *
+ * Both the waiters and the races are handed to the caller through a pointer,
+ * which is set to NULL before the callback is called, so that the caller can
+ * cancel them if it goes away before.
+ */
+
+struct pxy_dns_waiter {
+	// Event on the evbase of the waiter, activated when the query is done
+	struct event *ev;
+	pxy_dns_cb_t cb;
+	void *arg;
+	pxy_dns_waiter_t **handle;
+	dns_addrs_t addrs;
+	// Query waited for, NULL once done, protected by pxy_dns_mutex
+	struct pxy_dns_query *query;
+	struct pxy_dns_waiter *next;
+};
+
+typedef struct pxy_dns_query {
+	// Lowercase hostname, the cache key
+	char *host;
+	struct evdns_base *dnsbase;
+	global_t *global;
+
+	// Number of outstanding evdns requests
+	int pending;
+
+	struct sockaddr_in6 addr6[CACHEDNS_MAX_ADDRS];
+	struct sockaddr_in addr4[CACHEDNS_MAX_ADDRS];
+	int naddr6;
+	int naddr4;
+	// Smallest TTL of the answers, -1 if none
+	int ttl;
+	// DNS_ERR_* of the failed request, DNS_ERR_NOTEXIST wins
+	int dnserr;
+
+	pxy_dns_waiter_t *waiters;
+	struct pxy_dns_query *next;
+} pxy_dns_query_t;
+
+static pthread_mutex_t pxy_dns_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Queries in flight, protected by pxy_dns_mutex
+static pxy_dns_query_t *pxy_dns_queries;
+
+static void NONNULL(1)
+pxy_dns_waiter_free(pxy_dns_waiter_t *w)
+{
+	if (w->ev)
+		event_free(w->ev);
+	free(w);
+}
+
+static void
+pxy_dns_waiter_cb(UNUSED evutil_socket_t fd, UNUSED short what, void *arg)
+{
+	pxy_dns_waiter_t *w = arg;
+	pxy_dns_cb_t cb = w->cb;
+	void *cbarg = w->arg;
+	dns_addrs_t addrs;
+
+	memcpy(&addrs, &w->addrs, sizeof(dns_addrs_t));
+	*w->handle = NULL;
+	pxy_dns_waiter_free(w);
+
+	cb(addrs.naddrs ? 0 : addrs.errcode, &addrs, cbarg);
+}
+
+/*
+ * Cancel waiting for the result of pxy_dns_resolve(), on the thread running
+ * the evbase passed to it.  The callback is not called.
+ */
+void
+pxy_dns_resolve_cancel(pxy_dns_waiter_t *w)
+{
+	pthread_mutex_lock(&pxy_dns_mutex);
+	if (w->query) {
+		pxy_dns_waiter_t **p;
+		for (p = &w->query->waiters; *p; p = &(*p)->next) {
+			if (*p == w) {
+				*p = w->next;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock(&pxy_dns_mutex);
+
+	// Removes the event if the query is done but it has not fired yet
+	*w->handle = NULL;
+	pxy_dns_waiter_free(w);
+}
+
+static void NONNULL(1)
+pxy_dns_query_free(pxy_dns_query_t *q)
+{
+	free(q->host);
+	free(q);
+}
+
+static int
+pxy_dns_eai(int dnserr)
+{
+	switch (dnserr) {
+		case DNS_ERR_NOTEXIST:
+			return EVUTIL_EAI_NONAME;
+		case DNS_ERR_NONE:
+		case DNS_ERR_NODATA:
+			return EVUTIL_EAI_NODATA;
+		case DNS_ERR_SERVERFAILED:
+		case DNS_ERR_TIMEOUT:
+			return EVUTIL_EAI_AGAIN;
+		default:
+			return EVUTIL_EAI_FAIL;
+	}
+}
+
+/*
+ * Called when both the A and AAAA queries are done.  Interleave the address
+ * families starting with IPv6, cache the result and hand it to all waiters.
+ */
+static void NONNULL(1)
+pxy_dns_query_done(pxy_dns_query_t *q)
+{
+	dns_addrs_t res;
+	pxy_dns_waiter_t *w;
+	pxy_dns_query_t **p;
+	time_t now = time(NULL);
+	int i6 = 0, i4 = 0;
+
+	memset(&res, 0, sizeof(dns_addrs_t));
+	while (res.naddrs < CACHEDNS_MAX_ADDRS && (i6 < q->naddr6 || i4 < q->naddr4)) {
+		if (i6 < q->naddr6) {
+			res.addr[res.naddrs++].sin6 = q->addr6[i6++];
+		}
+		if (i4 < q->naddr4 && res.naddrs < CACHEDNS_MAX_ADDRS) {
+			res.addr[res.naddrs++].sin = q->addr4[i4++];
+		}
+	}
+
+	if (res.naddrs) {
+		unsigned int ttl = q->global->dns_cache_max_ttl;
+		if ((unsigned int)q->ttl < ttl)
+			ttl = q->ttl;
+		res.expiry = now + ttl;
+	} else {
+		res.errcode = pxy_dns_eai(q->dnserr);
+		res.expiry = now + q->global->dns_negative_ttl;
+	}
+	if (res.expiry > now)
+		cachemgr_dns_set(q->host, &res);
+
+	log_finer_main_va("Resolved %s: naddrs=%d, ttl=%lld, errcode=%d", q->host, res.naddrs, (long long)(res.expiry - now), res.errcode);
+
+	// Waiters may be canceled by their threads until they are activated
+	pthread_mutex_lock(&pxy_dns_mutex);
+	for (p = &pxy_dns_queries; *p; p = &(*p)->next) {
+		if (*p == q) {
+			*p = q->next;
+			break;
+		}
+	}
+	for (w = q->waiters; w; w = w->next) {
+		memcpy(&w->addrs, &res, sizeof(dns_addrs_t));
+		w->query = NULL;
+		event_active(w->ev, EV_TIMEOUT, 1);
+	}
+	pthread_mutex_unlock(&pxy_dns_mutex);
+	pxy_dns_query_free(q);
+}
+
+static void
+pxy_dns_resolve_cb(int result, char type, int count, int ttl, void *addresses, void *arg)
+{
+	pxy_dns_query_t *q = arg;
+
+	if (result == DNS_ERR_NONE) {
+		for (int i = 0; i < count; i++) {
+			if (type == DNS_IPv6_AAAA && q->naddr6 < CACHEDNS_MAX_ADDRS) {
+				struct sockaddr_in6 *sin6 = &q->addr6[q->naddr6++];
+				sin6->sin6_family = AF_INET6;
+				memcpy(&sin6->sin6_addr, (struct in6_addr *)addresses + i, sizeof(struct in6_addr));
+			} else if (type == DNS_IPv4_A && q->naddr4 < CACHEDNS_MAX_ADDRS) {
+				struct sockaddr_in *sin = &q->addr4[q->naddr4++];
+				sin->sin_family = AF_INET;
+				memcpy(&sin->sin_addr, (uint32_t *)addresses + i, sizeof(uint32_t));
+			}
+		}
+		if (count && (q->ttl < 0 || ttl < q->ttl))
+			q->ttl = ttl;
+	} else if (q->dnserr == DNS_ERR_NONE || result == DNS_ERR_NOTEXIST) {
+		q->dnserr = result;
+	}
+
+	if (--q->pending == 0)
+		pxy_dns_query_done(q);
+}
+
+/*
+ * Parse a numeric IPv6 or IPv4 address into addr.
+ * Returns 1 if str is an address, 0 otherwise.
+ */
+static int NONNULL(1,2)
+pxy_dns_parse_addr(const char *str, dns_addr_t *addr)
+{
+	memset(addr, 0, sizeof(dns_addr_t));
+	if (evutil_inet_pton(AF_INET6, str, &addr->sin6.sin6_addr) == 1) {
+		addr->sin6.sin6_family = AF_INET6;
+		return 1;
+	}
+	if (evutil_inet_pton(AF_INET, str, &addr->sin.sin_addr) == 1) {
+		addr->sin.sin_family = AF_INET;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Load the entries of a hosts file into the DNS cache, where they never
+ * expire.  Names are looked up in the hosts file before DNS as with
+ * getaddrinfo(3), but the file is read only once, before chroot.
+ *
+ * Returns -1 on failure, 0 on success or if the file does not exist.
+ */
+int
+pxy_dns_load_hosts(const char *path)
+{
+	FILE *f;
+	char line[1024];
+
+	if (!(f = fopen(path, "r")))
+		return errno == ENOENT ? 0 : -1;
+
+	while (fgets(line, sizeof(line), f)) {
+		dns_addr_t addr;
+		char *p, *save, *name;
+
+		if ((p = strchr(line, '#')))
+			*p = '\0';
+		if (!(p = strtok_r(line, " \t\r\n", &save)) || !pxy_dns_parse_addr(p, &addr))
+			continue;
+
+		while ((name = strtok_r(NULL, " \t\r\n", &save))) {
+			dns_addrs_t ent, *cached;
+
+			if ((cached = cachemgr_dns_get(name))) {
+				memcpy(&ent, cached, sizeof(dns_addrs_t));
+				free(cached);
+			} else {
+				memset(&ent, 0, sizeof(dns_addrs_t));
+			}
+			if (ent.naddrs < CACHEDNS_MAX_ADDRS) {
+				ent.addr[ent.naddrs++] = addr;
+				cachemgr_dns_set(name, &ent);
+			}
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+/*
+ * Resolve host and call cb with the result, on the thread running evbase.
+ * Cache hits and numeric hosts are called back before returning, so the
+ * caller must not touch arg after this function returns 0.  Otherwise
+ * *handle is set to the waiter for the result until cb is called, so that
+ * it can be canceled with pxy_dns_resolve_cancel().
+ *
+ * Returns -1 on failure, in which case cb is not called, 0 on success.
+ */
+int
+pxy_dns_resolve(struct event_base *evbase, struct evdns_base *dnsbase, global_t *global,
+                const char *host, pxy_dns_cb_t cb, void *arg, pxy_dns_waiter_t **handle)
+{
+	dns_addrs_t res;
+	dns_addrs_t *cached;
+	pxy_dns_waiter_t *w;
+	pxy_dns_query_t *q;
+
+	*handle = NULL;
+	memset(&res, 0, sizeof(dns_addrs_t));
+	if (pxy_dns_parse_addr(host, &res.addr[0])) {
+		res.naddrs = 1;
+		cb(0, &res, arg);
+		return 0;
+	}
+
+	if ((cached = cachemgr_dns_get(host))) {
+		log_finest_main_va("DNS cache hit for %s", host);
+		cb(cached->naddrs ? 0 : cached->errcode, cached, arg);
+		free(cached);
+		return 0;
+	}
+
+	w = malloc(sizeof(pxy_dns_waiter_t));
+	if (!w)
+		return -1;
+	memset(w, 0, sizeof(pxy_dns_waiter_t));
+	w->cb = cb;
+	w->arg = arg;
+	w->handle = handle;
+	if (!(w->ev = event_new(evbase, -1, 0, pxy_dns_waiter_cb, w))) {
+		free(w);
+		return -1;
+	}
+
+	q = malloc(sizeof(pxy_dns_query_t));
+	if (!q) {
+		pxy_dns_waiter_free(w);
+		return -1;
+	}
+	memset(q, 0, sizeof(pxy_dns_query_t));
+	if (!(q->host = cachedns_mkkey(host))) {
+		free(q);
+		pxy_dns_waiter_free(w);
+		return -1;
+	}
+
+	pthread_mutex_lock(&pxy_dns_mutex);
+	for (pxy_dns_query_t *iq = pxy_dns_queries; iq; iq = iq->next) {
+		if (equal(iq->host, q->host)) {
+			log_finest_main_va("DNS query for %s already in flight", host);
+			w->query = iq;
+			w->next = iq->waiters;
+			iq->waiters = w;
+			*handle = w;
+			pthread_mutex_unlock(&pxy_dns_mutex);
+			pxy_dns_query_free(q);
+			return 0;
+		}
+	}
+	// The query for host may have finished since the cache lookup above
+	if ((cached = cachemgr_dns_get(host))) {
+		pthread_mutex_unlock(&pxy_dns_mutex);
+		pxy_dns_query_free(q);
+		pxy_dns_waiter_free(w);
+		cb(cached->naddrs ? 0 : cached->errcode, cached, arg);
+		free(cached);
+		return 0;
+	}
+	q->dnsbase = dnsbase;
+	q->global = global;
+	q->ttl = -1;
+	q->waiters = w;
+	q->next = pxy_dns_queries;
+	pxy_dns_queries = q;
+	w->query = q;
+	*handle = w;
+	pthread_mutex_unlock(&pxy_dns_mutex);
+
+	log_finer_main_va("Resolving %s", host);
+
+	// One for each request, plus one held until both requests are made
+	q->pending = 3;
+	if (!evdns_base_resolve_ipv6(dnsbase, q->host, 0, pxy_dns_resolve_cb, q))
+		q->pending--;
+	if (!evdns_base_resolve_ipv4(dnsbase, q->host, 0, pxy_dns_resolve_cb, q))
+		q->pending--;
+	if (--q->pending == 0)
+		pxy_dns_query_done(q);
+	return 0;
+}
+
+struct pxy_dns_race {
+	struct event_base *evbase;
+	dns_addrs_t addrs;
+	struct timeval delay;
+	pxy_dns_connect_cb_t cb;
+	void *arg;
+	pxy_dns_race_t **handle;
+
+	// Index of the next address to try
+	int next;
+	// Attempts in progress
+	int active;
+	int error;
+	evutil_socket_t fd[CACHEDNS_MAX_ADDRS];
+	struct event *ev[CACHEDNS_MAX_ADDRS];
+	struct event *timer;
+	// Timeout of the whole race
+	struct event *timeout;
+};
+
+static void pxy_dns_race_next(pxy_dns_race_t *) NONNULL(1);
+
+/*
+ * Close all attempts except the winner, if any, and free the race.
+ * Returns the socket of the winner, -1 if none.
+ */
+static evutil_socket_t NONNULL(1)
+pxy_dns_race_free(pxy_dns_race_t *r, int winner)
+{
+	evutil_socket_t fd = -1;
+
+	for (int i = 0; i < r->next; i++) {
+		if (r->ev[i])
+			event_free(r->ev[i]);
+		if (i == winner) {
+			fd = r->fd[i];
+		} else if (r->fd[i] != -1) {
+			evutil_closesocket(r->fd[i]);
+		}
+	}
+	if (r->timer)
+		event_free(r->timer);
+	if (r->timeout)
+		event_free(r->timeout);
+	*r->handle = NULL;
+	free(r);
+	return fd;
+}
+
+/*
+ * Free the race and call back with the winner, if any.
+ */
+static void NONNULL(1)
+pxy_dns_race_end(pxy_dns_race_t *r, int winner)
+{
+	pxy_dns_connect_cb_t cb = r->cb;
+	void *arg = r->arg;
+	dns_addr_t addr = r->addrs.addr[winner == -1 ? 0 : winner];
+	int error = r->error;
+	evutil_socket_t fd = pxy_dns_race_free(r, winner);
+
+	cb(fd, error, &addr.sa, dns_addr_len(&addr), arg);
+}
+
+/*
+ * Cancel a race started by pxy_dns_connect(), closing all attempts.
+ * The callback is not called.
+ */
+void
+pxy_dns_connect_cancel(pxy_dns_race_t *r)
+{
+	pxy_dns_race_free(r, -1);
+}
+
+static void
+pxy_dns_race_connect_cb(evutil_socket_t fd, UNUSED short what, void *arg)
+{
+	pxy_dns_race_t *r = arg;
+	int error = 0;
+	socklen_t len = sizeof(error);
+	int i;
+
+	for (i = 0; i < r->next; i++) {
+		if (r->fd[i] == fd)
+			break;
+	}
+
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+		error = errno;
+	}
+	if (!error) {
+		log_finer_main_va("Connect attempt %d won, fd=%d", i, fd);
+		pxy_dns_race_end(r, i);
+		return;
+	}
+
+	log_finer_main_va("Connect attempt %d failed, fd=%d: %s", i, fd, strerror(error));
+	event_free(r->ev[i]);
+	r->ev[i] = NULL;
+	evutil_closesocket(fd);
+	r->fd[i] = -1;
+	r->active--;
+	r->error = error;
+
+	// Do not wait for the delay to expire after a failure
+	pxy_dns_race_next(r);
+}
+
+static void
+pxy_dns_race_timer_cb(UNUSED evutil_socket_t fd, UNUSED short what, void *arg)
+{
+	pxy_dns_race_next(arg);
+}
+
+static void
+pxy_dns_race_timeout_cb(UNUSED evutil_socket_t fd, UNUSED short what, void *arg)
+{
+	pxy_dns_race_t *r = arg;
+
+	log_finer_main_va("Connect attempts timed out, active=%d", r->active);
+	r->error = ETIMEDOUT;
+	pxy_dns_race_end(r, -1);
+}
+
+/*
+ * Start the next connect attempt, skipping addresses which fail immediately,
+ * and arm the timer for the one after it.
+ */
+static void
+pxy_dns_race_next(pxy_dns_race_t *r)
+{
+	while (r->next < r->addrs.naddrs) {
+		int i = r->next++;
+		dns_addr_t *addr = &r->addrs.addr[i];
+
+		r->fd[i] = socket(addr->sa.sa_family, SOCK_STREAM, 0);
+		if (r->fd[i] == -1) {
+			r->error = errno;
+			continue;
+		}
+		if (evutil_make_socket_nonblocking(r->fd[i]) == -1 ||
+		    evutil_make_socket_closeonexec(r->fd[i]) == -1 ||
+		    (connect(r->fd[i], &addr->sa, dns_addr_len(addr)) == -1 && errno != EINPROGRESS)) {
+			r->error = errno;
+			log_finer_main_va("Connect attempt %d failed, fd=%d: %s", i, r->fd[i], strerror(errno));
+			evutil_closesocket(r->fd[i]);
+			r->fd[i] = -1;
+			continue;
+		}
+
+		// Connected or not, the write event tells us the result
+		r->ev[i] = event_new(r->evbase, r->fd[i], EV_WRITE, pxy_dns_race_connect_cb, r);
+		if (!r->ev[i] || event_add(r->ev[i], NULL) == -1) {
+			r->error = ENOMEM;
+			evutil_closesocket(r->fd[i]);
+			r->fd[i] = -1;
+			continue;
+		}
+		r->active++;
+
+		if (r->next < r->addrs.naddrs && event_add(r->timer, &r->delay) == -1) {
+			// Fall back to trying the addresses one at a time
+			log_err_level_printf(LOG_WARNING, "Error arming connect race timer\n");
+		}
+		return;
+	}
+
+	if (!r->active)
+		pxy_dns_race_end(r, -1);
+}
+
+/*
+ * Race connects to the addresses of a host on the given port, and call cb
+ * with the first socket to connect, or with fd -1 if none has connected in
+ * ConnectTimeout seconds.  The callback may be called before this function
+ * returns if all addresses fail immediately.  Until cb is called, *handle is
+ * set to the race, so that it can be canceled with pxy_dns_connect_cancel().
+ *
+ * Returns -1 on failure, in which case cb is not called, 0 on success.
+ */
+int
+pxy_dns_connect(struct event_base *evbase, global_t *global, const dns_addrs_t *addrs,
+                unsigned short port, pxy_dns_connect_cb_t cb, void *arg, pxy_dns_race_t **handle)
+{
+	pxy_dns_race_t *r;
+	struct timeval timeout = {global->connect_timeout, 0};
+
+	*handle = NULL;
+	r = malloc(sizeof(pxy_dns_race_t));
+	if (!r)
+		return -1;
+	memset(r, 0, sizeof(pxy_dns_race_t));
+	r->handle = handle;
+
+	r->timer = evtimer_new(evbase, pxy_dns_race_timer_cb, r);
+	r->timeout = evtimer_new(evbase, pxy_dns_race_timeout_cb, r);
+	if (!r->timer || !r->timeout || evtimer_add(r->timeout, &timeout) == -1) {
+		pxy_dns_race_free(r, -1);
+		return -1;
+	}
+	r->evbase = evbase;
+	r->cb = cb;
+	r->arg = arg;
+	r->error = EHOSTUNREACH;
+	r->delay.tv_sec = global->happy_eyeballs_delay / 1000;
+	r->delay.tv_usec = (global->happy_eyeballs_delay % 1000) * 1000;
+
+	memcpy(&r->addrs, addrs, sizeof(dns_addrs_t));
+	for (int i = 0; i < r->addrs.naddrs; i++) {
+		if (r->addrs.addr[i].sa.sa_family == AF_INET6) {
+			r->addrs.addr[i].sin6.sin6_port = htons(port);
+		} else {
+			r->addrs.addr[i].sin.sin_port = htons(port);
+		}
+	}
+
+	*handle = r;
+	pxy_dns_race_next(r);
+	return 0;
+}
+
+/* vim: set noet ft=c: */
@@ -0,0 +1,67 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PXYDNS_H
+#define PXYDNS_H
+
+#include "attrib.h"
+#include "opts.h"
+#include "cachedns.h"
+
+#include <event2/event.h>
+#include <event2/dns.h>
+
+/*
+ * Called with errcode 0 and the addresses of the host, or with an
+ * EVUTIL_EAI_* errcode if the host cannot be resolved.
+ */
+typedef void (*pxy_dns_cb_t)(int errcode, const dns_addrs_t *addrs, void *arg);
+
+/*
+ * Called with the connected socket and its address for the winning
+ * connection attempt, or with fd -1, an errno, and the first address if all
+ * attempts failed.
+ */
+typedef void (*pxy_dns_connect_cb_t)(evutil_socket_t fd, int error,
+                                     const struct sockaddr *addr, socklen_t addrlen,
+                                     void *arg);
+
+typedef struct pxy_dns_waiter pxy_dns_waiter_t;
+typedef struct pxy_dns_race pxy_dns_race_t;
+
+int pxy_dns_load_hosts(const char *) NONNULL(1) WUNRES;
+int pxy_dns_resolve(struct event_base *, struct evdns_base *, global_t *,
+                    const char *, pxy_dns_cb_t, void *, pxy_dns_waiter_t **) NONNULL(1,2,3,4,5,7) WUNRES;
+void pxy_dns_resolve_cancel(pxy_dns_waiter_t *) NONNULL(1);
+int pxy_dns_connect(struct event_base *, global_t *, const dns_addrs_t *,
+                    unsigned short, pxy_dns_connect_cb_t, void *, pxy_dns_race_t **) NONNULL(1,2,3,5,7) WUNRES;
+void pxy_dns_connect_cancel(pxy_dns_race_t *) NONNULL(1);
+
+#endif /* !PXYDNS_H */
+
+/* vim: set noet ft=c: */
@@ -0,0 +1,309 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pxypool.h"
+
+#include "log.h"
+#include "pxythr.h"
+#include "pxythrmgr.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+
+static void pxy_pool_refill(pxy_pool_t *) NONNULL(1);
+
+static void NONNULL(1)
+pxy_pool_conn_free(pxy_pool_conn_t *pc)
+{
+	if (pc->ev)
+		event_free(pc->ev);
+	if (pc->fd != -1)
+		evutil_closesocket(pc->fd);
+	free(pc);
+}
+
+static void NONNULL(1,2)
+pxy_pool_list_remove(pxy_pool_conn_t **list, pxy_pool_conn_t *pc)
+{
+	while (*list) {
+		if (*list == pc) {
+			*list = pc->next;
+			pc->next = NULL;
+			return;
+		}
+		list = &(*list)->next;
+	}
+}
+
+/*
+ * The listening program does not send anything before it receives the
+ * SSLproxy line, so an idle pool conn becomes readable only on EOF or error.
+ */
+static void
+pxy_pool_idle_cb(UNUSED evutil_socket_t fd, UNUSED short what, void *arg)
+{
+	pxy_pool_conn_t *pc = arg;
+	pxy_pool_t *pool = pc->pool;
+
+	log_finer_main_va("Idle divert pool conn closed, thr=%d, fd=%d", pool->thr->id, pc->fd);
+
+	pxy_pool_list_remove(&pool->idle, pc);
+	pool->idle_count--;
+	pxy_pool_conn_free(pc);
+
+	pxy_pool_refill(pool);
+}
+
+static void
+pxy_pool_connect_cb(evutil_socket_t fd, short what, void *arg)
+{
+	pxy_pool_conn_t *pc = arg;
+	pxy_pool_t *pool = pc->pool;
+	int error = 0;
+	socklen_t len = sizeof(error);
+
+	pxy_pool_list_remove(&pool->pending, pc);
+	pool->pending_count--;
+
+	if (what & EV_TIMEOUT) {
+		error = ETIMEDOUT;
+	} else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+		error = errno;
+	}
+
+	if (error) {
+		log_fine_main_va("Divert pool connect failed, thr=%d, fd=%d: %s", pool->thr->id, fd, strerror(error));
+		pxy_pool_conn_free(pc);
+		pool->failed = 1;
+		return;
+	}
+
+	event_free(pc->ev);
+	pc->ev = event_new(pool->thr->evbase, fd, EV_READ, pxy_pool_idle_cb, pc);
+	if (!pc->ev || event_add(pc->ev, NULL) == -1) {
+		log_err_level_printf(LOG_CRIT, "Error creating divert pool event\n");
+		pxy_pool_conn_free(pc);
+		pool->failed = 1;
+		return;
+	}
+
+	pc->ctime = time(NULL);
+	pc->next = pool->idle;
+	pool->idle = pc;
+	pool->idle_count++;
+
+	log_finer_main_va("Divert pool conn ready, thr=%d, fd=%d, idle=%u", pool->thr->id, fd, pool->idle_count);
+
+	pxy_pool_refill(pool);
+}
+
+static int NONNULL(1) WUNRES
+pxy_pool_connect(pxy_pool_t *pool)
+{
+	pxy_pool_conn_t *pc;
+	struct timeval timeout = {pool->thr->thrmgr->global->expired_conn_check_period, 0};
+
+	pc = malloc(sizeof(pxy_pool_conn_t));
+	if (!pc)
+		return -1;
+	memset(pc, 0, sizeof(pxy_pool_conn_t));
+	pc->pool = pool;
+
+	pc->fd = socket(pool->spec->divert_addr.ss_family, SOCK_STREAM, 0);
+	if (pc->fd == -1) {
+		log_err_level_printf(LOG_WARNING, "Error creating divert pool socket: %s (%i)\n", strerror(errno), errno);
+		free(pc);
+		return -1;
+	}
+	if (evutil_make_socket_nonblocking(pc->fd) == -1 ||
+	    evutil_make_socket_closeonexec(pc->fd) == -1) {
+		pxy_pool_conn_free(pc);
+		return -1;
+	}
+
+	if (connect(pc->fd, (struct sockaddr *)&pool->spec->divert_addr, pool->spec->divert_addrlen) == -1 && errno != EINPROGRESS) {
+		log_fine_main_va("Divert pool connect failed, thr=%d, fd=%d: %s", pool->thr->id, pc->fd, strerror(errno));
+		pxy_pool_conn_free(pc);
+		return -1;
+	}
+
+	// Connected or not, the write event tells us the result
+	pc->ev = event_new(pool->thr->evbase, pc->fd, EV_WRITE, pxy_pool_connect_cb, pc);
+	if (!pc->ev || event_add(pc->ev, &timeout) == -1) {
+		log_err_level_printf(LOG_CRIT, "Error creating divert pool event\n");
+		pxy_pool_conn_free(pc);
+		return -1;
+	}
+
+	pc->next = pool->pending;
+	pool->pending = pc;
+	pool->pending_count++;
+	return 0;
+}
+
+/*
+ * Start connects until the pool reaches its configured size.
+ * Stops on the first failure, the timer retries on the next tick.
+ */
+static void
+pxy_pool_refill(pxy_pool_t *pool)
+{
+	unsigned int size = pool->thr->thrmgr->global->divert_conn_pool;
+
+	while (!pool->failed && pool->idle_count + pool->pending_count < size) {
+		if (pxy_pool_connect(pool) == -1) {
+			pool->failed = 1;
+		}
+	}
+}
+
+/*
+ * Create the divert pools of a thread, one per proxyspec with a divert address.
+ * Must be called from the thread owning the pools.
+ *
+ * Returns -1 on failure, 0 on success.
+ */
+int
+pxy_pool_init(pxy_thr_ctx_t *tctx)
+{
+	global_t *global = tctx->thrmgr->global;
+
+	if (!global->divert_conn_pool)
+		return 0;
+
+	for (proxyspec_t *spec = global->spec; spec; spec = spec->next) {
+		if (!spec->divert_addrlen)
+			continue;
+
+		pxy_pool_t *pool = malloc(sizeof(pxy_pool_t));
+		if (!pool)
+			return -1;
+		memset(pool, 0, sizeof(pxy_pool_t));
+		pool->thr = tctx;
+		pool->spec = spec;
+
+		pool->next = tctx->pools;
+		tctx->pools = pool;
+
+		pxy_pool_refill(pool);
+	}
+	return 0;
+}
+
+void
+pxy_pool_free(pxy_thr_ctx_t *tctx)
+{
+	while (tctx->pools) {
+		pxy_pool_t *next = tctx->pools->next;
+
+		while (tctx->pools->idle) {
+			pxy_pool_conn_t *pc = tctx->pools->idle->next;
+			pxy_pool_conn_free(tctx->pools->idle);
+			tctx->pools->idle = pc;
+		}
+		while (tctx->pools->pending) {
+			pxy_pool_conn_t *pc = tctx->pools->pending->next;
+			pxy_pool_conn_free(tctx->pools->pending);
+			tctx->pools->pending = pc;
+		}
+		free(tctx->pools);
+		tctx->pools = next;
+	}
+}
+
+/*
+ * Take a connected socket to the divert address of the spec from the pool,
+ * and start replenishing the pool.
+ * The caller owns the returned socket.
+ *
+ * Returns -1 if the pool is disabled or empty.
+ */
+evutil_socket_t
+pxy_pool_take(pxy_thr_ctx_t *tctx, proxyspec_t *spec)
+{
+	pxy_pool_t *pool = tctx->pools;
+	while (pool && pool->spec != spec)
+		pool = pool->next;
+	if (!pool)
+		return -1;
+
+	pxy_pool_conn_t *pc = pool->idle;
+	if (!pc) {
+		pool->missed++;
+		pxy_pool_refill(pool);
+		return -1;
+	}
+
+	pool->idle = pc->next;
+	pool->idle_count--;
+	pool->taken++;
+
+	evutil_socket_t fd = pc->fd;
+	pc->fd = -1;
+	pxy_pool_conn_free(pc);
+
+	log_finer_main_va("Took divert pool conn, thr=%d, fd=%d, idle=%u", tctx->id, fd, pool->idle_count);
+
+	pxy_pool_refill(pool);
+	return fd;
+}
+
+/*
+ * Called by the thread timer: drop idle conns older than the conn idle
+ * timeout, so that we never hand out conns the listening program or
+ * a middlebox may have forgotten, then retry failed pools.
+ */
+void
+pxy_pool_timer(pxy_thr_ctx_t *tctx)
+{
+	time_t now = time(NULL);
+	unsigned int timeout = tctx->thrmgr->global->conn_idle_timeout;
+
+	for (pxy_pool_t *pool = tctx->pools; pool; pool = pool->next) {
+		pxy_pool_conn_t **pcp = &pool->idle;
+		while (*pcp) {
+			pxy_pool_conn_t *pc = *pcp;
+			if (now - pc->ctime >= timeout) {
+				*pcp = pc->next;
+				pool->idle_count--;
+				pxy_pool_conn_free(pc);
+			} else {
+				pcp = &pc->next;
+			}
+		}
+
+		log_finest_main_va("thr=%d, idle=%u, pending=%u, taken=%zu, missed=%zu%s",
+				tctx->id, pool->idle_count, pool->pending_count, pool->taken, pool->missed, pool->failed ? ", failed" : "");
+
+		pool->failed = 0;
+		pxy_pool_refill(pool);
+	}
+}
+
+/* vim: set noet ft=c: */
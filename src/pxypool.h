@@ -0,0 +1,86 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PXYPOOL_H
+#define PXYPOOL_H
+
+#include "attrib.h"
+#include "opts.h"
+#include "pxythr.h"
+
+#include <time.h>
+
+#include <event2/event.h>
+
+/*
+ * A pre-established connection to the divert address of a proxyspec.
+ * Each pool conn is used by only one logical connection, the SSLproxy line
+ * sent at the start of the stream introduces the conn to the listening program.
+ */
+typedef struct pxy_pool_conn {
+	evutil_socket_t fd;
+	time_t ctime;
+	// Write event while connecting, read event while idle
+	struct event *ev;
+	pxy_pool_t *pool;
+	struct pxy_pool_conn *next;
+} pxy_pool_conn_t;
+
+/*
+ * Per-thread pool of divert conns of a proxyspec.
+ * Only the thread owning the pool accesses it, hence no locking.
+ */
+struct pxy_pool {
+	pxy_thr_ctx_t *thr;
+	proxyspec_t *spec;
+
+	// Connected and ready to be taken
+	pxy_pool_conn_t *idle;
+	// Connect in progress
+	pxy_pool_conn_t *pending;
+	unsigned int idle_count;
+	unsigned int pending_count;
+
+	// Set on connect failure to stop refilling until the next timer tick
+	unsigned int failed : 1;
+
+	// Statistics
+	size_t taken;
+	size_t missed;
+
+	struct pxy_pool *next;
+};
+
+int pxy_pool_init(pxy_thr_ctx_t *) NONNULL(1) WUNRES;
+void pxy_pool_free(pxy_thr_ctx_t *) NONNULL(1);
+evutil_socket_t pxy_pool_take(pxy_thr_ctx_t *, proxyspec_t *) NONNULL(1,2) WUNRES;
+void pxy_pool_timer(pxy_thr_ctx_t *) NONNULL(1);
+
+#endif /* !PXYPOOL_H */
+
+/* vim: set noet ft=c: */
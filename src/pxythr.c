@@ -30,9 +30,12 @@
 
 #include "log.h"
 #include "pxyconn.h"
+#include "pxypool.h"
 #include "util.h"
 
 #include <assert.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
 
 /*
  * Attach a connection to its thread.
@@ -48,7 +51,7 @@ pxy_thr_attach(pxy_conn_ctx_t *ctx)
 	log_finest("Adding conn");
 
 	// Always keep thr load and conns list in sync
-	ctx->thr->load++;
+	__atomic_add_fetch(&ctx->thr->load, 1, __ATOMIC_RELAXED);
 
 	ctx->next = ctx->thr->conns;
 	ctx->thr->conns = ctx;
@@ -71,7 +74,7 @@ pxy_thr_detach(pxy_conn_ctx_t *ctx)
 	log_finest("Removing conn");
 
 	// We increment thr load in pxy_conn_init() only (for parent conns)
-	ctx->thr->load--;
+	__atomic_sub_fetch(&ctx->thr->load, 1, __ATOMIC_RELAXED);
 
 	if (ctx->prev) {
 		ctx->prev->next = ctx->next;
@@ -173,6 +176,88 @@ pxy_thr_get_expired_conns(pxy_thr_ctx_t *tctx, pxy_conn_ctx_t **expired_conns)
 	}
 }
 
+/*
+ * Free the chain memory of an empty evbuffer.
+ * Libevent keeps the chain reserved for a read which returned no data, such as
+ * the final SSL_read() which wants more data, in the input buffer until more
+ * data arrives. Draining an empty evbuffer does not free its chains, but
+ * draining all of its data does. Returns the number of bytes freed.
+ * The end of the input buffers of socket bevs is frozen, so it is unfrozen
+ * while adding and draining, as the socket bev does for its reads.
+ * This relies on evbuffer_peek() counting the empty chain, and on draining the
+ * added byte freeing it, which is libevent internals, checked against libevent
+ * 2.1.12. See pxythrmgr.t.c.
+ */
+size_t
+pxy_thr_reclaim_evbuf(struct evbuffer *buf)
+{
+	struct evbuffer_iovec v;
+	int frozen = 0;
+	int rv;
+
+	if (evbuffer_get_length(buf) || evbuffer_peek(buf, -1, NULL, &v, 1) != 1)
+		return 0;
+	// Does not allocate, since the empty chain has space
+	if (evbuffer_reserve_space(buf, 1, &v, 1) != 1) {
+		// Fails only if the end is frozen
+		frozen = 1;
+		evbuffer_unfreeze(buf, 0);
+		if (evbuffer_reserve_space(buf, 1, &v, 1) != 1) {
+			evbuffer_freeze(buf, 0);
+			return 0;
+		}
+	}
+	rv = evbuffer_add(buf, "", 1);
+	if (rv == 0)
+		evbuffer_drain(buf, 1);
+	if (frozen)
+		evbuffer_freeze(buf, 0);
+	return rv == 0 ? v.iov_len : 0;
+}
+
+static size_t
+pxy_thr_reclaim_desc(pxy_conn_desc_t *desc)
+{
+	// @attention Do not touch output buffers, adding to them triggers writes, e.g. SSL_write() with openssl bevs,
+	// and libevent frees their chains once written out anyway
+	if (desc->bev && !desc->closed)
+		return pxy_thr_reclaim_evbuf(bufferevent_get_input(desc->bev));
+	return 0;
+}
+
+/*
+ * Reclaim the evbuffer memory of the conns which have been idle for at least
+ * ConnIdleReclaimTime seconds. OpenSSL releases its own buffers of idle conns,
+ * since we use SSL_MODE_RELEASE_BUFFERS.
+ */
+static void
+pxy_thr_reclaim_idle_mem(pxy_thr_ctx_t *tctx)
+{
+	time_t now = time(NULL);
+
+	pxy_conn_ctx_t *ctx = tctx->conns;
+	while (ctx) {
+		if (now - ctx->atime >= (time_t)tctx->thrmgr->global->conn_idle_reclaim_time) {
+			size_t bytes = pxy_thr_reclaim_desc(&ctx->src) + pxy_thr_reclaim_desc(&ctx->dst);
+			// dst may be the same as srvdst, but then it is empty already
+			bytes += pxy_thr_reclaim_desc(&ctx->srvdst);
+
+			pxy_conn_child_ctx_t *child = ctx->children;
+			while (child) {
+				bytes += pxy_thr_reclaim_desc(&child->src) + pxy_thr_reclaim_desc(&child->dst);
+				child = child->next;
+			}
+
+			if (bytes) {
+				log_finest_main_va("Reclaimed %zu bytes of idle conn thr=%d, fd=%d", bytes, tctx->id, ctx->fd);
+				tctx->idle_reclaimed_conns++;
+				tctx->idle_reclaimed_bytes += bytes;
+			}
+		}
+		ctx = ctx->next;
+	}
+}
+
 static evutil_socket_t
 pxy_thr_print_children(pxy_conn_child_ctx_t *ctx)
 {
@@ -260,13 +345,13 @@ pxy_thr_print_info(pxy_thr_ctx_t *tctx)
 		}
 	}
 
-	log_finest_main_va("thr=%d, mld=%zu, mfd=%d, mat=%lld, mct=%lld, iib=%llu, iob=%llu, eib=%llu, eob=%llu, swm=%zu, uwm=%zu, to=%zu, err=%zu, si=%u",
+	log_finest_main_va("thr=%d, mld=%zu, mfd=%d, mat=%lld, mct=%lld, iib=%llu, iob=%llu, eib=%llu, eob=%llu, swm=%zu, uwm=%zu, to=%zu, err=%zu, irc=%zu, irb=%llu, vch=%zu, vcm=%zu, fch=%zu, fcm=%zu, fbc=%zu, fbs=%zu, si=%u",
 			tctx->id, tctx->max_load, tctx->max_fd, (long long)max_atime, (long long)max_ctime, tctx->intif_in_bytes, tctx->intif_out_bytes, tctx->extif_in_bytes, tctx->extif_out_bytes,
-			tctx->set_watermarks, tctx->unset_watermarks, tctx->timedout_conns, tctx->errors, tctx->stats_id);
+			tctx->set_watermarks, tctx->unset_watermarks, tctx->timedout_conns, tctx->errors, tctx->idle_reclaimed_conns, tctx->idle_reclaimed_bytes, tctx->verify_cache_hits, tctx->verify_cache_misses, tctx->filter_cache_hits, tctx->filter_cache_misses, tctx->filter_bloom_stats.checks, tctx->filter_bloom_stats.skips, tctx->stats_id);
 
-	if (asprintf(&smsg, "STATS: thr=%d, mld=%zu, mfd=%d, mat=%lld, mct=%lld, iib=%llu, iob=%llu, eib=%llu, eob=%llu, swm=%zu, uwm=%zu, to=%zu, err=%zu, si=%u\n",
+	if (asprintf(&smsg, "STATS: thr=%d, mld=%zu, mfd=%d, mat=%lld, mct=%lld, iib=%llu, iob=%llu, eib=%llu, eob=%llu, swm=%zu, uwm=%zu, to=%zu, err=%zu, irc=%zu, irb=%llu, vch=%zu, vcm=%zu, fch=%zu, fcm=%zu, fbc=%zu, fbs=%zu, si=%u\n",
 			tctx->id, tctx->max_load, tctx->max_fd, (long long)max_atime, (long long)max_ctime, tctx->intif_in_bytes, tctx->intif_out_bytes, tctx->extif_in_bytes, tctx->extif_out_bytes,
-			tctx->set_watermarks, tctx->unset_watermarks, tctx->timedout_conns, tctx->errors, tctx->stats_id) < 0) {
+			tctx->set_watermarks, tctx->unset_watermarks, tctx->timedout_conns, tctx->errors, tctx->idle_reclaimed_conns, tctx->idle_reclaimed_bytes, tctx->verify_cache_hits, tctx->verify_cache_misses, tctx->filter_cache_hits, tctx->filter_cache_misses, tctx->filter_bloom_stats.checks, tctx->filter_bloom_stats.skips, tctx->stats_id) < 0) {
 		return;
 	}
 	if (log_stats(smsg) == -1) {
@@ -280,6 +365,14 @@ pxy_thr_print_info(pxy_thr_ctx_t *tctx)
 	tctx->errors = 0;
 	tctx->set_watermarks = 0;
 	tctx->unset_watermarks = 0;
+	tctx->idle_reclaimed_conns = 0;
+	tctx->idle_reclaimed_bytes = 0;
+	tctx->verify_cache_hits = 0;
+	tctx->verify_cache_misses = 0;
+	tctx->filter_cache_hits = 0;
+	tctx->filter_cache_misses = 0;
+	tctx->filter_bloom_stats.checks = 0;
+	tctx->filter_bloom_stats.skips = 0;
 
 	tctx->intif_in_bytes = 0;
 	tctx->intif_out_bytes = 0;
@@ -325,6 +418,12 @@ pxy_thr_timer_cb(UNUSED evutil_socket_t fd, UNUSED short what, UNUSED void *arg)
 	}
 #endif /* DEBUG_PROXY */
 
+	pxy_pool_timer(tctx);
+
+	if (tctx->thrmgr->global->conn_idle_reclaim_time) {
+		pxy_thr_reclaim_idle_mem(tctx);
+	}
+
 	// @attention Print thread info only if stats logging is enabled, if disabled debug logs are not printed either
 	if (tctx->thrmgr->global->statslog) {
 		tctx->timeout_count++;
@@ -350,8 +449,20 @@ pxy_thr(void *arg)
 	if (!ev)
 		return NULL;
 	evtimer_add(ev, &timer_delay);
+	if (pxy_pool_init(tctx) == -1) {
+		log_err_level_printf(LOG_WARNING, "Error creating divert pools of thr %d\n", tctx->id);
+	}
+	// Filtering works without the cache, only slower
+	if (!(tctx->filter_cache = filtercache_new(FILTERCACHE_SIZE))) {
+		log_err_level_printf(LOG_WARNING, "Error creating filter cache of thr %d\n", tctx->id);
+	}
 	tctx->running = 1;
 	event_base_dispatch(tctx->evbase);
+	pxy_pool_free(tctx);
+	if (tctx->filter_cache) {
+		filtercache_free(tctx->filter_cache);
+		tctx->filter_cache = NULL;
+	}
 	event_free(ev);
 
 	return NULL;
@@ -30,21 +30,26 @@
 #define PXYTHR_H
 
 #include "attrib.h"
+#include "filtercache.h"
+#include "bloom.h"
 
 #include <sys/types.h>
 #include <sys/socket.h>
 
 #include <event2/event.h>
 #include <event2/dns.h>
+#include <event2/buffer.h>
 #include <pthread.h>
 
 typedef struct pxy_conn_ctx pxy_conn_ctx_t;
 typedef struct pxy_thrmgr_ctx pxy_thrmgr_ctx_t;
+typedef struct pxy_pool pxy_pool_t;
 
 typedef struct pxy_thr_ctx {
 	pthread_t thr;
 	int id;
 	pxy_thrmgr_ctx_t *thrmgr;
+	// Written by the thread only, read by others with atomic loads
 	size_t load;
 	struct event_base *evbase;
 	struct evdns_base *dnsbase;
@@ -61,6 +66,17 @@ typedef struct pxy_thr_ctx {
 	long long unsigned int intif_out_bytes;
 	long long unsigned int extif_in_bytes;
 	long long unsigned int extif_out_bytes;
+	// Number of idle conns and bytes of evbuffer memory reclaimed
+	size_t idle_reclaimed_conns;
+	long long unsigned int idle_reclaimed_bytes;
+	// Upstream verification cache hits and misses
+	size_t verify_cache_hits;
+	size_t verify_cache_misses;
+	// Filter decision cache hits and misses
+	size_t filter_cache_hits;
+	size_t filter_cache_misses;
+	// Site lookups checked against and skipped by filter Bloom filters
+	bloom_stats_t filter_bloom_stats;
 	// Each stats has an id, incremented on each stats print
 	unsigned short stats_id;
 	// Used to print statistics, compared against stats_period
@@ -69,6 +85,12 @@ typedef struct pxy_thr_ctx {
 	// List of active connections on the thread
 	pxy_conn_ctx_t *conns;
 
+	// Pools of pre-established divert conns, one per proxyspec
+	pxy_pool_t *pools;
+
+	// Cache of filter decisions, owned by the thread
+	filtercache_t *filter_cache;
+
 #ifndef WITHOUT_USERAUTH
 	// Per-thread sqlite stmt is necessary to prevent multithreading issues between threads
 	struct sqlite3_stmt *get_user;
@@ -77,6 +99,7 @@ typedef struct pxy_thr_ctx {
 
 void pxy_thr_attach(pxy_conn_ctx_t *) NONNULL(1);
 void pxy_thr_detach(pxy_conn_ctx_t *) NONNULL(1);
+size_t pxy_thr_reclaim_evbuf(struct evbuffer *) NONNULL(1);
 
 void *pxy_thr(void *);
 
@@ -201,8 +201,7 @@ pxy_thrmgr_free(pxy_thrmgr_ctx_t *ctx)
  * Assign a new connection to a thread.  Chooses the thread with the fewest
  * currently active connections, returns the appropriate event bases.
  * No need to be so accurate about balancing thread loads,
- * so does not use mutexes, thread or thrmgr level.
- * @todo Check if read accesses to thr load can cause any multithreading issues.
+ * so does not use mutexes, thread or thrmgr level, but atomic loads.
  * Returns the index of the chosen thread.
  * This function cannot fail.
  */
@@ -212,7 +211,7 @@ pxy_thrmgr_assign_thr(pxy_conn_ctx_t *ctx)
 	log_finest("ENTER");
 
 	pxy_thrmgr_ctx_t *tmctx = ctx->thrmgr;
-	size_t minload = tmctx->thr[0]->load;
+	size_t minload = __atomic_load_n(&tmctx->thr[0]->load, __ATOMIC_RELAXED);
 
 #ifdef DEBUG_THREAD
 	log_dbg_printf("===> Proxy connection handler thread status:\nthr[0]: %zu\n", minload);
@@ -220,7 +219,7 @@ pxy_thrmgr_assign_thr(pxy_conn_ctx_t *ctx)
 
 	int thrid = 0;
 	for (int i = 1; i < tmctx->num_thr; i++) {
-		size_t thrload = tmctx->thr[i]->load;
+		size_t thrload = __atomic_load_n(&tmctx->thr[i]->load, __ATOMIC_RELAXED);
 		if (minload > thrload) {
 			minload = thrload;
 			thrid = i;
@@ -238,4 +237,20 @@ pxy_thrmgr_assign_thr(pxy_conn_ctx_t *ctx)
 #endif /* DEBUG_THREAD */
 }
 
+/*
+ * Return the total number of conns on all threads.
+ * Thread loads are read atomically but not all at once, so this is an
+ * approximation.
+ */
+size_t
+pxy_thrmgr_get_load(pxy_thrmgr_ctx_t *ctx)
+{
+	size_t load = 0;
+
+	for (int i = 0; i < ctx->num_thr; i++) {
+		load += __atomic_load_n(&ctx->thr[i]->load, __ATOMIC_RELAXED);
+	}
+	return load;
+}
+
 /* vim: set noet ft=c: */
@@ -53,6 +53,7 @@ int pxy_thrmgr_run(pxy_thrmgr_ctx_t *) NONNULL(1) WUNRES;
 void pxy_thrmgr_free(pxy_thrmgr_ctx_t *) NONNULL(1);
 
 void pxy_thrmgr_assign_thr(pxy_conn_ctx_t *) NONNULL(1);
+size_t pxy_thrmgr_get_load(pxy_thrmgr_ctx_t *) NONNULL(1) WUNRES;
 
 #endif /* !PXYTHRMGR_H */
 
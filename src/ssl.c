@@ -269,6 +269,23 @@ ssl_openssl_version(void)
  */
 static int ssl_initialized = 0;
 
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L) && !defined(LIBRESSL_VERSION_NUMBER)
+/*
+ * Digests used per connection, fetched once from the default library context
+ * by ssl_init(), after OpenSSL has loaded its configuration.  Passing fetched
+ * digests to EVP_Digest() and X509_digest() skips the implicit fetch of the
+ * legacy EVP_sha1() etc. on each call, which goes through the locks of the
+ * method store shared by all threads.  Freed by ssl_engine(), since only the
+ * legacy digests go through a default engine.
+ */
+static EVP_MD *ssl_mds[3];
+static const char *ssl_md_names[] = {
+	"MD5", "SHA1", "SHA256"
+};
+
+static void ssl_mds_free(void);
+#endif /* OpenSSL >= 3.0.0 */
+
 #if defined(OPENSSL_THREADS) && ((OPENSSL_VERSION_NUMBER < 0x10100000L) || (defined(LIBRESSL_VERSION_NUMBER) && LIBRESSL_VERSION_NUMBER < 0x20701000L))
 struct CRYPTO_dynlock_value {
 	pthread_mutex_t mutex;
@@ -446,6 +463,13 @@ ssl_init(void)
 	sk_SSL_COMP_zero(comp_methods);
 #endif /* USE_FOOTPRINT_HACKS */
 
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L) && !defined(LIBRESSL_VERSION_NUMBER)
+	/* digests not available are fetched on demand like before */
+	for (size_t i = 0; i < sizeof(ssl_mds)/sizeof(ssl_mds[0]); i++)
+		ssl_mds[i] = EVP_MD_fetch(NULL, ssl_md_names[i], NULL);
+	ERR_clear_error();
+#endif /* OpenSSL >= 3.0.0 */
+
 	ssl_initialized = 1;
 	return 0;
 }
@@ -505,6 +529,10 @@ ssl_fini(void)
     ((OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER))
 	ENGINE_cleanup();
 #endif /* !OPENSSL_NO_ENGINE && OPENSSL_VERSION_NUMBER < 0x10100000L */
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L) && !defined(LIBRESSL_VERSION_NUMBER)
+	ssl_mds_free();
+#endif /* OpenSSL >= 3.0.0 */
+
 	CONF_modules_finish();
 	CONF_modules_unload(1);
 	CONF_modules_free();
@@ -533,10 +561,40 @@ ssl_engine(const char *name) {
 
 	if (!ENGINE_set_default(engine, ENGINE_METHOD_ALL))
 		return -1;
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L) && !defined(LIBRESSL_VERSION_NUMBER)
+	ssl_mds_free();
+#endif /* OpenSSL >= 3.0.0 */
 	return 0;
 }
 #endif /* !OPENSSL_NO_ENGINE */
 
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L) && !defined(LIBRESSL_VERSION_NUMBER)
+static void
+ssl_mds_free(void)
+{
+	for (size_t i = 0; i < sizeof(ssl_mds)/sizeof(ssl_mds[0]); i++) {
+		EVP_MD_free(ssl_mds[i]);
+		ssl_mds[i] = NULL;
+	}
+}
+
+/*
+ * Returns the digest fetched by ssl_init() with the same type as md, or md
+ * itself if there is none.
+ */
+static const EVP_MD *
+ssl_md(const EVP_MD *md)
+{
+	for (size_t i = 0; i < sizeof(ssl_mds)/sizeof(ssl_mds[0]); i++) {
+		if (ssl_mds[i] && EVP_MD_get_type(ssl_mds[i]) == EVP_MD_get_type(md))
+			return ssl_mds[i];
+	}
+	return md;
+}
+#else /* OpenSSL < 3.0.0 */
+#define ssl_md(md) (md)
+#endif /* OpenSSL < 3.0.0 */
+
 /*
  * Format raw SHA1 hash into newly allocated string, with or without colons.
  */
@@ -1408,7 +1466,7 @@ ssl_key_identifier_sha1(EVP_PKEY *key, unsigned char *keyid)
 		return -1;
 	if (!X509_PUBKEY_get0_param(NULL, &pk, &length, NULL, pubkey))
 		goto errout;
-	if (!EVP_Digest(pk, length, keyid, NULL, EVP_sha1(), NULL))
+	if (!EVP_Digest(pk, length, keyid, NULL, ssl_md(EVP_sha1()), NULL))
 		goto errout;
 	X509_PUBKEY_free(pubkey);
 	return 0;
@@ -1479,7 +1537,51 @@ ssl_x509_fingerprint_sha1(X509 *crt, unsigned char *fpr)
 {
 	unsigned int sz = SSL_X509_FPRSZ;
 
-	return X509_digest(crt, EVP_sha1(), fpr, &sz) ? 0 : -1;
+	return X509_digest(crt, ssl_md(EVP_sha1()), fpr, &sz) ? 0 : -1;
+}
+
+/*
+ * Write the SHA256 fingerprint of certificate to fpr as SSL_X509_FPRSZ_SHA256
+ * (32) bytes long binary buffer.
+ * Returns -1 on error, 0 on success.
+ */
+int
+ssl_x509_fingerprint_sha256(X509 *crt, unsigned char *fpr)
+{
+	unsigned int sz = SSL_X509_FPRSZ_SHA256;
+
+	return X509_digest(crt, ssl_md(EVP_sha256()), fpr, &sz) ? 0 : -1;
+}
+
+/*
+ * Write the SHA256 hash over the SHA256 fingerprints of all certificates in
+ * chain to fpr as SSL_X509_FPRSZ_SHA256 (32) bytes long binary buffer.
+ * Returns -1 on error, 0 on success.
+ */
+int
+ssl_x509chain_fingerprint_sha256(STACK_OF(X509) *chain, unsigned char *fpr)
+{
+	unsigned char *fprs;
+	int n = sk_X509_num(chain);
+	int rv = -1;
+
+	if (n <= 0) {
+		return EVP_Digest("", 0, fpr, NULL,
+		                  ssl_md(EVP_sha256()), NULL) ? 0 : -1;
+	}
+	if (!(fprs = malloc(n * SSL_X509_FPRSZ_SHA256)))
+		return -1;
+	for (int i = 0; i < n; i++) {
+		if (ssl_x509_fingerprint_sha256(sk_X509_value(chain, i),
+		                                fprs + i * SSL_X509_FPRSZ_SHA256) == -1)
+			goto out;
+	}
+	if (EVP_Digest(fprs, n * SSL_X509_FPRSZ_SHA256, fpr, NULL,
+	               ssl_md(EVP_sha256()), NULL))
+		rv = 0;
+out:
+	free(fprs);
+	return rv;
 }
 
 /*
@@ -1511,6 +1613,16 @@ ssl_dh_refcount_inc(DH *dh)
 	DH_up_ref(dh);
 #endif /* !OPENSSL_THREADS */
 }
+
+/*
+ * Decrement the reference count of DH parameters, freeing them with the
+ * last reference.  Keeps the deprecated DH API out of opts.c.
+ */
+void
+ssl_dh_free(DH *dh)
+{
+	DH_free(dh);
+}
 #endif /* !OPENSSL_NO_DH */
 
 /*
@@ -1979,8 +2091,391 @@ ssl_is_ocspreq(const unsigned char *buf, size_t sz)
 	return 1;
 }
 
+#ifdef DEBUG_CLIENTHELLO_PARSER
+#define DBG_printf(...) log_dbg_printf("ClientHello parser: " __VA_ARGS__)
+#else /* !DEBUG_CLIENTHELLO_PARSER */
+#define DBG_printf(...) 
+#endif /* !DEBUG_CLIENTHELLO_PARSER */
+
+/*
+ * GREASE values (RFC 8701) are {0x0a0a, 0x1a1a, ..., 0xfafa}.
+ */
+#define SSL_TLS_IS_GREASE(v) \
+	((((v) & 0x0f0f) == 0x0a0a) && (((v) >> 8) == ((v) & 0xff)))
+
+/*
+ * Parse the body of a ClientHello handshake message, i.e. the n bytes
+ * following the 4 byte handshake message header, into *info.  The lists in
+ * *info point into the message.
+ * Returns 0 if it is a valid ClientHello, -1 otherwise.
+ *
+ * Extensions other than server_name are only recorded if well-formed, but
+ * do not invalidate the ClientHello otherwise, as before they were parsed.
+ */
+static int
+ssl_tls_clienthello_parse_msg(const unsigned char *p, ssize_t n,
+                              ssl_tls_clienthello_info_t *info)
+{
+	memset(info, 0, sizeof(ssl_tls_clienthello_info_t));
+
+	if (n < 2)
+		return -1;
+	DBG_printf("clienthello version %02x %02x\n", p[0], p[1]);
+	/* inner version check, see outer one in
+	 * ssl_tls_clienthello_parse_record() */
+	if (p[0] != 0x03 || p[1] > 0x03)
+		return -1;
+	info->version = p[1] + (p[0] << 8);
+	info->max_version = info->version;
+	p += 2; n -= 2;
+
+	if (n < 32)
+		return -1;
+	DBG_printf("clienthello random %02x %02x %02x %02x ...\n",
+	           p[0], p[1], p[2], p[3]);
+	p += 32; n -= 32;
+
+	if (n < 1)
+		return -1;
+	DBG_printf("clienthello sidlen %02x\n", *p);
+	ssize_t sidlen = *p; /* session id length, 0..32 */
+	p += 1; n -= 1;
+	if (n < sidlen)
+		return -1;
+	p += sidlen; n -= sidlen;
+
+	if (n < 2)
+		return -1;
+	DBG_printf("clienthello cipher suites length %02x %02x\n",
+	           p[0], p[1]);
+	ssize_t suiteslen = p[1] + (p[0] << 8);
+	p += 2; n -= 2;
+	if (n < suiteslen)
+		return -1;
+	info->ciphers = p;
+	info->ciphers_len = suiteslen;
+	p += suiteslen;
+	n -= suiteslen;
+
+	if (n < 1)
+		return -1;
+	DBG_printf("clienthello compress methods length %02x\n", *p);
+	ssize_t compslen = *p;
+	p++; n--;
+	if (n < compslen)
+		return -1;
+	p += compslen;
+	n -= compslen;
+
+	/* begin of extensions */
+
+	if (n == 0) {
+		/* valid ClientHello without extensions */
+		return 0;
+	}
+	if (n < 2)
+		return -1;
+	DBG_printf("tlsexts length %02x %02x\n", p[0], p[1]);
+	ssize_t tlsextslen = p[1] + (p[0] << 8);
+	DBG_printf("tlsextslen %zd\n", tlsextslen);
+	p += 2; n -= 2;
+	if (n < tlsextslen)
+		return -1;
+	n = tlsextslen; /* only parse exts, ignore trailing bits */
+
+	while (n > 0) {
+		if (n < 4)
+			return -1;
+		DBG_printf("tlsext type %02x %02x len %02x %02x\n",
+		           p[0], p[1], p[2], p[3]);
+		unsigned short exttype = p[1] + (p[0] << 8);
+		ssize_t extlen = p[3] + (p[2] << 8);
+		p += 4; n -= 4;
+		if (n < extlen)
+			return -1;
+
+		if (info->nexts < SSL_TLS_CLIENTHELLO_MAXEXTS) {
+			info->exts[info->nexts++] = exttype;
+		} else {
+			info->exts_truncated = 1;
+		}
+
+		const unsigned char *extp = p;
+		ssize_t extn = extlen;
+		ssize_t listlen;
+
+		switch (exttype) {
+		case 0: /* server_name */
+			if (extn < 2)
+				return -1;
+			DBG_printf("list length %02x %02x\n", extp[0], extp[1]);
+			listlen = extp[1] + (extp[0] << 8);
+			DBG_printf("namelistlen = %zd\n", listlen);
+			extp += 2;
+			extn -= 2;
+
+			if (listlen != extn)
+				return -1;
+
+			while (extn > 0) {
+				if (extn < 3)
+					return -1;
+				DBG_printf("ServerName type %02x len %02x %02x\n",
+				           extp[0], extp[1], extp[2]);
+				unsigned char sntype = extp[0];
+				ssize_t snlen = extp[2] + (extp[1] << 8);
+				extp += 3;
+				extn -= 3;
+				if (snlen > extn)
+					return -1;
+				if (snlen > TLSEXT_MAXLEN_host_name)
+					return -1;
+				/*
+				 * We use the first name only.
+				 * RFC 6066: "The ServerNameList MUST NOT
+				 * contain more than one name of the same
+				 * name_type."
+				 */
+				if (sntype == 0 && !info->sni) {
+					info->sni = extp;
+					info->sni_len = snlen;
+					/* deliberately not checking for
+					 * malformed hostnames containing
+					 * invalid chars */
+				}
+				extp += snlen;
+				extn -= snlen;
+			}
+			break;
+		case 10: /* supported_groups */
+		case 13: /* signature_algorithms */
+		case 16: /* application_layer_protocol_negotiation */
+			if (extn < 2)
+				break;
+			listlen = extp[1] + (extp[0] << 8);
+			if (listlen != extn - 2)
+				break;
+			if (exttype == 10) {
+				info->groups = extp + 2;
+				info->groups_len = listlen;
+			} else if (exttype == 13) {
+				info->sigalgs = extp + 2;
+				info->sigalgs_len = listlen;
+			} else {
+				info->alpn = extp + 2;
+				info->alpn_len = listlen;
+			}
+			break;
+		case 11: /* ec_point_formats */
+			if (extn < 1 || extp[0] != extn - 1)
+				break;
+			info->pointfmts = extp + 1;
+			info->pointfmts_len = extp[0];
+			break;
+		case 43: /* supported_versions */
+			if (extn < 1 || extp[0] != extn - 1)
+				break;
+			for (ssize_t i = 1; i + 1 < extn; i += 2) {
+				unsigned int v = extp[i + 1] + (extp[i] << 8);
+				if (!SSL_TLS_IS_GREASE(v) && v > info->max_version)
+					info->max_version = v;
+			}
+			break;
+		case 51: /* key_share */
+			if (extn < 2)
+				break;
+			listlen = extp[1] + (extp[0] << 8);
+			if (listlen != extn - 2)
+				break;
+			extp += 2;
+			extn -= 2;
+			while (extn >= 4 &&
+			       info->nkeyshares < SSL_TLS_CLIENTHELLO_MAXKEYSHARES) {
+				ssize_t keylen = extp[3] + (extp[2] << 8);
+				if (keylen > extn - 4)
+					break;
+				info->keyshares[info->nkeyshares++] =
+					extp[1] + (extp[0] << 8);
+				extp += 4 + keylen;
+				extn -= 4 + keylen;
+			}
+			break;
+		default:
+			DBG_printf("skipped\n");
+			break;
+		}
+		p += extlen;
+		n -= extlen;
+	} /* while have more extensions */
+
+	return 0;
+}
+
+/*
+ * Parse a ClientHello record starting at p, with n bytes available.
+ * Returns 0 if it is a complete and valid ClientHello, 1 if it is truncated,
+ * -1 if it is not a ClientHello.
+ */
+static int
+ssl_tls_clienthello_parse_record(const unsigned char *p, ssize_t n,
+                                 ssl_tls_clienthello_info_t *info)
+{
+	if (n < 1) {
+		DBG_printf("===> Truncated: rv 1, *clienthello set\n");
+		return 1;
+	}
+
+	DBG_printf("byte 0: %02x\n", *p);
+	/* +0 0x80 +2 0x01 SSLv2 short header, clientHello;
+	 * +0 0x16 +1 0x03 SSLv3/TLSv1.x handshake, clientHello */
+	if (*p == 0x80) {
+		/* SSLv2 handled here */
+		p++; n--;
+
+		if (n < 10) { /* length + 9 */
+			DBG_printf("===> [SSLv2] Truncated:"
+			           " rv 1, *clienthello set\n");
+			return 1;
+		}
+
+		DBG_printf("length: %02x\n", p[0]);
+		if (n - 1 < p[0]) {
+			DBG_printf("===> [SSLv2] Truncated:"
+			           " rv 1, *clienthello set\n");
+			return 1;
+		}
+		p++; n--;
+
+		DBG_printf("msgtype: %02x\n", p[0]);
+		if (*p != 0x01)
+			return -1;
+		p++; n--;
+
+		DBG_printf("version: %02x %02x\n", p[0], p[1]);
+		/* byte order is actually swapped for SSLv2 */
+		if (!(
+#ifdef HAVE_SSLV2
+		      (p[0] == 0x00 && p[1] == 0x02) ||
+#endif /* HAVE_SSLV2 */
+		      (p[0] == 0x03 && p[1] <= 0x03)))
+			return -1;
+		unsigned int version = p[1] + (p[0] << 8);
+		p += 2; n -= 2;
+
+		DBG_printf("cipher-spec-len: %02x %02x\n", p[0], p[1]);
+		ssize_t cipherspec_len = p[0] << 8 | p[1];
+		p += 2; n -= 2;
+
+		DBG_printf("session-id-len: %02x %02x\n", p[0], p[1]);
+		ssize_t sessionid_len = p[0] << 8 | p[1];
+		p += 2; n -= 2;
+
+		DBG_printf("challenge-len: %02x %02x\n", p[0], p[1]);
+		ssize_t challenge_len = p[0] << 8 | p[1];
+		p += 2; n -= 2;
+		if (challenge_len < 16 || challenge_len > 32)
+			return -1;
+
+		if (n < cipherspec_len + sessionid_len + challenge_len) {
+			DBG_printf("===> [SSLv2] Truncated:"
+			           " rv 1, *clienthello set\n");
+			return 1;
+		}
+
+		memset(info, 0, sizeof(ssl_tls_clienthello_info_t));
+		info->version = version;
+		info->max_version = version;
+		info->sslv2 = 1;
+		DBG_printf("===> [SSLv2] Match: rv 0, *clienthello set\n");
+		return 0;
+	}
+	if (*p != 0x16)
+		return -1;
+	p++; n--;
+
+	if (n < 2) {
+		DBG_printf("===> Truncated: rv 1, *clienthello set\n");
+		return 1;
+	}
+	DBG_printf("version: %02x %02x\n", p[0], p[1]);
+	/* This supports up to TLS 1.2 (0x03 0x03), TLS 1.3 ClientHellos
+	 * carry 0x03 0x01 here and 0x03 0x03 in the inner version, see
+	 * ssl_tls_clienthello_parse_msg() */
+	if (p[0] != 0x03 || p[1] > 0x03)
+		return -1;
+	p += 2; n -= 2;
+
+	if (n < 2) {
+		DBG_printf("===> Truncated: rv 1, *clienthello set\n");
+		return 1;
+	}
+	DBG_printf("length: %02x %02x\n", p[0], p[1]);
+	ssize_t recordlen = p[1] + (p[0] << 8);
+	DBG_printf("recordlen=%zd\n", recordlen);
+	p += 2; n -= 2;
+	if (recordlen < 36) /* arbitrary size too small for a c-h */
+		return -1;
+	if (n < recordlen) {
+		DBG_printf("n < recordlen: n=%zd\n", n);
+		DBG_printf("===> Truncated: rv 1, *clienthello set\n");
+		return 1;
+	}
+
+	/* from here we give up on a candidate if there is not enough
+	 * data available in the buffer, because we already checked the
+	 * availability of the whole record. */
+
+	DBG_printf("message type: %i\n", *p);
+	if (*p != 0x01) /* message type: ClientHello */
+		return -1;
+	p++; n--;
+
+	DBG_printf("message len: %02x %02x %02x\n", p[0], p[1], p[2]);
+	ssize_t msglen = p[2] + (p[1] << 8) + (p[0] << 16);
+	DBG_printf("msglen=%zd\n", msglen);
+	p += 3; n -= 3;
+	if (msglen < 32) /* arbitrary size too small for a c-h */
+		return -1;
+	if (msglen != recordlen - 4) {
+		DBG_printf("msglen != recordlen - 4\n");
+		return -1;
+	}
+
+	if (ssl_tls_clienthello_parse_msg(p, msglen, info) == -1)
+		return -1;
+
+	/* Valid ClientHello with or without server name */
+	DBG_printf("===> Match: rv 0, *clienthello set\n");
+	return 0;
+}
+
+/*
+ * Returns the next byte at or after p which may start a ClientHello record,
+ * i.e. 0x16 or 0x80, or NULL if there is none before end.  The positions of
+ * the next 0x16 and 0x80 are cached in *next16 and *next80, both NULL
+ * initially, so that every byte is scanned at most once for each.
+ */
+static const unsigned char *
+ssl_tls_clienthello_next(const unsigned char *p, const unsigned char *end,
+                         const unsigned char **next16,
+                         const unsigned char **next80)
+{
+	if (!*next16 || (*next16 != end && *next16 < p)) {
+		*next16 = memchr(p, 0x16, end - p);
+		if (!*next16)
+			*next16 = end;
+	}
+	if (!*next80 || (*next80 != end && *next80 < p)) {
+		*next80 = memchr(p, 0x80, end - p);
+		if (!*next80)
+			*next80 = end;
+	}
+	p = *next16 < *next80 ? *next16 : *next80;
+	return p == end ? NULL : p;
+}
+
 /*
- * Ugly hack to manually parse a clientHello message from a memory buffer.
+ * Parse a ClientHello message from a memory buffer.
  * This is needed in order to be able to support SNI and STARTTLS.
  *
  * The OpenSSL SNI API only allows to read the indicated server name at the
@@ -2004,17 +2499,16 @@ ssl_is_ocspreq(const unsigned char *buf, size_t sz)
  *     indicating that the caller should retry later with more bytes available
  *  0  if buf contains a complete ClientHello message;
  *     *clienthello will point to the start of the complete ClientHello message
- *
- * If a servername pointer was supplied by the caller, and a server name
- * extension was found and parsed, the server name is returned in *servername
- * as a newly allocated string that must be freed by the caller.  This may
- * only occur for a return value of 0.
+ *     and *info is filled in; the lists in *info point into buf
  *
  * If search is non-zero, then the buffer will be searched for a ClientHello
  * message beginning at offsets >= 0, whereas if search is zero, only
- * ClientHello messages starting at offset 0 will be considered.
+ * ClientHello messages starting at offset 0 will be considered.  Searching
+ * scans the buffer once using memchr(), only candidates starting with a
+ * record header byte are parsed, and each candidate is parsed at most up to
+ * the end of its record.
  *
- * This code currently supports SSL 2.0, SSL 3.0 and TLS 1.0-1.2.
+ * This code currently supports SSL 2.0, SSL 3.0 and TLS 1.0-1.3.
  *
  * References:
  * draft-hickman-netscape-ssl-00: The SSL Protocol
@@ -2025,45 +2519,25 @@ ssl_is_ocspreq(const unsigned char *buf, size_t sz)
  * RFC 4366: Transport Layer Security (TLS) Extensions
  * RFC 5246: The Transport Layer Security (TLS) Protocol Version 1.2
  * RFC 6066: Transport Layer Security (TLS) Extensions: Extension Definitions
+ * RFC 8446: The Transport Layer Security (TLS) Protocol Version 1.3
  */
 int
-ssl_tls_clienthello_parse(const unsigned char *buf, ssize_t sz, int search,
-                          const unsigned char **clienthello, char **servername)
+ssl_tls_clienthello_parse_info(const unsigned char *buf, ssize_t sz,
+                               int search, const unsigned char **clienthello,
+                               ssl_tls_clienthello_info_t *info)
 {
-#ifdef DEBUG_CLIENTHELLO_PARSER
-#define DBG_printf(...) log_dbg_printf("ClientHello parser: " __VA_ARGS__)
-#else /* !DEBUG_CLIENTHELLO_PARSER */
-#define DBG_printf(...) 
-#endif /* !DEBUG_CLIENTHELLO_PARSER */
 	const unsigned char *p = buf;
-	ssize_t n = sz;
-	char *sn = NULL;
-
-	*clienthello = NULL;
+	const unsigned char *end = buf + (sz > 0 ? sz : 0);
+	const unsigned char *next16 = NULL, *next80 = NULL;
+	int rv;
 
 	DBG_printf("parsing buffer of sz %zd\n", sz);
 
-	do {
-		if (*clienthello) {
-			/*
-			 * Rewind after skipping an invalid ClientHello by
-			 * restarting the search one byte after the beginning
-			 * of the last candidate
-			 */
-			p = (*clienthello) + 1;
-			n = sz - (p - buf);
-			if (sn) {
-				free(sn);
-				sn = NULL;
-			}
-		}
-
+	for (;;) {
 		if (search) {
 			/* Search for a potential ClientHello */
-			while ((n > 0) && (*p != 0x16) && (*p != 0x80)) {
-				p++; n--;
-			}
-			if (n <= 0) {
+			p = ssl_tls_clienthello_next(p, end, &next16, &next80);
+			if (!p) {
 				/* Search completed without a match; reset
 				 * clienthello to NULL to indicate to the
 				 * caller that this buffer does not need to be
@@ -2077,291 +2551,329 @@ ssl_tls_clienthello_parse(const unsigned char *buf, ssize_t sz, int search,
 		*clienthello = p;
 		DBG_printf("candidate at offset %td\n", p - buf);
 
-		DBG_printf("byte 0: %02x\n", *p);
-		/* +0 0x80 +2 0x01 SSLv2 short header, clientHello;
-		 * +0 0x16 +1 0x03 SSLv3/TLSv1.x handshake, clientHello */
-		if (*p == 0x80) {
-			/* SSLv2 handled here */
-			p++; n--;
-
-			if (n < 10) { /* length + 9 */
-				DBG_printf("===> [SSLv2] Truncated:"
-				           " rv 1, *clienthello set\n");
-				return 1;
-			}
-
-			DBG_printf("length: %02x\n", p[0]);
-			if (n - 1 < p[0]) {
-				DBG_printf("===> [SSLv2] Truncated:"
-				           " rv 1, *clienthello set\n");
-				return 1;
-			}
-			p++; n--;
-
-			DBG_printf("msgtype: %02x\n", p[0]);
-			if (*p != 0x01)
-				continue;
-			p++; n--;
+		rv = ssl_tls_clienthello_parse_record(p, end - p, info);
+		if (rv != -1)
+			return rv;
+		if (!search)
+			break;
+		/* skip the invalid candidate */
+		p++;
+	}
 
-			DBG_printf("version: %02x %02x\n", p[0], p[1]);
-			/* byte order is actually swapped for SSLv2 */
-			if (!(
-#ifdef HAVE_SSLV2
-			      (p[0] == 0x00 && p[1] == 0x02) ||
-#endif /* HAVE_SSLV2 */
-			      (p[0] == 0x03 && p[1] <= 0x03)))
-				continue;
-			p += 2; n -= 2;
+	/* No valid ClientHello messages found, not even a truncated one */
+	DBG_printf("===> No match: rv 1, *clienthello NULL\n");
+	*clienthello = NULL;
+	return 1;
+}
 
-			DBG_printf("cipher-spec-len: %02x %02x\n", p[0], p[1]);
-			ssize_t cipherspec_len = p[0] << 8 | p[1];
-			p += 2; n -= 2;
+/*
+ * Returns the server name of a parsed ClientHello in a newly allocated string
+ * that must be freed by the caller, or NULL if there is none.
+ */
+char *
+ssl_tls_clienthello_sni(const ssl_tls_clienthello_info_t *info)
+{
+	char *sn;
 
-			DBG_printf("session-id-len: %02x %02x\n", p[0], p[1]);
-			ssize_t sessionid_len = p[0] << 8 | p[1];
-			p += 2; n -= 2;
+	if (!info->sni)
+		return NULL;
+	sn = malloc(info->sni_len + 1);
+	if (!sn)
+		return NULL;
+	memcpy(sn, info->sni, info->sni_len);
+	sn[info->sni_len] = '\0';
+	return sn;
+}
 
-			DBG_printf("challenge-len: %02x %02x\n", p[0], p[1]);
-			ssize_t challenge_len = p[0] << 8 | p[1];
-			p += 2; n -= 2;
-			if (challenge_len < 16 || challenge_len > 32)
-				continue;
+/*
+ * Parse a ClientHello message from a memory buffer, see
+ * ssl_tls_clienthello_parse_info(), for the server name only.
+ *
+ * If a servername pointer was supplied by the caller, and a server name
+ * extension was found and parsed, the server name is returned in *servername
+ * as a newly allocated string that must be freed by the caller.  This may
+ * only occur for a return value of 0.
+ */
+int
+ssl_tls_clienthello_parse(const unsigned char *buf, ssize_t sz, int search,
+                          const unsigned char **clienthello, char **servername)
+{
+	ssl_tls_clienthello_info_t info;
+	int rv;
 
-			if (n < cipherspec_len
-			      + sessionid_len
-			      + challenge_len) {
-				DBG_printf("===> [SSLv2] Truncated:"
-				           " rv 1, *clienthello set\n");
-				return 1;
-			}
+	rv = ssl_tls_clienthello_parse_info(buf, sz, search, clienthello, &info);
+	if (rv == 0 && servername)
+		*servername = ssl_tls_clienthello_sni(&info);
+	return rv;
+}
 
-			p += cipherspec_len + sessionid_len + challenge_len;
-			n -= cipherspec_len + sessionid_len + challenge_len;
-			goto done_parsing;
-		} else
-		if (*p != 0x16) {
-			/* this can only happen if search is 0 */
-			DBG_printf("===> No match: rv 1, *clienthello NULL\n");
-			*clienthello = NULL;
-			return 1;
-		}
-		p++; n--;
+static char *
+ssl_tls_ja3_append16(char *s, const unsigned char *list, size_t len)
+{
+	int first = 1;
 
-		if (n < 2) {
-			DBG_printf("===> Truncated: rv 1, *clienthello set\n");
-			return 1;
-		}
-		DBG_printf("version: %02x %02x\n", p[0], p[1]);
-		/* This supports up to TLS 1.2 (0x03 0x03) and will need to be
-		 * updated for TLS 1.3 once that is standardized and still
-		 * compatible with this parser; remember to also update the
-		 * inner version check below */
-		if (p[0] != 0x03 || p[1] > 0x03)
+	for (size_t i = 0; i + 1 < len; i += 2) {
+		unsigned int v = list[i + 1] + (list[i] << 8);
+		if (SSL_TLS_IS_GREASE(v))
 			continue;
-		p += 2; n -= 2;
+		s += sprintf(s, first ? "%u" : "-%u", v);
+		first = 0;
+	}
+	return s;
+}
 
-		if (n < 2) {
-			DBG_printf("===> Truncated: rv 1, *clienthello set\n");
-			return 1;
-		}
-		DBG_printf("length: %02x %02x\n", p[0], p[1]);
-		ssize_t recordlen = p[1] + (p[0] << 8);
-		DBG_printf("recordlen=%zd\n", recordlen);
-		p += 2; n -= 2;
-		if (recordlen < 36) /* arbitrary size too small for a c-h */
-			continue;
-		if (n < recordlen) {
-			DBG_printf("n < recordlen: n=%zd\n", n);
-			DBG_printf("===> Truncated: rv 1, *clienthello set\n");
-			return 1;
-		}
+/*
+ * Returns the JA3 fingerprint string of a parsed ClientHello, i.e.
+ * SSLVersion,Ciphers,Extensions,EllipticCurves,EllipticCurvePointFormats
+ * with GREASE values omitted, in a newly allocated string that must be freed
+ * by the caller.  Returns NULL for SSLv2 ClientHellos and on memory errors.
+ */
+char *
+ssl_tls_clienthello_ja3(const ssl_tls_clienthello_info_t *info)
+{
+	char *ja3, *s;
+	size_t sz;
+	int first;
 
-		/* from here we give up on a candidate if there is not enough
-		 * data available in the buffer, because we already checked the
-		 * availability of the whole record. */
+	if (info->sslv2)
+		return NULL;
 
-		if (n < 1)
-			continue;
-		DBG_printf("message type: %i\n", *p);
-		if (*p != 0x01) /* message type: ClientHello */
-			continue;
-		p++; n--;
+	/* up to 5 digits and a separator per value */
+	sz = 6 + 6 * (info->ciphers_len / 2 + info->nexts +
+	              info->groups_len / 2) + 4 * info->pointfmts_len + 5;
+	ja3 = malloc(sz);
+	if (!ja3)
+		return NULL;
 
-		if (n < 3)
-			continue;
-		DBG_printf("message len: %02x %02x %02x\n", p[0], p[1], p[2]);
-		ssize_t msglen = p[2] + (p[1] << 8) + (p[0] << 16);
-		DBG_printf("msglen=%zd\n", msglen);
-		p += 3; n -= 3;
-		if (msglen < 32) /* arbitrary size too small for a c-h */
-			continue;
-		if (msglen != recordlen - 4) {
-			DBG_printf("msglen != recordlen - 4\n");
+	s = ja3 + sprintf(ja3, "%u,", info->version);
+	s = ssl_tls_ja3_append16(s, info->ciphers, info->ciphers_len);
+	*s++ = ',';
+	first = 1;
+	for (size_t i = 0; i < info->nexts; i++) {
+		if (SSL_TLS_IS_GREASE(info->exts[i]))
 			continue;
-		}
-		if (n < msglen)
-			continue;
-		n = msglen; /* only parse first message */
+		s += sprintf(s, first ? "%u" : "-%u", info->exts[i]);
+		first = 0;
+	}
+	*s++ = ',';
+	s = ssl_tls_ja3_append16(s, info->groups, info->groups_len);
+	*s++ = ',';
+	for (size_t i = 0; i < info->pointfmts_len; i++) {
+		s += sprintf(s, i ? "-%u" : "%u", info->pointfmts[i]);
+	}
+	*s = '\0';
+	return ja3;
+}
 
-		if (n < 2)
-			continue;
-		DBG_printf("clienthello version %02x %02x\n", p[0], p[1]);
-		/* inner version check, see outer one above */
-		if (p[0] != 0x03 || p[1] > 0x03)
-			continue;
-		p += 2; n -= 2;
+/*
+ * Returns the JA3 hash of a parsed ClientHello, i.e. the MD5 digest of its
+ * JA3 fingerprint string as lowercase hex characters, in a newly allocated
+ * string that must be freed by the caller.  Returns NULL on errors.
+ */
+char *
+ssl_tls_clienthello_ja3_hash(const ssl_tls_clienthello_info_t *info)
+{
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int mdsz;
+	char *ja3, *hash;
 
-		if (n < 32)
-			continue;
-		DBG_printf("clienthello random %02x %02x %02x %02x ...\n",
-		           p[0], p[1], p[2], p[3]);
-		DBG_printf("compare localtime: %08x\n",
-		           (unsigned int)time(NULL));
-		p += 32; n -= 32;
+	ja3 = ssl_tls_clienthello_ja3(info);
+	if (!ja3)
+		return NULL;
+	if (!EVP_Digest(ja3, strlen(ja3), md, &mdsz, ssl_md(EVP_md5()), NULL)) {
+		free(ja3);
+		return NULL;
+	}
+	free(ja3);
 
-		if (n < 1)
-			continue;
-		DBG_printf("clienthello sidlen %02x\n", *p);
-		ssize_t sidlen = *p; /* session id length, 0..32 */
-		p += 1; n -= 1;
-		if (n < sidlen)
-			continue;
-		p += sidlen; n -= sidlen;
+	hash = malloc(mdsz * 2 + 1);
+	if (!hash)
+		return NULL;
+	for (unsigned int i = 0; i < mdsz; i++) {
+		sprintf(hash + i * 2, "%02x", md[i]);
+	}
+	return hash;
+}
 
-		if (n < 2)
-			continue;
-		DBG_printf("clienthello cipher suites length %02x %02x\n",
-		           p[0], p[1]);
-		ssize_t suiteslen = p[1] + (p[0] << 8);
-		p += 2; n -= 2;
-		if (n < suiteslen)
-			continue;
-		p += suiteslen;
-		n -= suiteslen;
+/*
+ * Incremental ClientHello assembler.
+ *
+ * ssl_tls_clienthello_parse() needs the complete ClientHello in a single TLS
+ * record in one contiguous buffer.  Large ClientHello messages, e.g. with
+ * post-quantum key shares or many extensions, can span several TCP segments
+ * and may be fragmented across several TLS records.  The assembler consumes
+ * the octets as they arrive, strips the record headers and reassembles the
+ * handshake message up to max octets, then parses it.
+ *
+ * The assembler must be initialized with ssl_tls_clienthello_asm_init() and
+ * released with ssl_tls_clienthello_asm_free().
+ */
+void
+ssl_tls_clienthello_asm_init(ssl_tls_clienthello_asm_t *a, size_t max)
+{
+	memset(a, 0, sizeof(ssl_tls_clienthello_asm_t));
+	a->max = max;
+}
 
-		if (n < 1)
-			continue;
-		DBG_printf("clienthello compress methods length %02x\n", *p);
-		ssize_t compslen = *p;
-		p++; n--;
-		if (n < compslen)
-			continue;
-		p += compslen;
-		n -= compslen;
+void
+ssl_tls_clienthello_asm_free(ssl_tls_clienthello_asm_t *a)
+{
+	if (a->msg)
+		free(a->msg);
+	ssl_tls_clienthello_asm_init(a, a->max);
+}
 
-		/* begin of extensions */
+/*
+ * Returns the number of octets the assembler needs in order to make progress,
+ * i.e. to complete the current record header, record or message.  Callers
+ * can use this to avoid waking up for every single segment.
+ */
+size_t
+ssl_tls_clienthello_asm_need(ssl_tls_clienthello_asm_t *a)
+{
+	size_t n;
+
+	if (!a->recleft)
+		return (a->sslv2 ? 2 : sizeof(a->hdr)) - a->hdrlen;
+
+	n = a->recleft;
+	if (a->msgsz && n > a->msgsz - a->msglen)
+		n = a->msgsz - a->msglen;
+	/* one more octet than max is enough to detect oversized messages */
+	if (n > a->max - a->msglen + 1)
+		n = a->max - a->msglen + 1;
+	return n;
+}
 
-		if (n == 0) {
-			/* valid ClientHello without extensions */
-			DBG_printf("===> Match: rv 0, *clienthello set\n");
-			if (servername)
-				*servername = NULL;
-			return 0;
-		}
-		if (n < 2)
-			continue;
-		DBG_printf("tlsexts length %02x %02x\n", p[0], p[1]);
-		ssize_t tlsextslen = p[1] + (p[0] << 8);
-		DBG_printf("tlsextslen %zd\n", tlsextslen);
-		p += 2; n -= 2;
-		if (n < tlsextslen)
-			continue;
-		n = tlsextslen; /* only parse exts, ignore trailing bits */
-
-		while (n > 0) {
-			if (n < 4)
-				goto continue_search;
-			DBG_printf("tlsext type %02x %02x len %02x %02x\n",
-			           p[0], p[1], p[2], p[3]);
-			unsigned short exttype = p[1] + (p[0] << 8);
-			ssize_t extlen = p[3] + (p[2] << 8);
-			p += 4; n -= 4;
-			if (n < extlen)
-				goto continue_search;
-			switch (exttype) {
-			case 0: {
-				ssize_t extn = extlen;
-				const unsigned char *extp = p;
-
-				if (extn < 2)
-					goto continue_search;
-				DBG_printf("list length %02x %02x\n",
-				           extp[0], extp[1]);
-				ssize_t namelistlen = extp[1] + (extp[0] << 8);
-				DBG_printf("namelistlen = %zd\n", namelistlen);
-				extp += 2;
-				extn -= 2;
-
-				if (namelistlen != extn)
-					goto continue_search;
-
-				while (extn > 0) {
-					if (extn < 3)
-						goto continue_search;
-					DBG_printf("ServerName type %02x"
-					           " len %02x %02x\n",
-					           extp[0], extp[1], extp[2]);
-					unsigned char sntype = extp[0];
-					ssize_t snlen = extp[2] + (extp[1]<<8);
-					extp += 3;
-					extn -= 3;
-					if (snlen > extn)
-						goto continue_search;
-					if (snlen > TLSEXT_MAXLEN_host_name)
-						goto continue_search;
-					/*
-					 * We copy the first name only.
-					 * RFC 6066: "The ServerNameList MUST
-					 * NOT contain more than one name of
-					 * the same name_type."
-					 */
-					if (servername &&
-					    sntype == 0 && sn == NULL) {
-						sn = malloc(snlen + 1);
-						memcpy(sn, extp, snlen);
-						sn[snlen] = '\0';
-						/* deliberately not checking
-						 * for malformed hostnames
-						 * containing invalid chars */
-					}
-					extp += snlen;
-					extn -= snlen;
+static int
+ssl_tls_clienthello_asm_append(ssl_tls_clienthello_asm_t *a,
+                               const unsigned char *buf, size_t sz)
+{
+	unsigned char *msg;
+	size_t msgcap;
+
+	if (a->msglen + sz > a->msgcap) {
+		msgcap = a->msgcap ? a->msgcap : 1024;
+		while (msgcap < a->msglen + sz)
+			msgcap *= 2;
+		if (msgcap > a->max)
+			msgcap = a->max;
+		msg = realloc(a->msg, msgcap);
+		if (!msg)
+			return -1;
+		a->msg = msg;
+		a->msgcap = msgcap;
+	}
+	memcpy(a->msg + a->msglen, buf, sz);
+	a->msglen += sz;
+	return 0;
+}
+
+/*
+ * Feed the next sz octets received from the client to the assembler.  The
+ * octets must directly follow the ones fed in the previous call.
+ *
+ * Returns:
+ *  1  if more octets are needed to complete the ClientHello message
+ *  0  if the ClientHello message is complete and valid;
+ *     the server name is returned in *servername as for
+ *     ssl_tls_clienthello_parse(); remaining octets in buf are ignored;
+ *     the parsed message is in a->info until the assembler is released
+ *  2  if the ClientHello message exceeds max octets
+ * -1  if the octets are not a ClientHello message, or on memory error
+ *
+ * Once it has returned something other than 1, the assembler must not be fed
+ * any more octets before reinitializing it.
+ */
+int
+ssl_tls_clienthello_asm_feed(ssl_tls_clienthello_asm_t *a,
+                             const unsigned char *buf, size_t sz,
+                             char **servername)
+{
+	const unsigned char *chello;
+	size_t n;
+
+	while (sz > 0) {
+		if (!a->recleft) {
+			/* record header */
+			a->hdr[a->hdrlen++] = *buf;
+			buf++; sz--;
+			a->consumed++;
+
+			if (a->hdrlen == 1) {
+				/* SSLv2 short header is only possible on the
+				 * first record, all other records must be
+				 * handshake records */
+				if (*a->hdr == 0x80 && !a->msglen) {
+					a->sslv2 = 1;
+				} else if (*a->hdr != 0x16) {
+					return -1;
 				}
-				break;
+				continue;
 			}
-			default:
-				DBG_printf("skipped\n");
-				break;
+			if (a->sslv2) {
+				/* keep the header for the SSLv2 parser */
+				if (ssl_tls_clienthello_asm_append(a, a->hdr, 2) == -1)
+					return -1;
+				a->recleft = a->hdr[1];
+				a->msgsz = a->recleft + 2;
+				a->hdrlen = 0;
+				if (!a->recleft)
+					return -1;
+				continue;
 			}
-			p += extlen;
-			n -= extlen;
-		} /* while have more extensions */
+			if (a->hdrlen < sizeof(a->hdr))
+				continue;
 
-done_parsing:
-		;
-#ifdef DEBUG_CLIENTHELLO_PARSER
-		if (n > 0) {
-			DBG_printf("unparsed next bytes %02x %02x %02x %02x\n",
-			           p[0], p[1], p[2], p[3]);
+			/* outer version check as in
+			 * ssl_tls_clienthello_parse() */
+			if (a->hdr[1] != 0x03 || a->hdr[2] > 0x03)
+				return -1;
+			a->recleft = a->hdr[4] + (a->hdr[3] << 8);
+			a->hdrlen = 0;
+			if (!a->recleft)
+				return -1;
+			continue;
 		}
-#endif /* DEBUG_CLIENTHELLO_PARSER */
-		DBG_printf("%zd bytes unparsed\n", n);
 
-		/* Valid ClientHello with or without server name */
-		DBG_printf("===> Match: rv 0, *clienthello set\n");
-		if (servername)
-			*servername = sn;
-		return 0;
-continue_search:
-		;
-	} while (search && n > 0);
-
-	/* No valid ClientHello messages found, not even a truncated one */
-	DBG_printf("===> No match: rv 1, *clienthello NULL\n");
-	*clienthello = NULL;
-	if (sn) {
-		free(sn);
-		sn = NULL;
+		/* record payload */
+		n = sz < a->recleft ? sz : a->recleft;
+		if (a->msgsz && n > a->msgsz - a->msglen)
+			n = a->msgsz - a->msglen;
+		if (a->msglen + n > a->max)
+			return 2;
+		if (ssl_tls_clienthello_asm_append(a, buf, n) == -1)
+			return -1;
+		buf += n; sz -= n;
+		a->recleft -= n;
+		a->consumed += n;
+
+		if (!a->msgsz && a->msglen >= 4) {
+			if (*a->msg != 0x01) /* message type: ClientHello */
+				return -1;
+			a->msgsz = 4 + (a->msg[3] + (a->msg[2] << 8) +
+			                (a->msg[1] << 16));
+			if (a->msgsz < 4 + 32) /* too small for a c-h */
+				return -1;
+			if (a->msgsz > a->max)
+				return 2;
+		}
+		if (a->msgsz && a->msglen == a->msgsz) {
+			if (a->sslv2) {
+				if (ssl_tls_clienthello_parse_info(a->msg,
+				                                   a->msglen, 0,
+				                                   &chello,
+				                                   &a->info) != 0)
+					return -1;
+			} else if (ssl_tls_clienthello_parse_msg(a->msg + 4,
+			                                         a->msgsz - 4,
+			                                         &a->info) == -1) {
+				return -1;
+			}
+			if (servername)
+				*servername = ssl_tls_clienthello_sni(&a->info);
+			return 0;
+		}
 	}
 	return 1;
 }
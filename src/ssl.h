@@ -224,6 +224,7 @@ char * ssl_ssl_masterkey_to_str(SSL *) NONNULL(1) MALLOC;
 DH * ssl_tmp_dh_callback(SSL *, int, int) NONNULL(1) MALLOC;
 DH * ssl_dh_load(const char *) NONNULL(1) MALLOC;
 void ssl_dh_refcount_inc(DH *) NONNULL(1);
+void ssl_dh_free(DH *) NONNULL(1);
 #endif /* !OPENSSL_NO_DH */
 
 #ifndef OPENSSL_NO_EC
@@ -251,6 +252,10 @@ char * ssl_x509_subject_cn(X509 *, size_t *) NONNULL(1,2) MALLOC;
 #define SSL_X509_FPRSZ 20
 int ssl_x509_fingerprint_sha1(X509 *, unsigned char *) NONNULL(1,2);
 char * ssl_x509_fingerprint(X509 *, int) NONNULL(1) MALLOC;
+#define SSL_X509_FPRSZ_SHA256 32
+int ssl_x509_fingerprint_sha256(X509 *, unsigned char *) NONNULL(1,2);
+int ssl_x509chain_fingerprint_sha256(STACK_OF(X509) *, unsigned char *)
+    NONNULL(2);
 char ** ssl_x509_names(X509 *) NONNULL(1) MALLOC;
 int ssl_x509_names_match(X509 *, const char *) NONNULL(1,2);
 char * ssl_x509_names_to_str(X509 *) NONNULL(1) MALLOC;
@@ -270,9 +275,72 @@ int ssl_session_is_valid(SSL_SESSION *) NONNULL(1);
 
 int ssl_is_ocspreq(const unsigned char *, size_t) NONNULL(1) WUNRES;
 
+#define SSL_TLS_CLIENTHELLO_MAXEXTS 64
+#define SSL_TLS_CLIENTHELLO_MAXKEYSHARES 8
+
+/*
+ * Structured view of a parsed ClientHello, the lists point into the parsed
+ * buffer.  The lists of 16 bit values are in network byte order.
+ */
+typedef struct ssl_tls_clienthello_info {
+	unsigned int version;            /* legacy_version of ClientHello */
+	unsigned int max_version;        /* highest of supported_versions */
+	const unsigned char *ciphers;    /* cipher suites */
+	size_t ciphers_len;
+	unsigned short exts[SSL_TLS_CLIENTHELLO_MAXEXTS]; /* extension types */
+	size_t nexts;
+	const unsigned char *sni;        /* first host_name, not terminated */
+	size_t sni_len;
+	const unsigned char *alpn;       /* ProtocolNameList */
+	size_t alpn_len;
+	const unsigned char *groups;     /* supported_groups */
+	size_t groups_len;
+	const unsigned char *sigalgs;    /* signature_algorithms */
+	size_t sigalgs_len;
+	const unsigned char *pointfmts;  /* ec_point_formats, 8 bit values */
+	size_t pointfmts_len;
+	unsigned short keyshares[SSL_TLS_CLIENTHELLO_MAXKEYSHARES]; /* groups */
+	size_t nkeyshares;
+	unsigned int exts_truncated : 1; /* 1 if more than MAXEXTS exts */
+	unsigned int sslv2 : 1;          /* 1 if SSLv2 ClientHello */
+} ssl_tls_clienthello_info_t;
+
+int ssl_tls_clienthello_parse_info(const unsigned char *, ssize_t, int,
+                                   const unsigned char **,
+                                   ssl_tls_clienthello_info_t *)
+    NONNULL(1,4,5) WUNRES;
 int ssl_tls_clienthello_parse(const unsigned char *, ssize_t, int,
                               const unsigned char **, char **)
     NONNULL(1,4) WUNRES;
+char * ssl_tls_clienthello_sni(const ssl_tls_clienthello_info_t *)
+    NONNULL(1) MALLOC;
+char * ssl_tls_clienthello_ja3(const ssl_tls_clienthello_info_t *)
+    NONNULL(1) MALLOC;
+char * ssl_tls_clienthello_ja3_hash(const ssl_tls_clienthello_info_t *)
+    NONNULL(1) MALLOC;
+
+typedef struct ssl_tls_clienthello_asm {
+	unsigned char *msg;        /* reassembled handshake message */
+	size_t msglen;             /* octets in msg */
+	size_t msgcap;             /* allocated size of msg */
+	size_t msgsz;              /* size of the message, 0 if not known yet */
+	size_t max;                /* max size of the message */
+	size_t consumed;           /* octets consumed so far */
+	size_t recleft;            /* octets left in the current record */
+	unsigned char hdr[5];      /* current record header */
+	size_t hdrlen;             /* octets in hdr */
+	unsigned int sslv2 : 1;    /* 1 if SSLv2 short header */
+	ssl_tls_clienthello_info_t info; /* parsed message, once complete */
+} ssl_tls_clienthello_asm_t;
+
+void ssl_tls_clienthello_asm_init(ssl_tls_clienthello_asm_t *, size_t)
+    NONNULL(1);
+void ssl_tls_clienthello_asm_free(ssl_tls_clienthello_asm_t *) NONNULL(1);
+size_t ssl_tls_clienthello_asm_need(ssl_tls_clienthello_asm_t *)
+    NONNULL(1) WUNRES;
+int ssl_tls_clienthello_asm_feed(ssl_tls_clienthello_asm_t *,
+                                 const unsigned char *, size_t, char **)
+    NONNULL(1,2) WUNRES;
 int ssl_dnsname_match(const char *, size_t, const char *, size_t)
     NONNULL(1,3) WUNRES;
 char * ssl_wildcardify(const char *) NONNULL(1) MALLOC;
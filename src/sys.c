@@ -49,6 +49,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 
@@ -60,6 +61,10 @@
 #include <libproc.h>
 #endif
 
+#ifdef __linux__
+#include <linux/tcp.h>
+#endif /* __linux__ */
+
 #include <event2/util.h>
 
 /*
@@ -416,7 +421,9 @@ sys_group_str(gid_t gid)
 int
 sys_get_af(const char *addr)
 {
-	if (strstr(addr, ":"))
+	if (!strncmp(addr, SYS_UNIX_PREFIX, SYS_UNIX_PREFIX_LEN))
+		return AF_UNIX;
+	else if (strstr(addr, ":"))
 		return AF_INET6;
 	else if (!strpbrk(addr, "abcdefghijklmnopqrstu"
 							"vwxyzABCDEFGHIJKLMNOP"
@@ -428,6 +435,8 @@ sys_get_af(const char *addr)
 
 /*
  * Parse an ascii host/IP and port tuple into a sockaddr_storage.
+ * A host of the form unix:/path is parsed into a unix domain socket address,
+ * the port and af are ignored then.
  * On success, returns address family and fills in addr, addrlen.
  * Returns -1 on error.
  */
@@ -439,6 +448,23 @@ sys_sockaddr_parse(struct sockaddr_storage *addr, socklen_t *addrlen,
 	struct evutil_addrinfo *ai;
 	int rv;
 
+	if (!strncmp(naddr, SYS_UNIX_PREFIX, SYS_UNIX_PREFIX_LEN)) {
+		struct sockaddr_un *sun = (struct sockaddr_un *)addr;
+		const char *path = naddr + SYS_UNIX_PREFIX_LEN;
+		size_t pathlen = strlen(path);
+
+		if (!pathlen || pathlen >= sizeof(sun->sun_path)) {
+			log_err_level_printf(LOG_CRIT, "Invalid unix socket path '%s', use 1-%zu chars\n",
+			               path, sizeof(sun->sun_path) - 1);
+			return -1;
+		}
+		memset(addr, 0, sizeof(struct sockaddr_storage));
+		sun->sun_family = AF_UNIX;
+		memcpy(sun->sun_path, path, pathlen + 1);
+		*addrlen = sizeof(struct sockaddr_un);
+		return AF_UNIX;
+	}
+
 	memset(&hints, 0, sizeof(hints));
 	hints.ai_family = af;
 	hints.ai_socktype = SOCK_STREAM;
@@ -458,7 +484,7 @@ sys_sockaddr_parse(struct sockaddr_storage *addr, socklen_t *addrlen,
 }
 
 /*
- * Converts an IPv4/IPv6 sockaddr into printable string representations of the
+ * Converts an IPv4/IPv6/unix sockaddr into printable string representations of the
  * host and the service (port) part.  Writes allocated buffers to *host and
  * *serv which must both be freed by the caller.  Neither *host nor *port are
  * freed by this function before newly allocating.
@@ -473,6 +499,25 @@ sys_sockaddr_str(struct sockaddr *addr, socklen_t addrlen,
 	int rv;
 	size_t hostsz;
 
+	if (addr->sa_family == AF_UNIX) {
+		struct sockaddr_un *sun = (struct sockaddr_un *)addr;
+		// Unnamed sockets, e.g. the peer of an accepted conn, have no path
+		int pathlen = addrlen > offsetof(struct sockaddr_un, sun_path) ?
+				(int)strnlen(sun->sun_path, addrlen - offsetof(struct sockaddr_un, sun_path)) : 0;
+
+		if (asprintf(host, "%s%.*s", SYS_UNIX_PREFIX, pathlen, sun->sun_path) < 0) {
+			log_err_level_printf(LOG_CRIT, "Cannot allocate memory\n");
+			return -1;
+		}
+		*serv = strdup("0");
+		if (!*serv) {
+			log_err_level_printf(LOG_CRIT, "Cannot allocate memory\n");
+			free(*host);
+			return -1;
+		}
+		return 0;
+	}
+
 	*serv = malloc(6); /* max decimal digits of short plus terminator */
 	if (!*serv) {
 		log_err_level_printf(LOG_CRIT, "Cannot allocate memory\n");
@@ -753,6 +798,38 @@ sys_get_cpu_cores(void)
 #endif /* !_SC_NPROCESSORS_ONLN */
 }
 
+/*
+ * Estimate the bandwidth-delay product of a connected TCP socket in bytes,
+ * as the product of the smoothed RTT and the delivery rate reported by the
+ * kernel.  Falls back to the congestion window if the kernel does not report
+ * the delivery rate.  Returns 0 if the estimate is not available.
+ */
+size_t
+sys_get_sock_bdp(evutil_socket_t fd)
+{
+#if defined(__linux__) && defined(TCP_INFO)
+	struct tcp_info ti;
+	socklen_t len = sizeof(ti);
+
+	if (fd < 0)
+		return 0;
+
+	memset(&ti, 0, sizeof(ti));
+	if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) == -1)
+		return 0;
+
+	if (len >= offsetof(struct tcp_info, tcpi_delivery_rate) + sizeof(ti.tcpi_delivery_rate) &&
+			ti.tcpi_delivery_rate && ti.tcpi_rtt) {
+		/* tcpi_delivery_rate is in bytes/s, tcpi_rtt in usec */
+		return (size_t)(ti.tcpi_delivery_rate * ti.tcpi_rtt / 1000000);
+	}
+	return (size_t)ti.tcpi_snd_cwnd * ti.tcpi_snd_mss;
+#else /* !(__linux__ && TCP_INFO) */
+	(void)fd;
+	return 0;
+#endif /* !(__linux__ && TCP_INFO) */
+}
+
 /*
  * Send a message and optional file descriptor on a connected AF_UNIX
  * SOCKET_DGRAM socket s.  Returns the return value of sendmsg().
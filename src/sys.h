@@ -34,6 +34,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <stdint.h>
+#include <event2/util.h>
 
 int sys_privdrop(const char *, const char *, const char *) WUNRES;
 
@@ -49,6 +50,9 @@ int sys_isgeteuid(const char *) NONNULL(1) WUNRES;
 char * sys_user_str(uid_t) MALLOC;
 char * sys_group_str(gid_t) MALLOC;
 
+#define SYS_UNIX_PREFIX "unix:"
+#define SYS_UNIX_PREFIX_LEN (sizeof(SYS_UNIX_PREFIX) - 1)
+
 int sys_get_af(const char *);
 int sys_sockaddr_parse(struct sockaddr_storage *, socklen_t *,
                        char *, char *, int, int) NONNULL(1,2,3,4) WUNRES;
@@ -65,6 +69,7 @@ typedef int (*sys_dir_eachfile_cb_t)(const char *, void *) NONNULL(1) WUNRES;
 int sys_dir_eachfile(const char *, sys_dir_eachfile_cb_t, void *) NONNULL(1,2) WUNRES;
 
 uint32_t sys_get_cpu_cores(void) WUNRES;
+size_t sys_get_sock_bdp(evutil_socket_t) WUNRES;
 
 ssize_t sys_sendmsgfd(int, void *, size_t, int) NONNULL(2) WUNRES;
 ssize_t sys_recvmsgfd(int, void *, size_t, int *) NONNULL(2) WUNRES;
@@ -0,0 +1,198 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark for the substring matchers of filtering rules, run with
+ * `make bench`.  Compares the Aho-Corasick machine walking its goto and fail
+ * links with the flat DFA it is compiled into by filter_set(), for the first
+ * match in host names as in filter_site_substring_match().
+ */
+
+#include "filter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_HOSTS 1000
+#define BENCH_ITERATIONS 200
+
+static char hosts[BENCH_HOSTS][64];
+static size_t hostsbytes;
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+bench_word(char *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		buf[i] = "abcdefghijklmnopqrstuvwxyz0123456789-"[rand() % 37];
+	buf[len] = '\0';
+}
+
+/*
+ * Host names of two to four labels, most of which do not match any keyword,
+ * so that the whole name is scanned.
+ */
+static void
+bench_hosts(void)
+{
+	for (int i = 0; i < BENCH_HOSTS; i++) {
+		char *p = hosts[i];
+		int labels = 2 + rand() % 3;
+
+		for (int j = 0; j < labels; j++) {
+			bench_word(p, 3 + rand() % 10);
+			p += strlen(p);
+			*p++ = j < labels - 1 ? '.' : '\0';
+		}
+		hostsbytes += strlen(hosts[i]);
+	}
+}
+
+static ACMachine(char) *
+bench_machine(int nkeywords)
+{
+	ACMachine(char) *acm = ACM_create(char);
+	Keyword(char) k;
+	char kw[32];
+
+	for (int i = 0; i < nkeywords; i++) {
+		bench_word(kw, 5 + rand() % 10);
+		strcat(kw, i % 2 ? ".com" : ".net");
+		ACM_KEYWORD_SET(k, kw, strlen(kw));
+		ACM_register_keyword(acm, k, hosts[i % BENCH_HOSTS], 0);
+	}
+	return acm;
+}
+
+static size_t
+bench_match_machine(ACMachine(char) *acm)
+{
+	size_t found = 0;
+
+	for (int i = 0; i < BENCH_HOSTS; i++) {
+		const ACState(char) *state = ACM_reset(acm);
+		void *value = NULL;
+		for (char *c = hosts[i]; *c; c++) {
+			if (ACM_match(state, *c)) {
+				ACM_get_match(state, 0, 0, &value);
+				break;
+			}
+		}
+		found += !!value;
+	}
+	return found;
+}
+
+static size_t
+bench_match_dfa(const ACDfa(char) *dfa)
+{
+	size_t found = 0;
+
+	for (int i = 0; i < BENCH_HOSTS; i++) {
+		ACDfaState state = ACM_DFA_reset(dfa);
+		void *value = NULL;
+		for (char *c = hosts[i]; *c; c++) {
+			if (ACM_DFA_match(dfa, state, *c)) {
+				ACM_DFA_get_match(dfa, state, 0, &value);
+				break;
+			}
+		}
+		found += !!value;
+	}
+	return found;
+}
+
+static void
+bench_run(int nkeywords)
+{
+	ACMachine(char) *acm = bench_machine(nkeywords);
+	size_t found1 = 0, found2 = 0;
+	double t, t1, t2;
+
+	/* the machine builds its fail links on first use */
+	bench_match_machine(acm);
+	t = bench_now();
+	for (int i = 0; i < BENCH_ITERATIONS; i++)
+		found1 += bench_match_machine(acm);
+	t1 = bench_now() - t;
+
+	t = bench_now();
+	if (ACM_compile(acm, SIZE_MAX) != 1) {
+		fprintf(stderr, "Failed to compile machine\n");
+		exit(EXIT_FAILURE);
+	}
+	double tc = bench_now() - t;
+	const ACDfa(char) *dfa = ACM_DFA(acm);
+
+	t = bench_now();
+	for (int i = 0; i < BENCH_ITERATIONS; i++)
+		found2 += bench_match_dfa(dfa);
+	t2 = bench_now() - t;
+
+	if (found1 != found2) {
+		fprintf(stderr, "Engines disagree: %zu != %zu\n",
+		        found1, found2);
+		exit(EXIT_FAILURE);
+	}
+	printf("%6d keywords %7zu states %3zu classes %8.1f KiB "
+	       "%7.1f ms compile  machine %6.2f ns/byte  dfa %6.2f ns/byte\n",
+	       nkeywords, dfa->nb_states, dfa->nb_classes,
+	       (dfa->nb_states * dfa->nb_classes * sizeof(*dfa->next) +
+	        (dfa->nb_states + 1) * sizeof(*dfa->output)) / 1024.0,
+	       tc / 1e6,
+	       t1 / BENCH_ITERATIONS / hostsbytes,
+	       t2 / BENCH_ITERATIONS / hostsbytes);
+	ACM_release(acm);
+}
+
+int
+main(void)
+{
+	srand(1);
+	bench_hosts();
+
+	bench_run(10);
+	bench_run(100);
+	bench_run(1000);
+	bench_run(10000);
+	bench_run(50000);
+
+	return EXIT_SUCCESS;
+}
+
+/* vim: set noet ft=c: */
@@ -30,11 +30,13 @@
 #include "cachemgr.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <check.h>
 
 #define TESTCERT "pki/rsa.crt"
+#define TESTCERT2 "pki/server.crt"
 
 static void
 cachemgr_setup(void)
@@ -91,6 +93,139 @@ START_TEST(cache_fkcrt_03)
 }
 END_TEST
 
+START_TEST(cache_fkcrt_05)
+{
+	X509 *c1, *c2;
+
+	c1 = ssl_x509_load(TESTCERT);
+	fail_unless(!!c1, "loading certificate failed");
+	c2 = ssl_x509_load(TESTCERT2);
+	fail_unless(!!c2, "loading certificate failed");
+	cachemgr_fkcrt_set(c1, c1);
+	fail_unless(cachemgr_fkcrt_has(c1), "cache does not have certificate");
+	fail_unless(!cachemgr_fkcrt_has(c2), "cache has certificate not set");
+	cachemgr_fkcrt_del(c1);
+	fail_unless(!cachemgr_fkcrt_has(c1), "cache has deleted certificate");
+	X509_free(c1);
+	X509_free(c2);
+}
+END_TEST
+
+START_TEST(cache_fkcrt_06)
+{
+	X509 *c1, *c2, *c3, *top[2];
+
+	c1 = ssl_x509_load(TESTCERT);
+	fail_unless(!!c1, "loading certificate failed");
+	c2 = ssl_x509_load(TESTCERT2);
+	fail_unless(!!c2, "loading certificate failed");
+	cachefkcrt_set_keep_origcrt(1);
+	cachemgr_fkcrt_set(c1, c1);
+	cachemgr_fkcrt_set(c2, c2);
+	fail_unless(cachefkcrt_topn(cachemgr_fkcrt, top, 2) == 0,
+	            "certificates without hits returned");
+	for (int i = 0; i < 3; i++) {
+		c3 = cachemgr_fkcrt_get(c2);
+		fail_unless(c3 == c2, "cache did not return same pointer");
+		X509_free(c3);
+	}
+	fail_unless(cachemgr_fkcrt_has(c1), "cache does not have certificate");
+	fail_unless(cachefkcrt_topn(cachemgr_fkcrt, top, 2) == 1,
+	            "certificate without hits returned");
+	X509_free(top[0]);
+	c3 = cachemgr_fkcrt_get(c1);
+	X509_free(c3);
+	fail_unless(cachefkcrt_topn(cachemgr_fkcrt, top, 2) == 2,
+	            "not all certificates with hits returned");
+	fail_unless(!X509_cmp(top[0], c2), "most used certificate not first");
+	fail_unless(!X509_cmp(top[1], c1), "least used certificate not last");
+	fail_unless(top[0] != c2, "original certificate not copied");
+	X509_free(top[0]);
+	X509_free(top[1]);
+	fail_unless(cachefkcrt_topn(cachemgr_fkcrt, top, 1) == 1,
+	            "not one certificate returned");
+	fail_unless(!X509_cmp(top[0], c2), "most used certificate not returned");
+	X509_free(top[0]);
+	cachefkcrt_set_keep_origcrt(0);
+	X509_free(c1);
+	X509_free(c2);
+}
+END_TEST
+
+START_TEST(cache_fkcrt_07)
+{
+	X509 *c1, *c2, *top[1];
+
+	c1 = ssl_x509_load(TESTCERT);
+	fail_unless(!!c1, "loading certificate failed");
+	cachemgr_fkcrt_set(c1, c1);
+	c2 = cachemgr_fkcrt_get(c1);
+	X509_free(c2);
+	fail_unless(cachefkcrt_topn(cachemgr_fkcrt, top, 1) == 0,
+	            "certificate returned without keeping original");
+	X509_free(c1);
+}
+END_TEST
+
+START_TEST(cache_fkcrt_08)
+{
+	X509 *c1, *c2, *c3;
+	cachefkcrt_meta_t *meta = NULL;
+	char *s;
+
+	c1 = ssl_x509_load(TESTCERT);
+	fail_unless(!!c1, "loading certificate failed");
+	c2 = ssl_x509_load(TESTCERT2);
+	fail_unless(!!c2, "loading certificate failed");
+	cachemgr_fkcrt_set(c1, c2);
+	c3 = cachemgr_fkcrt_get_meta(c1, &meta);
+	fail_unless(c3 == c2, "cached certificate not same");
+	fail_unless(!!meta, "no metadata");
+	s = ssl_x509_names_to_str(c1);
+	fail_unless(!strcmp(meta->names_str, s), "names mismatch");
+	free(s);
+	fail_unless(meta->names[0] && !strcmp(meta->names[0], "SSLsplit Root CA"),
+	            "first name mismatch");
+	fail_unless(!strcmp(meta->wildcards[0], "*"),
+	            "first wildcard mismatch");
+	s = ssl_x509_fingerprint(c1, 0);
+	fail_unless(!strcmp(meta->origcrtfpr, s), "orig fingerprint mismatch");
+	free(s);
+	s = ssl_x509_fingerprint(c2, 0);
+	fail_unless(!strcmp(meta->usedcrtfpr, s), "used fingerprint mismatch");
+	free(s);
+	cachefkcrt_meta_free(meta);
+	X509_free(c1);
+	X509_free(c2);
+	X509_free(c3);
+}
+END_TEST
+
+START_TEST(cache_fkcrt_09)
+{
+	X509 *c1, *c2;
+	cachefkcrt_meta_t *m1, *m2 = NULL;
+
+	c1 = ssl_x509_load(TESTCERT);
+	fail_unless(!!c1, "loading certificate failed");
+	m1 = cachefkcrt_meta_new(c1);
+	fail_unless(!!m1, "creating metadata failed");
+	fail_unless(cachefkcrt_meta_set_usedcrt(m1, c1) == 0,
+	            "setting used cert failed");
+	cachemgr_fkcrt_set_meta(c1, c1, m1);
+	c2 = cachemgr_fkcrt_get_meta(c1, &m2);
+	fail_unless(c2 == c1, "cached certificate not same");
+	fail_unless(m2 == m1, "cached metadata not same");
+	fail_unless(m1->references == 3, "refcount != 3");
+	cachefkcrt_meta_free(m2);
+	cachemgr_fkcrt_del(c1);
+	fail_unless(m1->references == 1, "refcount != 1");
+	cachefkcrt_meta_free(m1);
+	X509_free(c1);
+	X509_free(c2);
+}
+END_TEST
+
 #if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
 START_TEST(cache_fkcrt_04)
 {
@@ -136,6 +271,11 @@ cachefkcrt_suite(void)
 	tcase_add_test(tc, cache_fkcrt_01);
 	tcase_add_test(tc, cache_fkcrt_02);
 	tcase_add_test(tc, cache_fkcrt_03);
+	tcase_add_test(tc, cache_fkcrt_05);
+	tcase_add_test(tc, cache_fkcrt_06);
+	tcase_add_test(tc, cache_fkcrt_07);
+	tcase_add_test(tc, cache_fkcrt_08);
+	tcase_add_test(tc, cache_fkcrt_09);
 #if (OPENSSL_VERSION_NUMBER < 0x10100000L) || defined(LIBRESSL_VERSION_NUMBER)
 	tcase_add_test(tc, cache_fkcrt_04);
 #endif
@@ -0,0 +1,237 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ssl.h"
+#include "cachemgr.h"
+
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#define TESTCERT "pki/rsa.crt"
+#define TESTCERT2 "pki/server.crt"
+
+static void
+cachemgr_setup(void)
+{
+	if ((ssl_init() == -1) || (cachemgr_preinit() == -1))
+		exit(EXIT_FAILURE);
+}
+
+static void
+cachemgr_teardown(void)
+{
+	cachemgr_fini();
+	ssl_fini();
+}
+
+START_TEST(cache_vrfy_01)
+{
+	X509 *c1;
+	vrfy_result_t *res;
+	unsigned int gen = cachevrfy_generation();
+
+	c1 = ssl_x509_load(TESTCERT);
+	fail_unless(!!c1, "loading certificate failed");
+	cachemgr_vrfy_set(c1, NULL, "daniel.roe.ch", gen, NULL,
+	                  X509_V_OK, 300);
+	res = cachemgr_vrfy_get(c1, NULL, "daniel.roe.ch", gen);
+	fail_unless(!!res, "cache did not return a result");
+	fail_unless(res->result == X509_V_OK, "cache returned wrong result");
+	free(res);
+	res = cachemgr_vrfy_get(c1, NULL, "Daniel.Roe.CH", gen);
+	fail_unless(!!res, "host lookup is case sensitive");
+	free(res);
+	X509_free(c1);
+}
+END_TEST
+
+START_TEST(cache_vrfy_02)
+{
+	X509 *c1, *c2;
+	STACK_OF(X509) *chain;
+	vrfy_result_t *res;
+	unsigned int gen = cachevrfy_generation();
+
+	c1 = ssl_x509_load(TESTCERT);
+	fail_unless(!!c1, "loading certificate failed");
+	c2 = ssl_x509_load(TESTCERT2);
+	fail_unless(!!c2, "loading certificate failed");
+	chain = sk_X509_new_null();
+	sk_X509_push(chain, c2);
+	cachemgr_vrfy_set(c1, NULL, "daniel.roe.ch", gen, NULL,
+	                  X509_V_ERR_CERT_UNTRUSTED, 300);
+	res = cachemgr_vrfy_get(c1, NULL, "daniel.roe.ch", gen);
+	fail_unless(!!res, "cache did not return a result");
+	fail_unless(res->result == X509_V_ERR_CERT_UNTRUSTED,
+	            "cache returned wrong result");
+	free(res);
+	res = cachemgr_vrfy_get(c2, NULL, "daniel.roe.ch", gen);
+	fail_unless(!res, "cache returned result for other cert");
+	res = cachemgr_vrfy_get(c1, chain, "daniel.roe.ch", gen);
+	fail_unless(!res, "cache returned result for other chain");
+	res = cachemgr_vrfy_get(c1, NULL, "www.roe.ch", gen);
+	fail_unless(!res, "cache returned result for other host");
+	res = cachemgr_vrfy_get(c1, NULL, NULL, gen);
+	fail_unless(!res, "cache returned result for no host");
+	res = cachemgr_vrfy_get(c1, NULL, "daniel.roe.ch", gen + 1);
+	fail_unless(!res, "cache returned result for other generation");
+	sk_X509_free(chain);
+	X509_free(c1);
+	X509_free(c2);
+}
+END_TEST
+
+START_TEST(cache_vrfy_03)
+{
+	X509 *c1;
+	vrfy_result_t *res;
+	unsigned int gen = cachevrfy_generation();
+
+	c1 = ssl_x509_load(TESTCERT);
+	fail_unless(!!c1, "loading certificate failed");
+	cachemgr_vrfy_set(c1, NULL, "daniel.roe.ch", gen, NULL,
+	                  X509_V_OK, 300);
+	cachemgr_vrfy_invalidate();
+	fail_unless(cachevrfy_generation() != gen, "generation not changed");
+	res = cachemgr_vrfy_get(c1, NULL, "daniel.roe.ch", gen);
+	fail_unless(!res, "cache returned result after invalidation");
+	/* late result from a verification started before invalidation */
+	cachemgr_vrfy_set(c1, NULL, "daniel.roe.ch", gen, NULL,
+	                  X509_V_OK, 300);
+	res = cachemgr_vrfy_get(c1, NULL, "daniel.roe.ch",
+	                        cachevrfy_generation());
+	fail_unless(!res, "cache returned result of old generation");
+	X509_free(c1);
+}
+END_TEST
+
+START_TEST(cache_vrfy_04)
+{
+	X509 *c1;
+	vrfy_result_t *res;
+	unsigned int gen = cachevrfy_generation();
+
+	c1 = ssl_x509_load(TESTCERT);
+	fail_unless(!!c1, "loading certificate failed");
+	cachemgr_vrfy_set(c1, NULL, "daniel.roe.ch", gen, NULL,
+	                  X509_V_OK, 1);
+	res = cachemgr_vrfy_get(c1, NULL, "daniel.roe.ch", gen);
+	fail_unless(!!res, "cache did not return a result");
+	fail_unless(res->expiry <= time(NULL) + 1, "expiry exceeds ttl");
+	free(res);
+	sleep(2);
+	res = cachemgr_vrfy_get(c1, NULL, "daniel.roe.ch", gen);
+	fail_unless(!res, "cache returned expired result");
+	X509_free(c1);
+}
+END_TEST
+
+START_TEST(cache_vrfy_05)
+{
+	X509 *c1;
+	vrfy_result_t *res;
+
+	c1 = ssl_x509_load(TESTCERT);
+	fail_unless(!!c1, "loading certificate failed");
+	res = cachevrfy_mkval(c1, NULL, X509_V_OK, 86400);
+	fail_unless(!!res, "mkval failed");
+	fail_unless(res->expiry <= time(NULL) + 86400, "expiry exceeds ttl");
+	free(res);
+	/* ttl beyond notAfter is capped by notAfter */
+	res = cachevrfy_mkval(c1, NULL, X509_V_OK, (unsigned int)INT_MAX);
+	fail_unless(!!res, "mkval failed");
+	fail_unless(ASN1_TIME_cmp_time_t(X509_get_notAfter(c1),
+	                                 res->expiry) >= 0,
+	            "expiry exceeds notAfter");
+	free(res);
+	X509_free(c1);
+}
+END_TEST
+
+START_TEST(cache_vrfy_06)
+{
+	X509 *c1, *c2;
+	STACK_OF(X509) *vchain;
+	vrfy_result_t *res;
+
+	c1 = ssl_x509_load(TESTCERT);
+	fail_unless(!!c1, "loading certificate failed");
+	c2 = ssl_x509_load(TESTCERT2);
+	fail_unless(!!c2, "loading certificate failed");
+	vchain = sk_X509_new_null();
+	sk_X509_push(vchain, c1);
+	sk_X509_push(vchain, c2);
+	/* expiry is capped by the earliest notAfter of the verified chain */
+	fail_unless(ASN1_TIME_compare(X509_get_notAfter(c2),
+	                              X509_get_notAfter(c1)) < 0,
+	            "test certs expire in the wrong order");
+	res = cachevrfy_mkval(c1, vchain, X509_V_OK, (unsigned int)INT_MAX);
+	fail_unless(!!res, "mkval failed");
+	fail_unless(ASN1_TIME_cmp_time_t(X509_get_notAfter(c2),
+	                                 res->expiry) >= 0,
+	            "expiry exceeds notAfter of chain");
+	free(res);
+	/* failures depending on the current time are not cached */
+	res = cachevrfy_mkval(c1, NULL, X509_V_ERR_CERT_HAS_EXPIRED, 300);
+	fail_unless(!res, "cached expired cert");
+	res = cachevrfy_mkval(c1, NULL, X509_V_ERR_CERT_NOT_YET_VALID, 300);
+	fail_unless(!res, "cached not yet valid cert");
+	res = cachevrfy_mkval(c1, NULL, X509_V_ERR_CERT_UNTRUSTED, 300);
+	fail_unless(!!res, "did not cache untrusted cert");
+	free(res);
+	sk_X509_free(vchain);
+	X509_free(c1);
+	X509_free(c2);
+}
+END_TEST
+
+Suite *
+cachevrfy_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("cachevrfy");
+
+	tc = tcase_create("cache_vrfy");
+	tcase_add_checked_fixture(tc, cachemgr_setup, cachemgr_teardown);
+	tcase_add_test(tc, cache_vrfy_01);
+	tcase_add_test(tc, cache_vrfy_02);
+	tcase_add_test(tc, cache_vrfy_03);
+	tcase_add_test(tc, cache_vrfy_04);
+	tcase_add_test(tc, cache_vrfy_05);
+	tcase_add_test(tc, cache_vrfy_06);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+/* vim: set noet ft=c: */
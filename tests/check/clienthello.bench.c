@@ -0,0 +1,195 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Micro-benchmarks for the ClientHello parser and assembler, run with
+ * `make bench`.
+ */
+
+#include "ssl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ITERATIONS 200000
+
+static unsigned char hello[8192];
+static size_t hellosz;
+
+/*
+ * Build a TLS 1.3 style ClientHello with many cipher suites and extensions
+ * and a large key share, in records of at most fraglen octets.
+ */
+static size_t
+bench_build(unsigned char *buf, size_t fraglen)
+{
+	unsigned char msg[4096];
+	size_t n = 4, extsn, off, sz = 0;
+
+	msg[n++] = 0x03; msg[n++] = 0x03;
+	memset(msg + n, 0x42, 32); n += 32;
+	msg[n++] = 32; memset(msg + n, 0x24, 32); n += 32;
+	msg[n++] = 0x00; msg[n++] = 64;
+	for (int i = 0; i < 32; i++) {
+		msg[n++] = 0xc0; msg[n++] = i;
+	}
+	msg[n++] = 0x01; msg[n++] = 0x00;
+	extsn = n; n += 2;
+	/* server_name */
+	memcpy(msg + n, "\x00\x00\x00\x14\x00\x12\x00\x00\x0f"
+	       "www.example.org", 24); n += 24;
+	/* supported_groups */
+	memcpy(msg + n, "\x00\x0a\x00\x0a\x00\x08\x11\xec\x00\x1d\x00\x17"
+	       "\x00\x18", 14); n += 14;
+	/* ec_point_formats */
+	memcpy(msg + n, "\x00\x0b\x00\x02\x01\x00", 6); n += 6;
+	/* signature_algorithms */
+	memcpy(msg + n, "\x00\x0d\x00\x0a\x00\x08\x04\x03\x08\x04\x04\x01"
+	       "\x05\x03", 14); n += 14;
+	/* application_layer_protocol_negotiation */
+	memcpy(msg + n, "\x00\x10\x00\x0e\x00\x0c\x02h2\x08http/1.1", 18);
+	n += 18;
+	/* supported_versions */
+	memcpy(msg + n, "\x00\x2b\x00\x05\x04\x03\x04\x03\x03", 9); n += 9;
+	/* key_share with a 1216 octet X25519MLKEM768 share */
+	memcpy(msg + n, "\x00\x33\x04\xc6\x04\xc4\x11\xec\x04\xc0", 10);
+	n += 10;
+	memset(msg + n, 0x5a, 1216); n += 1216;
+	msg[extsn] = (n - extsn - 2) >> 8;
+	msg[extsn + 1] = (n - extsn - 2) & 0xff;
+	msg[0] = 0x01; msg[1] = 0x00;
+	msg[2] = (n - 4) >> 8; msg[3] = (n - 4) & 0xff;
+
+	for (off = 0; off < n; off += fraglen) {
+		size_t reclen = n - off < fraglen ? n - off : fraglen;
+		buf[sz++] = 0x16; buf[sz++] = 0x03; buf[sz++] = 0x01;
+		buf[sz++] = reclen >> 8; buf[sz++] = reclen & 0xff;
+		memcpy(buf + sz, msg + off, reclen);
+		sz += reclen;
+	}
+	return sz;
+}
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+bench_report(const char *name, double start, unsigned long n)
+{
+	printf("%-40s %10.1f ns/op\n", name, (bench_now() - start) / n);
+}
+
+int
+main(void)
+{
+	static unsigned char junk[65536 + sizeof(hello)];
+	ssl_tls_clienthello_info_t info;
+	ssl_tls_clienthello_asm_t a;
+	const unsigned char *ch;
+	unsigned char frag[sizeof(hello) * 2];
+	size_t fragsz, junksz;
+	char *s;
+	double t;
+
+	hellosz = bench_build(hello, 16384);
+	fragsz = bench_build(frag, 512);
+
+	/* 64 KiB of plain text with the occasional record type byte */
+	for (junksz = 0; junksz < 65536; junksz++) {
+		junk[junksz] = (junksz % 97) ? 'a' + junksz % 26 : 0x16;
+	}
+	memcpy(junk + junksz, hello, hellosz);
+	junksz += hellosz;
+
+	t = bench_now();
+	for (unsigned long i = 0; i < BENCH_ITERATIONS; i++) {
+		if (ssl_tls_clienthello_parse_info(hello, hellosz, 0, &ch,
+		                                   &info) != 0)
+			return EXIT_FAILURE;
+	}
+	bench_report("parse_info", t, BENCH_ITERATIONS);
+
+	t = bench_now();
+	for (unsigned long i = 0; i < BENCH_ITERATIONS; i++) {
+		if (ssl_tls_clienthello_parse(hello, hellosz, 0, &ch,
+		                              &s) != 0)
+			return EXIT_FAILURE;
+		free(s);
+	}
+	bench_report("parse with sni", t, BENCH_ITERATIONS);
+
+	t = bench_now();
+	for (unsigned long i = 0; i < BENCH_ITERATIONS / 100; i++) {
+		if (ssl_tls_clienthello_parse_info(junk, junksz, 1, &ch,
+		                                   &info) != 0)
+			return EXIT_FAILURE;
+	}
+	bench_report("parse_info search 64k prefix", t,
+	             BENCH_ITERATIONS / 100);
+
+	t = bench_now();
+	for (unsigned long i = 0; i < BENCH_ITERATIONS; i++) {
+		size_t off, n;
+		int rv = 1;
+
+		ssl_tls_clienthello_asm_init(&a, 16384);
+		for (off = 0; rv == 1 && off < fragsz; off += n) {
+			n = fragsz - off < 1460 ? fragsz - off : 1460;
+			rv = ssl_tls_clienthello_asm_feed(&a, frag + off, n,
+			                                  NULL);
+		}
+		ssl_tls_clienthello_asm_free(&a);
+		if (rv != 0)
+			return EXIT_FAILURE;
+	}
+	bench_report("asm_feed 512 octet records", t, BENCH_ITERATIONS);
+
+	if (ssl_tls_clienthello_parse_info(hello, hellosz, 0, &ch,
+	                                   &info) != 0)
+		return EXIT_FAILURE;
+	t = bench_now();
+	for (unsigned long i = 0; i < BENCH_ITERATIONS; i++) {
+		s = ssl_tls_clienthello_ja3_hash(&info);
+		if (!s)
+			return EXIT_FAILURE;
+		free(s);
+	}
+	bench_report("ja3_hash", t, BENCH_ITERATIONS);
+
+	return EXIT_SUCCESS;
+}
+
+/* vim: set noet ft=c: */
@@ -0,0 +1,169 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Fuzz target for the ClientHello parser and assembler.
+ *
+ * Build with libFuzzer, e.g.:
+ *   make fuzz CC=clang FUZZ_CFLAGS="-fsanitize=fuzzer,address -DFUZZ_LIBFUZZER"
+ * Without libFuzzer, the standalone driver below runs the inputs given as
+ * files on the command line, or random mutations of a built-in ClientHello.
+ */
+
+#include "ssl.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *, size_t);
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	ssl_tls_clienthello_info_t info;
+	ssl_tls_clienthello_asm_t a;
+	const unsigned char *ch;
+	size_t half;
+	char *s = NULL;
+	int rv;
+
+	for (int search = 0; search <= 1; search++) {
+		if (ssl_tls_clienthello_parse_info(data, size, search,
+		                                   &ch, &info) == 0) {
+			s = ssl_tls_clienthello_sni(&info);
+			free(s);
+			s = ssl_tls_clienthello_ja3_hash(&info);
+			free(s);
+		}
+	}
+
+	ssl_tls_clienthello_asm_init(&a, 16384);
+	half = size / 2;
+	rv = 1;
+	if (half)
+		rv = ssl_tls_clienthello_asm_feed(&a, data, half, NULL);
+	if (rv == 1 && size > half) {
+		s = NULL;
+		rv = ssl_tls_clienthello_asm_feed(&a, data + half,
+		                                  size - half, &s);
+		if (rv == 0) {
+			free(s);
+			s = ssl_tls_clienthello_ja3(&a.info);
+			free(s);
+		}
+	}
+	ssl_tls_clienthello_asm_free(&a);
+	return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+static unsigned char seed[] =
+	"\x16\x03\x01\x00\x6c\x01\x00\x00\x68\x03\x01\x4a\x9d\x49\x75\xb2"
+	"\x7e\xf9\xbc\xc3\x76\xac\x19\x78\xfb\x6a\xee\x50\x55\x5e\x35\x4c"
+	"\xca\xf2\x21\x15\xf3\x8a\x2a\xfc\xb5\x35\xed\x00\x00\x28\x00\x39"
+	"\x00\x38\x00\x35\x00\x16\x00\x13\x00\x0a\x00\x33\x00\x32\x00\x2f"
+	"\x00\x07\x00\x05\x00\x04\x00\x15\x00\x12\x00\x09\x00\x14\x00\x11"
+	"\x00\x08\x00\x06\x00\x03\x01\x00\x00\x17\x00\x00\x00\x0f\x00\x0d"
+	"\x00\x00\x0a\x6b\x61\x6d\x65\x73\x68\x2e\x63\x6f\x6d\x00\x23\x00"
+	"\x00";
+
+static uint32_t
+fuzz_rand(void)
+{
+	static uint32_t x = 2463534242U;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+static int
+fuzz_file(const char *fn)
+{
+	unsigned char buf[65536];
+	size_t sz;
+	FILE *f;
+
+	f = fopen(fn, "rb");
+	if (!f) {
+		fprintf(stderr, "Cannot open %s\n", fn);
+		return -1;
+	}
+	sz = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+	return LLVMFuzzerTestOneInput(buf, sz);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned char buf[sizeof(seed) * 2];
+	unsigned long iterations = 1000000;
+	size_t sz;
+
+	if (argc > 1) {
+		for (int i = 1; i < argc; i++) {
+			if (fuzz_file(argv[i]) == -1)
+				return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	for (unsigned long i = 0; i < iterations; i++) {
+		memcpy(buf, seed, sizeof(seed) - 1);
+		sz = sizeof(seed) - 1;
+		for (int j = fuzz_rand() % 8; j >= 0; j--) {
+			switch (fuzz_rand() % 4) {
+			case 0: /* flip a byte */
+				buf[fuzz_rand() % sz] ^= 1 << (fuzz_rand() % 8);
+				break;
+			case 1: /* overwrite a byte */
+				buf[fuzz_rand() % sz] = fuzz_rand();
+				break;
+			case 2: /* truncate */
+				sz = fuzz_rand() % (sz + 1);
+				break;
+			default: /* append */
+				if (sz < sizeof(buf))
+					buf[sz++] = fuzz_rand();
+				break;
+			}
+			if (!sz)
+				break;
+		}
+		LLVMFuzzerTestOneInput(buf, sz);
+	}
+	printf("clienthello: %lu fuzz iterations\n", iterations);
+	return EXIT_SUCCESS;
+}
+#endif /* !FUZZ_LIBFUZZER */
+
+/* vim: set noet ft=c: */
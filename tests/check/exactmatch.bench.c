@@ -0,0 +1,170 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * Benchmark for exact site rules, run with `make bench`.  Compares the hash
+ * table lookups of filter_site_exact_match() with lookups of the same sites
+ * in a B-tree ordered by strcmp(), for host names of a few labels, half of
+ * which are in the rules.
+ */
+
+#include "filter.h"
+#include "kbtree.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_NAMES 100000
+#define BENCH_LOOKUPS 100000
+#define BENCH_ITERATIONS 20
+#define BENCH_NAME_MAX_LEN 64
+
+typedef const char *str_t;
+#define getk_site(a) (a)->site
+typedef filter_site_t *filter_site_p_t;
+KBTREE_INIT(site, filter_site_p_t, kb_str_cmp, str_t, getk_site)
+
+static char names[BENCH_NAMES * 2][BENCH_NAME_MAX_LEN];
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+bench_word(char *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		buf[i] = "abcdefghijklmnopqrstuvwxyz0123456789-"[rand() % 37];
+	buf[len] = '\0';
+}
+
+/*
+ * Names share their parent domains, as in real block lists, so that the
+ * B-tree compares long common suffixes only after differing prefixes.
+ */
+static void
+bench_names(void)
+{
+	static const char *tlds[] = {"com", "net", "org", "example.com"};
+	char label[32];
+
+	for (int i = 0; i < BENCH_NAMES * 2; i++) {
+		bench_word(label, 4 + rand() % 12);
+		snprintf(names[i], sizeof(names[i]), "%s.cdn%d.%s", label, rand() % 100, tlds[rand() % 4]);
+	}
+}
+
+static size_t
+bench_lookup_hash(khash_t(filter) *hash)
+{
+	size_t found = 0;
+
+	for (int i = 0; i < BENCH_LOOKUPS; i++)
+		found += !!filter_site_exact_match(hash, names[(i * 7) % (BENCH_NAMES * 2)]);
+	return found;
+}
+
+static size_t
+bench_lookup_btree(kbtree_t(site) *btree)
+{
+	size_t found = 0;
+
+	for (int i = 0; i < BENCH_LOOKUPS; i++)
+		found += !!kb_get(site, btree, names[(i * 7) % (BENCH_NAMES * 2)]);
+	return found;
+}
+
+static void
+bench_run(int nsites)
+{
+	opts_t *opts = opts_new();
+	conn_opts_t *conn_opts = conn_opts_new();
+	tmp_opts_t tmp_opts;
+	kbtree_t(site) *btree = kb_init(site, KB_DEFAULT_SIZE);
+	size_t found1 = 0, found2 = 0;
+	double t, t1, t2;
+	char rule[sizeof("to sni ") + BENCH_NAME_MAX_LEN];
+
+	memset(&tmp_opts, 0, sizeof(tmp_opts));
+	for (int i = 0; i < nsites; i++) {
+		snprintf(rule, sizeof(rule), "to sni %.*s", BENCH_NAME_MAX_LEN - 1, names[i * 2]);
+		if (filter_rule_set(opts, conn_opts, "Block", rule, 0) == -1) {
+			fprintf(stderr, "Failed to set rule\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	filter_t *filter = opts->filter = filter_set(opts->filter_rules, "bench", &tmp_opts);
+	if (!filter) {
+		fprintf(stderr, "Failed to set filter\n");
+		exit(EXIT_FAILURE);
+	}
+	for (int i = 0; i < nsites; i++) {
+		filter_site_t *site = filter_site_exact_match(filter->all->sni_hash, names[i * 2]);
+		kb_put(site, btree, site);
+	}
+
+	t = bench_now();
+	for (int i = 0; i < BENCH_ITERATIONS; i++)
+		found1 += bench_lookup_btree(btree);
+	t1 = bench_now() - t;
+
+	t = bench_now();
+	for (int i = 0; i < BENCH_ITERATIONS; i++)
+		found2 += bench_lookup_hash(filter->all->sni_hash);
+	t2 = bench_now() - t;
+
+	printf("%6d sites  btree %6.1f ns/lookup %6zu found  hash %6.1f ns/lookup %6zu found\n",
+	       nsites,
+	       t1 / BENCH_ITERATIONS / BENCH_LOOKUPS, found1 / BENCH_ITERATIONS,
+	       t2 / BENCH_ITERATIONS / BENCH_LOOKUPS, found2 / BENCH_ITERATIONS);
+	__kb_destroy(btree);
+	opts_free(opts);
+	conn_opts_free(conn_opts);
+}
+
+int
+main(void)
+{
+	srand(1);
+	bench_names();
+
+	bench_run(10);
+	bench_run(1000);
+	bench_run(10000);
+	bench_run(100000);
+
+	return EXIT_SUCCESS;
+}
+
+/* vim: set noet ft=c: */
@@ -0,0 +1,243 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "attrib.h"
+#include "extlist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+static void
+extlist_tmpfile(char *path, const char *content)
+{
+	int fd = mkstemp(path);
+	fail_unless(fd != -1, "cannot create list file");
+	close(fd);
+
+	FILE *f = fopen(path, "w");
+	fail_unless(f != NULL, "cannot open list file");
+	fputs(content, f);
+	fclose(f);
+}
+
+START_TEST(extlist_01)
+{
+	char path[] = "/tmp/sslproxy.test.list.XXXXXX";
+	extlist_t *list;
+
+	extlist_tmpfile(path,
+		"# comment\n"
+		"\n"
+		"example.com\n"
+		"  .example.org   # suffix\n"
+		"WWW.Example.NET.\n"
+		"example.com\n"
+		".example.com\n");
+
+	list = extlist_open(path);
+	fail_unless(list != NULL, "cannot open list");
+	// Duplicate names are merged
+	fail_unless(extlist_count(list) == 3, "wrong count %zu", extlist_count(list));
+
+	fail_unless(extlist_match_name(list, "example.com"), "exact not matched");
+	fail_unless(extlist_match_name(list, "www.example.com"), "exact and suffix not merged");
+	fail_unless(extlist_match_name(list, "example.org"), "suffix did not match domain");
+	fail_unless(extlist_match_name(list, "a.b.example.org"), "suffix did not match subdomain");
+	fail_unless(!extlist_match_name(list, "evilexample.org"), "matched across label");
+	fail_unless(extlist_match_name(list, "www.example.net"), "case not ignored");
+	fail_unless(extlist_match_name(list, "www.example.net."), "trailing dot not ignored");
+	fail_unless(!extlist_match_name(list, "a.www.example.net"), "exact matched subdomain");
+	fail_unless(!extlist_match_name(list, "example.net"), "matched parent");
+	fail_unless(!extlist_match_name(list, ""), "matched empty name");
+	fail_unless(!extlist_match_addr(list, "192.168.0.1"), "matched address");
+
+	extlist_close(list);
+	unlink(path);
+}
+END_TEST
+
+START_TEST(extlist_02)
+{
+	char path[] = "/tmp/sslproxy.test.list.XXXXXX";
+	extlist_t *list;
+
+	extlist_tmpfile(path,
+		"192.168.1.1\n"
+		"10.0.0.0/8\n"
+		"10.1.0.0/16\n"
+		"172.16.0.0/24\n"
+		"172.16.1.0/24\n"
+		"2001:db8::/32\n"
+		"::ffff:198.51.100.0/120\n");
+
+	list = extlist_open(path);
+	fail_unless(list != NULL, "cannot open list");
+	// Overlapping and adjacent ranges are merged
+	fail_unless(extlist_count(list) == 5, "wrong count %zu", extlist_count(list));
+
+	fail_unless(extlist_match_addr(list, "192.168.1.1"), "address not matched");
+	fail_unless(!extlist_match_addr(list, "192.168.1.2"), "wrong address matched");
+	fail_unless(extlist_match_addr(list, "10.0.0.0"), "range start not matched");
+	fail_unless(extlist_match_addr(list, "10.255.255.255"), "range end not matched");
+	fail_unless(!extlist_match_addr(list, "11.0.0.0"), "address after range matched");
+	fail_unless(extlist_match_addr(list, "172.16.1.255"), "merged range not matched");
+	fail_unless(!extlist_match_addr(list, "172.16.2.0"), "address after merged range matched");
+	fail_unless(extlist_match_addr(list, "2001:db8:1::1"), "ipv6 not matched");
+	fail_unless(!extlist_match_addr(list, "2001:db9::1"), "wrong ipv6 matched");
+	fail_unless(extlist_match_addr(list, "198.51.100.7"), "v4-mapped range not matched");
+	fail_unless(extlist_match_addr(list, "::ffff:10.1.2.3"), "v4-mapped address not matched");
+	fail_unless(!extlist_match_addr(list, "example.com"), "matched name");
+	fail_unless(!extlist_match_name(list, "192.168.1.1"), "matched address as name");
+
+	extlist_close(list);
+	unlink(path);
+}
+END_TEST
+
+START_TEST(extlist_03)
+{
+	char path[] = "/tmp/sslproxy.test.list.XXXXXX";
+	static const char *invalid[] = {
+		"0.0.0.0 example.com\n",
+		"example..com\n",
+		".\n",
+		"*.example.com\n",
+		"10.0.0.0/33\n",
+	};
+
+	close(2);
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+		strcpy(path, "/tmp/sslproxy.test.list.XXXXXX");
+		extlist_tmpfile(path, invalid[i]);
+		fail_unless(extlist_open(path) == NULL, "opened invalid list: %s", invalid[i]);
+		unlink(path);
+	}
+	fail_unless(extlist_open("/nonexistent/sslproxy.test.list") == NULL, "opened missing list");
+}
+END_TEST
+
+START_TEST(extlist_04)
+{
+	char path[] = "/tmp/sslproxy.test.list.XXXXXX";
+	extlist_t *list, *list2;
+	FILE *f;
+
+	extlist_tmpfile(path, "example.com\n");
+
+	list = extlist_open(path);
+	fail_unless(list != NULL, "cannot open list");
+	list2 = extlist_open(path);
+	fail_unless(list2 == list, "list not shared");
+	fail_unless(extlist_refresh(list) == 0, "unchanged list reloaded");
+
+	f = fopen(path, "w");
+	fputs("example.org\n10.0.0.0/8\n", f);
+	fclose(f);
+
+	fail_unless(extlist_refresh_all() == 1, "changed list not reloaded");
+	fail_unless(!extlist_match_name(list, "example.com"), "old entry kept");
+	fail_unless(extlist_match_name(list, "example.org"), "new entry not matched");
+	fail_unless(extlist_match_addr(list2, "10.1.2.3"), "new range not matched");
+	fail_unless(extlist_refresh_all() == 0, "unchanged list reloaded");
+
+	// Invalid lists do not replace the current entries
+	close(2);
+	f = fopen(path, "w");
+	fputs("example..net\n", f);
+	fclose(f);
+
+	fail_unless(extlist_refresh(list) == -1, "invalid list reloaded");
+	fail_unless(extlist_match_name(list, "example.org"), "current entry dropped");
+
+	extlist_close(list2);
+	extlist_close(list);
+	unlink(path);
+}
+END_TEST
+
+START_TEST(extlist_05)
+{
+	char path[] = "/tmp/sslproxy.test.list.XXXXXX";
+	char name[64];
+	extlist_t *list;
+	FILE *f;
+
+	extlist_tmpfile(path, "");
+	f = fopen(path, "w");
+	for (int i = 0; i < 100000; i++) {
+		fprintf(f, "host%d.example%d.com\n", i, i % 100);
+		fprintf(f, "10.%d.%d.0/24\n", i / 256 % 256, i % 256);
+	}
+	fclose(f);
+
+	list = extlist_open(path);
+	fail_unless(list != NULL, "cannot open list");
+	// The /24s cover all of 10.0.0.0/8, merged into a single range
+	fail_unless(extlist_count(list) == 100000 + 1, "wrong count %zu", extlist_count(list));
+
+	for (int i = 0; i < 100000; i += 997) {
+		snprintf(name, sizeof(name), "host%d.example%d.com", i, i % 100);
+		fail_unless(extlist_match_name(list, name), "name not matched: %s", name);
+		snprintf(name, sizeof(name), "host%d.example%d.com", i, (i + 1) % 100);
+		fail_unless(!extlist_match_name(list, name), "wrong name matched: %s", name);
+	}
+	fail_unless(extlist_match_addr(list, "10.255.255.1"), "range not matched");
+	fail_unless(!extlist_match_addr(list, "11.0.0.1"), "wrong address matched");
+
+	extlist_close(list);
+	unlink(path);
+}
+END_TEST
+
+Suite *
+extlist_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("extlist");
+
+	tc = tcase_create("extlist_match");
+	tcase_add_test(tc, extlist_01);
+	tcase_add_test(tc, extlist_02);
+	tcase_add_test(tc, extlist_03);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("extlist_refresh");
+	tcase_add_test(tc, extlist_04);
+	tcase_add_test(tc, extlist_05);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+/* vim: set noet ft=c: */
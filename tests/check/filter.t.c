@@ -30,6 +30,8 @@
 #include "filter.h"
 
 #include <check.h>
+#include <ctype.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 START_TEST(set_filter_rule_01)
@@ -3160,6 +3162,892 @@ START_TEST(set_filter_rule_15)
 END_TEST
 #endif /* !WITHOUT_USERAUTH */
 
+START_TEST(filter_match_01)
+{
+	char *s;
+	int rv;
+	opts_t *opts = opts_new();
+	conn_opts_t *conn_opts = conn_opts_new();
+	filter_site_t *site;
+
+	s = strdup("to sni example.org*");
+	rv = filter_rule_set(opts, conn_opts, "Pass", s, 0);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+	s = strdup("to sni ample.or*");
+	rv = filter_rule_set(opts, conn_opts, "Block", s, 0);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+	s = strdup("to sni .net*");
+	rv = filter_rule_set(opts, conn_opts, "Divert", s, 0);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	tmp_opts_t *tmp_opts = malloc(sizeof(tmp_opts_t));
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+
+	opts->filter = filter_set(opts->filter_rules, "sslproxy", tmp_opts);
+	fail_unless(!!opts->filter, "failed to set filter");
+	fail_unless(!!opts->filter->all->sni_acm, "no sni substring matcher");
+	fail_unless(!!ACM_DFA(opts->filter->all->sni_acm), "matcher not compiled");
+
+	s = strdup("www.example.org");
+	site = filter_site_substring_match(opts->filter->all->sni_acm, s);
+	fail_unless(site && !strcmp(site->site, "ample.or"), "wrong first match");
+	free(s);
+	s = strdup("www.example.net");
+	site = filter_site_substring_match(opts->filter->all->sni_acm, s);
+	fail_unless(site && !strcmp(site->site, ".net"), "wrong match");
+	free(s);
+	s = strdup("www.example.com");
+	site = filter_site_substring_match(opts->filter->all->sni_acm, s);
+	fail_unless(!site, "unexpected match");
+	free(s);
+
+	opts_free(opts);
+	conn_opts_free(conn_opts);
+	tmp_opts_free(tmp_opts);
+}
+END_TEST
+
+static int
+filter_match_nocaseeq(const char a, const char b)
+{
+	return tolower((unsigned char)a) == tolower((unsigned char)b);
+}
+
+/*
+ * The compiled DFA must report the same matches as the machine, in the same
+ * order, for random keywords and texts over a small alphabet, which gives
+ * many overlapping keywords and long fail chains.
+ */
+static void
+filter_match_compare(ACMachine(char) *acm)
+{
+	char text[64];
+
+	fail_unless(ACM_compile(acm, SIZE_MAX) == 1, "failed to compile");
+	const ACDfa(char) *dfa = ACM_DFA(acm);
+	fail_unless(!!dfa, "no dfa");
+
+	for (int i = 0; i < 1000; i++) {
+		size_t len = rand() % (sizeof(text) - 1);
+		for (size_t j = 0; j < len; j++)
+			text[j] = "abcABC.\xe9"[rand() % 8];
+		text[len] = '\0';
+
+		const ACState(char) *state = ACM_reset(acm);
+		ACDfaState dstate = ACM_DFA_reset(dfa);
+		for (size_t j = 0; j < len; j++) {
+			size_t n = ACM_match(state, text[j]);
+			fail_unless(!!ACM_DFA_match(dfa, dstate, text[j]) == !!n,
+			            "match mismatch");
+			fail_unless(ACM_DFA_nb_matches(dfa, dstate) == n,
+			            "number of matches mismatch");
+			for (size_t k = 0; k < n; k++) {
+				void *v1, *v2;
+				fail_unless(ACM_get_match(state, k, 0, &v1) ==
+				            ACM_DFA_get_match(dfa, dstate, k, &v2),
+				            "rank mismatch");
+				fail_unless(v1 == v2, "value mismatch");
+			}
+		}
+	}
+}
+
+START_TEST(filter_match_02)
+{
+	static char values[200];
+	char kw[8];
+	Keyword(char) k;
+
+	srand(1);
+	for (int eq = 0; eq < 2; eq++) {
+		ACMachine(char) *acm = eq ? ACM_create(char, filter_match_nocaseeq)
+		                          : ACM_create(char);
+		for (size_t i = 0; i < sizeof(values); i++) {
+			size_t len = 1 + rand() % (sizeof(kw) - 1);
+			for (size_t j = 0; j < len; j++)
+				kw[j] = "abcAB.\xe9"[rand() % 7];
+			ACM_KEYWORD_SET(k, kw, len);
+			ACM_register_keyword(acm, k, &values[i], 0);
+		}
+		filter_match_compare(acm);
+
+		/* registering drops the dfa, which is then recompiled */
+		ACM_KEYWORD_SET(k, "c", 1);
+		ACM_register_keyword(acm, k, &values[0], 0);
+		fail_unless(!ACM_DFA(acm), "dfa not dropped");
+		filter_match_compare(acm);
+		ACM_release(acm);
+	}
+}
+END_TEST
+
+START_TEST(filter_match_03)
+{
+	char *s;
+	int rv;
+	opts_t *opts = opts_new();
+	conn_opts_t *conn_opts = conn_opts_new();
+	filter_site_t *site;
+	char buf[64];
+
+	/* insert in reverse order, enough to rehash the tables a few times */
+	for (int i = 299; i >= 0; i--) {
+		snprintf(buf, sizeof(buf), "to sni h%03d.example.com port %d", i, 1000 + i % 7);
+		s = strdup(buf);
+		rv = filter_rule_set(opts, conn_opts, "Pass", s, 0);
+		fail_unless(rv == 0, "failed to parse rule");
+		free(s);
+	}
+
+	tmp_opts_t *tmp_opts = malloc(sizeof(tmp_opts_t));
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+
+	opts->filter = filter_set(opts->filter_rules, "sslproxy", tmp_opts);
+	fail_unless(!!opts->filter, "failed to set filter");
+	fail_unless(kh_size(opts->filter->all->sni_hash) == 300, "wrong number of sites");
+
+	for (int i = 0; i < 300; i++) {
+		snprintf(buf, sizeof(buf), "h%03d.example.com", i);
+		site = filter_site_exact_match(opts->filter->all->sni_hash, buf);
+		fail_unless(site && !strcmp(site->site, buf), "site not found: %s", buf);
+		fail_unless(kh_size(site->port_hash) == 1, "wrong number of ports");
+	}
+	site = filter_site_exact_match(opts->filter->all->sni_hash, "h001.example.co");
+	fail_unless(!site, "matched prefix of site");
+	site = filter_site_exact_match(opts->filter->all->sni_hash, "h001.example.comm");
+	fail_unless(!site, "matched extension of site");
+	site = filter_site_exact_match(opts->filter->all->sni_hash, "");
+	fail_unless(!site, "matched empty site");
+
+	/* dumps are sorted regardless of the table layout */
+	s = filter_str(opts->filter);
+	char *prev = s;
+	for (int i = 0; i < 300; i++) {
+		snprintf(buf, sizeof(buf), " h%03d.example.com ", i);
+		char *p = strstr(s, buf);
+		fail_unless(p && p > prev, "site not in order: %s", buf);
+		prev = p;
+	}
+	free(s);
+
+	opts_free(opts);
+	conn_opts_free(conn_opts);
+	tmp_opts_free(tmp_opts);
+}
+END_TEST
+
+/*
+ * Machines whose DFA would exceed the budget are left uncompiled, and
+ * still match.
+ */
+START_TEST(filter_match_04)
+{
+	char *s;
+	int rv;
+	opts_t *opts = opts_new();
+	conn_opts_t *conn_opts = conn_opts_new();
+	filter_site_t *site;
+
+	s = strdup("to sni example.org*");
+	rv = filter_rule_set(opts, conn_opts, "Pass", s, 0);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	tmp_opts_t *tmp_opts = malloc(sizeof(tmp_opts_t));
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+
+	filter_dfa_max_size_set(0);
+	opts->filter = filter_set(opts->filter_rules, "sslproxy", tmp_opts);
+	filter_dfa_max_size_set(FILTER_DFA_MAX_SIZE);
+	fail_unless(!!opts->filter, "failed to set filter");
+	ACMachine(char) *acm = opts->filter->all->sni_acm;
+	fail_unless(!!acm, "no sni substring matcher");
+	fail_unless(!ACM_DFA(acm), "matcher compiled with no budget");
+
+	s = strdup("www.example.org");
+	site = filter_site_substring_match(acm, s);
+	fail_unless(site && !strcmp(site->site, "example.org"), "no match without dfa");
+	free(s);
+
+	fail_unless(ACM_compile(acm, sizeof(ACDfa(char))) == -1, "budget not checked");
+	fail_unless(!ACM_DFA(acm), "dfa over budget");
+	fail_unless(ACM_compile(acm, SIZE_MAX) == 1, "failed to compile");
+	fail_unless(!!ACM_DFA(acm), "no dfa");
+
+	opts_free(opts);
+	conn_opts_free(conn_opts);
+	tmp_opts_free(tmp_opts);
+}
+END_TEST
+
+START_TEST(filter_cidr_01)
+{
+	iptrie_prefix_t p;
+	char *s;
+
+	fail_unless(!iptrie_prefix_parse("10.1.2.3/16", &p), "failed to parse v4");
+	fail_unless(p.af == AF_INET && p.len == 16, "wrong v4 prefix");
+	s = iptrie_prefix_str(&p);
+	fail_unless(!strcmp(s, "10.1.0.0/16"), "host bits not cleared: %s", s);
+	free(s);
+
+	fail_unless(!iptrie_prefix_parse("2001:DB8::1/32", &p), "failed to parse v6");
+	fail_unless(p.af == AF_INET6 && p.len == 32, "wrong v6 prefix");
+	s = iptrie_prefix_str(&p);
+	fail_unless(!strcmp(s, "2001:db8::/32"), "wrong v6 prefix: %s", s);
+	free(s);
+
+	fail_unless(!iptrie_prefix_parse("::ffff:192.168.1.1", &p), "failed to parse mapped");
+	fail_unless(p.af == AF_INET && p.len == 32, "v4-mapped not converted");
+
+	fail_unless(iptrie_prefix_parse("10.0.0.0/33", &p) == -1, "parsed /33");
+	fail_unless(iptrie_prefix_parse("10.0.0.0/", &p) == -1, "parsed empty len");
+	fail_unless(iptrie_prefix_parse("10.0.0.0/8x", &p) == -1, "parsed trailing junk");
+	fail_unless(iptrie_prefix_parse("::/129", &p) == -1, "parsed /129");
+	fail_unless(iptrie_prefix_parse("example.com/8", &p) == -1, "parsed name");
+}
+END_TEST
+
+START_TEST(filter_cidr_02)
+{
+	static const char *prefixes[] = {
+		"0.0.0.0/0", "10.0.0.0/8", "10.1.0.0/16", "10.1.2.0/24", "10.1.2.3/32",
+		"192.168.0.0/16", "2001:db8::/32", "2001:db8:1::/48",
+	};
+	iptrie_t *trie = iptrie_new();
+	iptrie_prefix_t p;
+	void *v[IPTRIE_MAX_MATCHES];
+	void **slot;
+	int created;
+
+	for (size_t i = 0; i < sizeof(prefixes)/sizeof(prefixes[0]); i++) {
+		fail_unless(!iptrie_prefix_parse(prefixes[i], &p), "failed to parse");
+		slot = iptrie_put(trie, &p, &created);
+		fail_unless(slot && created && !*slot, "failed to put");
+		*slot = (void *)prefixes[i];
+	}
+	fail_unless(!iptrie_prefix_parse("10.1.9.9/16", &p), "failed to parse");
+	slot = iptrie_put(trie, &p, &created);
+	fail_unless(slot && !created && *slot == prefixes[2], "duplicate created");
+	fail_unless(trie->count == 8, "wrong count");
+
+	fail_unless(!iptrie_prefix_parse("10.1.2.3", &p), "failed to parse");
+	fail_unless(iptrie_match(trie, &p, v, IPTRIE_MAX_MATCHES) == 5, "wrong number of matches");
+	fail_unless(v[0] == prefixes[4] && v[1] == prefixes[3] && v[2] == prefixes[2] &&
+		v[3] == prefixes[1] && v[4] == prefixes[0], "not longest first");
+
+	// 10.1.0.0/16 must not match 10.100.x.x
+	fail_unless(!iptrie_prefix_parse("10.100.2.3", &p), "failed to parse");
+	fail_unless(iptrie_match(trie, &p, v, 1) == 1 && v[0] == prefixes[1], "wrong match");
+
+	fail_unless(!iptrie_prefix_parse("172.16.0.1", &p), "failed to parse");
+	fail_unless(iptrie_match(trie, &p, v, 1) == 1 && v[0] == prefixes[0], "default not matched");
+
+	fail_unless(!iptrie_prefix_parse("2001:db8:1:2::1", &p), "failed to parse");
+	fail_unless(iptrie_match(trie, &p, v, IPTRIE_MAX_MATCHES) == 2 &&
+		v[0] == prefixes[7] && v[1] == prefixes[6], "wrong v6 matches");
+
+	fail_unless(!iptrie_prefix_parse("2001:db9::1", &p), "failed to parse");
+	fail_unless(iptrie_match(trie, &p, v, 1) == 0, "v6 matched v4 default");
+
+	fail_unless(!iptrie_prefix_parse("10.1.2.0/24", &p), "failed to parse");
+	fail_unless(iptrie_get(trie, &p) == prefixes[3], "exact get failed");
+	fail_unless(!iptrie_prefix_parse("10.1.2.0/23", &p), "failed to parse");
+	fail_unless(!iptrie_get(trie, &p), "exact get found glue");
+
+	iptrie_free(trie, NULL);
+}
+END_TEST
+
+START_TEST(filter_cidr_03)
+{
+	char *s;
+	int rv;
+	opts_t *opts = opts_new();
+	conn_opts_t *conn_opts = conn_opts_new();
+
+	s = strdup("from ip 10.1.0.0/16 to ip 192.168.0.0/16 log connect");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 0);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	s = strdup("from ip 10.0.0.0/8 to ip 192.168.1.0/24 log content");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 1);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	s = strdup("from ip 10.1.2.3 to ip 192.168.1.1 log pcap");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 2);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	close(2);
+	s = strdup("from ip 10.0.0.0/33 log connect");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 3);
+	fail_unless(rv == -1, "parsed invalid cidr");
+	free(s);
+
+	s = strdup("to ip 192.168.0.0/ log connect");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 4);
+	fail_unless(rv == -1, "parsed invalid cidr");
+	free(s);
+
+	tmp_opts_t *tmp_opts = malloc(sizeof(tmp_opts_t));
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+	opts->filter = filter_set(opts->filter_rules, "sslproxy", tmp_opts);
+	fail_unless(opts->filter != NULL, "failed to set filter");
+
+	filter_t *filter = opts->filter;
+	filter_ip_t *ips[IPTRIE_MAX_MATCHES];
+	filter_site_t *site;
+
+	fail_unless(filter_ip_exact_match(filter->ip_hash, "10.1.2.3") != NULL, "exact src not found");
+	fail_unless(filter_ip_cidr_match(filter->ip_trie, "10.1.2.3", ips) == 2, "wrong src matches");
+	fail_unless(!strcmp(ips[0]->ip, "10.1.0.0/16") && !strcmp(ips[1]->ip, "10.0.0.0/8"), "src not longest first");
+	fail_unless(ips[0]->cidr, "src not cidr");
+	fail_unless(filter_ip_cidr_match(filter->ip_trie, "10.100.2.3", ips) == 1 &&
+		!strcmp(ips[0]->ip, "10.0.0.0/8"), "10.1.0.0/16 matched 10.100.2.3");
+	fail_unless(filter_ip_cidr_match(filter->ip_trie, "11.1.2.3", ips) == 0, "wrong src match");
+
+	// The dst ranges are in the lists of the src ranges
+	filter_list_t *list = ips[0]->list;
+	site = filter_dstip_find(list, "192.168.1.7", NULL);
+	fail_unless(site && !strcmp(site->site, "192.168.1.0/24") && site->cidr, "dst lpm failed");
+
+	fail_unless(filter_ip_cidr_match(filter->ip_trie, "10.1.2.3", ips) == 2, "wrong src matches");
+	list = ips[0]->list;
+	site = filter_dstip_find(list, "192.168.1.7", NULL);
+	fail_unless(site && !strcmp(site->site, "192.168.0.0/16"), "dst lpm failed");
+	fail_unless(!filter_dstip_find(list, "192.169.1.7", NULL), "dst matched out of range");
+
+	s = filter_str(filter);
+	fail_unless(strstr(s, " ip 1 10.0.0.0/8 (cidr)=\n") != NULL, "src cidr not in dump: %s", s);
+	fail_unless(strstr(s, "0: 192.168.1.0/24 (cidr, action=") != NULL, "dst cidr not in dump: %s", s);
+	free(s);
+
+	opts_free(opts);
+	conn_opts_free(conn_opts);
+	tmp_opts_free(tmp_opts);
+}
+END_TEST
+
+START_TEST(filter_suffix_01)
+{
+	static const char *domains[] = {
+		"com", "example.com", "www.example.com", "example.org.", "Example.NET",
+	};
+	domtrie_t *trie = domtrie_new();
+	void **slot;
+	int created;
+
+	fail_unless(!domtrie_domain_check("example.com"), "valid domain rejected");
+	fail_unless(!domtrie_domain_check("example.com."), "valid domain rejected");
+	fail_unless(domtrie_domain_check("") == -1, "empty domain accepted");
+	fail_unless(domtrie_domain_check(".example.com") == -1, "empty label accepted");
+	fail_unless(domtrie_domain_check("example..com") == -1, "empty label accepted");
+
+	for (size_t i = 0; i < sizeof(domains)/sizeof(domains[0]); i++) {
+		slot = domtrie_put(trie, domains[i], &created);
+		fail_unless(slot && created && !*slot, "failed to put");
+		*slot = (void *)domains[i];
+	}
+	slot = domtrie_put(trie, "EXAMPLE.com", &created);
+	fail_unless(slot && !created && *slot == domains[1], "duplicate created");
+	fail_unless(trie->count == 5, "wrong count");
+
+	fail_unless(domtrie_match(trie, "example.com") == domains[1], "domain not matched");
+	fail_unless(domtrie_match(trie, "a.b.example.com") == domains[1], "subdomain not matched");
+	fail_unless(domtrie_match(trie, "www.example.com") == domains[2], "not longest suffix");
+	fail_unless(domtrie_match(trie, "a.www.example.com.") == domains[2], "trailing dot not ignored");
+	fail_unless(domtrie_match(trie, "wwwexample.com") == domains[0], "matched across label");
+	fail_unless(domtrie_match(trie, "evilexample.com") == domains[0], "matched across label");
+	fail_unless(domtrie_match(trie, "www.example.org") == domains[3], "trailing dot not ignored");
+	fail_unless(domtrie_match(trie, "WWW.example.net") == domains[4], "case not ignored");
+	fail_unless(!domtrie_match(trie, "example.co"), "matched prefix of label");
+	fail_unless(!domtrie_match(trie, "org"), "matched parent domain");
+	fail_unless(!domtrie_match(trie, ""), "matched empty name");
+
+	fail_unless(domtrie_get(trie, "www.example.com") == domains[2], "exact get failed");
+	fail_unless(!domtrie_get(trie, "a.www.example.com"), "exact get matched subdomain");
+	fail_unless(!domtrie_get(trie, "org"), "exact get found inner node");
+
+	domtrie_free(trie, NULL);
+}
+END_TEST
+
+START_TEST(filter_suffix_02)
+{
+	char *s;
+	int rv;
+	opts_t *opts = opts_new();
+	conn_opts_t *conn_opts = conn_opts_new();
+
+	s = strdup("to sni .example.com log connect");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 0);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	s = strdup("to sni .www.example.com log content");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 1);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	s = strdup("to sni www.example.com log pcap");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 2);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	s = strdup("to sni example.org* log cert");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 3);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	s = strdup("to host .example.com log connect");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 4);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	close(2);
+	s = strdup("to sni . log connect");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 5);
+	fail_unless(rv == -1, "parsed invalid suffix");
+	free(s);
+
+	s = strdup("to cn .example..com log connect");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 6);
+	fail_unless(rv == -1, "parsed invalid suffix");
+	free(s);
+
+	tmp_opts_t *tmp_opts = malloc(sizeof(tmp_opts_t));
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+	opts->filter = filter_set(opts->filter_rules, "sslproxy", tmp_opts);
+	fail_unless(opts->filter != NULL, "failed to set filter");
+
+	filter_list_t *list = opts->filter->all;
+	filter_site_t *site;
+
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "example.com", NULL);
+	fail_unless(site && !strcmp(site->site, ".example.com") && site->suffix, "domain not matched");
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "mail.example.com", NULL);
+	fail_unless(site && !strcmp(site->site, ".example.com"), "subdomain not matched");
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "a.www.example.com", NULL);
+	fail_unless(site && !strcmp(site->site, ".www.example.com"), "not longest suffix");
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "www.example.com", NULL);
+	fail_unless(site && !strcmp(site->site, "www.example.com") && !site->suffix, "exact match not first");
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "evilexample.com", NULL);
+	fail_unless(!site, "matched across label");
+	// Suffix matches take precedence over substring matches
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "example.org.example.com", NULL);
+	fail_unless(site && !strcmp(site->site, ".example.com"), "substring match first");
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "www.example.org", NULL);
+	fail_unless(site && !strcmp(site->site, "example.org") && !site->suffix, "substring not matched");
+
+	site = filter_site_find(list->host_bloom, list->host_hash, list->host_trie, list->host_acm, list->lists, list->host_all, "www.example.com", NULL);
+	fail_unless(site && !strcmp(site->site, ".example.com"), "host not matched");
+
+	s = filter_str(opts->filter);
+	fail_unless(strstr(s, "    sni suffix:\n"
+"      0: .example.com (suffix, action=||||match, log=connect|||||, precedence=2)\n"
+"      1: .www.example.com (suffix, action=||||match, log=|||content||, precedence=2)\n"
+"    sni substring:\n") != NULL, "sni suffix not in dump: %s", s);
+	fail_unless(strstr(s, "    host suffix:\n") != NULL, "host suffix not in dump: %s", s);
+	free(s);
+
+	opts_free(opts);
+	conn_opts_free(conn_opts);
+	tmp_opts_free(tmp_opts);
+}
+END_TEST
+
+START_TEST(filter_list_01)
+{
+	char path[] = "/tmp/sslproxy.test.list.XXXXXX";
+	char *s;
+	int rv;
+	opts_t *opts = opts_new();
+	conn_opts_t *conn_opts = conn_opts_new();
+
+	int fd = mkstemp(path);
+	fail_unless(fd != -1, "cannot create list file");
+	fail_unless(write(fd, ".example.com\n192.168.0.0/16\n", 28) == 28, "cannot write list file");
+	close(fd);
+
+	char *rule;
+	fail_unless(asprintf(&rule, "to list %s log connect", path) != -1, "oom");
+	rv = filter_rule_set(opts, conn_opts, "Block", rule, 0);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(rule);
+
+	fail_unless(asprintf(&rule, "from ip 10.0.0.1 to list %s port 443", path) != -1, "oom");
+	rv = filter_rule_set(opts, conn_opts, "Pass", rule, 1);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(rule);
+
+	s = strdup("to sni www.example.com log content");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 2);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	close(2);
+	s = strdup("to list");
+	rv = filter_rule_set(opts, conn_opts, "Block", s, 3);
+	fail_unless(rv == -1, "parsed list without file");
+	free(s);
+
+	s = filter_rule_str(opts->filter_rules);
+	fail_unless(strstr(s, "filter rule 0: list=/tmp/sslproxy.test.list.") != NULL, "list not in rule: %s", s);
+	free(s);
+
+	tmp_opts_t *tmp_opts = malloc(sizeof(tmp_opts_t));
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+	opts->filter = filter_set(opts->filter_rules, "sslproxy", tmp_opts);
+	fail_unless(opts->filter != NULL, "failed to set filter");
+
+	filter_list_t *list = opts->filter->all;
+	filter_site_t *site;
+
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "mail.example.com", NULL);
+	fail_unless(site && site->extlist && site->action.block, "sni not matched in list %p %s", (void *)site, site ? site->site : "");
+	site = filter_site_find(list->cn_bloom, list->cn_hash, list->cn_trie, list->cn_acm, list->lists, list->cn_all, "example.com", NULL);
+	fail_unless(site && site->extlist, "cn not matched in list");
+	site = filter_site_find(list->host_bloom, list->host_hash, list->host_trie, list->host_acm, list->lists, list->host_all, "example.org", NULL);
+	fail_unless(!site, "host matched out of list");
+	// Rules for specific sites take precedence over lists
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "www.example.com", NULL);
+	fail_unless(site && !site->extlist && !strcmp(site->site, "www.example.com"), "list matched first");
+
+	site = filter_dstip_find(list, "192.168.1.1", NULL);
+	fail_unless(site && site->extlist, "dst not matched in list");
+	fail_unless(!filter_dstip_find(list, "192.169.1.1", NULL), "dst matched out of list");
+
+	// Lists are shared by all rules and filters
+	filter_ip_t *ip = filter_ip_exact_match(opts->filter->ip_hash, "10.0.0.1");
+	fail_unless(ip != NULL, "src not found");
+	site = filter_dstip_find(ip->list, "192.168.1.1", NULL);
+	fail_unless(site && site->extlist == list->lists->site->extlist, "list not shared");
+	fail_unless(filter_port_find(site, "443") != NULL, "list port not found");
+
+	s = filter_str(opts->filter);
+	fail_unless(strstr(s, "    list:\n      0: /tmp/sslproxy.test.list.") != NULL, "list not in dump: %s", s);
+	fail_unless(strstr(s, " (list, action=|||block|, log=connect|||||, precedence=2)") != NULL, "list action not in dump: %s", s);
+	free(s);
+
+	opts_free(opts);
+	conn_opts_free(conn_opts);
+	tmp_opts_free(tmp_opts);
+
+	// Filters fail to set if their lists cannot be loaded
+	opts = opts_new();
+	conn_opts = conn_opts_new();
+	s = strdup("to list /nonexistent/sslproxy.test.list");
+	rv = filter_rule_set(opts, conn_opts, "Block", s, 0);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	tmp_opts = malloc(sizeof(tmp_opts_t));
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+	opts->filter = filter_set(opts->filter_rules, "sslproxy", tmp_opts);
+	fail_unless(opts->filter == NULL, "set filter with missing list");
+
+	opts_free(opts);
+	conn_opts_free(conn_opts);
+	tmp_opts_free(tmp_opts);
+	unlink(path);
+}
+END_TEST
+
+static uint64_t
+filter_bloom_test_hash(const char *s)
+{
+	uint64_t hash = bloom_hash_init();
+	while (*s)
+		hash = bloom_hash_update(hash, *s++);
+	return hash;
+}
+
+START_TEST(filter_bloom_01)
+{
+	char key[32];
+	size_t fp = 0;
+
+	bloom_t *bloom = bloom_new(10000, 10);
+	fail_unless(bloom != NULL, "cannot create bloom filter");
+	// 10 bits per key rounded up to a power of two blocks
+	fail_unless(bloom_size(bloom) == 16384, "wrong size %zu", bloom_size(bloom));
+
+	for (int i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "www%d.example.com", i);
+		bloom_add(bloom, filter_bloom_test_hash(key));
+	}
+	for (int i = 0; i < 10000; i++) {
+		snprintf(key, sizeof(key), "www%d.example.com", i);
+		fail_unless(bloom_check(bloom, filter_bloom_test_hash(key)), "false negative %s", key);
+	}
+	for (int i = 0; i < 100000; i++) {
+		snprintf(key, sizeof(key), "www%d.example.org", i);
+		fp += bloom_check(bloom, filter_bloom_test_hash(key));
+	}
+	fail_unless(fp < 1000, "false positive rate too high %zu/100000", fp);
+	bloom_free(bloom);
+
+	bloom = bloom_new(1, 500);
+	fail_unless(bloom != NULL, "cannot create bloom filter");
+	fail_unless(bloom_size(bloom) == 64, "wrong min size %zu", bloom_size(bloom));
+	bloom_free(bloom);
+}
+END_TEST
+
+START_TEST(filter_bloom_02)
+{
+	char *s;
+	int rv;
+	opts_t *opts = opts_new();
+	conn_opts_t *conn_opts = conn_opts_new();
+
+	s = strdup("to sni .example.com log connect");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 0);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	s = strdup("to sni www.example.org log content");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 1);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	s = strdup("to sni example* log pcap");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 2);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	s = strdup("to ip 192.168.0.1 log connect");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 3);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	tmp_opts_t *tmp_opts = malloc(sizeof(tmp_opts_t));
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+	opts->filter = filter_set(opts->filter_rules, "sslproxy", tmp_opts);
+	fail_unless(opts->filter != NULL, "failed to set filter");
+
+	filter_list_t *list = opts->filter->all;
+	filter_site_t *site;
+	bloom_stats_t stats = {0, 0};
+
+	fail_unless(list->sni_bloom && list->ip_bloom, "no bloom filters");
+	fail_unless(!list->cn_bloom && !list->host_bloom && !list->uri_bloom, "bloom filters without sites");
+
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "www.example.org", &stats);
+	fail_unless(site && !strcmp(site->site, "www.example.org"), "exact site not matched");
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "Mail.EXAMPLE.com", &stats);
+	fail_unless(site && !strcmp(site->site, ".example.com"), "suffix not matched");
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "example.com.", &stats);
+	fail_unless(site && !strcmp(site->site, ".example.com"), "root dot not matched");
+	fail_unless(stats.checks == 2 && stats.skips == 0, "wrong stats %zu %zu", stats.checks, stats.skips);
+
+	// Skipped lookups still try substring matches
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "example.net", &stats);
+	fail_unless(site && !strcmp(site->site, "example"), "substring not matched");
+	site = filter_site_find(list->sni_bloom, list->sni_hash, list->sni_trie, list->sni_acm, list->lists, list->sni_all, "www.sslproxy.org", &stats);
+	fail_unless(!site, "matched without site");
+	fail_unless(stats.checks == 4 && stats.skips == 2, "wrong skip stats %zu %zu", stats.checks, stats.skips);
+
+	fail_unless(!filter_site_bloom_check(list->sni_bloom, "example.com.evil", 1, NULL), "suffix not at label boundary");
+	fail_unless(filter_site_bloom_check(NULL, "example.com.evil", 1, &stats), "checked without bloom filter");
+	fail_unless(stats.checks == 4, "counted check without bloom filter");
+
+	site = filter_dstip_find(list, "192.168.0.1", &stats);
+	fail_unless(site && !strcmp(site->site, "192.168.0.1"), "dst not matched");
+	fail_unless(!filter_dstip_find(list, "192.168.0.2", &stats), "dst matched");
+	fail_unless(stats.checks == 6 && stats.skips == 3, "wrong dst stats %zu %zu", stats.checks, stats.skips);
+
+	opts_free(opts);
+	conn_opts_free(conn_opts);
+
+	// Bloom filters are disabled with a false positive rate of 0
+	opts = opts_new();
+	conn_opts = conn_opts_new();
+	s = strdup("to sni www.example.org");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 0);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	filter_bloom_fprate_set(0);
+	opts->filter = filter_set(opts->filter_rules, "sslproxy", tmp_opts);
+	filter_bloom_fprate_set(BLOOM_FPRATE);
+	fail_unless(opts->filter != NULL, "failed to set filter");
+	fail_unless(!opts->filter->all->sni_bloom, "bloom filter not disabled");
+
+	opts_free(opts);
+	conn_opts_free(conn_opts);
+	tmp_opts_free(tmp_opts);
+}
+END_TEST
+
+START_TEST(filter_path_01)
+{
+	static const char *patterns[] = {
+		"/admin/", "/admin/public", "/api/v*/upload", "/api/v1/upload", "/", "/a*b*c", "/static/*.js/",
+	};
+	pathtrie_t *trie = pathtrie_new();
+	void **slot;
+	int created;
+
+	fail_unless(!pathtrie_pattern_check("/"), "valid pattern rejected");
+	fail_unless(!pathtrie_pattern_check("/admin/"), "valid pattern rejected");
+	fail_unless(!pathtrie_pattern_check("/api/v*/upload"), "valid pattern rejected");
+	fail_unless(pathtrie_pattern_check("") == -1, "empty pattern accepted");
+	fail_unless(pathtrie_pattern_check("admin/") == -1, "relative pattern accepted");
+	fail_unless(pathtrie_pattern_check("/admin//users") == -1, "empty segment accepted");
+	fail_unless(pathtrie_pattern_check("/admin/../users") == -1, "dot segment accepted");
+	fail_unless(pathtrie_pattern_check("/admin?x=1") == -1, "query accepted");
+
+	for (size_t i = 0; i < sizeof(patterns)/sizeof(patterns[0]); i++) {
+		slot = pathtrie_put(trie, patterns[i], &created);
+		fail_unless(slot && created && !*slot, "failed to put");
+		*slot = (void *)patterns[i];
+	}
+	slot = pathtrie_put(trie, "/admin/public", &created);
+	fail_unless(slot && !created && *slot == patterns[1], "duplicate created");
+	slot = pathtrie_put(trie, "/admin", &created);
+	fail_unless(slot && created && !*slot, "prefix and whole path share slot");
+	*slot = "/admin";
+	fail_unless(trie->count == 8, "wrong count");
+
+	fail_unless(pathtrie_match(trie, "/admin") == *slot, "whole path not first");
+	fail_unless(pathtrie_match(trie, "/admin/users") == patterns[0], "prefix not matched");
+	fail_unless(pathtrie_match(trie, "/admin/public") == patterns[1], "whole path not first");
+	fail_unless(pathtrie_match(trie, "/admin/public/x") == patterns[0], "whole path matched prefix");
+	fail_unless(pathtrie_match(trie, "/administrator") == patterns[4], "matched across segment");
+	fail_unless(pathtrie_match(trie, "/api/v2/upload") == patterns[2], "glob not matched");
+	fail_unless(pathtrie_match(trie, "/api/v1/upload") == patterns[3], "literal not first");
+	fail_unless(pathtrie_match(trie, "/api/v2/upload/x") == patterns[4], "glob not anchored");
+	fail_unless(pathtrie_match(trie, "/api/x2/upload") == patterns[4], "glob matched wrong segment");
+	fail_unless(pathtrie_match(trie, "/aXbYc") == patterns[5], "glob not matched");
+	fail_unless(pathtrie_match(trie, "/abc") == patterns[5], "empty glob not matched");
+	fail_unless(pathtrie_match(trie, "/aXbY") == patterns[4], "glob matched partially");
+	fail_unless(pathtrie_match(trie, "/static/app.js/x") == patterns[6], "glob prefix not matched");
+
+	// Normalization
+	fail_unless(pathtrie_match(trie, "/admin/public?x=1") == patterns[1], "query not dropped");
+	fail_unless(pathtrie_match(trie, "/admin/public#top") == patterns[1], "fragment not dropped");
+	fail_unless(pathtrie_match(trie, "//admin/./public/") == patterns[1], "empty or dot segments not skipped");
+	fail_unless(pathtrie_match(trie, "/public/../admin/x") == patterns[0], "dot dot segment not removed");
+	fail_unless(pathtrie_match(trie, "/../../admin/x") == patterns[0], "dot dot above root not ignored");
+	fail_unless(pathtrie_match(trie, "/%61dmin/public") == patterns[1], "percent-encoding not decoded");
+	fail_unless(pathtrie_match(trie, "/admin%2Fusers") == patterns[4], "encoded slash decoded");
+
+	pathtrie_free(trie, NULL);
+
+	// Deep paths only match prefixes
+	trie = pathtrie_new();
+	slot = pathtrie_put(trie, "/a/", &created);
+	*slot = "/a/";
+	char deep[2 * (PATHTRIE_MAX_SEGMENTS + 1) + 1];
+	for (int i = 0; i < PATHTRIE_MAX_SEGMENTS + 1; i++)
+		memcpy(deep + 2 * i, "/a", 2);
+	deep[sizeof(deep) - 1] = '\0';
+	fail_unless(pathtrie_match(trie, deep) == *slot, "deep path not matched");
+	pathtrie_free(trie, NULL);
+}
+END_TEST
+
+START_TEST(filter_path_02)
+{
+	char *s;
+	int rv;
+	opts_t *opts = opts_new();
+	conn_opts_t *conn_opts = conn_opts_new();
+
+	s = strdup("to host example.com");
+	rv = filter_rule_set(opts, conn_opts, "Pass", s, 0);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	s = strdup("to host example.com path /admin/ log connect");
+	rv = filter_rule_set(opts, conn_opts, "Block", s, 1);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	s = strdup("to host example.com path /admin/public");
+	rv = filter_rule_set(opts, conn_opts, "Pass", s, 2);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	s = strdup("to host .example.org path /api/v*/upload");
+	rv = filter_rule_set(opts, conn_opts, "Block", s, 3);
+	fail_unless(rv == 0, "failed to parse rule");
+	free(s);
+
+	close(2);
+	s = strdup("to sni example.com path /admin/");
+	rv = filter_rule_set(opts, conn_opts, "Block", s, 4);
+	fail_unless(rv == -1, "parsed path with sni");
+	free(s);
+
+	s = strdup("to host example.com path admin/");
+	rv = filter_rule_set(opts, conn_opts, "Block", s, 5);
+	fail_unless(rv == -1, "parsed invalid path");
+	free(s);
+
+	s = strdup("to host example.com path /admin/ port 443");
+	rv = filter_rule_set(opts, conn_opts, "Block", s, 6);
+	fail_unless(rv == -1, "parsed path with port");
+	free(s);
+
+	s = filter_rule_str(opts->filter_rules);
+	fail_unless(strstr(s, "filter rule 1: host=example.com, path=/admin/, dstport=, srcip=, ") != NULL, "path not in rule: %s", s);
+	fail_unless(strstr(s, "filter rule 0: host=example.com, dstport=, srcip=, ") != NULL, "path in rule without path: %s", s);
+	free(s);
+
+	tmp_opts_t *tmp_opts = malloc(sizeof(tmp_opts_t));
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+	opts->filter = filter_set(opts->filter_rules, "sslproxy", tmp_opts);
+	fail_unless(opts->filter != NULL, "failed to set filter");
+
+	filter_list_t *list = opts->filter->all;
+	filter_site_t *site;
+	filter_path_t *path;
+
+	site = filter_site_exact_match(list->host_hash, "example.com");
+	fail_unless(site && site->action.pass && site->path_trie, "host not added");
+
+	path = filter_path_find(site, "/admin/users?id=1");
+	fail_unless(path && !strcmp(path->path, "/admin/") && path->action.block && path->action.precedence == 3, "prefix not matched");
+	path = filter_path_find(site, "/admin/public");
+	fail_unless(path && !strcmp(path->path, "/admin/public") && path->action.pass, "whole path not first");
+	path = filter_path_find(site, "http://example.com/admin/users");
+	fail_unless(path && !strcmp(path->path, "/admin/"), "absolute url not matched");
+	path = filter_path_find(site, "http://example.com");
+	fail_unless(!path, "matched absolute url without path");
+	path = filter_path_find(site, "/public/../admin");
+	fail_unless(path && !strcmp(path->path, "/admin/"), "dot dot segment not removed");
+	path = filter_path_find(site, "/index.html");
+	fail_unless(!path, "matched other path");
+
+	site = filter_site_suffix_match(list->host_trie, "www.example.org");
+	fail_unless(site && site->path_trie && !site->action.block, "suffix host not added");
+	path = filter_path_find(site, "/api/v2/upload");
+	fail_unless(path && path->action.block, "glob not matched");
+	path = filter_path_find(site, "/api/v2/upload/x");
+	fail_unless(!path, "glob not anchored");
+
+	s = filter_str(opts->filter);
+	fail_unless(strstr(s, "      0: example.com (exact, action=||pass||, log=|||||, precedence=1)\n"
+"        path:\n"
+"          0: /admin/ (prefix, action=|||block|, log=connect|||||, precedence=3)\n"
+"          1: /admin/public (exact, action=||pass||, log=|||||, precedence=2)") != NULL, "paths not in dump: %s", s);
+	fail_unless(strstr(s, "          0: /api/v*/upload (glob, action=|||block|, log=|||||, precedence=2)") != NULL, "glob not in dump: %s", s);
+	free(s);
+
+	opts_free(opts);
+	conn_opts_free(conn_opts);
+	tmp_opts_free(tmp_opts);
+}
+END_TEST
+
 Suite *
 filter_suite(void)
 {
@@ -3193,6 +4081,38 @@ filter_suite(void)
 #endif /* !WITHOUT_USERAUTH */
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("filter_match");
+	tcase_add_test(tc, filter_match_01);
+	tcase_add_test(tc, filter_match_02);
+	tcase_add_test(tc, filter_match_03);
+	tcase_add_test(tc, filter_match_04);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("filter_cidr");
+	tcase_add_test(tc, filter_cidr_01);
+	tcase_add_test(tc, filter_cidr_02);
+	tcase_add_test(tc, filter_cidr_03);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("filter_suffix");
+	tcase_add_test(tc, filter_suffix_01);
+	tcase_add_test(tc, filter_suffix_02);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("filter_list");
+	tcase_add_test(tc, filter_list_01);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("filter_bloom");
+	tcase_add_test(tc, filter_bloom_01);
+	tcase_add_test(tc, filter_bloom_02);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("filter_path");
+	tcase_add_test(tc, filter_path_01);
+	tcase_add_test(tc, filter_path_02);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
 
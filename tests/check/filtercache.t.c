@@ -0,0 +1,130 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "filtercache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+static int values[4];
+
+START_TEST(filter_cache_01)
+{
+	filtercache_t *cache = filtercache_new(4);
+	void *value;
+
+	fail_unless(!!cache, "failed to create cache");
+	fail_unless(!filtercache_get(cache, 1, "a", &value), "empty cache hit");
+
+	fail_unless(!filtercache_set(cache, 1, "a", &values[0]), "failed to set");
+	fail_unless(!filtercache_set(cache, 1, "b", NULL), "failed to set");
+	fail_unless(filtercache_get(cache, 1, "a", &value) && value == &values[0], "wrong value");
+	// No match is a cached decision too
+	value = &values[1];
+	fail_unless(filtercache_get(cache, 1, "b", &value) && !value, "null value not cached");
+
+	fail_unless(!filtercache_set(cache, 1, "a", &values[2]), "failed to replace");
+	fail_unless(filtercache_get(cache, 1, "a", &value) && value == &values[2], "value not replaced");
+	fail_unless(filtercache_count(cache) == 2, "wrong count");
+
+	filtercache_free(cache);
+}
+END_TEST
+
+START_TEST(filter_cache_02)
+{
+	filtercache_t *cache = filtercache_new(3);
+	void *value;
+
+	fail_unless(!filtercache_set(cache, 1, "a", &values[0]), "failed to set");
+	fail_unless(!filtercache_set(cache, 1, "b", &values[1]), "failed to set");
+	fail_unless(!filtercache_set(cache, 1, "c", &values[2]), "failed to set");
+	// Use a, so that b is the least recently used
+	fail_unless(filtercache_get(cache, 1, "a", &value), "a not cached");
+	fail_unless(!filtercache_set(cache, 1, "d", &values[3]), "failed to set");
+
+	fail_unless(filtercache_count(cache) == 3, "cache grew beyond its size");
+	fail_unless(!filtercache_get(cache, 1, "b", &value), "lru entry not evicted");
+	fail_unless(filtercache_get(cache, 1, "a", &value) && value == &values[0], "a evicted");
+	fail_unless(filtercache_get(cache, 1, "c", &value) && value == &values[2], "c evicted");
+	fail_unless(filtercache_get(cache, 1, "d", &value) && value == &values[3], "d not cached");
+
+	filtercache_free(cache);
+}
+END_TEST
+
+START_TEST(filter_cache_03)
+{
+	filtercache_t *cache = filtercache_new(FILTERCACHE_SIZE);
+	char key[16];
+	void *value;
+
+	fail_unless(!filtercache_set(cache, 1, "a", &values[0]), "failed to set");
+	// A new filter generation empties the cache
+	fail_unless(!filtercache_get(cache, 2, "a", &value), "old generation hit");
+	fail_unless(filtercache_count(cache) == 0, "cache not emptied");
+	fail_unless(!filtercache_set(cache, 2, "a", &values[1]), "failed to set");
+	fail_unless(!filtercache_get(cache, 1, "a", &value), "new generation hit");
+
+	for (int i = 0; i < 2 * FILTERCACHE_SIZE; i++) {
+		snprintf(key, sizeof(key), "%d", i);
+		fail_unless(!filtercache_set(cache, 3, key, &values[i % 4]), "failed to set");
+	}
+	fail_unless(filtercache_count(cache) == FILTERCACHE_SIZE, "wrong count");
+	for (int i = 0; i < 2 * FILTERCACHE_SIZE; i++) {
+		snprintf(key, sizeof(key), "%d", i);
+		if (i < FILTERCACHE_SIZE)
+			fail_unless(!filtercache_get(cache, 3, key, &value), "evicted entry hit");
+		else
+			fail_unless(filtercache_get(cache, 3, key, &value) && value == &values[i % 4], "entry missing");
+	}
+
+	filtercache_free(cache);
+}
+END_TEST
+
+Suite *
+filtercache_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("filtercache");
+
+	tc = tcase_create("filter_cache");
+	tcase_add_test(tc, filter_cache_01);
+	tcase_add_test(tc, filter_cache_02);
+	tcase_add_test(tc, filter_cache_03);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+/* vim: set noet ft=c: */
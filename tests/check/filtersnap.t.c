@@ -0,0 +1,220 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "attrib.h"
+#include "opts.h"
+#include "filter.h"
+#include "filtersnap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+static opts_t *
+filtersnap_rules(void)
+{
+	opts_t *opts = opts_new();
+	conn_opts_t *conn_opts = conn_opts_new();
+	char *s;
+	UNUSED int rv;
+
+	s = strdup("$ips 192.168.0.1 192.168.0.2");
+	rv = filter_macro_set(opts, s, 0);
+	free(s);
+	s = strdup("from ip $ips to sni example.com log connect");
+	rv = filter_rule_set(opts, conn_opts, "Pass", s, 1);
+	free(s);
+	s = strdup("to host .example.net port 80");
+	rv = filter_rule_set(opts, conn_opts, "Block", s, 2);
+	free(s);
+	s = strdup("to ip 10.0.0.0/8 log !pcap");
+	rv = filter_rule_set(opts, conn_opts, "Match", s, 3);
+	free(s);
+	s = strdup("*");
+	rv = filter_rule_set(opts, conn_opts, "Divert", s, 4);
+	free(s);
+	s = strdup("example.org");
+	rv = filter_passsite_set(opts, conn_opts, s, 5);
+	free(s);
+
+	conn_opts_free(conn_opts);
+	return opts;
+}
+
+static void
+filtersnap_tmpfile(char *path)
+{
+	int fd = mkstemp(path);
+	fail_unless(fd != -1, "cannot create snapshot file");
+	close(fd);
+}
+
+START_TEST(filter_snapshot_01)
+{
+	char path[] = "/tmp/sslproxy.test.snap.XXXXXX";
+	opts_t *opts = filtersnap_rules();
+	opts_t *snap = opts_new();
+
+	filtersnap_tmpfile(path);
+	fail_unless(filtersnap_write(opts->filter_rules, path) == 0, "failed to write snapshot");
+	fail_unless(filtersnap_load(snap, path, 0) == 0, "failed to load snapshot");
+	unlink(path);
+
+	char *rs = filter_rule_str(opts->filter_rules);
+	char *ss = filter_rule_str(snap->filter_rules);
+	fail_unless(!strcmp(rs, ss), "snapshot rules differ: %s", ss);
+	free(rs);
+	free(ss);
+
+	filter_t *rf = filter_set(opts->filter_rules, "sslproxy", NULL);
+	filter_t *sf = filter_set(snap->filter_rules, "sslproxy", NULL);
+	fail_unless(rf && sf, "failed to set filters");
+	rs = filter_str(rf);
+	ss = filter_str(sf);
+	fail_unless(!strcmp(rs, ss), "snapshot filter differs: %s", ss);
+	free(rs);
+	free(ss);
+	filter_release(rf);
+	filter_release(sf);
+
+	filter_macro_free(opts);
+	filter_rules_free(opts);
+	opts_free(opts);
+	filter_rules_free(snap);
+	opts_free(snap);
+}
+END_TEST
+
+START_TEST(filter_snapshot_02)
+{
+	char path[] = "/tmp/sslproxy.test.snap.XXXXXX";
+	opts_t *opts = filtersnap_rules();
+	opts_t *snap = opts_new();
+	conn_opts_t *conn_opts = conn_opts_new();
+	UNUSED int rv;
+
+	filtersnap_tmpfile(path);
+	fail_unless(filtersnap_write(opts->filter_rules, path) == 0, "failed to write snapshot");
+
+	// Rules in the snapshot are appended to the rules defined earlier
+	char *s = strdup("to sni example.com");
+	rv = filter_rule_set(snap, conn_opts, "Split", s, 0);
+	free(s);
+	filter_rule_t *first = snap->filter_rules;
+	fail_unless(filtersnap_load(snap, path, 0) == 0, "failed to load snapshot");
+	unlink(path);
+
+	fail_unless(snap->filter_rules == first, "first rule replaced");
+	fail_unless(first->action.split, "first rule not split");
+	fail_unless(first->next && first->next->action.pass, "snapshot rules not appended");
+
+	filter_macro_free(opts);
+	filter_rules_free(opts);
+	opts_free(opts);
+	filter_rules_free(snap);
+	opts_free(snap);
+	conn_opts_free(conn_opts);
+}
+END_TEST
+
+START_TEST(filter_snapshot_03)
+{
+	char path[] = "/tmp/sslproxy.test.snap.XXXXXX";
+	opts_t *opts = filtersnap_rules();
+	opts_t *snap = opts_new();
+	FILE *f;
+
+	filtersnap_tmpfile(path);
+	fail_unless(filtersnap_write(opts->filter_rules, path) == 0, "failed to write snapshot");
+
+	// Flip a byte in the string table
+	f = fopen(path, "r+");
+	fail_unless(fseek(f, -2, SEEK_END) == 0, "cannot seek");
+	fputc('X', f);
+	fclose(f);
+	fail_unless(filtersnap_load(snap, path, 0) == -1, "corrupt snapshot loaded");
+	fail_unless(!snap->filter_rules, "rules of corrupt snapshot loaded");
+
+	fail_unless(truncate(path, 60) == 0, "cannot truncate");
+	fail_unless(filtersnap_load(snap, path, 0) == -1, "truncated snapshot loaded");
+
+	f = fopen(path, "w");
+	fputs("Pass to sni example.com\n", f);
+	fclose(f);
+	fail_unless(filtersnap_load(snap, path, 0) == -1, "text file loaded");
+
+	unlink(path);
+	fail_unless(filtersnap_load(snap, path, 0) == -1, "missing snapshot loaded");
+	fail_unless(!snap->filter_rules, "rules loaded");
+
+	filter_macro_free(opts);
+	filter_rules_free(opts);
+	opts_free(opts);
+	opts_free(snap);
+}
+END_TEST
+
+START_TEST(filter_snapshot_04)
+{
+	char path[] = "/tmp/sslproxy.test.snap.XXXXXX";
+	opts_t *opts = filtersnap_rules();
+
+	// Conn options of struct filtering rules cannot be compiled
+	opts->filter_rules->action.conn_opts = conn_opts_new();
+	filtersnap_tmpfile(path);
+	fail_unless(filtersnap_write(opts->filter_rules, path) == -1, "conn options compiled");
+	unlink(path);
+
+	filter_macro_free(opts);
+	filter_rules_free(opts);
+	opts_free(opts);
+}
+END_TEST
+
+Suite *
+filtersnap_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("filtersnap");
+
+	tc = tcase_create("filter_snapshot");
+	tcase_add_test(tc, filter_snapshot_01);
+	tcase_add_test(tc, filter_snapshot_02);
+	tcase_add_test(tc, filter_snapshot_03);
+	tcase_add_test(tc, filter_snapshot_04);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+/* vim: set noet ft=c: */
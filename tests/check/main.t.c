@@ -76,6 +76,10 @@ Suite * cachefkcrt_suite(void);
 Suite * cachetgcrt_suite(void);
 Suite * cachedsess_suite(void);
 Suite * cachessess_suite(void);
+Suite * cachevrfy_suite(void);
+Suite * filtercache_suite(void);
+Suite * filtersnap_suite(void);
+Suite * extlist_suite(void);
 Suite * ssl_suite(void);
 Suite * sys_suite(void);
 Suite * base64_suite(void);
@@ -84,6 +88,7 @@ Suite * util_suite(void);
 Suite * pxythrmgr_suite(void);
 Suite * defaults_suite(void);
 Suite * proto_suite(void);
+Suite * pxydns_suite(void);
 
 int
 main(UNUSED int argc, UNUSED char *argv[])
@@ -104,6 +109,10 @@ main(UNUSED int argc, UNUSED char *argv[])
 	srunner_add_suite(sr, cachetgcrt_suite());
 	srunner_add_suite(sr, cachedsess_suite());
 	srunner_add_suite(sr, cachessess_suite());
+	srunner_add_suite(sr, cachevrfy_suite());
+	srunner_add_suite(sr, filtercache_suite());
+	srunner_add_suite(sr, filtersnap_suite());
+	srunner_add_suite(sr, extlist_suite());
 	srunner_add_suite(sr, ssl_suite());
 	srunner_add_suite(sr, sys_suite());
 	srunner_add_suite(sr, base64_suite());
@@ -112,6 +121,7 @@ main(UNUSED int argc, UNUSED char *argv[])
 	srunner_add_suite(sr, pxythrmgr_suite());
 	srunner_add_suite(sr, defaults_suite());
 	srunner_add_suite(sr, proto_suite());
+	srunner_add_suite(sr, pxydns_suite());
 	srunner_run_all(sr, CK_NORMAL);
 	nfail = srunner_ntests_failed(sr);
 	srunner_free(sr);
@@ -36,6 +36,8 @@
 #include <string.h>
 #include <unistd.h>
 #include <netinet/in.h>
+#include <sys/un.h>
+#include <pthread.h>
 
 static char *argv01[] = {
 	"https", "127.0.0.1", "10443", "up:8080", "127.0.0.2", "443"
@@ -87,6 +89,9 @@ static char *argv14[] = {
 	"https", "127.0.0.1", "10443", "up:8080",
 	"autossl", "127.0.0.1", "10025", "up:9199", "127.0.0.2", "25"
 };
+static char *argv15[] = {
+	"https", "127.0.0.1", "10443", "up:0", "ua:unix:/tmp/lp.sock", "ra:unix:/tmp/sslproxy.ret", "127.0.0.2", "443"
+};
 
 #ifdef __linux__
 #define NATENGINE "netfilter"
@@ -584,6 +589,35 @@ START_TEST(proxyspec_parse_13)
 }
 END_TEST
 
+START_TEST(proxyspec_parse_14)
+{
+	global_t *global = global_new();
+	proxyspec_t *spec = NULL;
+	int argc = 8;
+	char **argv = argv15;
+
+	tmp_opts_t *tmp_opts = malloc(sizeof(tmp_opts_t));
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+
+	UNUSED int rv = proxyspec_parse(&argc, &argv, NATENGINE, global, "sslproxy", tmp_opts);
+	spec = global->spec;
+	fail_unless(!!spec, "failed to parse spec");
+	fail_unless(spec->divert_addr.ss_family == AF_UNIX,
+	            "not unix divert addr");
+	fail_unless(!strcmp(((struct sockaddr_un *)&spec->divert_addr)->sun_path, "/tmp/lp.sock"),
+	            "wrong divert path");
+	fail_unless(spec->return_addr.ss_family == AF_UNIX,
+	            "not unix return addr");
+	fail_unless(!strcmp(((struct sockaddr_un *)&spec->return_addr)->sun_path, "/tmp/sslproxy.ret"),
+	            "wrong return path");
+	fail_unless(spec->connect_addrlen == sizeof(struct sockaddr_in),
+	            "not IPv4 connect addr");
+	fail_unless(spec->opts->divert, "not divert");
+	global_free(global);
+	tmp_opts_free(tmp_opts);
+}
+END_TEST
+
 START_TEST(proxyspec_set_proto_01)
 {
 	global_t *global = global_new();
@@ -724,6 +758,9 @@ START_TEST(proxyspec_struct_parse_01)
 #endif /* !WITHOUT_USERAUTH */
 		"ValidateProto yes\n"
 		"MaxHTTPHeaderSize 2048\n"
+		"OutbufLimit 262144\n"
+		"AdaptiveOutbufLimit yes\n"
+		"DynamicRecordSizing yes\n"
 		"\n"
 		"PassSite example4.com\n"
 		"\n"
@@ -779,6 +816,9 @@ START_TEST(proxyspec_struct_parse_01)
 #endif /* !WITHOUT_USERAUTH */
 			"ValidateProto no\n"
 			"MaxHTTPHeaderSize 2048\n"
+			"OutbufLimit 65536\n"
+			"AdaptiveOutbufLimit no\n"
+			"DynamicRecordSizing no\n"
 			"}\n"
 		"}";
 	f = fmemopen(s, strlen(s), "r");
@@ -801,7 +841,7 @@ START_TEST(proxyspec_struct_parse_01)
 "sni 4444\n"
 "divert addr= [127.0.0.1]:8080\n"
 "return addr= [192.168.2.1]:0\n"
-"opts= conn opts: "SSL_PROTO_CONFIG_PROXYSPEC"|deny_ocsp|MEDIUM:HIGH|TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256|"ECDH_PRIME1"http://example2.com/example2.crl|remove_http_accept_encoding|remove_http_referer|verify_peer|user_auth|https://192.168.0.13/userdblogin3.php|300|validate_proto|2048\n"
+"opts= conn opts: "SSL_PROTO_CONFIG_PROXYSPEC"|deny_ocsp|MEDIUM:HIGH|TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256|"ECDH_PRIME1"http://example2.com/example2.crl|remove_http_accept_encoding|remove_http_referer|verify_peer|user_auth|https://192.168.0.13/userdblogin3.php|300|validate_proto|2048|262144|adaptive_outbuf_limit|dynamic_record_sizing\n"
 "divert|daemon,root|daemon,root\n"
 "macro $ip = 127.0.0.1\n"
 "filter rule 0: sni=example4.com, dstport=, srcip=, user=, desc=, exact=site||||, all=conns|||, action=||pass||, log=|||||, precedence=1\n"
@@ -812,7 +852,7 @@ START_TEST(proxyspec_struct_parse_01)
 "filter rule 4: dstip=127.0.0.1, dstport=9191, srcip=127.0.0.1, user=, desc=, exact=site|port|ip||, all=|||, action=|split|||, log=|||content||, precedence=4\n"
 "filter rule 5: dstip=127.0.0.1, dstport=9191, srcip=127.0.0.1, user=, desc=, exact=site|port|ip||, all=|||, action=divert||||, log=|||content||, precedence=4\n"
 "filter rule 6: dstip=192.168.0.2, dstport=, srcip=192.168.0.1, user=, desc=, exact=site||ip||, all=|||, action=||||match, log=connect|||||, precedence=3\n"
-"  conn opts: "SSL_PROTO_CONFIG_FILTERRULE"|passthrough|LOW|TLS_AES_128_CCM_SHA256|"ECDH_PRIME2"http://example1.com/example1.crl|allow_wrong_host|https://192.168.0.12/userdblogin1.php|1200|reconnect_ssl|2048\n"
+"  conn opts: "SSL_PROTO_CONFIG_FILTERRULE"|passthrough|LOW|TLS_AES_128_CCM_SHA256|"ECDH_PRIME2"http://example1.com/example1.crl|allow_wrong_host|https://192.168.0.12/userdblogin1.php|1200|reconnect_ssl|2048|65536\n"
 "filter=>\n"
 "userdesc_filter_exact->\n"
 "userdesc_filter_substring->\n"
@@ -830,7 +870,7 @@ START_TEST(proxyspec_struct_parse_01)
 "  ip 1 192.168.0.1 (exact)=\n"
 "    ip exact:\n"
 "      0: 192.168.0.2 (exact, action=||||match, log=connect|||||, precedence=3\n"
-"        conn opts: "SSL_PROTO_CONFIG_FILTERRULE"|passthrough|LOW|TLS_AES_128_CCM_SHA256|"ECDH_PRIME2"no leafcrlurl|allow_wrong_host|https://192.168.0.12/userdblogin1.php|1200|reconnect_ssl|2048)\n"
+"        conn opts: "SSL_PROTO_CONFIG_FILTERRULE"|passthrough|LOW|TLS_AES_128_CCM_SHA256|"ECDH_PRIME2"no leafcrlurl|allow_wrong_host|https://192.168.0.12/userdblogin1.php|1200|reconnect_ssl|2048|65536)\n"
 "ip_filter_substring->\n"
 "filter_all->\n"
 "    sni exact:\n"
@@ -844,7 +884,7 @@ START_TEST(proxyspec_struct_parse_01)
 "sni 4444\n"
 "divert addr= [127.0.0.1]:8080\n"
 "return addr= [192.168.2.1]:0\n"
-"opts= conn opts: "SSL_PROTO_CONFIG_PROXYSPEC"|deny_ocsp|MEDIUM:HIGH|TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256|"ECDH_PRIME1"http://example2.com/example2.crl|remove_http_accept_encoding|remove_http_referer|verify_peer|validate_proto|2048\n"
+"opts= conn opts: "SSL_PROTO_CONFIG_PROXYSPEC"|deny_ocsp|MEDIUM:HIGH|TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256|"ECDH_PRIME1"http://example2.com/example2.crl|remove_http_accept_encoding|remove_http_referer|verify_peer|validate_proto|2048|262144|adaptive_outbuf_limit|dynamic_record_sizing\n"
 "divert\n"
 "macro $ip = 127.0.0.1\n"
 "filter rule 0: sni=example4.com, dstport=, srcip=, exact=site||, all=conns||, action=||pass||, log=|||||, precedence=1\n"
@@ -855,7 +895,7 @@ START_TEST(proxyspec_struct_parse_01)
 "filter rule 4: dstip=127.0.0.1, dstport=9191, srcip=127.0.0.1, exact=site|port|ip, all=||, action=|split|||, log=|||content||, precedence=4\n"
 "filter rule 5: dstip=127.0.0.1, dstport=9191, srcip=127.0.0.1, exact=site|port|ip, all=||, action=divert||||, log=|||content||, precedence=4\n"
 "filter rule 6: dstip=192.168.0.2, dstport=, srcip=192.168.0.1, exact=site||ip, all=||, action=||||match, log=connect|||||, precedence=3\n"
-"  conn opts: "SSL_PROTO_CONFIG_FILTERRULE"|passthrough|LOW|TLS_AES_128_CCM_SHA256|"ECDH_PRIME2"http://example1.com/example1.crl|allow_wrong_host|reconnect_ssl|2048\n"
+"  conn opts: "SSL_PROTO_CONFIG_FILTERRULE"|passthrough|LOW|TLS_AES_128_CCM_SHA256|"ECDH_PRIME2"http://example1.com/example1.crl|allow_wrong_host|reconnect_ssl|2048|65536\n"
 "filter=>\n"
 "ip_filter_exact->\n"
 "  ip 0 127.0.0.1 (exact)=\n"
@@ -866,7 +906,7 @@ START_TEST(proxyspec_struct_parse_01)
 "  ip 1 192.168.0.1 (exact)=\n"
 "    ip exact:\n"
 "      0: 192.168.0.2 (exact, action=||||match, log=connect|||||, precedence=3\n"
-"        conn opts: "SSL_PROTO_CONFIG_FILTERRULE"|passthrough|LOW|TLS_AES_128_CCM_SHA256|"ECDH_PRIME2"no leafcrlurl|allow_wrong_host|reconnect_ssl|2048)\n"
+"        conn opts: "SSL_PROTO_CONFIG_FILTERRULE"|passthrough|LOW|TLS_AES_128_CCM_SHA256|"ECDH_PRIME2"no leafcrlurl|allow_wrong_host|reconnect_ssl|2048|65536)\n"
 "ip_filter_substring->\n"
 "filter_all->\n"
 "    sni exact:\n"
@@ -1282,6 +1322,252 @@ START_TEST(opts_get_name_value_01)
 }
 END_TEST
 
+static void
+reload_write_conffile(const char *path, const char *conf)
+{
+	FILE *f = fopen(path, "w");
+	fail_unless(!!f, "cannot open conf file");
+	fputs(conf, f);
+	fclose(f);
+}
+
+/*
+ * Load the conf file given with -f and set the filters of proxyspecs as
+ * main() does.
+ */
+static global_t *
+reload_load_conffile(const char *path)
+{
+	global_t *global = global_new();
+	char *natengine = NULL;
+	tmp_opts_t *tmp_opts = malloc(sizeof(tmp_opts_t));
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+
+	UNUSED int rv = global_set_cli_option(global, "sslproxy", 'f', path, &natengine, tmp_opts);
+	fail_unless(rv == 0, "failed to load conf file");
+	for (proxyspec_t *spec = global->spec; spec; spec = spec->next) {
+		spec->opts->filter = filter_set(spec->opts->filter_rules, "sslproxy", tmp_opts);
+		fail_unless(!!spec->opts->filter, "failed to set filter");
+		filter_macro_free(spec->opts);
+		filter_rules_free(spec->opts);
+	}
+	filter_macro_free(global->opts);
+	filter_rules_free(global->opts);
+	tmp_opts_free(tmp_opts);
+	return global;
+}
+
+static int
+reload_filter_has(filter_t *filter, const char *site)
+{
+	char *fs = filter_str(filter);
+	int found = fs && strstr(fs, site);
+	free(fs);
+	return found;
+}
+
+#define RELOAD_CONF1 "Block to ip 10.0.0.1\nProxySpec tcp 127.0.0.1 10001 127.0.0.2 80\n"
+#define RELOAD_CONF2 "Block to ip 10.0.0.2\nProxySpec tcp 127.0.0.1 10001 127.0.0.2 80\n"
+
+START_TEST(global_reload_filters_01)
+{
+	char path[] = "/tmp/sslproxy.test.conf.XXXXXX";
+	int fd = mkstemp(path);
+	fail_unless(fd != -1, "cannot create conf file");
+	close(fd);
+
+	reload_write_conffile(path, RELOAD_CONF1);
+	global_t *global = reload_load_conffile(path);
+
+	// Simulate a conn created before reload
+	filter_t *conn_filter = filter_acquire(global->spec->opts);
+	fail_unless(conn_filter == global->spec->opts->filter, "conn filter not spec filter");
+	fail_unless(conn_filter->refcount == 2, "wrong refcount before reload");
+
+	reload_write_conffile(path, RELOAD_CONF2);
+	fail_unless(global_reload_filters(global, "sslproxy") == 0, "reload failed");
+	fail_unless(global->spec->opts->filter != conn_filter, "filter not replaced");
+	fail_unless(global->spec->opts->filter->refcount == 1, "wrong refcount of new filter");
+	fail_unless(conn_filter->refcount == 1, "wrong refcount of old filter");
+	fail_unless(reload_filter_has(conn_filter, "10.0.0.1"), "conn filter changed");
+	fail_unless(reload_filter_has(global->spec->opts->filter, "10.0.0.2"), "rule not reloaded");
+	filter_release(conn_filter);
+
+	unlink(path);
+	global_free(global);
+}
+END_TEST
+
+START_TEST(global_reload_filters_02)
+{
+	char path[] = "/tmp/sslproxy.test.conf.XXXXXX";
+	int fd = mkstemp(path);
+	fail_unless(fd != -1, "cannot create conf file");
+	close(fd);
+
+	reload_write_conffile(path, RELOAD_CONF1);
+	global_t *global = reload_load_conffile(path);
+	filter_t *filter = global->spec->opts->filter;
+
+	// Errors must not disturb the running filter
+	reload_write_conffile(path, "Block to ip\nProxySpec tcp 127.0.0.1 10001 127.0.0.2 80\n");
+	fail_unless(global_reload_filters(global, "sslproxy") == -1, "invalid rule reloaded");
+	fail_unless(global->spec->opts->filter == filter, "filter replaced on invalid rule");
+
+	reload_write_conffile(path, "Block to ip 10.0.0.2\nProxySpec tcp 127.0.0.1 10002 127.0.0.2 80\n");
+	fail_unless(global_reload_filters(global, "sslproxy") == -1, "changed proxyspec reloaded");
+	fail_unless(global->spec->opts->filter == filter, "filter replaced on changed proxyspec");
+
+	unlink(path);
+	fail_unless(global_reload_filters(global, "sslproxy") == -1, "missing conf file reloaded");
+	fail_unless(global->spec->opts->filter == filter, "filter replaced on missing conf file");
+	fail_unless(filter->refcount == 1, "wrong refcount");
+	fail_unless(reload_filter_has(filter, "10.0.0.1"), "filter changed");
+
+	global_free(global);
+}
+END_TEST
+
+static void
+reload_copy_file(const char *src, const char *dst)
+{
+	char buf[4096];
+	size_t n;
+	FILE *in = fopen(src, "r");
+	FILE *out = fopen(dst, "w");
+	fail_unless(in && out, "cannot copy file");
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		fail_unless(fwrite(buf, 1, n, out) == n, "cannot write file");
+	}
+	fclose(in);
+	fclose(out);
+}
+
+START_TEST(global_reload_filters_04)
+{
+	char path[] = "/tmp/sslproxy.test.conf.XXXXXX";
+	char keypath[] = "/tmp/sslproxy.test.key.XXXXXX";
+	char *natengine = NULL;
+	int fd = mkstemp(path);
+	fail_unless(fd != -1, "cannot create conf file");
+	close(fd);
+	fd = mkstemp(keypath);
+	fail_unless(fd != -1, "cannot create key file");
+	close(fd);
+	reload_copy_file("../testproxy/ca.key", keypath);
+
+	// Global options and key files are not loaded again on reload
+	reload_write_conffile(path, "LeafKeyRSABits 2048\nBlock to ip 10.0.0.1\n"
+		"ProxySpec https 127.0.0.1 10443 127.0.0.2 443\n");
+
+	global_t *global = global_new();
+	tmp_opts_t *tmp_opts = malloc(sizeof(tmp_opts_t));
+	memset(tmp_opts, 0, sizeof(tmp_opts_t));
+	UNUSED int rv = global_set_cli_option(global, "sslproxy", 'c', "../testproxy/ca.crt", &natengine, tmp_opts);
+	fail_unless(rv == 0, "failed to set CA cert");
+	rv = global_set_cli_option(global, "sslproxy", 'k', keypath, &natengine, tmp_opts);
+	fail_unless(rv == 0, "failed to set CA key");
+	rv = global_set_cli_option(global, "sslproxy", 'o', "Block to ip 10.0.0.3", &natengine, tmp_opts);
+	fail_unless(rv == 0, "failed to set option");
+	fail_unless(global_set_cli_option(global, "sslproxy", 'K', keypath, &natengine, tmp_opts) == 1, "global option recorded");
+	rv = global_set_cli_option(global, "sslproxy", 'f', path, &natengine, tmp_opts);
+	fail_unless(rv == 0, "failed to load conf file");
+	char *specv[] = {"tcp", "127.0.0.1", "10080", "127.0.0.2", "80"};
+	rv = global_set_cli_proxyspecs(global, "sslproxy", 5, specv, natengine, tmp_opts);
+	fail_unless(rv == 0, "failed to parse proxyspecs");
+	for (proxyspec_t *spec = global->spec; spec; spec = spec->next) {
+		spec->opts->filter = filter_set(spec->opts->filter_rules, "sslproxy", tmp_opts);
+		fail_unless(!!spec->opts->filter, "failed to set filter");
+		filter_macro_free(spec->opts);
+		filter_rules_free(spec->opts);
+	}
+	filter_macro_free(global->opts);
+	filter_rules_free(global->opts);
+	tmp_opts_free(tmp_opts);
+
+	unlink(keypath);
+	reload_write_conffile(path, "LeafKeyRSABits 2048\nBlock to ip 10.0.0.2\n"
+		"ProxySpec https 127.0.0.1 10443 127.0.0.2 443\n");
+	fail_unless(global_reload_filters(global, "sslproxy") == 0, "reload failed");
+
+	// The command line proxyspec is the first one
+	fail_unless(global->spec->listen_addrlen && !global->spec->ssl, "not cli proxyspec");
+	fail_unless(reload_filter_has(global->spec->opts->filter, "10.0.0.3"), "cli option lost");
+	fail_unless(reload_filter_has(global->spec->next->opts->filter, "10.0.0.2"), "rule not reloaded");
+	fail_unless(reload_filter_has(global->spec->next->opts->filter, "10.0.0.3"), "cli option lost");
+	fail_unless(!reload_filter_has(global->spec->next->opts->filter, "10.0.0.1"), "old rule kept");
+
+	unlink(path);
+	global_free(global);
+}
+END_TEST
+
+typedef struct reload_load {
+	opts_t *opts;
+	volatile int stop;
+	int conns;
+	int errors;
+} reload_load_t;
+
+/*
+ * Load generator: create and free conns using the filter of opts.
+ */
+static void *
+reload_load_thr(void *arg)
+{
+	reload_load_t *load = arg;
+
+	while (!load->stop) {
+		filter_t *filter = filter_acquire(load->opts);
+		if (!filter || !(reload_filter_has(filter, "10.0.0.1") ^ reload_filter_has(filter, "10.0.0.2")))
+			load->errors++;
+		filter_release(filter);
+		load->conns++;
+	}
+	return NULL;
+}
+
+#define RELOAD_LOAD_THRS 4
+
+START_TEST(global_reload_filters_03)
+{
+	char path[] = "/tmp/sslproxy.test.conf.XXXXXX";
+	pthread_t thrs[RELOAD_LOAD_THRS];
+	reload_load_t loads[RELOAD_LOAD_THRS];
+	int fd = mkstemp(path);
+	fail_unless(fd != -1, "cannot create conf file");
+	close(fd);
+
+	reload_write_conffile(path, RELOAD_CONF1);
+	global_t *global = reload_load_conffile(path);
+
+	for (int i = 0; i < RELOAD_LOAD_THRS; i++) {
+		memset(&loads[i], 0, sizeof(reload_load_t));
+		loads[i].opts = global->spec->opts;
+		fail_unless(!pthread_create(&thrs[i], NULL, reload_load_thr, &loads[i]), "cannot create thr");
+	}
+
+	for (int i = 0; i < 100; i++) {
+		reload_write_conffile(path, i % 2 ? RELOAD_CONF1 : RELOAD_CONF2);
+		fail_unless(global_reload_filters(global, "sslproxy") == 0, "reload failed");
+	}
+
+	int conns = 0;
+	for (int i = 0; i < RELOAD_LOAD_THRS; i++) {
+		loads[i].stop = 1;
+		pthread_join(thrs[i], NULL);
+		fail_unless(loads[i].errors == 0, "conn saw an invalid filter");
+		conns += loads[i].conns;
+	}
+	fail_unless(conns > 0, "no conns during reload");
+	fail_unless(global->spec->opts->filter->refcount == 1, "filter reference leaked");
+	fail_unless(reload_filter_has(global->spec->opts->filter, "10.0.0.1"), "last reload not published");
+
+	unlink(path);
+	global_free(global);
+}
+END_TEST
+
 Suite *
 opts_suite(void)
 {
@@ -1307,6 +1593,7 @@ opts_suite(void)
 	tcase_add_test(tc, proxyspec_parse_11);
 	tcase_add_test(tc, proxyspec_parse_12);
 	tcase_add_test(tc, proxyspec_parse_13);
+	tcase_add_test(tc, proxyspec_parse_14);
 	tcase_add_test(tc, proxyspec_set_proto_01);
 	tcase_add_test(tc, proxyspec_struct_parse_01);
 	suite_add_tcase(s, tc);
@@ -1325,6 +1612,13 @@ opts_suite(void)
 	tcase_add_test(tc, opts_get_name_value_01);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("global_reload");
+	tcase_add_test(tc, global_reload_filters_01);
+	tcase_add_test(tc, global_reload_filters_02);
+	tcase_add_test(tc, global_reload_filters_03);
+	tcase_add_test(tc, global_reload_filters_04);
+	suite_add_tcase(s, tc);
+
 #ifdef TRAVIS
 	fprintf(stderr, "opts: 3 tests omitted because building in travis\n");
 #endif
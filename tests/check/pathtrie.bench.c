@@ -0,0 +1,195 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark for URL path rules, run with `make bench`.  Compares the path
+ * trie of host rules with substring matching of the same paths with the
+ * Aho-Corasick machine of uri rules, as in filter_site_substring_match(), for
+ * request paths of a few segments with a query.  The match counts differ,
+ * since substring matching also finds patterns in the middle of paths, and
+ * prefix patterns also match their directory without the trailing slash.
+ */
+
+#include "filter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_PATHS 1000
+#define BENCH_ITERATIONS 200
+#define BENCH_WORDS 64
+
+static char words[BENCH_WORDS][16];
+static char paths[BENCH_PATHS][160];
+static size_t pathsbytes;
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+bench_word(char *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		buf[i] = "abcdefghijklmnopqrstuvwxyz0123456789-"[rand() % 37];
+	buf[len] = '\0';
+}
+
+/*
+ * Segments are taken from a small set of words, so that paths share their
+ * leading segments with the patterns as in real sites.
+ */
+static void
+bench_segments(char *buf, int nsegs)
+{
+	for (int j = 0; j < nsegs; j++) {
+		*buf++ = '/';
+		strcpy(buf, words[rand() % BENCH_WORDS]);
+		buf += strlen(buf);
+	}
+}
+
+static void
+bench_paths(void)
+{
+	for (int i = 0; i < BENCH_WORDS; i++)
+		bench_word(words[i], 3 + rand() % 8);
+
+	for (int i = 0; i < BENCH_PATHS; i++) {
+		bench_segments(paths[i], 2 + rand() % 5);
+		strcat(paths[i], "?id=");
+		bench_word(paths[i] + strlen(paths[i]), 8);
+		pathsbytes += strlen(paths[i]);
+	}
+}
+
+static void
+bench_patterns(int npatterns, pathtrie_t *trie, ACMachine(char) *acm)
+{
+	Keyword(char) k;
+	char pattern[160];
+	void **slot;
+	int created;
+
+	for (int i = 0; i < npatterns; i++) {
+		bench_segments(pattern, 2 + rand() % 3);
+		strcat(pattern, "/");
+
+		if (!(slot = pathtrie_put(trie, pattern, &created))) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		*slot = paths[i % BENCH_PATHS];
+
+		ACM_KEYWORD_SET(k, pattern, strlen(pattern));
+		ACM_register_keyword(acm, k, paths[i % BENCH_PATHS], 0);
+	}
+}
+
+static size_t
+bench_match_trie(pathtrie_t *trie)
+{
+	size_t found = 0;
+
+	for (int i = 0; i < BENCH_PATHS; i++)
+		found += !!pathtrie_match(trie, paths[i]);
+	return found;
+}
+
+static size_t
+bench_match_acm(ACMachine(char) *acm)
+{
+	size_t found = 0;
+
+	for (int i = 0; i < BENCH_PATHS; i++) {
+		const ACState(char) *state = ACM_reset(acm);
+		void *value = NULL;
+		for (char *c = paths[i]; *c; c++) {
+			if (ACM_match(state, *c)) {
+				ACM_get_match(state, 0, 0, &value);
+				break;
+			}
+		}
+		found += !!value;
+	}
+	return found;
+}
+
+static void
+bench_run(int npatterns)
+{
+	pathtrie_t *trie = pathtrie_new();
+	ACMachine(char) *acm = ACM_create(char);
+	size_t found1 = 0, found2 = 0;
+	double t, t1, t2;
+
+	bench_patterns(npatterns, trie, acm);
+
+	/* the machine builds its fail links on first use */
+	bench_match_acm(acm);
+	t = bench_now();
+	for (int i = 0; i < BENCH_ITERATIONS; i++)
+		found1 += bench_match_acm(acm);
+	t1 = bench_now() - t;
+
+	t = bench_now();
+	for (int i = 0; i < BENCH_ITERATIONS; i++)
+		found2 += bench_match_trie(trie);
+	t2 = bench_now() - t;
+
+	printf("%6d patterns  acm %6.2f ns/byte %5zu matches  trie %6.2f ns/byte %5zu matches\n",
+	       npatterns,
+	       t1 / BENCH_ITERATIONS / pathsbytes, found1 / BENCH_ITERATIONS,
+	       t2 / BENCH_ITERATIONS / pathsbytes, found2 / BENCH_ITERATIONS);
+	ACM_release(acm);
+	pathtrie_free(trie, NULL);
+}
+
+int
+main(void)
+{
+	srand(1);
+	bench_paths();
+
+	bench_run(10);
+	bench_run(100);
+	bench_run(1000);
+	bench_run(10000);
+	bench_run(50000);
+
+	return EXIT_SUCCESS;
+}
+
+/* vim: set noet ft=c: */
@@ -29,6 +29,15 @@
 #include "protohttp.h"
 #include "protopop3.h"
 #include "protosmtp.h"
+#include "prototcp.h"
+#include "sys.h"
+
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <event2/bufferevent.h>
 
 #include <check.h>
 
@@ -874,6 +883,130 @@ START_TEST(protosmtp_validate_response_08)
 }
 END_TEST
 
+/*
+ * Connect a TCP socket to a listener on 127.0.0.1, returns the connected
+ * socket, or -1 on error.
+ */
+static evutil_socket_t
+tcp_connect_local(evutil_socket_t *lfd, evutil_socket_t *afd)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	evutil_socket_t fd;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	*lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (*lfd == -1 ||
+	    bind(*lfd, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+	    listen(*lfd, 1) == -1 ||
+	    getsockname(*lfd, (struct sockaddr *)&sin, &len) == -1)
+		return -1;
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1 || connect(fd, (struct sockaddr *)&sin, sizeof(sin)) == -1)
+		return -1;
+	*afd = accept(*lfd, NULL, NULL);
+	return fd;
+}
+
+START_TEST(prototcp_get_outbuf_limit_01)
+{
+	pxy_conn_ctx_t *ctx = proto_init(PROTO_TCP);
+	pxy_conn_desc_t desc;
+
+	// Static limit, no socket needed
+	memset(&desc, 0, sizeof(desc));
+	ctx->conn_opts->outbuf_limit = 1024;
+	fail_unless(prototcp_get_outbuf_limit(ctx, &desc, 0) == 1024, "wrong static limit");
+	fail_unless(prototcp_get_outbuf_limit(ctx, &desc, 4096) == 1024, "static limit adapted");
+	fail_unless(desc.outbuf_limit == 0, "static limit stored");
+
+	proto_free(ctx);
+}
+END_TEST
+
+START_TEST(prototcp_get_outbuf_limit_02)
+{
+	pxy_conn_ctx_t *ctx = proto_init(PROTO_TCP);
+	struct event_base *evbase = event_base_new();
+	evutil_socket_t fd, lfd, afd;
+	pxy_conn_desc_t this, other;
+	size_t limit;
+
+	fd = tcp_connect_local(&lfd, &afd);
+	fail_unless(fd != -1, "cannot connect");
+
+	memset(&this, 0, sizeof(this));
+	memset(&other, 0, sizeof(other));
+	other.bev = bufferevent_socket_new(evbase, fd, 0);
+	ctx->conn_opts->outbuf_limit = 1024;
+	ctx->conn_opts->adaptive_outbuf_limit = 1;
+
+	// Below the limit, not recomputed
+	fail_unless(prototcp_get_outbuf_limit(ctx, &other, 512) == 1024, "recomputed below limit");
+	fail_unless(other.outbuf_limit == 0, "stored below limit");
+
+	limit = prototcp_get_outbuf_limit(ctx, &other, 1024);
+	fail_unless(limit >= ADAPTIVE_OUTBUF_LIMIT_MIN && limit <= ADAPTIVE_OUTBUF_LIMIT_MAX, "limit out of range");
+#ifdef __linux__
+	fail_unless(limit == MAX(2 * sys_get_sock_bdp(fd), ADAPTIVE_OUTBUF_LIMIT_MIN), "limit not twice the bdp");
+#endif /* __linux__ */
+	fail_unless(other.outbuf_limit == limit, "limit not stored in conn end");
+	fail_unless(prototcp_get_outbuf_limit(ctx, &other, 0) == limit, "stored limit not used");
+	// The other direction has its own limit
+	fail_unless(this.outbuf_limit == 0, "limit shared by conn ends");
+	fail_unless(prototcp_get_outbuf_limit(ctx, &this, 0) == 1024, "limit shared by conn ends");
+
+	bufferevent_free(other.bev);
+	close(afd);
+	close(lfd);
+	event_base_free(evbase);
+	proto_free(ctx);
+}
+END_TEST
+
+START_TEST(prototcp_get_outbuf_limit_03)
+{
+	pxy_conn_ctx_t *ctx = proto_init(PROTO_TCP);
+	struct event_base *evbase = event_base_new();
+	struct bufferevent *ubev;
+	evutil_socket_t fd, lfd, afd;
+	pxy_conn_desc_t other;
+	size_t limit;
+
+	fd = tcp_connect_local(&lfd, &afd);
+	fail_unless(fd != -1, "cannot connect");
+
+	// Filter bevs use the socket of the underlying bev
+	memset(&other, 0, sizeof(other));
+	ubev = bufferevent_socket_new(evbase, fd, 0);
+	other.bev = bufferevent_filter_new(ubev, NULL, NULL, 0, NULL, NULL);
+	fail_unless(!!other.bev, "cannot create filter bev");
+	ctx->conn_opts->outbuf_limit = 1024;
+	ctx->conn_opts->adaptive_outbuf_limit = 1;
+
+	limit = prototcp_get_outbuf_limit(ctx, &other, 1024);
+#ifdef __linux__
+	fail_unless(limit == MAX(2 * sys_get_sock_bdp(fd), ADAPTIVE_OUTBUF_LIMIT_MIN), "underlying socket not used");
+#endif /* __linux__ */
+	fail_unless(other.outbuf_limit == limit, "limit not stored in conn end");
+
+	// Fair share of the memory budget of 1 MB for 1 conn, in two directions
+	ctx->global->outbuf_mem_budget = 1;
+	other.outbuf_limit = 0;
+	limit = prototcp_get_outbuf_limit(ctx, &other, 1024);
+	fail_unless(limit <= 512 * 1024, "memory budget not respected");
+
+	bufferevent_free(other.bev);
+	bufferevent_free(ubev);
+	close(afd);
+	close(lfd);
+	event_base_free(evbase);
+	proto_free(ctx);
+}
+END_TEST
+
 Suite *
 proto_suite(void)
 {
@@ -924,6 +1057,12 @@ proto_suite(void)
 	tcase_add_test(tc, protosmtp_validate_response_08);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("prototcp_get_outbuf_limit");
+	tcase_add_test(tc, prototcp_get_outbuf_limit_01);
+	tcase_add_test(tc, prototcp_get_outbuf_limit_02);
+	tcase_add_test(tc, prototcp_get_outbuf_limit_03);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
 
@@ -0,0 +1,617 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pxydns.h"
+#include "cachemgr.h"
+#include "opts.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <event2/event.h>
+#include <event2/dns.h>
+#include <event2/dns_struct.h>
+
+#include <check.h>
+
+/*
+ * Stub resolver answering on a local UDP port, which the evdns base used
+ * by the tests is pointed at.
+ *
+ * a.test     A 127.0.0.1 ttl 300, AAAA ::1 ttl 60
+ * v4.test    A 127.0.0.2 ttl 300, no AAAA
+ * zero.test  A 127.0.0.3 ttl 0
+ * all others NXDOMAIN
+ */
+
+static struct event_base *evbase;
+static struct evdns_base *dnsbase;
+static struct evdns_server_port *stubport;
+static evutil_socket_t stubfd;
+static global_t *global;
+static int stub_queries;
+
+static void
+stub_request_cb(struct evdns_server_request *req, UNUSED void *arg)
+{
+	int err = DNS_ERR_NONE;
+
+	for (int i = 0; i < req->nquestions; i++) {
+		const struct evdns_server_question *q = req->questions[i];
+		uint32_t a;
+		struct in6_addr aaaa;
+
+		stub_queries++;
+
+		if (!strcasecmp(q->name, "a.test")) {
+			if (q->type == EVDNS_TYPE_A) {
+				a = htonl(0x7f000001);
+				evdns_server_request_add_a_reply(req, q->name, 1, &a, 300);
+			} else if (q->type == EVDNS_TYPE_AAAA) {
+				inet_pton(AF_INET6, "::1", &aaaa);
+				evdns_server_request_add_aaaa_reply(req, q->name, 1, &aaaa, 60);
+			}
+		} else if (!strcasecmp(q->name, "v4.test")) {
+			if (q->type == EVDNS_TYPE_A) {
+				a = htonl(0x7f000002);
+				evdns_server_request_add_a_reply(req, q->name, 1, &a, 300);
+			}
+		} else if (!strcasecmp(q->name, "zero.test")) {
+			if (q->type == EVDNS_TYPE_A) {
+				a = htonl(0x7f000003);
+				evdns_server_request_add_a_reply(req, q->name, 1, &a, 0);
+			}
+		} else {
+			err = DNS_ERR_NOTEXIST;
+		}
+	}
+	evdns_server_request_respond(req, err);
+}
+
+static void
+pxydns_setup(void)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	char ns[32];
+
+	if (cachemgr_preinit() == -1)
+		exit(EXIT_FAILURE);
+	if (!(global = global_new()))
+		exit(EXIT_FAILURE);
+	if (!(evbase = event_base_new()))
+		exit(EXIT_FAILURE);
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	stubfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (stubfd == -1 ||
+	    bind(stubfd, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+	    getsockname(stubfd, (struct sockaddr *)&sin, &len) == -1 ||
+	    evutil_make_socket_nonblocking(stubfd) == -1)
+		exit(EXIT_FAILURE);
+	stubport = evdns_add_server_port_with_base(evbase, stubfd, 0, stub_request_cb, NULL);
+	if (!stubport)
+		exit(EXIT_FAILURE);
+
+	if (!(dnsbase = evdns_base_new(evbase, 0)))
+		exit(EXIT_FAILURE);
+	snprintf(ns, sizeof(ns), "127.0.0.1:%d", ntohs(sin.sin_port));
+	if (evdns_base_nameserver_ip_add(dnsbase, ns) != 0)
+		exit(EXIT_FAILURE);
+	stub_queries = 0;
+}
+
+static void
+pxydns_teardown(void)
+{
+	evdns_base_free(dnsbase, 0);
+	evdns_close_server_port(stubport);
+	evutil_closesocket(stubfd);
+	event_base_free(evbase);
+	global_free(global);
+	cachemgr_fini();
+}
+
+typedef struct result {
+	int called;
+	int errcode;
+	dns_addrs_t addrs;
+	pxy_dns_waiter_t *waiter;
+} result_t;
+
+static void
+resolve_cb(int errcode, const dns_addrs_t *addrs, void *arg)
+{
+	result_t *r = arg;
+
+	r->called++;
+	r->errcode = errcode;
+	memcpy(&r->addrs, addrs, sizeof(dns_addrs_t));
+}
+
+/*
+ * Run the event loop until *called reaches n or 5 seconds pass.
+ */
+static void
+loop_until(int *called, int n)
+{
+	struct timeval tv = {5, 0};
+
+	event_base_loopexit(evbase, &tv);
+	while (*called < n && !event_base_got_exit(evbase)) {
+		event_base_loop(evbase, EVLOOP_ONCE);
+	}
+	// Clear the pending loopexit
+	event_base_loopbreak(evbase);
+	event_base_loop(evbase, EVLOOP_NONBLOCK);
+}
+
+START_TEST(pxydns_resolve_01)
+{
+	result_t r;
+
+	memset(&r, 0, sizeof(r));
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "a.test", resolve_cb, &r, &r.waiter), "resolve failed");
+	fail_unless(!r.called, "called back before lookup");
+	fail_unless(!!r.waiter, "no handle while pending");
+	loop_until(&r.called, 1);
+	fail_unless(r.called == 1, "not called back");
+	fail_unless(!r.waiter, "handle not cleared");
+	fail_unless(r.errcode == 0, "lookup failed");
+	fail_unless(r.addrs.naddrs == 2, "wrong number of addrs");
+	fail_unless(r.addrs.addr[0].sa.sa_family == AF_INET6, "IPv6 not first");
+	fail_unless(r.addrs.addr[1].sa.sa_family == AF_INET, "IPv4 not second");
+	fail_unless(r.addrs.addr[1].sin.sin_addr.s_addr == htonl(0x7f000001), "wrong IPv4 addr");
+	fail_unless(stub_queries == 2, "not one query per family");
+}
+END_TEST
+
+START_TEST(pxydns_resolve_02)
+{
+	result_t r1, r2, r3;
+
+	memset(&r1, 0, sizeof(r1));
+	memset(&r2, 0, sizeof(r2));
+	memset(&r3, 0, sizeof(r3));
+	// Second lookup joins the first one in flight
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "a.test", resolve_cb, &r1, &r1.waiter), "resolve 1 failed");
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "A.Test", resolve_cb, &r2, &r2.waiter), "resolve 2 failed");
+	loop_until(&r2.called, 1);
+	fail_unless(r1.called == 1 && r2.called == 1, "not called back");
+	fail_unless(r1.addrs.naddrs == 2 && r2.addrs.naddrs == 2, "wrong number of addrs");
+	fail_unless(stub_queries == 2, "in-flight lookup not shared");
+
+	// Third lookup is a cache hit, called back before returning
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "a.test", resolve_cb, &r3, &r3.waiter), "resolve 3 failed");
+	fail_unless(r3.called == 1, "cache hit not called back");
+	fail_unless(!r3.waiter, "handle set for cache hit");
+	fail_unless(r3.addrs.naddrs == 2, "wrong number of addrs");
+	fail_unless(stub_queries == 2, "cache hit sent queries");
+}
+END_TEST
+
+START_TEST(pxydns_resolve_03)
+{
+	result_t r;
+	dns_addrs_t *cached;
+	time_t ttl;
+
+	memset(&r, 0, sizeof(r));
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "a.test", resolve_cb, &r, &r.waiter), "resolve failed");
+	loop_until(&r.called, 1);
+
+	// Smallest TTL of the answers is used
+	cached = cachemgr_dns_get("a.test");
+	fail_unless(!!cached, "not cached");
+	ttl = cached->expiry - time(NULL);
+	fail_unless(ttl > 50 && ttl <= 60, "TTL not respected");
+	free(cached);
+}
+END_TEST
+
+START_TEST(pxydns_resolve_04)
+{
+	result_t r;
+	dns_addrs_t *cached;
+
+	global->dns_cache_max_ttl = 10;
+	memset(&r, 0, sizeof(r));
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "a.test", resolve_cb, &r, &r.waiter), "resolve failed");
+	loop_until(&r.called, 1);
+
+	cached = cachemgr_dns_get("a.test");
+	fail_unless(!!cached, "not cached");
+	fail_unless(cached->expiry - time(NULL) <= 10, "TTL not capped");
+	free(cached);
+}
+END_TEST
+
+START_TEST(pxydns_resolve_05)
+{
+	result_t r1, r2;
+
+	// TTL 0 answers are not cached
+	memset(&r1, 0, sizeof(r1));
+	memset(&r2, 0, sizeof(r2));
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "zero.test", resolve_cb, &r1, &r1.waiter), "resolve 1 failed");
+	loop_until(&r1.called, 1);
+	fail_unless(r1.errcode == 0 && r1.addrs.naddrs == 1, "lookup failed");
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "zero.test", resolve_cb, &r2, &r2.waiter), "resolve 2 failed");
+	fail_unless(!r2.called, "TTL 0 answer cached");
+	loop_until(&r2.called, 1);
+	fail_unless(stub_queries == 4, "TTL 0 answer cached");
+}
+END_TEST
+
+START_TEST(pxydns_resolve_06)
+{
+	result_t r1, r2;
+
+	memset(&r1, 0, sizeof(r1));
+	memset(&r2, 0, sizeof(r2));
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "v4.test", resolve_cb, &r1, &r1.waiter), "resolve failed");
+	loop_until(&r1.called, 1);
+	fail_unless(r1.errcode == 0, "lookup failed");
+	fail_unless(r1.addrs.naddrs == 1, "wrong number of addrs");
+	fail_unless(r1.addrs.addr[0].sa.sa_family == AF_INET, "not IPv4");
+
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "v4.test", resolve_cb, &r2, &r2.waiter), "resolve failed");
+	fail_unless(r2.called == 1, "cache hit not called back");
+	fail_unless(stub_queries == 2, "cache hit sent queries");
+}
+END_TEST
+
+START_TEST(pxydns_resolve_07)
+{
+	result_t r1, r2;
+
+	memset(&r1, 0, sizeof(r1));
+	memset(&r2, 0, sizeof(r2));
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "a.test", resolve_cb, &r1, &r1.waiter), "resolve 1 failed");
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "a.test", resolve_cb, &r2, &r2.waiter), "resolve 2 failed");
+	// Canceled waiter is not called back, the other one still is
+	pxy_dns_resolve_cancel(r1.waiter);
+	fail_unless(!r1.waiter, "handle not cleared");
+	loop_until(&r2.called, 1);
+	fail_unless(r2.called == 1, "not called back");
+	fail_unless(r2.addrs.naddrs == 2, "wrong number of addrs");
+	fail_unless(!r1.called, "canceled waiter called back");
+}
+END_TEST
+
+START_TEST(pxydns_negative_01)
+{
+	result_t r1, r2;
+	dns_addrs_t *cached;
+
+	memset(&r1, 0, sizeof(r1));
+	memset(&r2, 0, sizeof(r2));
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "nx.test", resolve_cb, &r1, &r1.waiter), "resolve 1 failed");
+	loop_until(&r1.called, 1);
+	fail_unless(r1.errcode == EVUTIL_EAI_NONAME, "NXDOMAIN not reported");
+	fail_unless(r1.addrs.naddrs == 0, "addrs for NXDOMAIN");
+
+	// Negative answer is cached
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "nx.test", resolve_cb, &r2, &r2.waiter), "resolve 2 failed");
+	fail_unless(r2.called == 1, "negative cache hit not called back");
+	fail_unless(r2.errcode == EVUTIL_EAI_NONAME, "negative cache hit not reported");
+	fail_unless(stub_queries == 2, "negative cache hit sent queries");
+
+	cached = cachemgr_dns_get("nx.test");
+	fail_unless(!!cached, "not cached");
+	fail_unless(cached->expiry - time(NULL) <= (time_t)global->dns_negative_ttl, "negative TTL not used");
+	free(cached);
+}
+END_TEST
+
+START_TEST(pxydns_negative_02)
+{
+	result_t r1, r2;
+
+	global->dns_negative_ttl = 0;
+	memset(&r1, 0, sizeof(r1));
+	memset(&r2, 0, sizeof(r2));
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "nx.test", resolve_cb, &r1, &r1.waiter), "resolve 1 failed");
+	loop_until(&r1.called, 1);
+	fail_unless(r1.errcode == EVUTIL_EAI_NONAME, "NXDOMAIN not reported");
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "nx.test", resolve_cb, &r2, &r2.waiter), "resolve 2 failed");
+	fail_unless(!r2.called, "negative answer cached");
+	loop_until(&r2.called, 1);
+	fail_unless(stub_queries == 4, "negative answer cached");
+}
+END_TEST
+
+START_TEST(pxydns_numeric_01)
+{
+	result_t r;
+
+	memset(&r, 0, sizeof(r));
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "192.0.2.1", resolve_cb, &r, &r.waiter), "resolve failed");
+	fail_unless(r.called == 1, "numeric host not called back");
+	fail_unless(r.addrs.naddrs == 1, "wrong number of addrs");
+	fail_unless(r.addrs.addr[0].sin.sin_addr.s_addr == htonl(0xc0000201), "wrong addr");
+	fail_unless(stub_queries == 0, "numeric host sent queries");
+}
+END_TEST
+
+START_TEST(pxydns_hosts_01)
+{
+	char path[] = "/tmp/sslproxy.test.hosts.XXXXXX";
+	result_t r;
+	FILE *f;
+	int fd;
+
+	fd = mkstemp(path);
+	fail_unless(fd != -1, "cannot create hosts file");
+	f = fdopen(fd, "w");
+	fprintf(f, "# comment\n127.0.0.9 h.test alias.test # comment\n::9 h.test\n\nbogus bogus.test\n");
+	fclose(f);
+	fail_unless(!pxy_dns_load_hosts(path), "cannot load hosts file");
+	unlink(path);
+
+	memset(&r, 0, sizeof(r));
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "H.test", resolve_cb, &r, &r.waiter), "resolve failed");
+	fail_unless(r.called == 1, "hosts entry not called back");
+	fail_unless(r.addrs.naddrs == 2, "wrong number of addrs");
+	fail_unless(r.addrs.expiry == 0, "hosts entry expires");
+	fail_unless(r.addrs.addr[0].sin.sin_addr.s_addr == htonl(0x7f000009), "wrong IPv4 addr");
+	fail_unless(r.addrs.addr[1].sa.sa_family == AF_INET6, "wrong IPv6 addr");
+
+	memset(&r, 0, sizeof(r));
+	fail_unless(!pxy_dns_resolve(evbase, dnsbase, global, "alias.test", resolve_cb, &r, &r.waiter), "resolve failed");
+	fail_unless(r.called == 1, "hosts alias not called back");
+	fail_unless(!cachemgr_dns_get("bogus.test"), "bogus hosts line loaded");
+	fail_unless(stub_queries == 0, "hosts entry sent queries");
+}
+END_TEST
+
+START_TEST(pxydns_hosts_02)
+{
+	fail_unless(!pxy_dns_load_hosts("/nonexistent/hosts"), "missing hosts file failed");
+}
+END_TEST
+
+typedef struct conn_result {
+	int called;
+	evutil_socket_t fd;
+	int error;
+	struct sockaddr_storage addr;
+	pxy_dns_race_t *race;
+} conn_result_t;
+
+static void
+connect_cb(evutil_socket_t fd, int error, const struct sockaddr *addr, socklen_t addrlen, void *arg)
+{
+	conn_result_t *r = arg;
+
+	r->called++;
+	r->fd = fd;
+	r->error = error;
+	memcpy(&r->addr, addr, addrlen);
+}
+
+/*
+ * Listen on a free port of 127.0.0.1, returns the port in host byte order.
+ */
+static unsigned short
+listen_local(evutil_socket_t *fd)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	*fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (*fd == -1 ||
+	    bind(*fd, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+	    listen(*fd, 5) == -1 ||
+	    getsockname(*fd, (struct sockaddr *)&sin, &len) == -1)
+		return 0;
+	return ntohs(sin.sin_port);
+}
+
+START_TEST(pxydns_connect_01)
+{
+	dns_addrs_t addrs;
+	conn_result_t r;
+	evutil_socket_t lfd;
+	unsigned short port;
+
+	port = listen_local(&lfd);
+	fail_unless(port != 0, "cannot listen");
+
+	// Nothing listens on ::1 at port, so IPv4 wins
+	memset(&addrs, 0, sizeof(addrs));
+	addrs.addr[0].sin6.sin6_family = AF_INET6;
+	addrs.addr[0].sin6.sin6_addr = in6addr_loopback;
+	addrs.addr[1].sin.sin_family = AF_INET;
+	addrs.addr[1].sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addrs.naddrs = 2;
+
+	memset(&r, 0, sizeof(r));
+	fail_unless(!pxy_dns_connect(evbase, global, &addrs, port, connect_cb, &r, &r.race), "connect failed");
+	loop_until(&r.called, 1);
+	fail_unless(r.called == 1, "not called back");
+	fail_unless(r.fd != -1, "no winner");
+	fail_unless(r.addr.ss_family == AF_INET, "wrong winner");
+	fail_unless(((struct sockaddr_in *)&r.addr)->sin_port == htons(port), "port not set");
+	evutil_closesocket(r.fd);
+	evutil_closesocket(lfd);
+}
+END_TEST
+
+START_TEST(pxydns_connect_02)
+{
+	dns_addrs_t addrs;
+	conn_result_t r;
+	evutil_socket_t lfd;
+	unsigned short port;
+
+	port = listen_local(&lfd);
+	fail_unless(port != 0, "cannot listen");
+	// Nothing listens at port anymore
+	evutil_closesocket(lfd);
+
+	memset(&addrs, 0, sizeof(addrs));
+	addrs.addr[0].sin.sin_family = AF_INET;
+	addrs.addr[0].sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addrs.addr[1].sin.sin_family = AF_INET;
+	addrs.addr[1].sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addrs.naddrs = 2;
+
+	memset(&r, 0, sizeof(r));
+	fail_unless(!pxy_dns_connect(evbase, global, &addrs, port, connect_cb, &r, &r.race), "connect failed");
+	loop_until(&r.called, 1);
+	fail_unless(r.called == 1, "not called back");
+	fail_unless(r.fd == -1, "winner without listener");
+	fail_unless(r.error == ECONNREFUSED, "wrong error");
+	fail_unless(r.addr.ss_family == AF_INET, "first addr not returned");
+}
+END_TEST
+
+START_TEST(pxydns_connect_03)
+{
+	dns_addrs_t addrs;
+	conn_result_t r;
+	evutil_socket_t lfd;
+	unsigned short port;
+
+	port = listen_local(&lfd);
+	fail_unless(port != 0, "cannot listen");
+
+	memset(&addrs, 0, sizeof(addrs));
+	addrs.addr[0].sin.sin_family = AF_INET;
+	addrs.addr[0].sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addrs.naddrs = 1;
+
+	// Canceled race is not called back
+	memset(&r, 0, sizeof(r));
+	fail_unless(!pxy_dns_connect(evbase, global, &addrs, port, connect_cb, &r, &r.race), "connect failed");
+	fail_unless(!!r.race, "no handle while pending");
+	pxy_dns_connect_cancel(r.race);
+	fail_unless(!r.race, "handle not cleared");
+	event_base_loop(evbase, EVLOOP_NONBLOCK);
+	fail_unless(!r.called, "canceled race called back");
+	evutil_closesocket(lfd);
+}
+END_TEST
+
+START_TEST(pxydns_connect_04)
+{
+	dns_addrs_t addrs;
+	conn_result_t r;
+	evutil_socket_t lfd, cfd[2];
+	struct sockaddr_in sin;
+	unsigned short port;
+
+	port = listen_local(&lfd);
+	fail_unless(port != 0, "cannot listen");
+	// Fill the accept queue, so that further SYNs are dropped
+	fail_unless(listen(lfd, 0) == 0, "cannot shrink backlog");
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin.sin_port = htons(port);
+	for (int i = 0; i < 2; i++) {
+		cfd[i] = socket(AF_INET, SOCK_STREAM, 0);
+		fail_unless(cfd[i] != -1, "cannot create socket");
+		evutil_make_socket_nonblocking(cfd[i]);
+		connect(cfd[i], (struct sockaddr *)&sin, sizeof(sin));
+	}
+	usleep(100000);
+
+	memset(&addrs, 0, sizeof(addrs));
+	addrs.addr[0].sin.sin_family = AF_INET;
+	addrs.addr[0].sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addrs.naddrs = 1;
+
+	global->connect_timeout = 1;
+	memset(&r, 0, sizeof(r));
+	fail_unless(!pxy_dns_connect(evbase, global, &addrs, port, connect_cb, &r, &r.race), "connect failed");
+	loop_until(&r.called, 1);
+	fail_unless(r.called == 1, "not called back");
+	fail_unless(r.fd == -1, "winner with full accept queue");
+	fail_unless(r.error == ETIMEDOUT, "wrong error");
+	fail_unless(!r.race, "handle not cleared");
+	for (int i = 0; i < 2; i++) {
+		evutil_closesocket(cfd[i]);
+	}
+	evutil_closesocket(lfd);
+}
+END_TEST
+
+Suite *
+pxydns_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("pxydns");
+
+	tc = tcase_create("pxy_dns_resolve");
+	tcase_add_checked_fixture(tc, pxydns_setup, pxydns_teardown);
+	tcase_add_test(tc, pxydns_resolve_01);
+	tcase_add_test(tc, pxydns_resolve_02);
+	tcase_add_test(tc, pxydns_resolve_03);
+	tcase_add_test(tc, pxydns_resolve_04);
+	tcase_add_test(tc, pxydns_resolve_05);
+	tcase_add_test(tc, pxydns_resolve_06);
+	tcase_add_test(tc, pxydns_resolve_07);
+	tcase_add_test(tc, pxydns_negative_01);
+	tcase_add_test(tc, pxydns_negative_02);
+	tcase_add_test(tc, pxydns_numeric_01);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("pxy_dns_load_hosts");
+	tcase_add_checked_fixture(tc, pxydns_setup, pxydns_teardown);
+	tcase_add_test(tc, pxydns_hosts_01);
+	tcase_add_test(tc, pxydns_hosts_02);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("pxy_dns_connect");
+	tcase_add_checked_fixture(tc, pxydns_setup, pxydns_teardown);
+	tcase_add_test(tc, pxydns_connect_01);
+	tcase_add_test(tc, pxydns_connect_02);
+	tcase_add_test(tc, pxydns_connect_03);
+	tcase_add_test(tc, pxydns_connect_04);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+/* vim: set noet ft=c: */
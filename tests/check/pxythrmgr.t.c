@@ -27,8 +27,12 @@
  */
 
 #include "pxythrmgr.h"
+#include "pxythr.h"
 
 #include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <event2/bufferevent.h>
 
 #include <check.h>
 
@@ -107,6 +111,113 @@ START_TEST(pxythrmgr_libevent_05)
 }
 END_TEST
 
+static int pxythr_reclaim_cbs;
+
+static void
+pxythr_reclaim_readcb(UNUSED struct bufferevent *bev, UNUSED void *arg)
+{
+	pxythr_reclaim_cbs++;
+}
+
+static void
+pxythr_reclaim_eventcb(UNUSED struct bufferevent *bev, UNUSED short events,
+                       UNUSED void *arg)
+{
+	pxythr_reclaim_cbs++;
+}
+
+/*
+ * pxy_thr_reclaim_evbuf() relies on libevent internals, see pxythr.c.
+ */
+START_TEST(pxythr_reclaim_01)
+{
+	struct event_base *evbase;
+	struct bufferevent *bev;
+	struct evbuffer *inbuf;
+	struct evbuffer_iovec v;
+	evutil_socket_t fds[2];
+	char c;
+	size_t sz;
+
+	evbase = event_base_new();
+	fail_unless(!!evbase, "no event base");
+	fail_unless(!evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, fds),
+	            "no socketpair");
+	fail_unless(!evutil_make_socket_nonblocking(fds[1]),
+	            "cannot make socket nonblocking");
+	bev = bufferevent_socket_new(evbase, fds[0], BEV_OPT_CLOSE_ON_FREE |
+	                             BEV_OPT_DEFER_CALLBACKS);
+	fail_unless(!!bev, "no bufferevent");
+	bufferevent_setcb(bev, pxythr_reclaim_readcb, NULL,
+	                  pxythr_reclaim_eventcb, NULL);
+	fail_unless(!bufferevent_enable(bev, EV_READ),
+	            "cannot enable bufferevent");
+	pxythr_reclaim_cbs = 0;
+
+	/* leave an empty chain reserved for a read which returned no data,
+	 * the socket bev keeps the end of its input frozen otherwise */
+	inbuf = bufferevent_get_input(bev);
+	fail_unless(evbuffer_reserve_space(inbuf, 4096, &v, 1) == -1,
+	            "input end not frozen");
+	evbuffer_unfreeze(inbuf, 0);
+	fail_unless(evbuffer_reserve_space(inbuf, 4096, &v, 1) == 1,
+	            "cannot reserve space");
+	evbuffer_freeze(inbuf, 0);
+	fail_unless(evbuffer_get_length(inbuf) == 0, "input not empty");
+	fail_unless(evbuffer_peek(inbuf, -1, NULL, &v, 1) == 1,
+	            "no empty chain");
+
+	sz = pxy_thr_reclaim_evbuf(inbuf);
+	fail_unless(sz >= 4096, "reclaimed %zu bytes", sz);
+	fail_unless(evbuffer_peek(inbuf, -1, NULL, &v, 1) == 0,
+	            "chain not freed");
+	fail_unless(evbuffer_get_length(inbuf) == 0, "data left in input");
+
+	/* nothing else to reclaim */
+	fail_unless(pxy_thr_reclaim_evbuf(inbuf) == 0, "reclaimed twice");
+	fail_unless(evbuffer_reserve_space(inbuf, 1, &v, 1) == -1,
+	            "input end not frozen again");
+
+	fail_unless(event_base_loop(evbase, EVLOOP_NONBLOCK) != -1,
+	            "event loop failed");
+	fail_unless(pxythr_reclaim_cbs == 0, "callback called");
+	fail_unless(recv(fds[1], &c, 1, 0) == -1 && errno == EAGAIN,
+	            "data sent to peer");
+
+	bufferevent_free(bev);
+	evutil_closesocket(fds[1]);
+	event_base_free(evbase);
+}
+END_TEST
+
+START_TEST(pxythr_reclaim_02)
+{
+	struct evbuffer *buf;
+	struct evbuffer_iovec v;
+	char c;
+
+	buf = evbuffer_new();
+	fail_unless(!!buf, "no evbuffer");
+
+	/* as in the input buffers of openssl bevs, which are not frozen */
+	fail_unless(evbuffer_reserve_space(buf, 4096, &v, 1) == 1,
+	            "cannot reserve space");
+	fail_unless(pxy_thr_reclaim_evbuf(buf) >= 4096, "nothing reclaimed");
+	fail_unless(evbuffer_peek(buf, -1, NULL, &v, 1) == 0,
+	            "chain not freed");
+	fail_unless(evbuffer_get_length(buf) == 0, "data left");
+
+	/* buffers with data or without chains are left alone */
+	fail_unless(pxy_thr_reclaim_evbuf(buf) == 0, "reclaimed without chain");
+	fail_unless(evbuffer_add(buf, "x", 1) == 0, "cannot add");
+	fail_unless(pxy_thr_reclaim_evbuf(buf) == 0, "reclaimed with data");
+	fail_unless(evbuffer_get_length(buf) == 1, "data lost");
+	fail_unless(evbuffer_remove(buf, &c, 1) == 1 && c == 'x', "data changed");
+
+	evbuffer_free(buf);
+}
+END_TEST
+
 Suite *
 pxythrmgr_suite(void)
 {
@@ -123,6 +234,11 @@ pxythrmgr_suite(void)
 	tcase_add_test(tc, pxythrmgr_libevent_05);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("pxythr_reclaim");
+	tcase_add_test(tc, pxythr_reclaim_01);
+	tcase_add_test(tc, pxythr_reclaim_02);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
 
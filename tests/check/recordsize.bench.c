@@ -0,0 +1,230 @@
+/*-
+ * SSLsplit - transparent SSL/TLS interception
+ * https://www.roe.ch/SSLsplit
+ *
+ * Copyright (c) 2017-2022, Soner Tari <sonertari@gmail.com>.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS ``AS IS''
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark for the TLS record sizes used by DynamicRecordSizing, run with
+ * `make bench`.  For each record size, reports the number of TCP segments a
+ * client has to receive before it can decrypt the first byte of a response,
+ * the wire overhead and the cost of encrypting and decrypting 1 MiB.
+ */
+
+#include "ssl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/ssl.h>
+
+#define BENCH_CERT "../testproxy/server.crt"
+#define BENCH_KEY "../testproxy/server.key"
+#define BENCH_MSS 1448
+#define BENCH_CHUNK 16384
+#define BENCH_BYTES (1024 * 1024)
+#define BENCH_ITERATIONS 20
+
+typedef struct bench_conn {
+	SSL *srv;
+	SSL *cli;
+	BIO *s2c;
+	BIO *c2s;
+} bench_conn_t;
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Move the data written by one end to the other end.
+ */
+static void
+bench_pump(BIO *from, BIO *to)
+{
+	char buf[65536];
+	int n;
+
+	while ((n = BIO_read(from, buf, sizeof(buf))) > 0) {
+		BIO_write(to, buf, n);
+	}
+}
+
+static int
+bench_connect(SSL_CTX *srvctx, SSL_CTX *clictx, bench_conn_t *c)
+{
+	BIO *srvin, *cliin;
+	int srvdone = 0, clidone = 0;
+
+	c->srv = SSL_new(srvctx);
+	c->cli = SSL_new(clictx);
+	/* the BIOs are owned by the SSLs, keep the write BIOs to pump */
+	srvin = BIO_new(BIO_s_mem());
+	cliin = BIO_new(BIO_s_mem());
+	c->s2c = BIO_new(BIO_s_mem());
+	c->c2s = BIO_new(BIO_s_mem());
+	if (!c->srv || !c->cli || !srvin || !cliin || !c->s2c || !c->c2s)
+		return -1;
+	SSL_set_bio(c->srv, srvin, c->s2c);
+	SSL_set_bio(c->cli, cliin, c->c2s);
+	SSL_set_accept_state(c->srv);
+	SSL_set_connect_state(c->cli);
+
+	for (int i = 0; i < 16 && !(srvdone && clidone); i++) {
+		if (!clidone)
+			clidone = SSL_do_handshake(c->cli) == 1;
+		bench_pump(c->c2s, srvin);
+		if (!srvdone)
+			srvdone = SSL_do_handshake(c->srv) == 1;
+		bench_pump(c->s2c, cliin);
+	}
+	return srvdone && clidone ? 0 : -1;
+}
+
+/*
+ * Write len bytes in BENCH_CHUNK sized SSL_write() calls, as libevent does
+ * with full evbuffer chains, and read them on the client.  Returns the number
+ * of bytes on the wire, and the size of the first record in first.
+ */
+static size_t
+bench_transfer(bench_conn_t *c, size_t len, size_t *first,
+               double *enc, double *dec)
+{
+	static unsigned char in[BENCH_CHUNK], out[BENCH_CHUNK];
+	BIO *cliin = SSL_get_rbio(c->cli);
+	unsigned char hdr[5];
+	size_t wire = 0;
+	double t;
+
+	*first = 0;
+	for (size_t off = 0; off < len; off += BENCH_CHUNK) {
+		size_t n = len - off < BENCH_CHUNK ? len - off : BENCH_CHUNK;
+		char buf[65536];
+		int m;
+
+		t = bench_now();
+		if (SSL_write(c->srv, in, n) != (int)n)
+			return 0;
+		*enc += bench_now() - t;
+
+		while ((m = BIO_read(c->s2c, buf, sizeof(buf))) > 0) {
+			if (!*first && m >= 5) {
+				memcpy(hdr, buf, 5);
+				*first = 5 + (hdr[3] << 8 | hdr[4]);
+			}
+			wire += m;
+			BIO_write(cliin, buf, m);
+		}
+
+		t = bench_now();
+		while (SSL_read(c->cli, out, sizeof(out)) > 0);
+		*dec += bench_now() - t;
+	}
+	return wire;
+}
+
+static void
+bench_report(const char *name, bench_conn_t *c, size_t small, size_t bytes)
+{
+	double enc = 0, dec = 0;
+	size_t wire = 0, first = 0, f;
+
+	for (int i = 0; i < BENCH_ITERATIONS; i++) {
+		/* raising max_send_fragment does not raise split_send_fragment */
+		SSL_set_max_send_fragment(c->srv, small);
+#ifdef SSL_CTRL_SET_SPLIT_SEND_FRAGMENT
+		SSL_set_split_send_fragment(c->srv, small);
+#endif /* SSL_CTRL_SET_SPLIT_SEND_FRAGMENT */
+		wire += bench_transfer(c, bytes < BENCH_BYTES ? bytes : BENCH_BYTES,
+		                       &f, &enc, &dec);
+		if (!first)
+			first = f;
+		if (bytes > BENCH_BYTES) {
+			SSL_set_max_send_fragment(c->srv, SSL3_RT_MAX_PLAIN_LENGTH);
+#ifdef SSL_CTRL_SET_SPLIT_SEND_FRAGMENT
+			SSL_set_split_send_fragment(c->srv,
+			                            SSL3_RT_MAX_PLAIN_LENGTH);
+#endif /* SSL_CTRL_SET_SPLIT_SEND_FRAGMENT */
+			wire += bench_transfer(c, bytes - BENCH_BYTES, &f,
+			                       &enc, &dec);
+		}
+	}
+	printf("%-28s %3zu seg to 1st byte %6.2f%% overhead "
+	       "%8.1f us/MiB enc %8.1f us/MiB dec\n", name,
+	       (first + BENCH_MSS - 1) / BENCH_MSS,
+	       100.0 * (wire - (double)bytes * BENCH_ITERATIONS) /
+	       ((double)bytes * BENCH_ITERATIONS),
+	       enc / 1e3 / BENCH_ITERATIONS / ((double)bytes / (1024 * 1024)),
+	       dec / 1e3 / BENCH_ITERATIONS / ((double)bytes / (1024 * 1024)));
+}
+
+int
+main(void)
+{
+	SSL_CTX *srvctx, *clictx;
+	bench_conn_t c;
+	X509 *crt;
+	EVP_PKEY *key;
+
+	if (ssl_init() == -1)
+		return EXIT_FAILURE;
+	crt = ssl_x509_load(BENCH_CERT);
+	key = ssl_key_load(BENCH_KEY);
+	srvctx = SSL_CTX_new(TLS_server_method());
+	clictx = SSL_CTX_new(TLS_client_method());
+	if (!crt || !key || !srvctx || !clictx ||
+	    SSL_CTX_use_certificate(srvctx, crt) != 1 ||
+	    SSL_CTX_use_PrivateKey(srvctx, key) != 1)
+		return EXIT_FAILURE;
+	if (bench_connect(srvctx, clictx, &c) == -1)
+		return EXIT_FAILURE;
+
+	bench_report("1 MiB, 16384 octet records", &c,
+	             SSL3_RT_MAX_PLAIN_LENGTH, BENCH_BYTES);
+	bench_report("1 MiB, 4096 octet records", &c, 4096, BENCH_BYTES);
+	bench_report("1 MiB, 1400 octet records", &c, 1400, BENCH_BYTES);
+	bench_report("4 MiB, 16384 octet records", &c,
+	             SSL3_RT_MAX_PLAIN_LENGTH, 4 * BENCH_BYTES);
+	bench_report("4 MiB, dynamic record sizing", &c, 1400,
+	             4 * BENCH_BYTES);
+
+	SSL_free(c.srv);
+	SSL_free(c.cli);
+	SSL_CTX_free(srvctx);
+	SSL_CTX_free(clictx);
+	X509_free(crt);
+	EVP_PKEY_free(key);
+	ssl_fini();
+	return EXIT_SUCCESS;
+}
+
+/* vim: set noet ft=c: */
@@ -31,6 +31,7 @@
 
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <check.h>
@@ -356,6 +357,21 @@ static unsigned char clienthello06[] =
 	"\x01\x01";
 	/* TLS 1.2, SNI extension with hostname "daniel.roe.ch" */
 
+static unsigned char clienthello07[] =
+	"\x16\x03\x01\x00\xa8\x01\x00\x00\xa4\x03\x03\x22\x22\x22\x22\x22"
+	"\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22"
+	"\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x22\x00\x00\x06\x0a\x0a"
+	"\x13\x01\x13\x02\x01\x00\x00\x75\x1a\x1a\x00\x00\x00\x00\x00\x0e"
+	"\x00\x0c\x00\x00\x09\x61\x2e\x65\x78\x61\x6d\x70\x6c\x65\x00\x0a"
+	"\x00\x08\x00\x06\x2a\x2a\x00\x1d\x00\x17\x00\x0b\x00\x02\x01\x00"
+	"\x00\x0d\x00\x06\x00\x04\x04\x03\x08\x04\x00\x10\x00\x05\x00\x03"
+	"\x02\x68\x32\x00\x2b\x00\x07\x06\x3a\x3a\x03\x04\x03\x03\x00\x33"
+	"\x00\x2b\x00\x29\x2a\x2a\x00\x01\x00\x00\x1d\x00\x20\x11\x11\x11"
+	"\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11"
+	"\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11\x11";
+	/* TLS 1.3 with GREASE, SNI extension with hostname "a.example",
+	 * ALPN "h2" and key shares for GREASE and X25519 */
+
 START_TEST(ssl_tls_clienthello_parse_00)
 {
 	int rv;
@@ -535,6 +551,339 @@ START_TEST(ssl_tls_clienthello_parse_10)
 }
 END_TEST
 
+START_TEST(ssl_tls_clienthello_parse_info_01)
+{
+	ssl_tls_clienthello_info_t info;
+	const unsigned char *ch = NULL;
+	int rv;
+
+	rv = ssl_tls_clienthello_parse_info(clienthello05,
+	                                    sizeof(clienthello05) - 1,
+	                                    0, &ch, &info);
+	fail_unless(rv == 0, "rv not 0");
+	fail_unless(ch == clienthello05, "ch does not point to start");
+	fail_unless(info.version == 0x0303, "wrong version");
+	fail_unless(info.max_version == 0x0303, "wrong max_version");
+	fail_unless(info.ciphers_len == 202, "wrong ciphers_len");
+	fail_unless(info.nexts == 6, "wrong nexts");
+	fail_unless(info.exts[0] == 0 && info.exts[5] == 15, "wrong exts");
+	fail_unless(info.sni_len == 13 &&
+	            !memcmp(info.sni, "daniel.roe.ch", 13), "wrong sni");
+	fail_unless(info.groups_len == 50, "wrong groups_len");
+	fail_unless(info.sigalgs_len == 32, "wrong sigalgs_len");
+	fail_unless(info.pointfmts_len == 3, "wrong pointfmts_len");
+	fail_unless(!info.alpn, "alpn not NULL");
+	fail_unless(info.nkeyshares == 0, "wrong nkeyshares");
+	fail_unless(!info.sslv2, "sslv2 set");
+}
+END_TEST
+
+START_TEST(ssl_tls_clienthello_parse_info_02)
+{
+	ssl_tls_clienthello_info_t info;
+	const unsigned char *ch = NULL;
+	int rv;
+
+	rv = ssl_tls_clienthello_parse_info(clienthello07,
+	                                    sizeof(clienthello07) - 1,
+	                                    0, &ch, &info);
+	fail_unless(rv == 0, "rv not 0");
+	fail_unless(info.version == 0x0303, "wrong version");
+	fail_unless(info.max_version == 0x0304, "wrong max_version");
+	fail_unless(info.ciphers_len == 6, "wrong ciphers_len");
+	fail_unless(info.nexts == 8, "wrong nexts");
+	fail_unless(info.exts[0] == 0x1a1a, "GREASE ext not recorded");
+	fail_unless(info.sni_len == 9 &&
+	            !memcmp(info.sni, "a.example", 9), "wrong sni");
+	fail_unless(info.alpn_len == 3 && !memcmp(info.alpn, "\x02h2", 3),
+	            "wrong alpn");
+	fail_unless(info.sigalgs_len == 4, "wrong sigalgs_len");
+	fail_unless(info.nkeyshares == 2, "wrong nkeyshares");
+	fail_unless(info.keyshares[0] == 0x2a2a && info.keyshares[1] == 0x1d,
+	            "wrong keyshares");
+}
+END_TEST
+
+START_TEST(ssl_tls_clienthello_parse_info_03)
+{
+	static unsigned char buf[4096 + sizeof(clienthello04)];
+	ssl_tls_clienthello_info_t info;
+	const unsigned char *ch = NULL;
+	int rv;
+
+	/* junk prefix of record type bytes */
+	memset(buf, 0x16, 4096);
+	memcpy(buf + 4096, clienthello04, sizeof(clienthello04) - 1);
+	rv = ssl_tls_clienthello_parse_info(buf,
+	                                    4096 + sizeof(clienthello04) - 1,
+	                                    1, &ch, &info);
+	fail_unless(rv == 0, "rv not 0");
+	fail_unless(ch == buf + 4096, "ch does not point to start");
+	fail_unless(info.sni_len == 10 &&
+	            !memcmp(info.sni, "kamesh.com", 10), "wrong sni");
+}
+END_TEST
+
+START_TEST(ssl_tls_clienthello_ja3_01)
+{
+	ssl_tls_clienthello_info_t info;
+	const unsigned char *ch = NULL;
+	char *ja3;
+	int rv;
+
+	rv = ssl_tls_clienthello_parse_info(clienthello04,
+	                                    sizeof(clienthello04) - 1,
+	                                    0, &ch, &info);
+	fail_unless(rv == 0, "rv not 0");
+	ja3 = ssl_tls_clienthello_ja3(&info);
+	fail_unless(ja3 && !strcmp(ja3, "769,57-56-53-22-19-10-51-50-47-7-5-"
+	                           "4-21-18-9-20-17-8-6-3,0-35,,"),
+	            "wrong ja3");
+	free(ja3);
+	ja3 = ssl_tls_clienthello_ja3_hash(&info);
+	fail_unless(ja3 && !strcmp(ja3, "55c12889ebbbe107214b8368aee64714"),
+	            "wrong ja3 hash");
+	free(ja3);
+}
+END_TEST
+
+START_TEST(ssl_tls_clienthello_ja3_02)
+{
+	ssl_tls_clienthello_info_t info;
+	const unsigned char *ch = NULL;
+	char *ja3;
+	int rv;
+
+	rv = ssl_tls_clienthello_parse_info(clienthello05,
+	                                    sizeof(clienthello05) - 1,
+	                                    0, &ch, &info);
+	fail_unless(rv == 0, "rv not 0");
+	ja3 = ssl_tls_clienthello_ja3_hash(&info);
+	fail_unless(ja3 && !strcmp(ja3, "dbb53b9b21b5c1b543dde20bde00193c"),
+	            "wrong ja3 hash");
+	free(ja3);
+}
+END_TEST
+
+START_TEST(ssl_tls_clienthello_ja3_03)
+{
+	ssl_tls_clienthello_info_t info;
+	const unsigned char *ch = NULL;
+	char *ja3;
+	int rv;
+
+	rv = ssl_tls_clienthello_parse_info(clienthello07,
+	                                    sizeof(clienthello07) - 1,
+	                                    0, &ch, &info);
+	fail_unless(rv == 0, "rv not 0");
+	ja3 = ssl_tls_clienthello_ja3(&info);
+	fail_unless(ja3 && !strcmp(ja3, "771,4865-4866,0-10-11-13-16-43-51,"
+	                           "29-23,0"), "GREASE not omitted");
+	free(ja3);
+	ja3 = ssl_tls_clienthello_ja3_hash(&info);
+	fail_unless(ja3 && !strcmp(ja3, "53fa2bfacc0164a2f295b33a7a812298"),
+	            "wrong ja3 hash");
+	free(ja3);
+}
+END_TEST
+
+START_TEST(ssl_tls_clienthello_ja3_04)
+{
+	ssl_tls_clienthello_info_t info;
+	const unsigned char *ch = NULL;
+	int rv;
+
+	rv = ssl_tls_clienthello_parse_info(clienthello01,
+	                                    sizeof(clienthello01) - 1,
+	                                    0, &ch, &info);
+	fail_unless(rv == 0, "rv not 0");
+	fail_unless(info.sslv2, "sslv2 not set");
+	fail_unless(ssl_tls_clienthello_ja3(&info) == NULL,
+	            "ja3 for SSLv2");
+}
+END_TEST
+
+/*
+ * Build a ClientHello with SNI extension for hostname "example.org" and a
+ * padding extension of padlen octets, fragmented into TLS records of at most
+ * fraglen octets.  Returns the size of the records in buf.
+ */
+static size_t
+ssl_tls_clienthello_build(unsigned char *buf, size_t bufsz,
+                          size_t padlen, size_t fraglen)
+{
+	static const unsigned char sni[] =
+		"\x00\x00\x00\x10\x00\x0e\x00\x00\x0b" "example.org";
+	unsigned char msg[4096];
+	size_t msglen, extslen, off, n;
+
+	fail_unless(padlen + 128 < sizeof(msg), "padlen too large");
+
+	/* handshake header is filled in below */
+	msglen = 4;
+	msg[msglen++] = 0x03; msg[msglen++] = 0x03;
+	memset(msg + msglen, 0x42, 32); msglen += 32;
+	msg[msglen++] = 0x00;
+	msg[msglen++] = 0x00; msg[msglen++] = 0x02;
+	msg[msglen++] = 0x13; msg[msglen++] = 0x01;
+	msg[msglen++] = 0x01; msg[msglen++] = 0x00;
+	extslen = sizeof(sni) - 1 + 4 + padlen;
+	msg[msglen++] = extslen >> 8; msg[msglen++] = extslen & 0xff;
+	memcpy(msg + msglen, sni, sizeof(sni) - 1); msglen += sizeof(sni) - 1;
+	msg[msglen++] = 0x00; msg[msglen++] = 0x15;
+	msg[msglen++] = padlen >> 8; msg[msglen++] = padlen & 0xff;
+	memset(msg + msglen, 0, padlen); msglen += padlen;
+	msg[0] = 0x01;
+	msg[1] = 0x00;
+	msg[2] = (msglen - 4) >> 8;
+	msg[3] = (msglen - 4) & 0xff;
+
+	for (off = 0, n = 0; off < msglen; off += fraglen) {
+		size_t reclen = msglen - off < fraglen ? msglen - off : fraglen;
+		fail_unless(n + 5 + reclen <= bufsz, "buf too small");
+		buf[n++] = 0x16; buf[n++] = 0x03; buf[n++] = 0x01;
+		buf[n++] = reclen >> 8; buf[n++] = reclen & 0xff;
+		memcpy(buf + n, msg + off, reclen);
+		n += reclen;
+	}
+	return n;
+}
+
+START_TEST(ssl_tls_clienthello_asm_01)
+{
+	ssl_tls_clienthello_asm_t a;
+	char *sni = NULL;
+	int rv;
+
+	ssl_tls_clienthello_asm_init(&a, 16384);
+	rv = ssl_tls_clienthello_asm_feed(&a, clienthello05,
+	                                  sizeof(clienthello05) - 1, &sni);
+	fail_unless(rv == 0, "rv not 0");
+	fail_unless(a.consumed == sizeof(clienthello05) - 1,
+	            "not all octets consumed");
+	fail_unless(sni && !strcmp(sni, "daniel.roe.ch"),
+	            "sni not 'daniel.roe.ch' but should be");
+	free(sni);
+	ssl_tls_clienthello_asm_free(&a);
+}
+END_TEST
+
+START_TEST(ssl_tls_clienthello_asm_02)
+{
+	ssl_tls_clienthello_asm_t a;
+	char *sni = NULL;
+	int rv = 1;
+
+	ssl_tls_clienthello_asm_init(&a, 16384);
+	for (size_t i = 0; i < sizeof(clienthello05) - 1; i++) {
+		fail_unless(rv == 1, "rv not 1 before last octet");
+		rv = ssl_tls_clienthello_asm_feed(&a, clienthello05 + i, 1,
+		                                  &sni);
+	}
+	fail_unless(rv == 0, "rv not 0");
+	fail_unless(sni && !strcmp(sni, "daniel.roe.ch"),
+	            "sni not 'daniel.roe.ch' but should be");
+	free(sni);
+	ssl_tls_clienthello_asm_free(&a);
+}
+END_TEST
+
+START_TEST(ssl_tls_clienthello_asm_03)
+{
+	ssl_tls_clienthello_asm_t a;
+	char *sni = NULL;
+	int rv;
+
+	ssl_tls_clienthello_asm_init(&a, 16384);
+	fail_unless(ssl_tls_clienthello_asm_need(&a) == 5, "need not 5");
+	rv = ssl_tls_clienthello_asm_feed(&a, clienthello05, 5, &sni);
+	fail_unless(rv == 1, "rv not 1");
+	fail_unless(ssl_tls_clienthello_asm_need(&a) == 0x17d,
+	            "need not record length");
+	rv = ssl_tls_clienthello_asm_feed(&a, clienthello05 + 5, 0x17d, &sni);
+	fail_unless(rv == 0, "rv not 0");
+	fail_unless(sni && !strcmp(sni, "daniel.roe.ch"),
+	            "sni not 'daniel.roe.ch' but should be");
+	free(sni);
+	ssl_tls_clienthello_asm_free(&a);
+}
+END_TEST
+
+START_TEST(ssl_tls_clienthello_asm_04)
+{
+	unsigned char buf[8192];
+	ssl_tls_clienthello_asm_t a;
+	char *sni = NULL;
+	size_t sz, off, n;
+	int rv = 1;
+
+	/* 2 KiB ClientHello in 512 octet records and 1460 octet segments */
+	sz = ssl_tls_clienthello_build(buf, sizeof(buf), 2048, 512);
+	fail_unless(sz > 2048 + 4 * 5, "not fragmented");
+
+	ssl_tls_clienthello_asm_init(&a, 16384);
+	for (off = 0; off < sz; off += n) {
+		fail_unless(rv == 1, "rv not 1 before last segment");
+		n = sz - off < 1460 ? sz - off : 1460;
+		rv = ssl_tls_clienthello_asm_feed(&a, buf + off, n, &sni);
+	}
+	fail_unless(rv == 0, "rv not 0");
+	fail_unless(a.consumed == sz, "not all octets consumed");
+	fail_unless(sni && !strcmp(sni, "example.org"),
+	            "sni not 'example.org' but should be");
+	free(sni);
+	ssl_tls_clienthello_asm_free(&a);
+}
+END_TEST
+
+START_TEST(ssl_tls_clienthello_asm_05)
+{
+	unsigned char buf[8192];
+	ssl_tls_clienthello_asm_t a;
+	char *sni = (void *)0xDEADBEEF;
+	size_t sz;
+	int rv;
+
+	sz = ssl_tls_clienthello_build(buf, sizeof(buf), 2048, 512);
+
+	ssl_tls_clienthello_asm_init(&a, 1024);
+	rv = ssl_tls_clienthello_asm_feed(&a, buf, sz, &sni);
+	fail_unless(rv == 2, "rv not 2");
+	fail_unless(sni == (void *)0xDEADBEEF, "sni modified");
+	ssl_tls_clienthello_asm_free(&a);
+}
+END_TEST
+
+START_TEST(ssl_tls_clienthello_asm_06)
+{
+	ssl_tls_clienthello_asm_t a;
+	char *sni = (void *)0xDEADBEEF;
+	int rv;
+
+	ssl_tls_clienthello_asm_init(&a, 16384);
+	rv = ssl_tls_clienthello_asm_feed(&a, clienthello06,
+	                                  sizeof(clienthello06) - 1, &sni);
+	fail_unless(rv == -1, "rv not -1");
+	fail_unless(sni == (void *)0xDEADBEEF, "sni modified");
+	ssl_tls_clienthello_asm_free(&a);
+}
+END_TEST
+
+START_TEST(ssl_tls_clienthello_asm_07)
+{
+	ssl_tls_clienthello_asm_t a;
+	char *sni = (void *)0xDEADBEEF;
+	int rv;
+
+	ssl_tls_clienthello_asm_init(&a, 16384);
+	rv = ssl_tls_clienthello_asm_feed(&a, clienthello01,
+	                                  sizeof(clienthello01) - 1, &sni);
+	fail_unless(rv == 0, "rv not 0");
+	fail_unless(sni == NULL, "sni not NULL");
+	ssl_tls_clienthello_asm_free(&a);
+}
+END_TEST
+
 START_TEST(ssl_key_identifier_sha1_01)
 {
 	X509 *c;
@@ -757,6 +1106,34 @@ START_TEST(ssl_x509_refcount_inc_01)
 }
 END_TEST
 
+START_TEST(ssl_x509_fingerprint_01)
+{
+	X509 *crt;
+	unsigned char fpr1[SSL_X509_FPRSZ_SHA256], fpr2[SSL_X509_FPRSZ_SHA256];
+	unsigned int sz;
+
+	crt = ssl_x509_load(TESTCERT2);
+	fail_unless(!!crt, "loading certificate failed");
+
+	/* digests fetched by ssl_init() match the legacy ones */
+	fail_unless(ssl_x509_fingerprint_sha1(crt, fpr1) == 0,
+	            "SHA1 fingerprint failed");
+	sz = sizeof(fpr2);
+	fail_unless(X509_digest(crt, EVP_sha1(), fpr2, &sz) && sz == SSL_X509_FPRSZ,
+	            "legacy SHA1 digest failed");
+	fail_unless(!memcmp(fpr1, fpr2, SSL_X509_FPRSZ), "SHA1 fingerprint mismatch");
+
+	fail_unless(ssl_x509_fingerprint_sha256(crt, fpr1) == 0,
+	            "SHA256 fingerprint failed");
+	sz = sizeof(fpr2);
+	fail_unless(X509_digest(crt, EVP_sha256(), fpr2, &sz) && sz == SSL_X509_FPRSZ_SHA256,
+	            "legacy SHA256 digest failed");
+	fail_unless(!memcmp(fpr1, fpr2, SSL_X509_FPRSZ_SHA256), "SHA256 fingerprint mismatch");
+
+	X509_free(crt);
+}
+END_TEST
+
 #ifndef OPENSSL_NO_ENGINE
 START_TEST(ssl_engine_01)
 {
@@ -822,6 +1199,32 @@ ssl_suite(void)
 	tcase_add_test(tc, ssl_tls_clienthello_parse_10);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("ssl_tls_clienthello_parse_info");
+	tcase_add_checked_fixture(tc, ssl_setup, ssl_teardown);
+	tcase_add_test(tc, ssl_tls_clienthello_parse_info_01);
+	tcase_add_test(tc, ssl_tls_clienthello_parse_info_02);
+	tcase_add_test(tc, ssl_tls_clienthello_parse_info_03);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("ssl_tls_clienthello_ja3");
+	tcase_add_checked_fixture(tc, ssl_setup, ssl_teardown);
+	tcase_add_test(tc, ssl_tls_clienthello_ja3_01);
+	tcase_add_test(tc, ssl_tls_clienthello_ja3_02);
+	tcase_add_test(tc, ssl_tls_clienthello_ja3_03);
+	tcase_add_test(tc, ssl_tls_clienthello_ja3_04);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("ssl_tls_clienthello_asm");
+	tcase_add_checked_fixture(tc, ssl_setup, ssl_teardown);
+	tcase_add_test(tc, ssl_tls_clienthello_asm_01);
+	tcase_add_test(tc, ssl_tls_clienthello_asm_02);
+	tcase_add_test(tc, ssl_tls_clienthello_asm_03);
+	tcase_add_test(tc, ssl_tls_clienthello_asm_04);
+	tcase_add_test(tc, ssl_tls_clienthello_asm_05);
+	tcase_add_test(tc, ssl_tls_clienthello_asm_06);
+	tcase_add_test(tc, ssl_tls_clienthello_asm_07);
+	suite_add_tcase(s, tc);
+
 	tc = tcase_create("ssl_key_identifier_sha1");
 	tcase_add_checked_fixture(tc, ssl_setup, ssl_teardown);
 	tcase_add_test(tc, ssl_key_identifier_sha1_01);
@@ -875,6 +1278,11 @@ ssl_suite(void)
 	tcase_add_test(tc, ssl_x509_refcount_inc_01);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("ssl_x509_fingerprint");
+	tcase_add_checked_fixture(tc, ssl_setup, ssl_teardown);
+	tcase_add_test(tc, ssl_x509_fingerprint_01);
+	suite_add_tcase(s, tc);
+
 #ifndef OPENSSL_NO_ENGINE
 	tc = tcase_create("ssl_engine");
 	tcase_add_checked_fixture(tc, ssl_setup, ssl_teardown);
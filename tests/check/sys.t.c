@@ -37,6 +37,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include <pthread.h>
 
 #include <check.h>
@@ -314,6 +316,102 @@ START_TEST(sys_ip46str_sanitize_03)
 }
 END_TEST
 
+START_TEST(sys_sockaddr_parse_unix_01)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	char *host, *serv;
+
+	fail_unless(sys_get_af("unix:/tmp/sslproxy.sock") == AF_UNIX,
+	            "Unexpected af");
+	fail_unless(sys_sockaddr_parse(&addr, &addrlen, "unix:/tmp/sslproxy.sock",
+	                               "8080", AF_INET, 0) == AF_UNIX,
+	            "Failed to parse unix addr");
+	fail_unless(addr.ss_family == AF_UNIX, "Unexpected family");
+	fail_unless(sys_sockaddr_str((struct sockaddr *)&addr, addrlen,
+	                             &host, &serv) == 0,
+	            "Failed to convert unix addr to str");
+	fail_unless(!strcmp(host, "unix:/tmp/sslproxy.sock"),
+	            "Unexpected host");
+	fail_unless(!strcmp(serv, "0"), "Unexpected serv");
+	free(host);
+	free(serv);
+}
+END_TEST
+
+START_TEST(sys_sockaddr_parse_unix_02)
+{
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	char path[256];
+
+	fail_unless(sys_sockaddr_parse(&addr, &addrlen, "unix:",
+	                               "0", AF_INET, 0) == -1,
+	            "Parsed empty unix path");
+
+	memset(path, 'a', sizeof(path) - 1);
+	path[sizeof(path) - 1] = '\0';
+	memcpy(path, "unix:/", 6);
+	fail_unless(sys_sockaddr_parse(&addr, &addrlen, path,
+	                               "0", AF_INET, 0) == -1,
+	            "Parsed too long unix path");
+}
+END_TEST
+
+
+/*
+ * Connect a TCP socket to a listener on 127.0.0.1, returns the connected
+ * socket, or -1 on error.
+ */
+static evutil_socket_t
+tcp_connect_local(evutil_socket_t *lfd, evutil_socket_t *afd)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	evutil_socket_t fd;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	*lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (*lfd == -1 ||
+	    bind(*lfd, (struct sockaddr *)&sin, sizeof(sin)) == -1 ||
+	    listen(*lfd, 1) == -1 ||
+	    getsockname(*lfd, (struct sockaddr *)&sin, &len) == -1)
+		return -1;
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1 || connect(fd, (struct sockaddr *)&sin, sizeof(sin)) == -1)
+		return -1;
+	*afd = accept(*lfd, NULL, NULL);
+	return fd;
+}
+
+START_TEST(sys_get_sock_bdp_01)
+{
+	evutil_socket_t fd, lfd, afd;
+
+	fd = tcp_connect_local(&lfd, &afd);
+	fail_unless(fd != -1, "Cannot connect");
+#ifdef __linux__
+	fail_unless(sys_get_sock_bdp(fd) > 0, "No BDP estimate for connected socket");
+#endif /* __linux__ */
+	close(afd);
+	close(fd);
+	close(lfd);
+}
+END_TEST
+
+START_TEST(sys_get_sock_bdp_02)
+{
+	evutil_socket_t fd;
+
+	fail_unless(sys_get_sock_bdp(-1) == 0, "BDP estimate for invalid fd");
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	fail_unless(fd != -1, "Cannot create socket");
+	fail_unless(sys_get_sock_bdp(fd) == 0, "BDP estimate for UDP socket");
+	close(fd);
+}
+END_TEST
 
 Suite *
 sys_suite(void)
@@ -370,6 +468,16 @@ sys_suite(void)
 	tcase_add_test(tc, sys_ip46str_sanitize_03);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("sys_sockaddr_parse");
+	tcase_add_test(tc, sys_sockaddr_parse_unix_01);
+	tcase_add_test(tc, sys_sockaddr_parse_unix_02);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("sys_get_sock_bdp");
+	tcase_add_test(tc, sys_get_sock_bdp_01);
+	tcase_add_test(tc, sys_get_sock_bdp_02);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
 
@@ -35,6 +35,8 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <sys/select.h>
 #include <sys/wait.h>
 #include <netinet/in.h>
@@ -240,7 +242,8 @@ privsep_server_opensock(const proxyspec_t *spec)
 	int on = 1;
 	int rv;
 
-	fd = socket(spec->listen_addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+	fd = socket(spec->listen_addr.ss_family, SOCK_STREAM,
+	            spec->listen_addr.ss_family == AF_UNIX ? 0 : IPPROTO_TCP);
 	if (fd == -1) {
 		log_err_level_printf(LOG_CRIT, "Error from socket(): %s (%i)\n",
 		               strerror(errno), errno);
@@ -272,6 +275,11 @@ privsep_server_opensock(const proxyspec_t *spec)
 		return -1;
 	}
 
+	if (spec->listen_addr.ss_family == AF_UNIX) {
+		/* remove the socket left by a previous run */
+		unlink(((struct sockaddr_un *)&spec->listen_addr)->sun_path);
+	}
+
 	rv = bind(fd, (struct sockaddr *)&spec->listen_addr,
 	          spec->listen_addrlen);
 	if (rv == -1) {
@@ -280,6 +288,16 @@ privsep_server_opensock(const proxyspec_t *spec)
 		return -1;
 	}
 
+	if (spec->listen_addr.ss_family == AF_UNIX) {
+		/* SSLproxy connects as an unprivileged user */
+		rv = chmod(((struct sockaddr_un *)&spec->listen_addr)->sun_path, 0666);
+		if (rv == -1) {
+			log_err_level_printf(LOG_CRIT, "Error from chmod(): %s\n", strerror(errno));
+			evutil_closesocket(fd);
+			return -1;
+		}
+	}
+
 	return fd;
 }
 
@@ -278,6 +278,8 @@ static int
 prototcp_parse_sslproxy_line(char *line, pxy_conn_ctx_t *ctx)
 {
 #define MAX_IPADDR_LEN 45
+// unix: prefix and sun_path
+#define MAX_UNIXADDR_LEN (SYS_UNIX_PREFIX_LEN + 107)
 #define MAX_PORT_LEN 5
 
 	// SSLproxy: [127.0.0.1]:34649,[192.168.3.24]:47286,[74.125.206.108]:465,s,soner
@@ -315,12 +317,14 @@ prototcp_parse_sslproxy_line(char *line, pxy_conn_ctx_t *ctx)
 		}
 
 		int addr_len = ip_end - ip_start;
-		if (addr_len > MAX_IPADDR_LEN) {
-			log_err_level_printf(LOG_ERR, "sslproxy addr_len greater than MAX_IPADDR_LEN: %d\n", addr_len);
+		// SSLproxy listens for return conns on a unix domain socket if its ReturnAddr is unix:/path
+		int max_addr_len = strncmp(ip_start, SYS_UNIX_PREFIX, SYS_UNIX_PREFIX_LEN) ? MAX_IPADDR_LEN : MAX_UNIXADDR_LEN;
+		if (addr_len > max_addr_len) {
+			log_err_level_printf(LOG_ERR, "sslproxy addr_len greater than max addr len: %d\n", addr_len);
 			return -1;
 		}
 
-		// We can use addr_len for size restriction here, because we check it against MAX_IPADDR_LEN above
+		// We can use addr_len for size restriction here, because we check it against max_addr_len above
 		char addr[addr_len + 1];
 		memcpy(addr, ip_start, addr_len);
 		addr[addr_len] = '\0';
@@ -380,6 +384,15 @@ prototcp_bev_readcb_src(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 			}
 
 			if (ctx->seen_sslproxy_line) {
+				/* SSLproxy may open conns in advance, and send the SSLproxy line
+				 * of a new logical conn much later, if its divert conn pool is enabled */
+				time_t wait = time(NULL) - ctx->ctime;
+				if (wait > 0) {
+					log_finer_va("SSLproxy line after %lld secs, pooled conn", (long long)wait);
+					ctx->thr->pooled_conns++;
+				}
+				ctx->thr->max_sslproxy_line_wait = MAX(ctx->thr->max_sslproxy_line_wait, wait);
+
 				/* initiate connection */
 				bufferevent_enable(ctx->dst.bev, EV_READ|EV_WRITE);
 				if (bufferevent_socket_connect(ctx->dst.bev, (struct sockaddr *)&ctx->dstaddr, ctx->dstaddrlen) == -1) {
@@ -510,6 +523,11 @@ prototcp_bev_eventcb_eof_src(struct bufferevent *bev, pxy_conn_ctx_t *ctx)
 	if (!ctx->src_connected) {
 		log_err_level(LOG_WARNING, "EOF on connection before connection establishment");
 		ctx->dst.closed = 1;
+	} else if (!ctx->seen_sslproxy_line) {
+		// SSLproxy closes the unused conns in its divert conn pool
+		log_fine("EOF before SSLproxy line, unused pooled conn");
+		ctx->thr->unused_pooled_conns++;
+		ctx->dst.closed = 1;
 	} else if (!ctx->dst.closed) {
 		log_finest("!dst->closed, terminate conn");
 		if (pxy_try_consume_last_input(bev, ctx) == -1) {
@@ -112,13 +112,13 @@ pxy_thr_print_thr_info(pxy_thr_ctx_t *tctx)
 		}
 	}
 
-	log_finest_main_va("STATS: thr=%d, mld=%zu, mfd=%d, mat=%lld, mct=%lld, iib=%llu, iob=%llu, eib=%llu, eob=%llu, swm=%zu, uwm=%zu, err=%zu, si=%u",
+	log_finest_main_va("STATS: thr=%d, mld=%zu, mfd=%d, mat=%lld, mct=%lld, iib=%llu, iob=%llu, eib=%llu, eob=%llu, swm=%zu, uwm=%zu, err=%zu, pcn=%zu, upc=%zu, mlw=%lld, si=%u",
 			tctx->id, tctx->max_load, tctx->max_fd, (long long)max_atime, (long long)max_ctime, tctx->intif_in_bytes, tctx->intif_out_bytes, tctx->extif_in_bytes, tctx->extif_out_bytes,
-			tctx->set_watermarks, tctx->unset_watermarks, tctx->errors, tctx->stats_id);
+			tctx->set_watermarks, tctx->unset_watermarks, tctx->errors, tctx->pooled_conns, tctx->unused_pooled_conns, (long long)tctx->max_sslproxy_line_wait, tctx->stats_id);
 
-	if (asprintf(&smsg, "STATS: thr=%d, mld=%zu, mfd=%d, mat=%lld, mct=%lld, iib=%llu, iob=%llu, eib=%llu, eob=%llu, swm=%zu, uwm=%zu, err=%zu, si=%u\n",
+	if (asprintf(&smsg, "STATS: thr=%d, mld=%zu, mfd=%d, mat=%lld, mct=%lld, iib=%llu, iob=%llu, eib=%llu, eob=%llu, swm=%zu, uwm=%zu, err=%zu, pcn=%zu, upc=%zu, mlw=%lld, si=%u\n",
 			tctx->id, tctx->max_load, tctx->max_fd, (long long)max_atime, (long long)max_ctime, tctx->intif_in_bytes, tctx->intif_out_bytes, tctx->extif_in_bytes, tctx->extif_out_bytes,
-			tctx->set_watermarks, tctx->unset_watermarks, tctx->errors, tctx->stats_id) < 0) {
+			tctx->set_watermarks, tctx->unset_watermarks, tctx->errors, tctx->pooled_conns, tctx->unused_pooled_conns, (long long)tctx->max_sslproxy_line_wait, tctx->stats_id) < 0) {
 		return;
 	}
 
@@ -132,6 +132,9 @@ pxy_thr_print_thr_info(pxy_thr_ctx_t *tctx)
 	tctx->errors = 0;
 	tctx->set_watermarks = 0;
 	tctx->unset_watermarks = 0;
+	tctx->pooled_conns = 0;
+	tctx->unused_pooled_conns = 0;
+	tctx->max_sslproxy_line_wait = 0;
 
 	tctx->intif_in_bytes = 0;
 	tctx->intif_out_bytes = 0;
@@ -59,6 +59,10 @@ typedef struct pxy_thr_ctx {
 	long long unsigned int intif_out_bytes;
 	long long unsigned int extif_in_bytes;
 	long long unsigned int extif_out_bytes;
+	// Conns which received the SSLproxy line later than accept, i.e. from the divert conn pool of SSLproxy
+	size_t pooled_conns;
+	size_t unused_pooled_conns;
+	time_t max_sslproxy_line_wait;
 	// Each stats has an id, incremented on each stats print
 	unsigned short stats_id;
 	// Used to print statistics, compared against stats_period
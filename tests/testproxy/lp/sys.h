@@ -47,6 +47,9 @@ int sys_isuser(const char *) NONNULL(1) WUNRES;
 int sys_isgroup(const char *) NONNULL(1) WUNRES;
 int sys_isgeteuid(const char *) NONNULL(1) WUNRES;
 
+#define SYS_UNIX_PREFIX "unix:"
+#define SYS_UNIX_PREFIX_LEN (sizeof(SYS_UNIX_PREFIX) - 1)
+
 int sys_get_af(const char *);
 int sys_sockaddr_parse(struct sockaddr_storage *, socklen_t *,
                        char *, char *, int, int) NONNULL(1,2,3,4) WUNRES;